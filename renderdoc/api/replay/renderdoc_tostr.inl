@@ -1125,6 +1125,8 @@ rdcstr DoStringise(const SectionType &el)
     STRINGISE_ENUM_CLASS_NAMED(EditedShaders, "renderdoc/ui/edits");
     STRINGISE_ENUM_CLASS_NAMED(D3D12Core, "renderdoc/internal/d3d12core");
     STRINGISE_ENUM_CLASS_NAMED(D3D12SDKLayers, "renderdoc/internal/d3d12sdklayers");
+    STRINGISE_ENUM_CLASS_NAMED(ChunkIndex, "renderdoc/internal/chunkindex");
+    STRINGISE_ENUM_CLASS_NAMED(CallstackTable, "renderdoc/internal/callstacks");
   }
   END_ENUM_STRINGISE();
 }
@@ -1186,6 +1188,7 @@ rdcstr DoStringise(const SectionFlags &el)
     STRINGISE_BITFIELD_CLASS_BIT_NAMED(ASCIIStored, "Stored as ASCII");
     STRINGISE_BITFIELD_CLASS_BIT_NAMED(LZ4Compressed, "Compressed with LZ4");
     STRINGISE_BITFIELD_CLASS_BIT_NAMED(ZstdCompressed, "Compressed with Zstd");
+    STRINGISE_BITFIELD_CLASS_BIT_NAMED(IndexedBlocks, "Indexed compressed blocks");
   }
   END_BITFIELD_STRINGISE();
 }
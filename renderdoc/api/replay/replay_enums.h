@@ -110,6 +110,20 @@ version of RenderDoc that addes a new section type. They should be considered eq
   This section contains an internal copy of D3D12SDKLayers for replaying.
 
   The name for this section will be "renderdoc/internal/d3d12sdklayers".
+
+.. data:: ChunkIndex
+
+  This section contains an index of the offset and length of every chunk in the uncompressed frame
+  capture section, so that individual chunks can be located without reading the whole section.
+
+  The name for this section will be "renderdoc/internal/chunkindex".
+
+.. data:: CallstackTable
+
+  This section contains every unique callstack collected while capturing. Chunks in the frame
+  capture section refer to callstacks in this table by index instead of storing them inline.
+
+  The name for this section will be "renderdoc/internal/callstacks".
 )");
 enum class SectionType : uint32_t
 {
@@ -126,6 +140,8 @@ enum class SectionType : uint32_t
   EditedShaders,
   D3D12Core,
   D3D12SDKLayers,
+  ChunkIndex,
+  CallstackTable,
   Count,
 };
 
@@ -4579,6 +4595,12 @@ DOCUMENT(R"(A set of flags describing the properties of a section in a renderdoc
 .. data:: ZstdCompressed
 
   This section is compressed with Zstd on disk.
+
+.. data:: IndexedBlocks
+
+  This section's compressed blocks are independent of each other and an index of the blocks is
+  stored after them, allowing any offset to be read without decompressing the preceding data. Only
+  valid in combination with :data:`LZ4Compressed` or :data:`ZstdCompressed`.
 )");
 enum class SectionFlags : uint32_t
 {
@@ -4586,6 +4608,7 @@ enum class SectionFlags : uint32_t
   ASCIIStored = 0x1,
   LZ4Compressed = 0x2,
   ZstdCompressed = 0x4,
+  IndexedBlocks = 0x8,
 };
 
 BITMASK_OPERATORS(SectionFlags);
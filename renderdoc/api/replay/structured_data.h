@@ -422,11 +422,31 @@ DECLARE_REFLECTION_STRUCT(SDObjectData);
 #if !defined(SWIG)
 using LazyGenerator = std::function<SDObject *(const void *)>;
 
+// Fills in the children of placeholder chunks the first time they're accessed. Implemented
+// internally so all calls go through the vtable.
+struct SDLazyChunkSource
+{
+  // populate the children of a placeholder chunk if that hasn't happened yet. Called on every
+  // access to the placeholder's children, possibly from several threads at once
+  virtual void Populate(const SDObject *chunk) = 0;
+  // the placeholder is being deleted or has been fully evaluated, and won't be populated again
+  virtual void Forget(const SDObject *chunk) = 0;
+
+protected:
+  virtual ~SDLazyChunkSource() = default;
+};
+
 struct LazyArrayData
 {
-  byte *data;
-  size_t elemSize;
+  byte *data = NULL;
+  size_t elemSize = 0;
   LazyGenerator generator;
+
+  // placeholder chunks populate all their children at once from chunkSource instead
+  SDLazyChunkSource *chunkSource = NULL;
+  uint64_t chunkOffset = 0;
+  // only read and written atomically by chunkSource, so that accesses from any thread can check it
+  int32_t chunkPopulated = 0;
 };
 #endif
 
@@ -544,14 +564,9 @@ struct SDObject
     ret->data.basic = data.basic;
     ret->data.str = data.str;
 
-    if(m_Lazy)
-    {
-      PopulateAllChildren();
-    }
-
-    ret->data.children.resize(data.children.size());
-    for(size_t i = 0; i < data.children.size(); i++)
-      ret->data.children[i] = data.children[i]->Duplicate();
+    ret->data.children.resize(NumChildren());
+    for(size_t i = 0; i < ret->data.children.size(); i++)
+      ret->data.children[i] = GetChild(i)->Duplicate();
 
     return ret;
   }
@@ -576,6 +591,9 @@ recursively through children.
   {
     bool ret = true;
 
+    PopulateLazyChunk();
+    obj->PopulateLazyChunk();
+
     if(data.str != obj->data.str)
     {
       ret = false;
@@ -624,6 +642,7 @@ returned.
 )");
   inline SDObject *FindChild(const rdcstr &childName)
   {
+    PopulateLazyChunk();
     for(size_t i = 0; i < data.children.size(); i++)
       if(GetChild(i)->name == childName)
         return GetChild(i);
@@ -664,6 +683,7 @@ returned.
 )");
   inline SDObject *GetChild(size_t index)
   {
+    PopulateLazyChunk();
     if(index < data.children.size())
     {
       PopulateChild(index);
@@ -684,6 +704,7 @@ returned.
   // const versions of FindChild/GetChild
   inline const SDObject *FindChild(const rdcstr &childName) const
   {
+    PopulateLazyChunk();
     for(size_t i = 0; i < data.children.size(); i++)
       if(GetChild(i)->name == childName)
         return GetChild(i);
@@ -706,6 +727,7 @@ returned.
   }
   inline const SDObject *GetChild(size_t index) const
   {
+    PopulateLazyChunk();
     if(index < data.children.size())
     {
       PopulateChild(index);
@@ -722,6 +744,7 @@ returned.
 )");
   inline void RemoveChild(size_t index)
   {
+    PopulateLazyChunk();
     if(index < data.children.size())
     {
       // we really shouldn't be deleting individually from a lazy array but just in case we are,
@@ -747,16 +770,20 @@ returned.
 :return: The number of children this object contains.
 :rtype: int
 )");
-  inline size_t NumChildren() const { return data.children.size(); }
+  inline size_t NumChildren() const
+  {
+    PopulateLazyChunk();
+    return data.children.size();
+  }
 #if !defined(SWIG)
   // these are for C++ iteration so not defined when SWIG is generating interfaces
   inline SDObjectIt<const SDObject> begin() const { return SDObjectIt<const SDObject>(this, 0); }
   inline SDObjectIt<const SDObject> end() const
   {
-    return SDObjectIt<const SDObject>(this, data.children.size());
+    return SDObjectIt<const SDObject>(this, NumChildren());
   }
   inline SDObjectIt<SDObject> begin() { return SDObjectIt<SDObject>(this, 0); }
-  inline SDObjectIt<SDObject> end() { return SDObjectIt<SDObject>(this, data.children.size()); }
+  inline SDObjectIt<SDObject> end() { return SDObjectIt<SDObject>(this, NumChildren()); }
 #endif
 
 #if !defined(SWIG)
@@ -806,6 +833,32 @@ returned.
     memcpy(m_Lazy->data, arrayData, sz);
     data.children.resize((size_t)arrayCount);
   }
+
+  // make this chunk a placeholder, with its children read from source on first access. The offset
+  // is stored for the source to locate the chunk. Once populated the children stay until the chunk
+  // is deleted, and any modification to the children makes the chunk fully owned again.
+  void SetLazyChunk(SDLazyChunkSource *source, uint64_t offset)
+  {
+    DeleteChildren();
+
+    void *lazyAlloc = alloc(sizeof(LazyArrayData));
+
+    m_Lazy = new(lazyAlloc) LazyArrayData;
+    m_Lazy->chunkSource = source;
+    m_Lazy->chunkOffset = offset;
+  }
+  bool IsLazyChunk() const { return m_Lazy && m_Lazy->chunkSource; }
+  uint64_t GetLazyChunkOffset() const { return m_Lazy ? m_Lazy->chunkOffset : 0; }
+  // only for use by the SDLazyChunkSource, to check and set the populated flag atomically
+  int32_t *GetLazyChunkPopulatedFlag() const { return m_Lazy ? &m_Lazy->chunkPopulated : NULL; }
+  // only for use by the SDLazyChunkSource, to set the children of a placeholder before marking it
+  // populated. The children are moved from the fully read copy of the chunk
+  void SetLazyChunkChildren(SDObject &from) const
+  {
+    data.children.swap(from.data.children);
+    for(size_t i = 0; i < data.children.size(); i++)
+      data.children[i]->m_Parent = (SDObject *)this;
+  }
 #endif
 
 // C++ gets more extensive typecasts. We'll add a couple for python in the interface file
@@ -951,9 +1004,15 @@ protected:
 
   // these functions can be const because we have 'mutable' allowing us to modify these members.
   // It's ugly, but necessary
+  inline void PopulateLazyChunk() const
+  {
+    if(m_Lazy && m_Lazy->chunkSource)
+      m_Lazy->chunkSource->Populate(this);
+  }
+
   inline void PopulateChild(size_t idx) const
   {
-    if(m_Lazy)
+    if(m_Lazy && !m_Lazy->chunkSource)
     {
       if(data.children[idx] == NULL)
       {
@@ -967,6 +1026,8 @@ protected:
   {
     if(m_Lazy)
     {
+      PopulateLazyChunk();
+
       for(size_t i = 0; i < data.children.size(); i++)
         PopulateChild(i);
 
@@ -1011,6 +1072,8 @@ private:
   {
     if(m_Lazy)
     {
+      if(m_Lazy->chunkSource)
+        m_Lazy->chunkSource->Forget(this);
       dealloc(m_Lazy->data);
       dealloc(m_Lazy);
       m_Lazy = NULL;
@@ -1407,12 +1470,9 @@ struct SDChunk : public SDObject
     ret->data.basic = data.basic;
     ret->data.str = data.str;
 
-    ret->data.children.resize(data.children.size());
-
-    PopulateAllChildren();
-
-    for(size_t i = 0; i < data.children.size(); i++)
-      ret->data.children[i] = data.children[i]->Duplicate();
+    ret->data.children.resize(NumChildren());
+    for(size_t i = 0; i < ret->data.children.size(); i++)
+      ret->data.children[i] = GetChild(i)->Duplicate();
 
     return ret;
   }
@@ -27,9 +27,17 @@
 #include <stdarg.h>
 #include <string.h>
 #include "common/threading.h"
+#include "core/settings.h"
 #include "os/os_specific.h"
 #include "strings/string_utils.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RDOC_SSE2 OPTION_ON
+#include <immintrin.h>
+#else
+#define RDOC_SSE2 OPTION_OFF
+#endif
+
 int utf8printv(char *buf, size_t bufsize, const char *fmt, va_list args);
 int utf8printf(char *str, size_t bufSize, const char *fmt, ...);
 
@@ -39,143 +47,295 @@ void rdcassert(const char *msg, const char *file, unsigned int line, const char
                 "Assertion failed: %s", msg);
 }
 
-#if 0
-static __m128 zero = {0};
+RDOC_CONFIG(uint32_t, Capture_MapDiffMergeGap, 4096,
+            "When looking for changes in persistently mapped memory, differences closer together "
+            "than this many bytes are merged into one range instead of being written separately.");
+
+#if ENABLED(RDOC_SSE2)
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+#define AVX2_FUNCTION __attribute__((target("avx2")))
 #endif
 
-// assumes a and b both point to 16-byte aligned 16-byte chunks of memory.
-// Returns if they're equal or different
-bool Vec16NotEqual(void *a, void *b)
+static bool DetectAVX2()
 {
-// disabled SSE version as it's acting dodgy
-#if 0
-	__m128 avec = _mm_load_ps(aflt);
-	__m128 bvec = _mm_load_ps(bflt);
-
-	__m128 diff = _mm_xor_ps(avec, bvec);
-
-	__m128 eq = _mm_cmpeq_ps(diff, zero);
-	int mask = _mm_movemask_ps(eq);
-	int signMask = _mm_movemask_ps(diff);
-
-	// first check ensures that diff is floatequal to zero (ie. avec bitwise equal to bvec).
-	// HOWEVER -0 is floatequal to 0, so we ensure no sign bits are set on diff
-	if((mask^0xf) || signMask != 0)
-	{
-		return true;
-	}
-	
-	return false;
-#elif ENABLED(RDOC_X64)
-  uint64_t *a64 = (uint64_t *)a;
-  uint64_t *b64 = (uint64_t *)b;
-
-  return a64[0] != b64[0] || a64[1] != b64[1];
+#if defined(_MSC_VER)
+  int info[4] = {};
+  __cpuid(info, 0);
+  if(info[0] < 7)
+    return false;
+
+  // we need AVX and OSXSAVE, and for the OS to be saving the YMM registers
+  const int avxBits = (1 << 27) | (1 << 28);
+  __cpuid(info, 1);
+  if((info[2] & avxBits) != avxBits || (_xgetbv(0) & 0x6) != 0x6)
+    return false;
+
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
 #else
-  uint32_t *a32 = (uint32_t *)a;
-  uint32_t *b32 = (uint32_t *)b;
-
-  return a32[0] != b32[0] || a32[1] != b32[1] || a32[2] != b32[2] || a32[3] != b32[3];
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") != 0;
 #endif
 }
 
-bool FindDiffRange(void *a, void *b, size_t bufSize, size_t &diffStart, size_t &diffEnd)
+static bool HasAVX2()
+{
+  static bool avx2 = DetectAVX2();
+  return avx2;
+}
+
+// the AVX2 functions only sweep whole 32-byte blocks, returning either the exact difference or how
+// far they got. The SSE2 path then finishes off the remainder.
+AVX2_FUNCTION static size_t FindFirstDiffAVX2(const byte *a, const byte *b, size_t bufSize)
 {
-  RDCASSERT(uintptr_t(a) % 16 == 0);
-  RDCASSERT(uintptr_t(b) % 16 == 0);
+  size_t offs = 0;
+
+  while(offs + 128 <= bufSize)
+  {
+    const __m256i *av = (const __m256i *)(a + offs);
+    const __m256i *bv = (const __m256i *)(b + offs);
 
-  diffStart = bufSize + 1;
-  diffEnd = 0;
+    __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(av + 0), _mm256_loadu_si256(bv + 0));
+    __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(av + 1), _mm256_loadu_si256(bv + 1));
+    __m256i eq2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(av + 2), _mm256_loadu_si256(bv + 2));
+    __m256i eq3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(av + 3), _mm256_loadu_si256(bv + 3));
 
-  size_t alignedSize = bufSize & (~0xf);
-  size_t numVecs = alignedSize / 16;
+    __m256i eq = _mm256_and_si256(_mm256_and_si256(eq0, eq1), _mm256_and_si256(eq2, eq3));
+
+    if(uint32_t(_mm256_movemask_epi8(eq)) != 0xffffffffU)
+      break;
+
+    offs += 128;
+  }
+
+  while(offs + 32 <= bufSize)
+  {
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + offs)),
+                                   _mm256_loadu_si256((const __m256i *)(b + offs)));
+
+    uint32_t mask = ~uint32_t(_mm256_movemask_epi8(eq));
+
+    if(mask != 0)
+      return offs + Bits::CountTrailingZeroes(mask);
+
+    offs += 32;
+  }
+
+  return offs;
+}
+
+AVX2_FUNCTION static size_t FindLastDiffAVX2(const byte *a, const byte *b, size_t bufSize)
+{
+  size_t end = bufSize;
+
+  while(end >= 32)
+  {
+    __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + end - 32)),
+                                   _mm256_loadu_si256((const __m256i *)(b + end - 32)));
+
+    uint32_t mask = ~uint32_t(_mm256_movemask_epi8(eq));
+
+    if(mask != 0)
+      return end - Bits::CountLeadingZeroes(mask);
+
+    end -= 32;
+  }
+
+  return end;
+}
+
+#endif    // ENABLED(RDOC_SSE2)
+
+size_t FindFirstDiff(const void *a, const void *b, size_t bufSize)
+{
+  const byte *a8 = (const byte *)a;
+  const byte *b8 = (const byte *)b;
 
   size_t offs = 0;
 
-  float *aflt = (float *)a;
-  float *bflt = (float *)b;
+#if ENABLED(RDOC_SSE2)
+  if(HasAVX2())
+    offs = FindFirstDiffAVX2(a8, b8, bufSize);
 
-  // sweep to find the start of differences
-  for(size_t v = 0; v < numVecs; v++)
+  // compare 64 bytes at a time while everything matches, then narrow down to the byte. Neither
+  // pointer needs to be aligned.
+  while(offs + 64 <= bufSize)
   {
-    if(Vec16NotEqual(aflt, bflt))
-    {
-      diffStart = offs;
+    const __m128i *av = (const __m128i *)(a8 + offs);
+    const __m128i *bv = (const __m128i *)(b8 + offs);
+
+    __m128i eq0 = _mm_cmpeq_epi8(_mm_loadu_si128(av + 0), _mm_loadu_si128(bv + 0));
+    __m128i eq1 = _mm_cmpeq_epi8(_mm_loadu_si128(av + 1), _mm_loadu_si128(bv + 1));
+    __m128i eq2 = _mm_cmpeq_epi8(_mm_loadu_si128(av + 2), _mm_loadu_si128(bv + 2));
+    __m128i eq3 = _mm_cmpeq_epi8(_mm_loadu_si128(av + 3), _mm_loadu_si128(bv + 3));
+
+    __m128i eq = _mm_and_si128(_mm_and_si128(eq0, eq1), _mm_and_si128(eq2, eq3));
+
+    if(_mm_movemask_epi8(eq) != 0xffff)
       break;
-    }
 
-    aflt += 4;
-    bflt += 4;
-    offs += 4 * sizeof(float);
+    offs += 64;
   }
 
-  // make sure we're byte-accurate, to comply with WRITE_NO_OVERWRITE
-  while(diffStart < bufSize && *((byte *)a + diffStart) == *((byte *)b + diffStart))
-    diffStart++;
+  while(offs + 16 <= bufSize)
+  {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a8 + offs)),
+                                _mm_loadu_si128((const __m128i *)(b8 + offs)));
+
+    uint32_t mask = uint32_t(_mm_movemask_epi8(eq)) ^ 0xffff;
 
-  // do we have some unaligned bytes at the end of the buffer?
-  if(bufSize > alignedSize)
+    if(mask != 0)
+      return offs + Bits::CountTrailingZeroes(mask);
+
+    offs += 16;
+  }
+#else
+  while(offs + sizeof(uint64_t) <= bufSize)
   {
-    size_t numBytes = bufSize - alignedSize;
+    uint64_t a64, b64;
+    memcpy(&a64, a8 + offs, sizeof(uint64_t));
+    memcpy(&b64, b8 + offs, sizeof(uint64_t));
 
-    // if we haven't even found a start, check in these bytes
-    if(diffStart > bufSize)
-    {
-      offs = alignedSize;
+    if(a64 != b64)
+      break;
 
-      for(size_t by = 0; by < numBytes; by++)
-      {
-        if(*((byte *)a + alignedSize + by) != *((byte *)b + alignedSize + by))
-        {
-          diffStart = offs;
-          break;
-        }
+    offs += sizeof(uint64_t);
+  }
+#endif
 
-        offs++;
-      }
-    }
+  while(offs < bufSize && a8[offs] == b8[offs])
+    offs++;
 
-    // sweep from the last byte to find the end
-    for(size_t by = 0; by < numBytes; by++)
-    {
-      if(*((byte *)a + bufSize - 1 - by) != *((byte *)b + bufSize - 1 - by))
-      {
-        diffEnd = bufSize - by;
-        break;
-      }
-    }
+  return offs;
+}
+
+// returns one past the last byte that differs between a and b, or 0 if they're identical
+static size_t FindLastDiff(const byte *a, const byte *b, size_t bufSize)
+{
+  size_t end = bufSize;
+
+#if ENABLED(RDOC_SSE2)
+  if(HasAVX2())
+    end = FindLastDiffAVX2(a, b, end);
+
+  while(end >= 16)
+  {
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + end - 16)),
+                                _mm_loadu_si128((const __m128i *)(b + end - 16)));
+
+    uint32_t mask = uint32_t(_mm_movemask_epi8(eq)) ^ 0xffff;
+
+    if(mask != 0)
+      return end - 16 + 32 - Bits::CountLeadingZeroes(mask);
+
+    end -= 16;
+  }
+#else
+  while(end >= sizeof(uint64_t))
+  {
+    uint64_t a64, b64;
+    memcpy(&a64, a + end - sizeof(uint64_t), sizeof(uint64_t));
+    memcpy(&b64, b + end - sizeof(uint64_t), sizeof(uint64_t));
+
+    if(a64 != b64)
+      break;
+
+    end -= sizeof(uint64_t);
   }
+#endif
 
-  // if we haven't found a start, or we've found a start AND and end,
-  // then we're done.
-  if(diffStart > bufSize || diffEnd > 0)
-    return diffStart < bufSize;
+  while(end > 0 && a[end - 1] == b[end - 1])
+    end--;
 
-  offs = alignedSize;
+  return end;
+}
 
-  // sweep from the last __m128
-  aflt = (float *)a + offs / sizeof(float) - 4;
-  bflt = (float *)b + offs / sizeof(float) - 4;
+bool FindDiffRange(void *a, void *b, size_t bufSize, size_t &diffStart, size_t &diffEnd)
+{
+  const byte *a8 = (const byte *)a;
+  const byte *b8 = (const byte *)b;
 
-  for(size_t v = 0; v < numVecs; v++)
+  // these are byte-accurate, to comply with WRITE_NO_OVERWRITE
+  diffStart = FindFirstDiff(a8, b8, bufSize);
+
+  if(diffStart >= bufSize)
   {
-    if(Vec16NotEqual(aflt, bflt))
-    {
-      diffEnd = offs;
+    diffStart = bufSize + 1;
+    diffEnd = 0;
+    return false;
+  }
+
+  diffEnd = diffStart + FindLastDiff(a8 + diffStart, b8 + diffStart, bufSize - diffStart);
+
+  return true;
+}
+
+size_t FindDiffRanges(const void *a, const void *b, size_t bufSize, size_t mergeGap,
+                      DiffRange *ranges, size_t maxRanges)
+{
+  const byte *a8 = (const byte *)a;
+  const byte *b8 = (const byte *)b;
+
+  size_t numRanges = 0;
+  size_t offs = 0;
+
+  while(numRanges < maxRanges)
+  {
+    size_t start = offs + FindFirstDiff(a8 + offs, b8 + offs, bufSize - offs);
+
+    if(start >= bufSize)
       break;
+
+    size_t end = start + 1;
+
+    // once we're on the last range it has to cover all remaining differences
+    if(numRanges + 1 == maxRanges)
+    {
+      end = start + FindLastDiff(a8 + start, b8 + start, bufSize - start);
     }
+    else
+    {
+      for(;;)
+      {
+        // step over densely changed data a block at a time, the end is trimmed afterwards
+        while(end + 32 <= bufSize && memcmp(a8 + end, b8 + end, 32) != 0)
+          end += 32;
+
+        // if there's another difference within the merge gap, continue on from it
+        size_t gap = RDCMIN(mergeGap, bufSize - end);
+        size_t next = end + FindFirstDiff(a8 + end, b8 + end, gap);
+
+        if(next == end + gap)
+          break;
+
+        end = next + 1;
+      }
 
-    aflt -= 4;
-    bflt -= 4;
-    offs -= 16;
+      while(end > start + 1 && a8[end - 1] == b8[end - 1])
+        end--;
+    }
+
+    // the memory may be written while we're looking at it, so never return an empty range
+    end = RDCMAX(end, start + 1);
+
+    ranges[numRanges].start = start;
+    ranges[numRanges].end = end;
+    numRanges++;
+
+    offs = end;
   }
 
-  // make sure we're byte-accurate, to comply with WRITE_NO_OVERWRITE
-  while(diffEnd > 0 && *((byte *)a + diffEnd - 1) == *((byte *)b + diffEnd - 1))
-    diffEnd--;
+  return numRanges;
+}
 
-  // if we found a start then we necessarily found an end
-  return diffStart < bufSize;
+size_t FindDiffRanges(const void *a, const void *b, size_t bufSize, DiffRange *ranges,
+                      size_t maxRanges)
+{
+  return FindDiffRanges(a, b, bufSize, Capture_MapDiffMergeGap(), ranges, maxRanges);
 }
 
 uint32_t CalcNumMips(int w, int h, int d)
@@ -298,6 +298,23 @@ inline T AlignUpPtr(T x, A a)
   (((uint32_t)(d) << 24) | ((uint32_t)(c) << 16) | ((uint32_t)(b) << 8) | (uint32_t)(a))
 
 bool FindDiffRange(void *a, void *b, size_t bufSize, size_t &diffStart, size_t &diffEnd);
+// returns the offset of the first byte that differs between a and b, or bufSize if they're identical
+size_t FindFirstDiff(const void *a, const void *b, size_t bufSize);
+
+struct DiffRange
+{
+  size_t start;
+  size_t end;
+};
+
+// fills out up to maxRanges [start, end) ranges where a and b differ, returning how many were found.
+// Differences fewer than mergeGap bytes apart are merged into one range, and if there are more
+// differences than ranges the last range covers all of the remainder.
+size_t FindDiffRanges(const void *a, const void *b, size_t bufSize, size_t mergeGap,
+                      DiffRange *ranges, size_t maxRanges);
+// as above, using the Capture_MapDiffMergeGap config setting
+size_t FindDiffRanges(const void *a, const void *b, size_t bufSize, DiffRange *ranges,
+                      size_t maxRanges);
 uint32_t CalcNumMips(int Width, int Height, int Depth);
 
 typedef uint8_t byte;
@@ -0,0 +1,135 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "common/common.h"
+#include "api/replay/rdcarray.h"
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+TEST_CASE("Test finding differences in memory", "[common]")
+{
+  rdcarray<byte> a, b;
+  a.resize(4096 + 7);
+  for(size_t i = 0; i < a.size(); i++)
+    a[i] = byte(i * 37 + 11);
+  b = a;
+
+  SECTION("FindDiffRange")
+  {
+    size_t diffStart = 0, diffEnd = 0;
+
+    CHECK_FALSE(FindDiffRange(a.data(), b.data(), a.size(), diffStart, diffEnd));
+
+    for(size_t offs : {0, 5, 31, 32, 1000, 4095, 4102})
+    {
+      b[offs]++;
+      CHECK(FindDiffRange(a.data(), b.data(), a.size(), diffStart, diffEnd));
+      CHECK(diffStart == offs);
+      CHECK(diffEnd == offs + 1);
+      b[offs]--;
+    }
+
+    b[3] = 0;
+    b[3000] = 0;
+
+    CHECK(FindDiffRange(a.data(), b.data(), a.size(), diffStart, diffEnd));
+    CHECK(diffStart == 3);
+    CHECK(diffEnd == 3001);
+  }
+
+  SECTION("FindDiffRanges")
+  {
+    DiffRange ranges[4] = {};
+
+    CHECK(FindDiffRanges(a.data(), b.data(), a.size(), 64, ranges, 4) == 0);
+
+    // the first and last byte only
+    b[0]++;
+    b[a.size() - 1]++;
+
+    REQUIRE(FindDiffRanges(a.data(), b.data(), a.size(), 64, ranges, 4) == 2);
+    CHECK(ranges[0].start == 0);
+    CHECK(ranges[0].end == 1);
+    CHECK(ranges[1].start == a.size() - 1);
+    CHECK(ranges[1].end == a.size());
+
+    // with only one range, it must cover everything
+    REQUIRE(FindDiffRanges(a.data(), b.data(), a.size(), 64, ranges, 1) == 1);
+    CHECK(ranges[0].start == 0);
+    CHECK(ranges[0].end == a.size());
+
+    b[0]--;
+    b[a.size() - 1]--;
+
+    // a dense run of changes, then two changes within the merge gap
+    for(size_t i = 100; i < 300; i++)
+      b[i]++;
+    b[1000]++;
+    b[1050]++;
+    b[2000]++;
+    b[3000]++;
+
+    REQUIRE(FindDiffRanges(a.data(), b.data(), a.size(), 64, ranges, 4) == 4);
+    CHECK(ranges[0].start == 100);
+    CHECK(ranges[0].end == 300);
+    CHECK(ranges[1].start == 1000);
+    CHECK(ranges[1].end == 1051);
+    CHECK(ranges[2].start == 2000);
+    CHECK(ranges[2].end == 2001);
+    CHECK(ranges[3].start == 3000);
+    CHECK(ranges[3].end == 3001);
+
+    // without a merge gap the two nearby changes are separate, and the last range takes the rest
+    REQUIRE(FindDiffRanges(a.data(), b.data(), a.size(), 0, ranges, 4) == 4);
+    CHECK(ranges[1].start == 1000);
+    CHECK(ranges[1].end == 1001);
+    CHECK(ranges[2].start == 1050);
+    CHECK(ranges[2].end == 1051);
+    CHECK(ranges[3].start == 2000);
+    CHECK(ranges[3].end == 3001);
+
+    // a large merge gap combines everything
+    REQUIRE(FindDiffRanges(a.data(), b.data(), a.size(), 4096, ranges, 4) == 1);
+    CHECK(ranges[0].start == 100);
+    CHECK(ranges[0].end == 3001);
+  }
+
+  SECTION("Unaligned pointers")
+  {
+    b[77]++;
+    b[78]++;
+
+    DiffRange ranges[2] = {};
+
+    REQUIRE(FindDiffRanges(a.data() + 3, b.data() + 3, a.size() - 3, 0, ranges, 2) == 1);
+    CHECK(ranges[0].start == 74);
+    CHECK(ranges[0].end == 76);
+
+    CHECK(FindFirstDiff(a.data() + 1, b.data() + 1, a.size() - 1) == 76);
+  }
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
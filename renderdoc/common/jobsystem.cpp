@@ -23,7 +23,14 @@
  ******************************************************************************/
 
 #include <math.h>
+#include "api/replay/renderdoc_replay.h"
+#include "core/settings.h"
 #include "threading.h"
+#include "timing.h"
+
+RDOC_CONFIG(bool, Threading_ProfileJobs, false,
+            "Add a profiler region around every job run by the job system, and log per-worker "
+            "utilisation statistics at each sync.");
 
 namespace Threading
 {
@@ -66,61 +73,66 @@ static float spinForce = 0.0f;
 
 // Principles:
 // - don't need priorities (yet)
-// - jobs are basically go-wide then one big sync, no need to track lifetimes, don't need a
-// continuous
-//   rolling parallelisation only using this during specific points (loading, shader debugging)
-// - all jobs explicitly launched from main thread, jobs cannot launch jobs
-// - only simple dependencies: 1 job depends on N parents
+// - jobs are mostly go-wide then one big sync, but a job or a group of jobs can be waited on
+//   individually with WaitForJob()/WaitForJobs() without syncing everything
+// - jobs can be launched from the main thread or from within other jobs. Jobs launched on a
+//   worker go onto that worker's own queue, everything else goes onto a shared queue
+// - only simple dependencies: 1 job depends on N parents. Jobs aren't queued at all until all
+//   parents have completed, the last parent to complete queues any children that became ready
 // - don't need to be fair: as long as all jobs complete, can happen in mostly any order
 // - jobs should not be too fast, 2ms would be a lower bound
-// - since we expect one sync point, we don't expect perfect forward progress indefinitely with no
-// syncs
+// - job lifetimes are only guaranteed until the next SyncAllJobs(), which deletes all jobs
+//
+// Scheduling:
+//
+// - each worker pops the most recent job from its own queue first as that is most likely to be
+//   hot in cache and is likely a child of the job it just ran, then takes from the shared queue,
+//   and finally steals the oldest job from another worker's queue.
+// - any thread waiting on a job (including SyncAllJobs()) runs other pending jobs while it waits.
+//   This means a job that waits on children it spawned can never deadlock, even with only one
+//   worker, since at worst it runs the children itself.
 //
 // Safety analysis:
 //
 // - over-waking a semaphore a little is not a problem, the worker might spin a bit but it will
 // eventually
 //   go back to sleep once it can't get any work.
-// - waking one semaphore is sufficient to drain the queue as one worker alone will eventually
+// - waking one semaphore is sufficient to drain the queues as one worker alone will eventually
 //   complete all work just potentially without the best parallelism if other workers are sleeping
 // - semaphore count limits mean we should not do one wake-per-job or it might overflow in theory
 // - we wake workers in a chain. Threads mark when they go to sleep and are prioritised to wake up
-//   for new jobs as we assume maximum saturation is desired. When a thread finds work in the queue
+//   for new jobs as we assume maximum saturation is desired. When a thread finds even more work
 //   pending it will try to wake a sleeping sibling.
-// - The main thread could in theory push work right as all threads are going to sleep but fail to
-//   wake any of them if it thinks they're running. This can only happen for one job at most at a
-//   time, the most recent job to be pushed, as otherwise the next job would find sleeping
-//   threads and wake them. Forward progress is guaranteed by an assumed SyncAll() call. This could
-//   be improved by forcing the main thread to always wake at least one thread, or perhaps to wait
-//   until either it's woken a thread or the job has been grabbed from the job queue.
+// - A job could in theory be pushed right as all threads are going to sleep but fail to wake any
+//   of them if it thinks they're running. To avoid this workers mark themselves as not running
+//   *before* checking the queued job count one last time, and pushers increment the count before
+//   looking for a sleeping worker. Either the worker sees the job, or the pusher sees the worker
+//   asleep.
 // - threads could be mis-identified as both sleeping or waking due to the gap between the atomic on
 //   'running' and the semaphore sleep/wake, but as a result of the above double-waking a thread is
 //   not a big problem as it will eventually sleep if there's no room. Thinking a thread is running
 //   when it's just gone to sleep is also fine as this is equivalent to if the thread really were
 //   running - we still have forward progress.
+// - a job is counted as pending from when it's added until the very last thing done after it
+//   completes, which is after any children have been queued. Once the pending count hits 0 no job
+//   can be referenced by a worker any more and all jobs can be safely deleted.
 
 namespace JobSystem
 {
 
 struct Job
 {
-  // 0 = not run or running, 1 = complete
+  // 0 = not run or running, 1 = complete. Only modified with dependencyLock held
   int32_t state = 0;
 
-  void run()
-  {
-    // run should not be called multiple times
-    RDCASSERT(state == 0);
+  // number of parents that haven't completed yet. Protected by dependencyLock
+  uint32_t pendingParents = 0;
 
-    callback();
-    Atomic::Inc32(&state);
+  // jobs that are waiting for this job to complete. Protected by dependencyLock
+  rdcarray<Job *> children;
 
-    // run should not be called multiple times
-    RDCASSERT(state == 1);
-  }
-
-  // list of jobs that must be complete before this job can be run
-  rdcarray<Job *> parents;
+  // optional name for profiling, must be a string literal or otherwise outlive the job
+  const char *name = NULL;
 
   // the actual callback
   std::function<void()> callback;
@@ -130,16 +142,69 @@ struct Job
 
 // TODO: could be multiple queues per-priority in future...
 
-// locked access to the queue and shutdown flag
+// locked access to the shared queue
 Threading::CriticalSection queueLock;
-// global flags for workers to shut down. DOES NOT automatically drain work, requires a sync first
-bool shutdown = false;
-// added to on on main thread and worker threads pull from and potentially reorder
+// jobs added from outside of a worker. All workers pull from this and it's drained in FIFO order
 rdcarray<Threading::JobSystem::Job *> jobQueue;
 
-// list of jobs, only for lifetime management. Only accessed on main thread, for cleanup in SyncAll()
+// global flag for workers to shut down. DOES NOT automatically drain work, requires a sync first
+int32_t shutdown = 0;
+
+// the number of jobs sitting in any queue, shared or per-worker, that haven't been picked up yet.
+// Lets idle threads skip looking through every queue when there's nothing to find
+int32_t queuedJobs = 0;
+
+// the number of jobs that have been added but not yet completed, including those waiting on parents
+int32_t pendingJobs = 0;
+
+// protects job state and dependency lists
+Threading::CriticalSection dependencyLock;
+
+// list of jobs, only for lifetime management and cleanup in SyncAll()
+Threading::CriticalSection allocLock;
 rdcarray<Threading::JobSystem::Job *> allocatedJobs;
 
+// a worker's queue of jobs. The worker pushes and pops at the back, thieves take from the front by
+// advancing a head index. The stolen slots at the front are only reclaimed once they're at least
+// half of the array, so a steal doesn't shift every remaining job down each time
+struct JobDeque
+{
+  bool empty() const { return head == jobs.size(); }
+  void push_back(Threading::JobSystem::Job *job) { jobs.push_back(job); }
+  Threading::JobSystem::Job *pop_back()
+  {
+    Threading::JobSystem::Job *ret = jobs.back();
+    jobs.pop_back();
+    if(empty())
+      Reset();
+    return ret;
+  }
+  Threading::JobSystem::Job *pop_front()
+  {
+    Threading::JobSystem::Job *ret = jobs[head++];
+    if(empty())
+    {
+      Reset();
+    }
+    else if(head >= 32 && head * 2 >= jobs.size())
+    {
+      jobs.erase(0, head);
+      head = 0;
+    }
+    return ret;
+  }
+
+private:
+  void Reset()
+  {
+    jobs.clear();
+    head = 0;
+  }
+
+  rdcarray<Threading::JobSystem::Job *> jobs;
+  size_t head = 0;
+};
+
 struct JobWorker
 {
   size_t idx;
@@ -149,12 +214,34 @@ struct JobWorker
 
   // 1 = running, or 0 = currently sleeping
   int32_t running = 1;
+
+  // this worker's own queue. The worker pushes and pops from the back, other threads steal from
+  // the front
+  Threading::CriticalSection queueLock;
+  JobDeque queue;
+
+  // statistics, only gathered when profiling jobs
+  uint32_t jobsRun = 0;
+  uint32_t jobsStolen = 0;
+  double busyTime = 0.0;
 };
 
-// the thread ID of the main thread - only thread that can access the external API
+// the thread ID of the main thread - only thread that can sync or shut down the job system
 uint64_t mainThread;
 
-rdcarray<JobWorker> workers;
+// TLS slot pointing to the current thread's JobWorker, or NULL if it's not a worker
+uint64_t workerSlot = 0;
+
+// workers are never moved once created as they're referenced by TLS
+rdcarray<JobWorker *> workers;
+
+// used to compute overall utilisation when profiling
+PerformanceTimer syncTimer;
+
+JobWorker *GetCurrentWorker()
+{
+  return (JobWorker *)Threading::GetTLSValue(workerSlot);
+}
 
 // wake at most one sleeping worker, either starting from 0 (and any) or starting from N (and not waking itself)
 bool TryWakeFirstSleepingWorker(size_t firstIdx = ~0U)
@@ -172,12 +259,12 @@ bool TryWakeFirstSleepingWorker(size_t firstIdx = ~0U)
       continue;
 
     // worker running state should always be 0 or 1
-    int32_t running = workers[idx].running;
+    int32_t running = workers[idx]->running;
     RDCASSERT(running == 0 || running == 1);
 
-    if(Atomic::CmpExch32(&workers[idx].running, 0, 0) == 0)
+    if(Atomic::CmpExch32(&workers[idx]->running, 0, 0) == 0)
     {
-      workers[idx].semaphore->Wake(1);
+      workers[idx]->semaphore->Wake(1);
       return true;
     }
   }
@@ -185,67 +272,168 @@ bool TryWakeFirstSleepingWorker(size_t firstIdx = ~0U)
   return false;
 }
 
-bool RunJobIfReady(Threading::JobSystem::Job *curJob)
+// queue a job that's ready to run, onto the current worker's queue if there is one
+void PushJob(Threading::JobSystem::Job *job)
 {
-  // default to ready to run if there are no parents
-  bool dependenciesSatisfied = true;
+  JobWorker *worker = GetCurrentWorker();
 
-  // check all parent jobs if they're completed. This is conservative,
-  // they might have finished but not updated state or one might finish after
-  // we checked it, but that's fine
-  for(Threading::JobSystem::Job *p : curJob->parents)
+  if(worker)
   {
-    if(Atomic::CmpExch32(&p->state, 0, 0) == 0)
-      dependenciesSatisfied = false;
-
-    // check that parent state is valid, should either be finished or not
-    int32_t state = p->state;
-    RDCASSERT(state == 0 || state == 1);
+    SCOPED_LOCK(worker->queueLock);
+    RandomSleepSpin(true);
+    worker->queue.push_back(job);
   }
-
-  // if we can run the job, run it. Return whether or not it was run
-  if(dependenciesSatisfied)
+  else
   {
-    curJob->run();
-    return true;
+    SCOPED_LOCK(queueLock);
+    RandomSleepSpin(true);
+    jobQueue.insert(0, job);
   }
 
-  return false;
+  Atomic::Inc32(&queuedJobs);
+
+  RandomSleepSpin(false);
+
+  TryWakeFirstSleepingWorker(worker ? worker->idx : ~0U);
 }
 
-void WorkerThread(JobWorker &worker)
+// grab the next job to run from the perspective of worker (which may be NULL). Sets moreWork if
+// there's still work left in the queue the job came from
+Threading::JobSystem::Job *PopJob(JobWorker *worker, bool &moreWork)
 {
-  // outer loop until shutdown
-  while(true)
+  Threading::JobSystem::Job *ret = NULL;
+
+  moreWork = false;
+
+  if(Atomic::CmpExch32(&queuedJobs, 0, 0) == 0)
+    return NULL;
+
+  // our own most recent job first
+  if(worker)
   {
-    // job we grabbed to work on
-    Threading::JobSystem::Job *curJob = NULL;
-    // if there is even more work to do
-    bool moreWork = false;
+    SCOPED_LOCK(worker->queueLock);
+    RandomSleepSpin(true);
+    if(!worker->queue.empty())
+    {
+      ret = worker->queue.pop_back();
+      moreWork = !worker->queue.empty();
+    }
+  }
 
-    RandomSleepSpin(false);
+  // then the shared queue
+  if(!ret)
+  {
+    SCOPED_LOCK(queueLock);
+    RandomSleepSpin(true);
+    if(!jobQueue.empty())
+    {
+      ret = jobQueue.back();
+      jobQueue.pop_back();
+      moreWork = !jobQueue.empty();
+    }
+  }
 
+  // finally try to steal the oldest job from another worker, starting with our neighbour so that
+  // thieves spread out
+  if(!ret)
+  {
+    size_t firstIdx = worker ? worker->idx + 1 : 0;
+    for(size_t i = 0; i < workers.size(); i++)
     {
-      SCOPED_LOCK(queueLock);
+      JobWorker *victim = workers[(firstIdx + i) % workers.size()];
 
-      RandomSleepSpin(true);
+      if(victim == worker)
+        continue;
 
-      // grab a job if the queue is non-empty
-      if(!jobQueue.empty())
+      SCOPED_LOCK(victim->queueLock);
+      RandomSleepSpin(true);
+      if(!victim->queue.empty())
       {
-        curJob = jobQueue.back();
-        jobQueue.pop_back();
+        ret = victim->queue.pop_front();
+        moreWork = !victim->queue.empty();
+
+        if(worker)
+          worker->jobsStolen++;
+        break;
       }
-      // if there's even more work, note it so we can wake up a sibling worker as needed
-      moreWork = !jobQueue.empty();
+    }
+  }
 
-      RandomSleepSpin(true);
+  if(ret)
+    Atomic::Dec32(&queuedJobs);
 
-      // shut down immediately if requested, check this in the lock
-      if(shutdown)
-        break;
+  return ret;
+}
+
+void RunJob(Threading::JobSystem::Job *job, JobWorker *worker)
+{
+  if(Threading_ProfileJobs())
+  {
+    PerformanceTimer timer;
+
+    {
+      RENDERDOC_PROFILEREGION(job->name ? job->name : "Job");
+      job->callback();
     }
 
+    if(worker)
+    {
+      worker->busyTime += timer.GetMilliseconds();
+      worker->jobsRun++;
+    }
+  }
+  else
+  {
+    job->callback();
+  }
+
+  RandomSleepSpin(false);
+
+  // mark the job as complete and find any children that are now ready to run
+  rdcarray<Threading::JobSystem::Job *> ready;
+  {
+    SCOPED_LOCK(dependencyLock);
+
+    // run should not be called multiple times
+    RDCASSERT(job->state == 0);
+    Atomic::Inc32(&job->state);
+
+    for(Threading::JobSystem::Job *child : job->children)
+    {
+      RDCASSERT(child->pendingParents > 0);
+      child->pendingParents--;
+      if(child->pendingParents == 0)
+        ready.push_back(child);
+    }
+    job->children.clear();
+  }
+
+  for(Threading::JobSystem::Job *child : ready)
+    PushJob(child);
+
+  // this must be the last thing that references the job
+  Atomic::Dec32(&pendingJobs);
+}
+
+void WorkerThread(JobWorker &worker)
+{
+  Threading::SetTLSValue(workerSlot, &worker);
+
+  // outer loop until shutdown
+  while(true)
+  {
+    RandomSleepSpin(false);
+
+    // shut down immediately if requested
+    if(Atomic::CmpExch32(&shutdown, 0, 0) != 0)
+      break;
+
+    // if there is even more work to do
+    bool moreWork = false;
+
+    // job we grabbed to work on
+    Threading::JobSystem::Job *curJob = PopJob(&worker, moreWork);
+
     RandomSleepSpin(false);
 
     // if there's no more work, go to sleep
@@ -256,23 +444,13 @@ void WorkerThread(JobWorker &worker)
 
       RandomSleepSpin(false);
 
-      // check the queue once more here to allow constant forward progress without a sync.
-      // If the main thread pushed work after we last checked, but it thought we were running so
-      // didn't wake us up and we got here, we can check for work and re-wake without a semaphore
-      // signal that might never come.
-      // If there's no work here then when the main thread adds more it will definitely see us (or
-      // at least one worker) not running and wake us
+      // check for work once more after marking ourselves as asleep. If a job was pushed after we
+      // last checked but the pusher thought we were running so didn't wake us, we'll see it here
+      // and re-wake without a semaphore signal that might never come.
+      if(Atomic::CmpExch32(&queuedJobs, 0, 0) != 0 || Atomic::CmpExch32(&shutdown, 0, 0) != 0)
       {
-        SCOPED_LOCK(queueLock);
-        RandomSleepSpin(true);
-
-        if(!jobQueue.empty())
-        {
-          RandomSleepSpin(true);
-
-          Atomic::Inc32(&worker.running);
-          continue;
-        }
+        Atomic::Inc32(&worker.running);
+        continue;
       }
 
       RandomSleepSpin(false);
@@ -282,6 +460,8 @@ void WorkerThread(JobWorker &worker)
       Atomic::Inc32(&worker.running);
 
       RandomSleepSpin(false);
+
+      continue;
     }
 
     // if there's more work to do, try to wake a sleeping worker too. If none are sleeping, this will do nothing
@@ -290,19 +470,43 @@ void WorkerThread(JobWorker &worker)
 
     RandomSleepSpin(false);
 
-    // run our job, and push it back onto the queue if it couldn't be run
-    if(curJob && !RunJobIfReady(curJob))
-    {
-      SCOPED_LOCK(queueLock);
+    RunJob(curJob, &worker);
+  }
 
-      RandomSleepSpin(true);
-      jobQueue.insert(0, curJob);
+  Atomic::Dec32(&worker.running);
 
-      RandomSleepSpin(true);
-    }
+  Threading::SetTLSValue(workerSlot, NULL);
+}
+
+void LogJobStatistics()
+{
+  double elapsed = syncTimer.GetMilliseconds();
+
+  uint32_t totalRun = 0, totalStolen = 0;
+  double totalBusy = 0.0;
+  for(JobWorker *worker : workers)
+  {
+    totalRun += worker->jobsRun;
+    totalStolen += worker->jobsStolen;
+    totalBusy += worker->busyTime;
   }
 
-  Atomic::Dec32(&worker.running);
+  // don't spam the log for syncs with nothing to do
+  if(totalRun == 0)
+    return;
+
+  RDCLOG("Job system ran %u jobs (%u stolen) in %.2f ms on %zu workers, %.1f%% utilisation",
+         totalRun, totalStolen, elapsed, workers.size(),
+         elapsed > 0.0 ? (totalBusy * 100.0) / (elapsed * workers.size()) : 0.0);
+
+  for(JobWorker *worker : workers)
+  {
+    RDCLOG("  Worker %zu: %u jobs (%u stolen), busy for %.2f ms", worker->idx, worker->jobsRun,
+           worker->jobsStolen, worker->busyTime);
+
+    worker->jobsRun = worker->jobsStolen = 0;
+    worker->busyTime = 0.0;
+  }
 }
 
 namespace JobSystem
@@ -311,9 +515,14 @@ void Init(uint32_t numThreads)
 {
   mainThread = Threading::GetCurrentID();
 
-  shutdown = false;
+  shutdown = 0;
+  queuedJobs = 0;
+  pendingJobs = 0;
   jobQueue.clear();
 
+  if(workerSlot == 0)
+    workerSlot = Threading::AllocateTLSSlot();
+
   // if numThreads is 0, auto-select a number of threads
   if(numThreads == 0)
   {
@@ -337,10 +546,19 @@ void Init(uint32_t numThreads)
   workers.resize(numThreads);
   for(size_t i = 0; i < numThreads; i++)
   {
-    workers[i].idx = i;
-    workers[i].semaphore = Threading::Semaphore::Create();
-    workers[i].thread = Threading::CreateThread([i] { WorkerThread(workers[i]); });
+    workers[i] = new JobWorker;
+    workers[i]->idx = i;
+    workers[i]->semaphore = Threading::Semaphore::Create();
   }
+
+  // create threads only once all workers exist, as they can steal from each other immediately
+  for(size_t i = 0; i < numThreads; i++)
+  {
+    JobWorker *worker = workers[i];
+    worker->thread = Threading::CreateThread([worker] { WorkerThread(*worker); });
+  }
+
+  syncTimer.Restart();
 }
 
 void Shutdown()
@@ -354,23 +572,82 @@ void Shutdown()
 
   mainThread = 0;
 
-  {
-    SCOPED_LOCK(queueLock);
-    shutdown = true;
-  }
+  Atomic::Inc32(&shutdown);
+
   for(size_t i = 0; i < workers.size(); i++)
-    workers[i].semaphore->Wake(1);
+    workers[i]->semaphore->Wake(1);
 
   for(size_t i = 0; i < workers.size(); i++)
   {
-    Threading::JoinThread(workers[i].thread);
-    Threading::CloseThread(workers[i].thread);
-    workers[i].semaphore->Destroy();
+    Threading::JoinThread(workers[i]->thread);
+    Threading::CloseThread(workers[i]->thread);
+    workers[i]->semaphore->Destroy();
+    delete workers[i];
   }
 
   workers.clear();
 }
 
+void WaitForJobs(const rdcarray<Job *> &jobs)
+{
+  JobWorker *worker = GetCurrentWorker();
+
+  for(Job *job : jobs)
+  {
+    if(!job)
+      continue;
+
+    // rather than blocking, run other jobs while we wait. This is what allows jobs to wait on
+    // jobs they spawned
+    while(Atomic::CmpExch32(&job->state, 0, 0) == 0)
+    {
+      bool moreWork = false;
+      Job *curJob = PopJob(worker, moreWork);
+
+      if(curJob)
+      {
+        if(moreWork)
+          TryWakeFirstSleepingWorker(worker ? worker->idx : ~0U);
+
+        RunJob(curJob, worker);
+      }
+      else
+      {
+        Threading::Sleep(0);
+      }
+    }
+  }
+}
+
+void WaitForJob(Job *job)
+{
+  WaitForJobs({job});
+}
+
+void FreeJobs(const rdcarray<Job *> &jobs)
+{
+  WaitForJobs(jobs);
+
+  // a job is marked complete with dependencyLock held and isn't referenced by the thread that ran
+  // it once the lock is released, so after taking it ourselves nothing can still be using them
+  {
+    SCOPED_LOCK(dependencyLock);
+  }
+
+  SCOPED_LOCK(allocLock);
+  for(Job *job : jobs)
+  {
+    int32_t idx = job ? allocatedJobs.indexOf(job) : -1;
+    if(idx < 0)
+      continue;
+
+    // order doesn't matter, so move the last job into the gap rather than shifting everything
+    allocatedJobs[idx] = allocatedJobs.back();
+    allocatedJobs.pop_back();
+    delete job;
+  }
+}
+
 void SyncAllJobs()
 {
   if(workers.empty())
@@ -378,68 +655,82 @@ void SyncAllJobs()
 
   RDCASSERTEQUAL(mainThread, Threading::GetCurrentID());
 
-  while(true)
+  // help run jobs until everything has completed, including any jobs that jobs spawned
+  while(Atomic::CmpExch32(&pendingJobs, 0, 0) != 0)
   {
-    // job we grabbed to work on
-    Job *curJob = NULL;
+    bool moreWork = false;
+    Job *curJob = PopJob(NULL, moreWork);
 
+    if(curJob)
     {
-      SCOPED_LOCK(queueLock);
-      if(jobQueue.empty())
-        break;
+      TryWakeFirstSleepingWorker();
 
-      curJob = jobQueue.back();
-      jobQueue.pop_back();
+      RunJob(curJob, NULL);
     }
-
-    if(!RunJobIfReady(curJob))
+    else
     {
-      SCOPED_LOCK(queueLock);
-      jobQueue.insert(0, curJob);
+      // the remaining jobs are all running on workers, sleep rather than spinning
+      Threading::Sleep(1);
     }
-
-    TryWakeFirstSleepingWorker();
   }
 
-  // the queue is now empty, but workers may still be running
-  bool workersRunning = false;
-  do
+  // nothing is pending, so nothing can be referencing any job. Delete them all
   {
-    workersRunning = false;
-
-    // if any worker is running, we keep looping. We know a worker can't wake up again after it's
-    // finished running because we force-drained the queue and nothing else will be adding work
-    for(size_t i = 0; i < workers.size(); i++)
-      workersRunning |= (Atomic::CmpExch32(&workers[i].running, 1, 1) == 1);
+    SCOPED_LOCK(allocLock);
+    for(Job *job : allocatedJobs)
+      delete job;
+    allocatedJobs.clear();
+  }
 
-    // sleep rather than spinning
-    if(workersRunning)
-      Threading::Sleep(1);
+  if(Threading_ProfileJobs())
+    LogJobStatistics();
 
-  } while(workersRunning);
+  syncTimer.Restart();
+}
 
-  // delete all jobs
-  for(Job *job : allocatedJobs)
-    delete job;
-  allocatedJobs.clear();
+bool CanAddJobs()
+{
+  return !workers.empty() &&
+         (mainThread == Threading::GetCurrentID() || GetCurrentWorker() != NULL);
 }
 
-Job *AddJob(std::function<void()> &&callback, const rdcarray<Job *> &parents)
+Job *AddJob(std::function<void()> &&callback, const rdcarray<Job *> &parents, const char *name)
 {
-  RDCASSERTEQUAL(mainThread, Threading::GetCurrentID());
+  RDCASSERT(CanAddJobs());
 
   Job *ret = new Job;
   ret->callback = std::move(callback);
-  ret->parents = parents;
+  ret->name = name;
+
+  {
+    SCOPED_LOCK(allocLock);
+    allocatedJobs.push_back(ret);
+  }
 
-  allocatedJobs.push_back(ret);
+  Atomic::Inc32(&pendingJobs);
 
+  // only hook up to parents that haven't completed yet. The last one to complete will queue us
+  bool ready = true;
   {
-    SCOPED_LOCK(queueLock);
-    jobQueue.insert(0, ret);
+    SCOPED_LOCK(dependencyLock);
+
+    for(Job *p : parents)
+    {
+      // check that parent state is valid, should either be finished or not
+      RDCASSERT(p->state == 0 || p->state == 1);
+
+      if(p->state == 0)
+      {
+        p->children.push_back(ret);
+        ret->pendingParents++;
+      }
+    }
+
+    ready = (ret->pendingParents == 0);
   }
 
-  TryWakeFirstSleepingWorker();
+  if(ready)
+    PushJob(ret);
 
   return ret;
 }
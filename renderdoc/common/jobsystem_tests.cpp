@@ -133,6 +133,111 @@ void RunJobTests()
     for(size_t c = 0; c < numChains; c++)
       CHECK(a[c] == b[c]);
   }
+
+  // waiting on specific jobs without a full sync
+  {
+    int32_t a = 0, b = 0;
+    Threading::JobSystem::Job *first =
+        Threading::JobSystem::AddJob([&a]() { Atomic::Inc32(&a); }, {}, "first");
+
+    rdcarray<Threading::JobSystem::Job *> group;
+    for(int i = 0; i < 20; i++)
+      group.push_back(Threading::JobSystem::AddJob([&b]() { Atomic::Inc32(&b); }, {first}));
+
+    Threading::JobSystem::WaitForJob(first);
+    CHECK(a == 1);
+
+    Threading::JobSystem::WaitForJobs(group);
+    CHECK(b == 20);
+
+    Threading::JobSystem::SyncAllJobs();
+  }
+
+  // jobs spawning jobs and waiting on them
+  {
+    static const size_t numJobs = 50;
+    static const size_t numChildren = 20;
+    static const size_t numItems = 500;
+    rdcarray<int> a[numJobs * numChildren];
+    int32_t merged[numJobs] = {};
+
+    for(size_t j = 0; j < numJobs; j++)
+    {
+      Threading::JobSystem::AddJob([&a, &merged, j]() {
+        rdcarray<Threading::JobSystem::Job *> children;
+        for(size_t c = 0; c < numChildren; c++)
+        {
+          rdcarray<int> &arr = a[j * numChildren + c];
+          children.push_back(Threading::JobSystem::AddJob([&arr]() {
+            for(size_t i = 0; i < numItems; i++)
+              arr.push_back(rand());
+            std::sort(arr.begin(), arr.end());
+          }));
+        }
+
+        Threading::JobSystem::WaitForJobs(children);
+
+        // all children must be complete here
+        for(size_t c = 0; c < numChildren; c++)
+          if(isSorted(a[j * numChildren + c]) && a[j * numChildren + c].size() == numItems)
+            merged[j]++;
+      });
+    }
+
+    Threading::JobSystem::SyncAllJobs();
+
+    for(size_t j = 0; j < numJobs; j++)
+      CHECK(merged[j] == (int32_t)numChildren);
+  }
+
+  // jobs spawning dependent jobs without waiting, which SyncAllJobs must still wait for
+  {
+    static const size_t numChains = 20;
+    rdcarray<int> a[numChains];
+    rdcarray<int> b[numChains];
+
+    for(size_t c = 0; c < numChains; c++)
+    {
+      Threading::JobSystem::AddJob([&a, c]() {
+        rdcarray<Threading::JobSystem::Job *> parents;
+        for(int i = 0; i < 100; i++)
+          parents = {Threading::JobSystem::AddJob([&a, c, i]() { a[c].push_back(i); }, parents)};
+      });
+
+      for(int i = 0; i < 100; i++)
+        b[c].push_back(i);
+    }
+
+    Threading::JobSystem::SyncAllJobs();
+
+    for(size_t c = 0; c < numChains; c++)
+      CHECK(a[c] == b[c]);
+  }
+
+  // freeing some jobs early, leaving others alone
+  {
+    int32_t other = 0;
+    Threading::JobSystem::Job *unrelated =
+        Threading::JobSystem::AddJob([&other]() { Atomic::Inc32(&other); });
+
+    for(int round = 0; round < 10; round++)
+    {
+      int32_t count = 0;
+      rdcarray<Threading::JobSystem::Job *> jobs;
+      for(int i = 0; i < 50; i++)
+        jobs.push_back(Threading::JobSystem::AddJob([&count]() { Atomic::Inc32(&count); }));
+
+      Threading::JobSystem::FreeJobs(jobs);
+
+      CHECK(count == 50);
+    }
+
+    // the unrelated job must still be valid and waitable
+    Threading::JobSystem::WaitForJob(unrelated);
+    CHECK(other == 1);
+
+    Threading::JobSystem::SyncAllJobs();
+  }
 }
 
 TEST_CASE("Check job system behaviour is correct with common thread counts", "[jobs]")
@@ -0,0 +1,424 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "shader_cache.h"
+#include <algorithm>
+#include "common/formatting.h"
+#include "core/settings.h"
+#include "zstd/zstd.h"
+
+RDOC_CONFIG(uint32_t, Replay_ShaderCacheSizeMB, 128,
+            "The maximum size in MB of the on-disk cache of shaders compiled for replay. When it's "
+            "exceeded the least recently used shaders are dropped.");
+
+static const uint32_t ShaderCacheMagic = MAKE_FOURCC('R', 'D', '$', 'I');
+
+static const int ShaderCacheCompressionLevel = 7;
+
+struct ShaderCacheHeader
+{
+  uint32_t globalMagic;
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numEntries;
+  uint64_t indexOffset;
+  uint64_t generation;
+};
+
+struct ShaderCacheIndexEntry
+{
+  uint64_t key;
+  uint64_t offset;
+  uint32_t compressedSize;
+  uint32_t uncompressedSize;
+  uint64_t lastUsed;
+};
+
+ShaderCacheFile::ShaderCacheFile(const rdcstr &path, uint32_t magicNumber, uint32_t versionNumber)
+    : m_Path(path), m_Magic(magicNumber), m_Version(versionNumber)
+{
+}
+
+ShaderCacheFile::~ShaderCacheFile()
+{
+  Close();
+}
+
+void ShaderCacheFile::Close()
+{
+  if(m_View)
+    FileIO::mapview_close(m_View);
+  m_View = NULL;
+  m_FileData.clear();
+  m_Data = NULL;
+}
+
+bool ShaderCacheFile::Load()
+{
+  Close();
+  m_Entries.clear();
+  m_Loaded = false;
+
+  // if there's no valid cache, write out a fresh one
+  m_Dirty = true;
+
+  FILE *f = FileIO::fopen(m_Path, FileIO::ReadBinary);
+
+  if(!f)
+    return false;
+
+  uint64_t fileSize = FileIO::GetFileSize(m_Path);
+
+  ShaderCacheHeader header = {};
+  rdcarray<ShaderCacheIndexEntry> index;
+
+  bool valid = FileIO::fread(&header, 1, sizeof(header), f) == sizeof(header) &&
+               header.globalMagic == ShaderCacheMagic && header.magic == m_Magic &&
+               header.version == m_Version && header.indexOffset >= sizeof(header) &&
+               header.indexOffset <= fileSize &&
+               header.numEntries <= (fileSize - header.indexOffset) / sizeof(ShaderCacheIndexEntry);
+
+  if(valid)
+  {
+    index.resize(header.numEntries);
+
+    FileIO::fseek64(f, header.indexOffset, SEEK_SET);
+    valid = FileIO::fread(index.data(), 1, index.byteSize(), f) == index.byteSize();
+
+    for(const ShaderCacheIndexEntry &e : index)
+    {
+      if(e.offset < sizeof(header) || e.offset + e.compressedSize > header.indexOffset)
+      {
+        valid = false;
+        break;
+      }
+    }
+  }
+
+  if(valid)
+  {
+    m_View = FileIO::mapview_open(f, 0, header.indexOffset);
+
+    if(m_View)
+    {
+      m_Data = FileIO::mapview_data(m_View);
+    }
+    else
+    {
+      m_FileData.resize((size_t)header.indexOffset);
+      FileIO::fseek64(f, 0, SEEK_SET);
+      valid = FileIO::fread(m_FileData.data(), 1, m_FileData.size(), f) == m_FileData.size();
+      m_Data = m_FileData.data();
+    }
+  }
+
+  FileIO::fclose(f);
+
+  if(!valid)
+  {
+    RDCWARN("Ignoring invalid or out of date shader cache '%s'", m_Path.c_str());
+    Close();
+    return false;
+  }
+
+  for(const ShaderCacheIndexEntry &e : index)
+  {
+    Entry &entry = m_Entries[e.key];
+    entry.offset = e.offset;
+    entry.compressedSize = e.compressedSize;
+    entry.uncompressedSize = e.uncompressedSize;
+    entry.lastUsed = e.lastUsed;
+  }
+
+  m_LoadedIndexOffset = header.indexOffset;
+  m_LoadedGeneration = header.generation;
+  m_Generation = header.generation + 1;
+  m_Loaded = true;
+  m_Dirty = false;
+
+  return true;
+}
+
+bool ShaderCacheFile::Contains(uint64_t key) const
+{
+  return m_Entries.find(key) != m_Entries.end();
+}
+
+const byte *ShaderCacheFile::GetCompressedData(const Entry &entry) const
+{
+  return entry.offset ? m_Data + entry.offset : entry.pending.data();
+}
+
+void ShaderCacheFile::MarkUsed(Entry &entry)
+{
+  if(entry.lastUsed != m_Generation)
+  {
+    entry.lastUsed = m_Generation;
+    m_Dirty = true;
+  }
+}
+
+bool ShaderCacheFile::Read(uint64_t key, bytebuf &data)
+{
+  auto it = m_Entries.find(key);
+
+  if(it == m_Entries.end())
+    return false;
+
+  Entry &entry = it->second;
+
+  data.resize(entry.uncompressedSize);
+
+  size_t size = ZSTD_decompress(data.data(), data.size(), GetCompressedData(entry),
+                                entry.compressedSize);
+
+  if(ZSTD_isError(size) || size != entry.uncompressedSize)
+  {
+    RDCWARN("Dropping corrupted shader cache entry %llx", key);
+    m_Entries.erase(it);
+    m_Dirty = true;
+    data.clear();
+    return false;
+  }
+
+  MarkUsed(entry);
+
+  return true;
+}
+
+void ShaderCacheFile::Write(uint64_t key, const byte *data, uint32_t size)
+{
+  Entry entry;
+  entry.pending.resize(ZSTD_compressBound(size));
+
+  size_t compSize = ZSTD_compress(entry.pending.data(), entry.pending.size(), data, size,
+                                  ShaderCacheCompressionLevel);
+
+  if(ZSTD_isError(compSize))
+  {
+    RDCERR("Couldn't compress shader of size %u for shadercache: %s", size,
+           ZSTD_getErrorName(compSize));
+    return;
+  }
+
+  entry.pending.resize(compSize);
+  entry.compressedSize = (uint32_t)compSize;
+  entry.uncompressedSize = size;
+  entry.lastUsed = m_Generation;
+
+  // if this replaces an entry already on disk, its old data is left behind until the next rewrite
+  m_Entries[key] = std::move(entry);
+  m_Dirty = true;
+}
+
+void ShaderCacheFile::Save()
+{
+  Save(uint64_t(Replay_ShaderCacheSizeMB()) * 1024 * 1024);
+}
+
+void ShaderCacheFile::Save(uint64_t budget)
+{
+  if(!m_Dirty)
+    return;
+
+  uint64_t total = 0, onDisk = 0;
+  for(auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+  {
+    total += it->second.compressedSize;
+    if(it->second.offset)
+      onDisk += it->second.compressedSize;
+  }
+
+  bool evicted = false;
+
+  if(total > budget)
+  {
+    rdcarray<rdcpair<uint64_t, uint64_t>> lru;
+    for(auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+      lru.push_back({it->second.lastUsed, it->first});
+
+    std::sort(lru.begin(), lru.end());
+
+    for(size_t i = 0; i < lru.size() && total > budget; i++)
+    {
+      total -= m_Entries[lru[i].second].compressedSize;
+      m_Entries.erase(lru[i].second);
+      evicted = true;
+    }
+
+    RDCLOG("Shader cache over budget, evicted down to %zu entries", m_Entries.size());
+  }
+
+  // if enough of the file is dead space from evicted or replaced entries, compact it instead of
+  // appending. Likewise if it's been changed by someone else since we loaded it.
+  bool rewrite =
+      !m_Loaded || evicted || (m_LoadedIndexOffset - sizeof(ShaderCacheHeader)) > onDisk * 2;
+
+  bool success = !rewrite && Append();
+
+  if(!success)
+    Rewrite();
+
+  // re-read what's on disk, so that entries are read from the new file from now on
+  Load();
+}
+
+bool ShaderCacheFile::Append()
+{
+  FILE *f = FileIO::fopen(m_Path, FileIO::UpdateBinary);
+
+  if(!f)
+    return false;
+
+  // hold the lock from checking the header until the new header is written, so two processes
+  // can't both append on top of the same index
+  if(!FileIO::flockexclusive(f))
+  {
+    FileIO::fclose(f);
+    return false;
+  }
+
+  ShaderCacheHeader header = {};
+  if(FileIO::fread(&header, 1, sizeof(header), f) != sizeof(header) ||
+     header.indexOffset != m_LoadedIndexOffset || header.generation != m_LoadedGeneration)
+  {
+    // another process has written the cache since we loaded it, rewrite it from our view
+    FileIO::funlock(f);
+    FileIO::fclose(f);
+    return false;
+  }
+
+  rdcarray<ShaderCacheIndexEntry> index;
+  index.reserve(m_Entries.size());
+
+  // new entries and the new index go after the old index, which the header on disk keeps
+  // pointing to until it's overwritten below. The old index becomes dead space for a later rewrite
+  uint64_t offset = header.indexOffset + header.numEntries * sizeof(ShaderCacheIndexEntry);
+  FileIO::fseek64(f, offset, SEEK_SET);
+
+  bool success = true;
+
+  for(auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+  {
+    const Entry &entry = it->second;
+    uint64_t entryOffset = entry.offset;
+
+    if(entryOffset == 0)
+    {
+      success &=
+          FileIO::fwrite(entry.pending.data(), 1, entry.pending.size(), f) == entry.pending.size();
+      entryOffset = offset;
+      offset += entry.compressedSize;
+    }
+
+    index.push_back(
+        {it->first, entryOffset, entry.compressedSize, entry.uncompressedSize, entry.lastUsed});
+  }
+
+  success &= FileIO::fwrite(index.data(), 1, index.byteSize(), f) == index.byteSize();
+
+  // only point the header at the new index once everything it refers to is written. If we fail
+  // before then the old header and index are untouched
+  if(success)
+  {
+    header.numEntries = (uint32_t)index.size();
+    header.indexOffset = offset;
+    header.generation = m_Generation;
+
+    FileIO::fseek64(f, 0, SEEK_SET);
+    success &= FileIO::fwrite(&header, 1, sizeof(header), f) == sizeof(header);
+  }
+
+  FileIO::funlock(f);
+  FileIO::fclose(f);
+
+  if(!success)
+    RDCERR("Error appending to shader cache");
+
+  return success;
+}
+
+bool ShaderCacheFile::Rewrite()
+{
+  // write to a temporary file first, so other processes never see a partial cache
+  rdcstr tmpPath = StringFormat::Fmt("%s.%u.tmp", m_Path.c_str(), Process::GetCurrentPID());
+
+  FileIO::CreateParentDirectory(m_Path);
+
+  FILE *f = FileIO::fopen(tmpPath, FileIO::WriteBinary);
+
+  if(!f)
+  {
+    RDCERR("Error opening shader cache for write");
+    return false;
+  }
+
+  ShaderCacheHeader header = {};
+  header.globalMagic = ShaderCacheMagic;
+  header.magic = m_Magic;
+  header.version = m_Version;
+  header.numEntries = (uint32_t)m_Entries.size();
+  header.generation = m_Generation;
+
+  bool success = FileIO::fwrite(&header, 1, sizeof(header), f) == sizeof(header);
+
+  rdcarray<ShaderCacheIndexEntry> index;
+  index.reserve(m_Entries.size());
+
+  uint64_t offset = sizeof(header);
+
+  for(auto it = m_Entries.begin(); it != m_Entries.end(); ++it)
+  {
+    const Entry &entry = it->second;
+
+    success &= FileIO::fwrite(GetCompressedData(entry), 1, entry.compressedSize, f) ==
+               entry.compressedSize;
+
+    index.push_back({it->first, offset, entry.compressedSize, entry.uncompressedSize, entry.lastUsed});
+    offset += entry.compressedSize;
+  }
+
+  success &= FileIO::fwrite(index.data(), 1, index.byteSize(), f) == index.byteSize();
+
+  header.indexOffset = offset;
+  FileIO::fseek64(f, 0, SEEK_SET);
+  success &= FileIO::fwrite(&header, 1, sizeof(header), f) == sizeof(header);
+
+  FileIO::fclose(f);
+
+  // release our mapping of the old file so it can be replaced
+  Close();
+
+  if(!success || !FileIO::Move(tmpPath, m_Path, true))
+  {
+    RDCERR("Error writing shader cache");
+    FileIO::Delete(tmpPath);
+    return false;
+  }
+
+  RDCDEBUG("Successfully wrote %u entries to cache, %llu bytes", header.numEntries,
+           offset + index.byteSize());
+
+  return true;
+}
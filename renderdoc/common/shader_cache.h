@@ -26,115 +26,142 @@
 
 #include <map>
 #include "common/common.h"
-#include "serialise/streamio.h"
-#include "serialise/zstdio.h"
-
-static const uint32_t ShaderCacheMagic = MAKE_FOURCC('R', 'D', '$', '$');
-
-template <typename ResultType, typename ShaderCallbacks>
-bool LoadShaderCache(const rdcstr &filename, const uint32_t magicNumber, const uint32_t versionNumber,
-                     std::map<uint32_t, ResultType> &resultCache, const ShaderCallbacks &callbacks)
+#include "os/os_specific.h"
+
+// An on-disk cache of compiled shader blobs, keyed by a 64-bit hash of the shader's source and
+// compile settings.
+//
+// The file contains a small index of keys and offsets and each entry is compressed on its own, so
+// opening the cache only reads the index and entries are decompressed the first time they're looked
+// up. New entries are appended on save, and once the cache grows past its budget the least recently
+// used entries are dropped when it's rewritten.
+class ShaderCacheFile
 {
-  rdcstr shadercache = FileIO::GetAppFolderFilename(filename);
-
-  StreamReader fileReader(FileIO::fopen(shadercache, FileIO::ReadBinary));
-
-  uint32_t globalMagic = 0, localMagic = 0, version = 0;
-  fileReader.Read(globalMagic);
-  fileReader.Read(localMagic);
-  fileReader.Read(version);
+public:
+  ShaderCacheFile(const rdcstr &path, uint32_t magicNumber, uint32_t versionNumber);
+  ~ShaderCacheFile();
 
-  if(globalMagic != ShaderCacheMagic || localMagic != magicNumber || version != versionNumber)
-    return false;
+  // reads the index from disk. Returns false if there's no valid cache file, in which case the
+  // cache starts empty.
+  bool Load();
 
-  uint64_t uncompressedSize = 0;
-  fileReader.Read(uncompressedSize);
+  // writes any new entries and updated usage back to disk, keeping the cache within budget bytes
+  void Save(uint64_t budget);
+  void Save();
 
-  // header has been read. The rest is zstd compressed
-  StreamReader compressedReader(new ZSTDDecompressor(&fileReader, Ownership::Nothing),
-                                uncompressedSize, Ownership::Stream);
+  bool Contains(uint64_t key) const;
+  bool Read(uint64_t key, bytebuf &data);
+  void Write(uint64_t key, const byte *data, uint32_t size);
 
-  uint32_t numentries = 0;
-  compressedReader.Read(numentries);
+  size_t NumEntries() const { return m_Entries.size(); }
+  bool IsDirty() const { return m_Dirty; }
 
-  bool ret = true;
-  bytebuf data;
-
-  for(uint32_t i = 0; i < numentries; i++)
+private:
+  struct Entry
+  {
+    // offset of the compressed data in the file, or 0 if it hasn't been written yet
+    uint64_t offset = 0;
+    uint32_t compressedSize = 0;
+    uint32_t uncompressedSize = 0;
+    // the save generation that this entry was last used in, for eviction
+    uint64_t lastUsed = 0;
+    // compressed data for entries that haven't been written yet
+    bytebuf pending;
+  };
+
+  const byte *GetCompressedData(const Entry &entry) const;
+  void MarkUsed(Entry &entry);
+
+  void Close();
+  bool Append();
+  bool Rewrite();
+
+  rdcstr m_Path;
+  uint32_t m_Magic;
+  uint32_t m_Version;
+
+  std::map<uint64_t, Entry> m_Entries;
+
+  // the on-disk state as of Load(), to check that nothing else has written the file since
+  uint64_t m_LoadedIndexOffset = 0;
+  uint64_t m_LoadedGeneration = 0;
+  bool m_Loaded = false;
+
+  uint64_t m_Generation = 1;
+  bool m_Dirty = false;
+
+  // the contents of the file up to the index, mapped if possible
+  FileIO::MappedView *m_View = NULL;
+  bytebuf m_FileData;
+  const byte *m_Data = NULL;
+};
+
+// wraps the file above and creates results from cached blobs on demand. ShaderCallbacks must
+// provide:
+//
+// bool Create(uint32_t size, byte *data, ResultType *ret) const;
+// void Destroy(ResultType result) const;
+// uint32_t GetSize(ResultType result) const;
+// const byte *GetData(ResultType result) const;
+template <typename ResultType>
+class ShaderCache
+{
+public:
+  ShaderCache(const rdcstr &filename, uint32_t magicNumber, uint32_t versionNumber)
+      : m_File(FileIO::GetAppFolderFilename(filename), magicNumber, versionNumber)
   {
-    uint32_t hash = 0, length = 0;
-    compressedReader.Read(hash);
-    compressedReader.Read(length);
+    m_File.Load();
+  }
 
-    data.resize(length);
-    compressedReader.Read(data.data(), length);
+  ~ShaderCache() { RDCASSERTMSG("Shader cache not shut down", m_Results.empty()); }
+  template <typename ShaderCallbacks>
+  bool Find(uint64_t key, ResultType &result, const ShaderCallbacks &callbacks)
+  {
+    auto it = m_Results.find(key);
+    if(it != m_Results.end())
+    {
+      result = it->second;
+      return true;
+    }
 
-    ResultType result;
-    bool created = callbacks.Create(length, data.data(), &result);
+    bytebuf data;
+    if(!m_File.Read(key, data))
+      return false;
 
-    if(!created)
+    if(!callbacks.Create((uint32_t)data.size(), data.data(), &result))
     {
-      RDCERR("Couldn't create blob of size %u from shadercache", length);
-      ret = false;
-      break;
+      RDCERR("Couldn't create blob of size %zu from shadercache", data.size());
+      return false;
     }
 
-    resultCache[hash] = result;
+    m_Results[key] = result;
+    return true;
   }
 
-  return ret && !compressedReader.IsErrored() && !fileReader.IsErrored();
-}
-
-template <typename ResultType, typename ShaderCallbacks>
-void SaveShaderCache(const rdcstr &filename, uint32_t magicNumber, uint32_t versionNumber,
-                     const std::map<uint32_t, ResultType> &cache, const ShaderCallbacks &callbacks)
-{
-  rdcstr shadercache = FileIO::GetAppFolderFilename(filename);
-
-  FILE *f = FileIO::fopen(shadercache, FileIO::WriteBinary);
-
-  if(!f)
+  // takes ownership of result, which stays valid until the cache is shut down
+  template <typename ShaderCallbacks>
+  void Insert(uint64_t key, ResultType result, const ShaderCallbacks &callbacks)
   {
-    RDCERR("Error opening shader cache for write");
-    return;
-  }
-
-  StreamWriter fileWriter(f, Ownership::Stream);
-
-  fileWriter.Write(ShaderCacheMagic);
-  fileWriter.Write(magicNumber);
-  fileWriter.Write(versionNumber);
-
-  uint32_t numentries = (uint32_t)cache.size();
-
-  uint64_t uncompressedSize = sizeof(numentries);    // number of entries
+    auto it = m_Results.find(key);
+    if(it != m_Results.end() && it->second != result)
+      callbacks.Destroy(it->second);
 
-  // hash + length + data for each entry
-  for(auto it = cache.begin(); it != cache.end(); ++it)
-    uncompressedSize += sizeof(uint32_t) * 2 + callbacks.GetSize(it->second);
-
-  fileWriter.Write(uncompressedSize);
-
-  StreamWriter compressedWriter(new ZSTDCompressor(&fileWriter, Ownership::Nothing),
-                                Ownership::Stream);
-
-  compressedWriter.Write(numentries);
+    m_Results[key] = result;
+    m_File.Write(key, callbacks.GetData(result), callbacks.GetSize(result));
+  }
 
-  for(auto it = cache.begin(); it != cache.end(); ++it)
+  // saves any changes to disk and destroys all the results that have been handed out
+  template <typename ShaderCallbacks>
+  void Shutdown(const ShaderCallbacks &callbacks)
   {
-    uint32_t hash = it->first;
-    uint32_t len = callbacks.GetSize(it->second);
-    const byte *data = callbacks.GetData(it->second);
-
-    compressedWriter.Write(hash);
-    compressedWriter.Write(len);
-    compressedWriter.Write(data, len);
+    m_File.Save();
 
-    callbacks.Destroy(it->second);
+    for(auto it = m_Results.begin(); it != m_Results.end(); ++it)
+      callbacks.Destroy(it->second);
+    m_Results.clear();
   }
 
-  compressedWriter.Finish();
-
-  RDCDEBUG("Successfully wrote %u entries to cache, compressed from %llu to %llu", numentries,
-           uncompressedSize, fileWriter.GetOffset());
-}
+private:
+  ShaderCacheFile m_File;
+  std::map<uint64_t, ResultType> m_Results;
+};
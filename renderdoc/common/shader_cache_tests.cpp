@@ -0,0 +1,232 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "common/shader_cache.h"
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+static bytebuf MakeShaderData(uint32_t seed, size_t size)
+{
+  // pseudo-random so that it doesn't compress, to make the compressed sizes predictable
+  bytebuf ret;
+  ret.resize(size);
+  for(size_t i = 0; i < size; i++)
+  {
+    seed = seed * 1103515245 + 12345;
+    ret[i] = byte(seed >> 16);
+  }
+  return ret;
+}
+
+TEST_CASE("Test shader cache file", "[shadercache]")
+{
+  rdcstr path = FileIO::GetTempFolderFilename() + "renderdoc_shader_cache_test.cache";
+  FileIO::Delete(path);
+
+  const uint32_t magic = 0x1234, version = 5;
+
+  const bytebuf a = MakeShaderData(1, 1000), b = MakeShaderData(2, 1000),
+                c = MakeShaderData(3, 1000), d = MakeShaderData(4, 1000);
+
+  const uint64_t keyA = 0x1000000000000001ULL, keyB = 0x2000000000000002ULL,
+                 keyC = 0x3000000000000003ULL, keyD = 0x4000000000000004ULL;
+
+  {
+    ShaderCacheFile cache(path, magic, version);
+
+    // no file yet
+    CHECK_FALSE(cache.Load());
+    CHECK(cache.NumEntries() == 0);
+
+    cache.Write(keyA, a.data(), (uint32_t)a.size());
+    cache.Write(keyB, b.data(), (uint32_t)b.size());
+    cache.Write(keyC, c.data(), (uint32_t)c.size());
+
+    // entries can be read back before they're saved
+    bytebuf data;
+    CHECK(cache.Read(keyB, data));
+    CHECK(data == b);
+
+    cache.Save(1024 * 1024);
+
+    CHECK_FALSE(cache.IsDirty());
+    CHECK(cache.NumEntries() == 3);
+  }
+
+  SECTION("Entries are read back")
+  {
+    ShaderCacheFile cache(path, magic, version);
+
+    REQUIRE(cache.Load());
+    CHECK(cache.NumEntries() == 3);
+    CHECK_FALSE(cache.IsDirty());
+
+    CHECK(cache.Contains(keyA));
+    CHECK(cache.Contains(keyB));
+    CHECK(cache.Contains(keyC));
+    CHECK_FALSE(cache.Contains(keyD));
+
+    bytebuf data;
+    CHECK(cache.Read(keyC, data));
+    CHECK(data == c);
+    CHECK(cache.Read(keyA, data));
+    CHECK(data == a);
+    CHECK_FALSE(cache.Read(keyD, data));
+  };
+
+  SECTION("A different magic or version is rejected")
+  {
+    ShaderCacheFile wrongMagic(path, magic + 1, version);
+    CHECK_FALSE(wrongMagic.Load());
+    CHECK(wrongMagic.NumEntries() == 0);
+
+    ShaderCacheFile wrongVersion(path, magic, version + 1);
+    CHECK_FALSE(wrongVersion.Load());
+    CHECK(wrongVersion.NumEntries() == 0);
+  };
+
+  SECTION("New entries are appended")
+  {
+    uint64_t oldSize = FileIO::GetFileSize(path);
+
+    {
+      ShaderCacheFile cache(path, magic, version);
+      REQUIRE(cache.Load());
+
+      cache.Write(keyD, d.data(), (uint32_t)d.size());
+      cache.Save(1024 * 1024);
+    }
+
+    // only the new entry and a new index should have been added
+    CHECK(FileIO::GetFileSize(path) < oldSize + d.size() + 200);
+
+    ShaderCacheFile cache(path, magic, version);
+    REQUIRE(cache.Load());
+    CHECK(cache.NumEntries() == 4);
+
+    bytebuf data;
+    CHECK(cache.Read(keyB, data));
+    CHECK(data == b);
+    CHECK(cache.Read(keyD, data));
+    CHECK(data == d);
+  };
+
+  SECTION("An append that doesn't finish leaves the old cache intact")
+  {
+    byte oldHeader[40];
+
+    FILE *f = FileIO::fopen(path, FileIO::ReadBinary);
+    REQUIRE(f);
+    FileIO::fread(oldHeader, 1, sizeof(oldHeader), f);
+    FileIO::fclose(f);
+
+    {
+      ShaderCacheFile cache(path, magic, version);
+      REQUIRE(cache.Load());
+
+      cache.Write(keyD, d.data(), (uint32_t)d.size());
+      cache.Save(1024 * 1024);
+    }
+
+    // put back the old header, as if the append stopped just before writing it
+    f = FileIO::fopen(path, FileIO::UpdateBinary);
+    REQUIRE(f);
+    FileIO::fwrite(oldHeader, 1, sizeof(oldHeader), f);
+    FileIO::fclose(f);
+
+    ShaderCacheFile cache(path, magic, version);
+    REQUIRE(cache.Load());
+    CHECK(cache.NumEntries() == 3);
+    CHECK_FALSE(cache.Contains(keyD));
+
+    bytebuf data;
+    CHECK(cache.Read(keyA, data));
+    CHECK(data == a);
+    CHECK(cache.Read(keyC, data));
+    CHECK(data == c);
+  };
+
+  SECTION("Least recently used entries are evicted")
+  {
+    {
+      ShaderCacheFile cache(path, magic, version);
+      REQUIRE(cache.Load());
+
+      bytebuf data;
+      CHECK(cache.Read(keyA, data));
+
+      cache.Write(keyD, d.data(), (uint32_t)d.size());
+
+      // only enough room for two entries, the ones used in this session
+      cache.Save(2500);
+    }
+
+    ShaderCacheFile cache(path, magic, version);
+    REQUIRE(cache.Load());
+    CHECK(cache.NumEntries() == 2);
+
+    CHECK(cache.Contains(keyA));
+    CHECK_FALSE(cache.Contains(keyB));
+    CHECK_FALSE(cache.Contains(keyC));
+    CHECK(cache.Contains(keyD));
+
+    bytebuf data;
+    CHECK(cache.Read(keyA, data));
+    CHECK(data == a);
+    CHECK(cache.Read(keyD, data));
+    CHECK(data == d);
+
+    CHECK(FileIO::GetFileSize(path) < 2500 + 200);
+  };
+
+  SECTION("Corrupted files are ignored")
+  {
+    FILE *f = FileIO::fopen(path, FileIO::UpdateBinary);
+    REQUIRE(f);
+    // point the index past the end of the file
+    uint64_t indexOffset = ~0ULL;
+    FileIO::fseek64(f, 16, SEEK_SET);
+    FileIO::fwrite(&indexOffset, 1, sizeof(indexOffset), f);
+    FileIO::fclose(f);
+
+    ShaderCacheFile cache(path, magic, version);
+    CHECK_FALSE(cache.Load());
+    CHECK(cache.NumEntries() == 0);
+
+    // the cache is rewritten from scratch on save
+    cache.Write(keyD, d.data(), (uint32_t)d.size());
+    cache.Save(1024 * 1024);
+
+    ShaderCacheFile reloaded(path, magic, version);
+    REQUIRE(reloaded.Load());
+    CHECK(reloaded.NumEntries() == 1);
+    CHECK(reloaded.Contains(keyD));
+  };
+
+  FileIO::Delete(path);
+};
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -116,8 +116,21 @@ namespace JobSystem
 struct Job;
 void Init(uint32_t numThreads = 0);
 void Shutdown();
-Job *AddJob(std::function<void()> &&cb, const rdcarray<Job *> &parents = {});
+// name is optional and only used for profiling, it must outlive the job (e.g. a string literal)
+Job *AddJob(std::function<void()> &&cb, const rdcarray<Job *> &parents = {},
+            const char *name = NULL);
+// wait for a particular job or group of jobs to complete, running other jobs in the meantime. Can
+// be called from within a job to wait on jobs it spawned. Jobs are only valid until SyncAllJobs()
+void WaitForJob(Job *job);
+void WaitForJobs(const rdcarray<Job *> &jobs);
+// wait for the given jobs to complete then free them without waiting for any other jobs. They must
+// not be referenced afterwards, including as parents of new jobs
+void FreeJobs(const rdcarray<Job *> &jobs);
+// wait for all jobs to complete and free them. Only valid on the thread that called Init()
 void SyncAllJobs();
+// returns true if the job system is running and jobs can be added from the current thread, which
+// must either be the thread that called Init() or a job running on a worker
+bool CanAddJobs();
 };
 
 };
@@ -32,6 +32,215 @@
 template <typename T>
 struct Intervals;
 
+// Sorted map from interval start points to values, used as the storage for `Intervals<T>`.
+//
+// Up to BlockSize start points are kept in a single sorted array, the same as a flat map. Beyond
+// that the array is split into blocks of at most BlockSize sorted entries - a two-level B-tree - so
+// that splitting or merging an interval only shifts the entries within one block (and the list of
+// blocks, when one splits or empties) rather than every later start point. Heavily fragmented
+// intervals would otherwise take quadratic time to build up.
+template <typename T>
+class IntervalsStartMap
+{
+public:
+  typedef rdcpair<uint64_t, T> value_type;
+  typedef size_t size_type;
+
+  static const size_t BlockSize = 256;
+
+  template <typename Owner, typename Value>
+  class Iter
+  {
+    friend class IntervalsStartMap<T>;
+
+  public:
+    Iter() = default;
+    Iter &operator++()
+    {
+      idx++;
+      if(idx == owner->blocks[block].size() && block + 1 < owner->blocks.size())
+      {
+        block++;
+        idx = 0;
+      }
+      return *this;
+    }
+    Iter operator++(int)
+    {
+      Iter tmp(*this);
+      operator++();
+      return tmp;
+    }
+    Iter &operator--()
+    {
+      if(idx == 0)
+      {
+        block--;
+        idx = owner->blocks[block].size();
+      }
+      idx--;
+      return *this;
+    }
+    Iter operator--(int)
+    {
+      Iter tmp(*this);
+      operator--();
+      return tmp;
+    }
+    bool operator==(const Iter &o) const { return block == o.block && idx == o.idx; }
+    bool operator!=(const Iter &o) const { return !(*this == o); }
+    Value &operator*() const { return owner->blocks[block][idx]; }
+    Value *operator->() const { return &owner->blocks[block][idx]; }
+  private:
+    Iter(Owner *owner, size_t block, size_t idx) : owner(owner), block(block), idx(idx) {}
+    // an element is always at an index within its block, only end() has idx == block size
+    Owner *owner = NULL;
+    size_t block = 0, idx = 0;
+  };
+
+  typedef Iter<IntervalsStartMap, value_type> iterator;
+  typedef Iter<const IntervalsStartMap, const value_type> const_iterator;
+
+  IntervalsStartMap() { blocks.resize(1); }
+  size_type size() const { return count; }
+  iterator begin() { return iterator(this, 0, 0); }
+  iterator end() { return iterator(this, blocks.size() - 1, blocks.back().size()); }
+  const_iterator begin() const { return const_iterator(this, 0, 0); }
+  const_iterator end() const { return const_iterator(this, blocks.size() - 1, blocks.back().size()); }
+  iterator upper_bound(uint64_t x)
+  {
+    Pos p = Locate(x, true);
+    return iterator(this, p.block, p.idx);
+  }
+  const_iterator upper_bound(uint64_t x) const
+  {
+    Pos p = Locate(x, true);
+    return const_iterator(this, p.block, p.idx);
+  }
+
+  rdcpair<iterator, bool> insert(const value_type &val)
+  {
+    Pos p = Locate(val.first, false);
+
+    rdcarray<value_type> &blk = blocks[p.block];
+    if(p.idx < blk.size() && blk[p.idx].first == val.first)
+      return {iterator(this, p.block, p.idx), false};
+
+    blk.insert(p.idx, val);
+    count++;
+
+    if(blk.size() > BlockSize)
+    {
+      // split the full block in half
+      const size_t half = blk.size() / 2;
+      rdcarray<value_type> upper;
+      upper.assign(blk.data() + half, blk.size() - half);
+      blk.resize(half);
+      blocks.insert(p.block + 1, std::move(upper));
+
+      if(p.idx >= half)
+      {
+        p.block++;
+        p.idx -= half;
+      }
+    }
+
+    return {iterator(this, p.block, p.idx), true};
+  }
+
+  // returns the iterator following the erased element
+  iterator erase(iterator it)
+  {
+    size_t b = it.block, i = it.idx;
+
+    blocks[b].erase(i);
+    count--;
+
+    if(blocks.size() > 1)
+    {
+      if(blocks[b].empty())
+      {
+        blocks.erase(b);
+        if(b == blocks.size())
+          return end();
+        return iterator(this, b, 0);
+      }
+
+      // fold small blocks into a neighbour, so that erasing doesn't leave lots of sparse blocks
+      if(blocks[b].size() < BlockSize / 4)
+      {
+        if(b > 0 && blocks[b - 1].size() + blocks[b].size() <= BlockSize)
+        {
+          i += blocks[b - 1].size();
+          blocks[b - 1].append(blocks[b]);
+          blocks.erase(b);
+          b--;
+        }
+        else if(b + 1 < blocks.size() && blocks[b].size() + blocks[b + 1].size() <= BlockSize)
+        {
+          blocks[b].append(blocks[b + 1]);
+          blocks.erase(b + 1);
+        }
+      }
+
+      if(i == blocks[b].size() && b + 1 < blocks.size())
+      {
+        b++;
+        i = 0;
+      }
+    }
+
+    return iterator(this, b, i);
+  }
+
+private:
+  struct Pos
+  {
+    size_t block, idx;
+  };
+
+  // find the first entry with a start greater than x (or greater or equal, if !upper)
+  Pos Locate(uint64_t x, bool upper) const
+  {
+    auto after = [upper, x](uint64_t start) { return upper ? start > x : start >= x; };
+
+    // find the first block starting after x, the entry is in the block before it
+    size_t lo = 0, hi = blocks.size();
+    while(lo < hi)
+    {
+      size_t mid = (lo + hi) / 2;
+      if(blocks[mid].empty() || after(blocks[mid][0].first))
+        hi = mid;
+      else
+        lo = mid + 1;
+    }
+
+    if(lo == 0)
+      return {0, 0};
+
+    const rdcarray<value_type> &blk = blocks[lo - 1];
+
+    size_t first = 0, last = blk.size();
+    while(first < last)
+    {
+      size_t mid = (first + last) / 2;
+      if(after(blk[mid].first))
+        last = mid;
+      else
+        first = mid + 1;
+    }
+
+    if(first == blk.size() && lo < blocks.size())
+      return {lo, 0};
+
+    return {lo - 1, first};
+  }
+
+  // never empty, and only the first block can have no entries (when the map is empty)
+  rdcarray<rdcarray<value_type>> blocks;
+  size_t count = 0;
+};
+
 template <typename T, typename Map, typename Iter, typename Interval>
 class IntervalsIter;
 
@@ -98,8 +307,8 @@ public:
       prev_it--;
       if(this->iter->second == prev_it->second)
       {
-        this->owner->erase(this->iter);
-        this->iter = prev_it;
+        this->iter = this->owner->erase(this->iter);
+        this->iter--;
       }
     }
   }
@@ -162,7 +371,7 @@ template <typename T>
 struct Intervals
 {
 public:
-  using MapType = rdcsortedflatmap<uint64_t, T>;
+  using MapType = IntervalsStartMap<T>;
 
   typedef IntervalRef<T, MapType, typename MapType::iterator> interval;
   typedef IntervalsIter<T, MapType, typename MapType::iterator, interval> iterator;
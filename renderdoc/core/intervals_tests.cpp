@@ -27,6 +27,7 @@
 #if ENABLED(ENABLE_UNIT_TESTS)
 
 #include "api/replay/rdcarray.h"
+#include "common/timing.h"
 #include "intervals.h"
 
 #include "catch/catch.hpp"
@@ -439,4 +440,142 @@ TEST_CASE("Test Intervals type", "[intervals]")
   };
 };
 
+// check every point in [0, reference.size()) against a flat array of values, and that adjacent
+// intervals were merged
+void check_against_reference(Intervals<uint64_t> &value, const rdcarray<uint64_t> &reference)
+{
+  uint64_t prevValue = ~0ULL;
+  for(auto i = value.begin(); i != value.end(); i++)
+  {
+    CHECK(i->value() != prevValue);
+    prevValue = i->value();
+
+    uint64_t finish = RDCMIN(i->finish(), (uint64_t)reference.size());
+    for(uint64_t x = i->start(); x < finish; x++)
+    {
+      if(reference[(size_t)x] != i->value())
+      {
+        // only report the first mismatch per interval
+        CHECK(reference[(size_t)x] == i->value());
+        break;
+      }
+    }
+  }
+
+  for(uint64_t x = 0; x < reference.size(); x += 7)
+  {
+    auto i = value.find(x);
+    CHECK(i->start() <= x);
+    CHECK(x < i->finish());
+  }
+}
+
+TEST_CASE("Test fragmented Intervals", "[intervals]")
+{
+  const uint64_t domain = 20000;
+
+  Intervals<uint64_t> test;
+  rdcarray<uint64_t> reference;
+  reference.resize(domain);
+
+  uint32_t seed = 12345;
+  auto next = [&seed]() {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) & 0xffff;
+  };
+
+  // many small updates to build up thousands of intervals
+  for(int n = 0; n < 4000; n++)
+  {
+    uint64_t start = (next() * domain) >> 16;
+    uint64_t finish = RDCMIN(domain, start + 1 + (next() & 15));
+    uint64_t val = next() & 7;
+
+    test.update(start, finish, val, [](uint64_t, uint64_t y) { return y; });
+    for(uint64_t x = start; x < finish; x++)
+      reference[(size_t)x] = val;
+  }
+
+  CHECK(test.size() > IntervalsStartMap<uint64_t>::BlockSize * 4);
+  check_against_reference(test, reference);
+
+  SECTION("merge with another fragmented Intervals")
+  {
+    Intervals<uint64_t> other;
+    for(uint64_t x = 0; x < domain; x += 3)
+      other.update(x, x + 1, 100, [](uint64_t, uint64_t y) { return y; });
+
+    test.merge(other, [](uint64_t x, uint64_t y) { return x + y; });
+
+    for(uint64_t x = 0; x < domain; x += 3)
+      reference[(size_t)x] += 100;
+
+    check_against_reference(test, reference);
+  }
+
+  SECTION("coalescing back to a single interval")
+  {
+    // clear in pieces so that entries are erased from each block rather than all at once
+    for(uint64_t x = 0; x < domain; x += 97)
+    {
+      test.update(x, RDCMIN(domain, x + 97), 0, [](uint64_t, uint64_t) { return 0ULL; });
+      for(uint64_t y = x; y < RDCMIN(domain, x + 97); y++)
+        reference[(size_t)y] = 0;
+
+      if((x / 97) % 40 == 0)
+        check_against_reference(test, reference);
+    }
+
+    check_against_reference(test, reference);
+    CHECK(test.size() == 1);
+  }
+}
+
+TEST_CASE("Benchmark fragmented Intervals", "[.][intervals][benchmark]")
+{
+  for(uint64_t fragments : {1000ULL, 10000ULL, 100000ULL})
+  {
+    Intervals<uint64_t> test;
+
+    PerformanceTimer timer;
+
+    // mark every other page in a scattered order, as sparse binding or memory references might
+    for(uint64_t n = 0; n < fragments; n++)
+    {
+      uint64_t page = (n * 7919) % fragments;
+      test.update(page * 2, page * 2 + 1, 1, [](uint64_t x, uint64_t y) { return x | y; });
+    }
+
+    double buildTime = timer.GetMilliseconds();
+
+    CHECK(test.size() == fragments * 2);
+
+    timer.Restart();
+
+    uint64_t found = 0;
+    for(uint64_t n = 0; n < fragments; n++)
+      found += test.find(((n * 104729) % fragments) * 2)->value();
+
+    double findTime = timer.GetMilliseconds();
+
+    CHECK(found == fragments);
+
+    timer.Restart();
+
+    // fill in the gaps again, merging everything back together
+    for(uint64_t n = 0; n < fragments; n++)
+    {
+      uint64_t page = (n * 7919) % fragments;
+      test.update(page * 2 + 1, page * 2 + 2, 1, [](uint64_t x, uint64_t y) { return x | y; });
+    }
+
+    double mergeTime = timer.GetMilliseconds();
+
+    CHECK(test.size() == 2);
+
+    WARN(fragments << " fragments: split " << buildTime << "ms, find " << findTime << "ms, merge "
+                   << mergeTime << "ms");
+  }
+}
+
 #endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -673,12 +673,11 @@ static void ActiveRemoteClientThread(ClientThread *threadData,
 
       if(resolver)
       {
-        StackFrames.reserve(StackAddresses.size());
-        for(uint64_t frame : StackAddresses)
-        {
-          Callstack::AddressDetails info = resolver->GetAddr(frame);
-          StackFrames.push_back(info.formattedString());
-        }
+        rdcarray<Callstack::AddressDetails> info = resolver->GetAddrs(StackAddresses);
+
+        StackFrames.reserve(info.size());
+        for(Callstack::AddressDetails &frame : info)
+          StackFrames.push_back(frame.formattedString());
       }
       else
       {
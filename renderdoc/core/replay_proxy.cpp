@@ -24,7 +24,6 @@
  ******************************************************************************/
 
 #include "replay_proxy.h"
-#include <list>
 #include "lz4/lz4.h"
 #include "replay/dummy_driver.h"
 #include "serialise/lz4io.h"
@@ -2104,25 +2103,201 @@ void ReplayProxy::FetchStructuredFile()
   PROXY_FUNCTION(FetchStructuredFile);
 }
 
-struct DeltaSection
+// each op covers the next 'length' bytes of the new data. Copies take them from 'offs' in the
+// reference data the other side already has, literals are sent in full after the list of ops (and
+// 'offs' is their position in the new data).
+struct DeltaOp
 {
   uint64_t offs = 0;
-  bytebuf contents;
-
-  void swap(DeltaSection &o)
-  {
-    std::swap(offs, o.offs);
-    contents.swap(o.contents);
-  }
+  uint64_t length = 0;
+  bool literal = false;
 };
 
-DECLARE_REFLECTION_STRUCT(DeltaSection);
+DECLARE_REFLECTION_STRUCT(DeltaOp);
 
 template <typename SerialiserType>
-void DoSerialise(SerialiserType &ser, DeltaSection &el)
+void DoSerialise(SerialiserType &ser, DeltaOp &el)
 {
   SERIALISE_MEMBER(offs);
-  SERIALISE_MEMBER(contents);
+  SERIALISE_MEMBER(length);
+  SERIALISE_MEMBER(literal);
+}
+
+static void AddDeltaOp(rdcarray<DeltaOp> &ops, bool literal, uint64_t offs, uint64_t length)
+{
+  if(length == 0)
+    return;
+
+  // literals are always contiguous in the new data, copies can only be merged if they're also
+  // contiguous in the reference data.
+  if(!ops.empty() && ops.back().literal == literal && ops.back().offs + ops.back().length == offs)
+  {
+    ops.back().length += length;
+    return;
+  }
+
+  DeltaOp op;
+  op.offs = offs;
+  op.length = length;
+  op.literal = literal;
+  ops.push_back(op);
+}
+
+static uint64_t CountLiteralBytes(const rdcarray<DeltaOp> &ops)
+{
+  uint64_t ret = 0;
+  for(const DeltaOp &op : ops)
+    if(op.literal)
+      ret += op.length;
+  return ret;
+}
+
+// diff reference and new data of the same size in place, sending any changed chunks.
+static void CalcAlignedDeltas(const bytebuf &referenceData, const bytebuf &newData,
+                              rdcarray<DeltaOp> &ops)
+{
+  // we only care about large-ish chunks at a time. This prevents us generating lots of tiny
+  // deltas where we could batch changes together. This is tuned to not be too large (and
+  // thus causing us to miss too many sections we could skip) and not too small (causing us
+  // to devolve into lots of byte-wise deltas). The current value as of this comment of 128
+  // is definitely on the small end of the range, but consider e.g. an android image of
+  // 1440x2560 and a pixel-wide line that goes vertically from top to bottom. Reading
+  // horizontally that will mean 2560 different diffs, and only actually one pixel changed.
+  // The larger this value gets, the more redundant data we'll send along with.
+  const size_t chunkSize = 128;
+
+  const byte *ref = referenceData.data();
+  const byte *data = newData.data();
+  const size_t size = newData.size();
+
+  size_t offs = 0;
+
+  while(offs < size)
+  {
+    // skip over identical data as fast as possible, then back up to the start of the chunk
+    // containing the first difference. offs is always chunk aligned here.
+    size_t same = FindFirstDiff(ref + offs, data + offs, size - offs);
+
+    if(same == size - offs)
+    {
+      AddDeltaOp(ops, false, offs, same);
+      break;
+    }
+
+    size_t diffStart = offs + same;
+    diffStart -= diffStart % chunkSize;
+
+    AddDeltaOp(ops, false, offs, diffStart - offs);
+
+    // the changed run continues until we find a whole chunk that's unchanged
+    size_t diffEnd = RDCMIN(diffStart + chunkSize, size);
+    while(diffEnd < size)
+    {
+      size_t len = RDCMIN(chunkSize, size - diffEnd);
+      if(memcmp(ref + diffEnd, data + diffEnd, len) == 0)
+        break;
+      diffEnd += len;
+    }
+
+    AddDeltaOp(ops, true, diffStart, diffEnd - diffStart);
+
+    offs = diffEnd;
+  }
+}
+
+static const size_t DeltaBlockSize = 64;
+static const uint32_t DeltaHashMult = 0x01000193;
+
+static uint32_t HashDeltaBlock(const byte *block)
+{
+  uint32_t h = 0;
+  for(size_t i = 0; i < DeltaBlockSize; i++)
+    h = h * DeltaHashMult + block[i];
+  return h;
+}
+
+// find blocks of the new data anywhere in the reference data, using a rolling hash over the new
+// data. This handles data that's been resized or shifted, which the aligned diff can't.
+static void CalcRollingDeltas(const bytebuf &referenceData, const bytebuf &newData,
+                              rdcarray<DeltaOp> &ops)
+{
+  const size_t blockSize = DeltaBlockSize;
+
+  const byte *ref = referenceData.data();
+  const byte *data = newData.data();
+  const size_t refSize = referenceData.size();
+  const size_t size = newData.size();
+
+  const size_t numBlocks = refSize / blockSize;
+
+  if(numBlocks == 0 || size < blockSize || numBlocks >= (1U << 30))
+  {
+    AddDeltaOp(ops, true, 0, size);
+    return;
+  }
+
+  // DeltaHashMult ^ blockSize, to remove the byte leaving the window
+  uint32_t outMult = 1;
+  for(size_t i = 0; i < blockSize; i++)
+    outMult *= DeltaHashMult;
+
+  // open addressing isn't worth it, on a collision we just keep the first block. Entries are the
+  // block index plus one so that 0 is empty.
+  const uint32_t tableBits = Log2Ceil(uint32_t(numBlocks)) + 1;
+  rdcarray<uint32_t> table;
+  table.resize(size_t(1) << tableBits);
+
+  auto slot = [tableBits](uint32_t h) { return (h * 0x9E3779B1U) >> (32 - tableBits); };
+
+  for(size_t b = 0; b < numBlocks; b++)
+  {
+    uint32_t &entry = table[slot(HashDeltaBlock(ref + b * blockSize))];
+    if(entry == 0)
+      entry = uint32_t(b + 1);
+  }
+
+  size_t literalStart = 0;
+  size_t offs = 0;
+  uint32_t h = HashDeltaBlock(data);
+
+  while(offs + blockSize <= size)
+  {
+    uint32_t entry = table[slot(h)];
+
+    if(entry != 0 && memcmp(ref + (entry - 1) * blockSize, data + offs, blockSize) == 0)
+    {
+      size_t refOffs = (entry - 1) * blockSize;
+
+      // extend the match backwards into any pending literal bytes, then forwards as far as it goes
+      while(offs > literalStart && refOffs > 0 && ref[refOffs - 1] == data[offs - 1])
+      {
+        offs--;
+        refOffs--;
+      }
+
+      size_t len = blockSize;
+      len += FindFirstDiff(ref + refOffs + len, data + offs + len,
+                           RDCMIN(refSize - refOffs, size - offs) - len);
+
+      AddDeltaOp(ops, true, literalStart, offs - literalStart);
+      AddDeltaOp(ops, false, refOffs, len);
+
+      offs += len;
+      literalStart = offs;
+
+      if(offs + blockSize <= size)
+        h = HashDeltaBlock(data + offs);
+
+      continue;
+    }
+
+    if(offs + blockSize < size)
+      h = h * DeltaHashMult + data[offs + blockSize] - data[offs] * outMult;
+
+    offs++;
+  }
+
+  AddDeltaOp(ops, true, literalStart, size - literalStart);
 }
 
 template <typename SerialiserType>
@@ -2140,218 +2315,152 @@ void ReplayProxy::DeltaTransferBytes(SerialiserType &xferser, bytebuf &reference
       RDCDEBUG("Unchanged");
       return;
     }
-    else
-    {
-      rdcarray<DeltaSection> deltas;
 
-      {
-        ReadSerialiser ser(
-            new StreamReader(new LZ4Decompressor(xferser.GetReader(), Ownership::Nothing),
-                             uncompSize, Ownership::Stream),
-            Ownership::Stream);
+    ReadSerialiser ser(new StreamReader(new LZ4Decompressor(xferser.GetReader(), Ownership::Nothing),
+                                        uncompSize, Ownership::Stream),
+                       Ownership::Stream);
+
+    uint64_t newSize = 0;
+    bool inPlace = false;
+    rdcarray<DeltaOp> ops;
+
+    SERIALISE_ELEMENT(newSize);
+    SERIALISE_ELEMENT(inPlace);
+    SERIALISE_ELEMENT(ops);
 
-        SERIALISE_ELEMENT(deltas);
+    StreamReader *reader = ser.GetReader();
 
-        // add any necessary padding.
-        uint64_t offs = ser.GetReader()->GetOffset();
-        RDCASSERT(offs <= uncompSize, offs, uncompSize);
+    uint64_t offs = 0;
+    uint64_t literalBytes = 0;
 
-        if(offs < uncompSize)
+    // if every copy is from the same place in the reference data, we can read the literals
+    // straight over the top of it
+    if(inPlace && newSize == referenceData.size())
+    {
+      for(const DeltaOp &op : ops)
+      {
+        if(offs + op.length > newSize)
         {
-          if(uncompSize - offs > 128)
-          {
-            RDCERR("Unexpected amount of padding: %llu", uncompSize - offs);
-            m_IsErrored = true;
-          }
-          ser.GetReader()->Read(NULL, uncompSize - offs);
+          RDCERR("{%llu, %llu} larger than new data (%llu bytes)", offs, op.length, newSize);
+          m_IsErrored = true;
+          break;
         }
-      }
 
-      if(deltas.empty())
-      {
-        RDCERR("Unexpected empty delta list");
-        m_IsErrored = true;
-      }
-      else if(referenceData.empty())
-      {
-        // if we don't have reference data we blat the whole contents.
-        // in this case we only expect one delta with the whole range
-        if(deltas.size() != 1)
-          RDCERR("Got more than one delta with no reference data - taking first delta.");
+        if(op.literal)
+        {
+          reader->Read(referenceData.data() + (ptrdiff_t)offs, op.length);
+          literalBytes += op.length;
+        }
 
-        referenceData = deltas.front().contents;
-        RDCDEBUG("Creating new reference data, %llu bytes", (uint64_t)referenceData.size());
+        offs += op.length;
       }
-      else
+    }
+    else
+    {
+      bytebuf result;
+      result.resize((size_t)newSize);
+
+      for(const DeltaOp &op : ops)
       {
-        uint64_t deltaBytes = 0;
+        if(offs + op.length > newSize)
+        {
+          RDCERR("{%llu, %llu} larger than new data (%llu bytes)", offs, op.length, newSize);
+          m_IsErrored = true;
+          break;
+        }
 
-        // apply deltas to refData
-        for(const DeltaSection &delta : deltas)
+        if(op.literal)
         {
-          if(delta.offs + delta.contents.size() > referenceData.size())
-          {
-            RDCERR("{%llu, %llu} larger than reference data (%llu bytes) - expanding to fit.",
-                   delta.offs, (uint64_t)delta.contents.size(), (uint64_t)referenceData.size());
+          reader->Read(result.data() + (ptrdiff_t)offs, op.length);
+          literalBytes += op.length;
+        }
+        else if(op.offs + op.length > referenceData.size())
+        {
+          RDCERR("Copy {%llu, %llu} outside of reference data (%llu bytes)", op.offs, op.length,
+                 (uint64_t)referenceData.size());
+          m_IsErrored = true;
+          break;
+        }
+        else
+        {
+          memcpy(result.data() + (ptrdiff_t)offs, referenceData.data() + (ptrdiff_t)op.offs,
+                 (size_t)op.length);
+        }
 
-            referenceData.resize(size_t(delta.offs + delta.contents.size()));
-          }
+        offs += op.length;
+      }
 
-          byte *dst = referenceData.data() + (ptrdiff_t)delta.offs;
-          const byte *src = delta.contents.data();
+      referenceData.swap(result);
+    }
 
-          memcpy(dst, src, delta.contents.size());
+    if(!m_IsErrored && offs != newSize)
+    {
+      RDCERR("Deltas only covered %llu bytes of %llu", offs, newSize);
+      m_IsErrored = true;
+    }
 
-          deltaBytes += (uint64_t)delta.contents.size();
-        }
+    // skip anything we didn't read, if we errored out early
+    if(reader->GetOffset() < uncompSize)
+      reader->Read(NULL, uncompSize - reader->GetOffset());
 
-        RDCDEBUG("Applied %u deltas data, %llu total delta bytes to %llu resource size",
-                 (uint32_t)deltas.size(), deltaBytes, (uint64_t)referenceData.size());
-      }
-    }
+    RDCDEBUG("Applied %u deltas, %llu literal bytes to %llu resource size", (uint32_t)ops.size(),
+             literalBytes, newSize);
   }
   else
   {
     uint64_t uncompSize = 0;
 
-    // we use a list so that we don't have to reserve and pushing new sections will never cause
-    // previous ones to be reallocated and move around lots of data.
-    std::list<DeltaSection> deltasList;
+    rdcarray<DeltaOp> ops;
 
     if(referenceData.empty())
     {
       // no previous reference data, need to transfer the whole object.
-      deltasList.resize(1);
-      deltasList.back().contents = newData;
+      AddDeltaOp(ops, true, 0, newData.size());
     }
     else
     {
-      if(referenceData.size() != newData.size())
-      {
-        RDCERR("Reference data existed at %llu bytes, but new data is now %llu bytes",
-               referenceData.size(), newData.size());
+      if(referenceData.size() == newData.size())
+        CalcAlignedDeltas(referenceData, newData, ops);
 
-        // re-transfer the whole block, something went seriously wrong if the resource changed size.
-        deltasList.resize(1);
-        deltasList.back().contents = newData;
-      }
-      else
+      // if the size changed, or so much changed in place that the data might have moved instead,
+      // look for blocks of the new data anywhere in the reference data. Keep whichever sends less.
+      if(referenceData.size() != newData.size() || CountLiteralBytes(ops) > newData.size() / 4)
       {
-        // do actual diff.
-        const byte *srcBegin = newData.data();
-        const byte *src = srcBegin;
-        const byte *dst = referenceData.data();
-        size_t bytesRemain = newData.size();
-
-        // we only care about large-ish chunks at a time. This prevents us generating lots of tiny
-        // deltas where we could batch changes together. This is tuned to not be too large (and
-        // thus causing us to miss too many sections we could skip) and not too small (causing us
-        // to devolve into lots of byte-wise deltas). The current value as of this comment of 128
-        // is definitely on the small end of the range, but consider e.g. an android image of
-        // 1440x2560 and a pixel-wide line that goes vertically from top to bottom. Reading
-        // horizontally that will mean 2560 different diffs, and only actually one pixel changed.
-        // The larger this value gets, the more redundant data we'll send along with.
-        const size_t chunkSize = 128;
-
-        // we use a simple state machine. Start in state 1
-        //
-        // State 1: No active delta. Look at the current chunk, if there's no difference move to the
-        //          next chunk and stay in this state. If there is a difference, push a delta onto
-        //          the list at the current offset. Copy the current chunk into the contents of the
-        //          delta. Move to state 2.
-        // State 2. Active delta. Look at the current chunk, if there is a difference then append
-        //          the current chunk to the last delta's contents, move to the next chunk, and stay
-        //          in this state. If there isn't a difference, move back to state 1 (the delta is
-        //          already 'finished' so we have no need to do anything more on it).
-        //
-        // At any point we can end the loop, both states are 'complete' at all points.
-
-        enum DeltaState
-        {
-          None,
-          Active
-        };
-        DeltaState state = DeltaState::None;
+        rdcarray<DeltaOp> rollingOps;
+        CalcRollingDeltas(referenceData, newData, rollingOps);
 
-        // loop over whole chunks
-        while(bytesRemain > chunkSize)
-        {
-          // check if there's a difference in this chunk.
-          bool chunkDiff = memcmp(src, dst, chunkSize) != 0;
-
-          // if we're in state 1
-          if(state == DeltaState::None)
-          {
-            // if there's a difference, append a new delta with the current offset and chunk
-            // contents and move to state 2
-            if(chunkDiff)
-            {
-              deltasList.push_back(DeltaSection());
-              deltasList.back().offs = src - srcBegin;
-              deltasList.back().contents.append(src, chunkSize);
-
-              state = DeltaState::Active;
-            }
-          }
-          // if we're in state 2
-          else if(state == DeltaState::Active)
-          {
-            // continue to append to the delta if there's another difference in this chunk.
-            if(chunkDiff)
-            {
-              deltasList.back().contents.append(src, chunkSize);
-            }
-            else
-            {
-              state = DeltaState::None;
-            }
-          }
-
-          // move to the next chunk
-          bytesRemain -= chunkSize;
-          src += chunkSize;
-          dst += chunkSize;
-        }
-
-        // if there are still some bytes remaining at the end of the image, smaller than the chunk
-        // size, just diff directly and send if needed. We could combine this with the last delta if
-        // we ended in the active state.
-        if(bytesRemain > 0 && memcmp(src, dst, bytesRemain) != 0)
-        {
-          deltasList.push_back(DeltaSection());
-          deltasList.back().offs = src - srcBegin;
-          deltasList.back().contents.append(src, bytesRemain);
-        }
+        if(referenceData.size() != newData.size() ||
+           CountLiteralBytes(rollingOps) < CountLiteralBytes(ops))
+          ops.swap(rollingOps);
       }
     }
 
-    // serialise as an array, move the storage from the list into here
-    rdcarray<DeltaSection> deltas;
-    deltas.resize(deltasList.size());
+    uint64_t newSize = newData.size();
+    bool inPlace = (newData.size() == referenceData.size());
 
     {
-      // swap between the list and array, so all the buffers just move storage
-      size_t i = 0;
-      for(auto it = deltasList.begin(); it != deltasList.end(); it++)
+      uint64_t offs = 0;
+      for(const DeltaOp &op : ops)
       {
-        deltas[i].swap(*it);
-        i++;
+        if(!op.literal && op.offs != offs)
+          inPlace = false;
+        offs += op.length;
       }
     }
 
     // fast path - no changes.
-    if(deltas.empty())
-    {
-      uncompSize = 0;
-    }
-    else
+    const bool unchanged = inPlace && CountLiteralBytes(ops) == 0;
+
+    if(!unchanged)
     {
       // serialise to an invalid writer, to get the size of the data that will be written.
       WriteSerialiser ser(new StreamWriter(StreamWriter::InvalidStream), Ownership::Stream);
 
-      SERIALISE_ELEMENT(deltas);
+      SERIALISE_ELEMENT(newSize);
+      SERIALISE_ELEMENT(inPlace);
+      SERIALISE_ELEMENT(ops);
 
-      uncompSize = ser.GetWriter()->GetOffset() + ser.GetChunkAlignment();
+      uncompSize = ser.GetWriter()->GetOffset() + CountLiteralBytes(ops);
     }
 
     xferser.Serialise("uncompSize"_lit, uncompSize);
@@ -2362,17 +2471,17 @@ void ReplayProxy::DeltaTransferBytes(SerialiserType &xferser, bytebuf &reference
                                            Ownership::Stream),
                           Ownership::Stream);
 
-      SERIALISE_ELEMENT(deltas);
+      SERIALISE_ELEMENT(newSize);
+      SERIALISE_ELEMENT(inPlace);
+      SERIALISE_ELEMENT(ops);
 
-      char empty[128] = {};
+      // write the literal bytes straight from the new data, there's no need to copy them anywhere
+      for(const DeltaOp &op : ops)
+        if(op.literal)
+          ser.GetWriter()->Write(newData.data() + (ptrdiff_t)op.offs, op.length);
 
-      // add any necessary padding.
-      uint64_t offs = ser.GetWriter()->GetOffset();
-      RDCASSERT(offs <= uncompSize, offs, uncompSize);
-      RDCASSERT(uncompSize - offs < sizeof(empty), offs, uncompSize);
-
-      if(offs < uncompSize)
-        ser.GetWriter()->Write(empty, uncompSize - offs);
+      RDCASSERT(ser.GetWriter()->GetOffset() == uncompSize, ser.GetWriter()->GetOffset(),
+                uncompSize);
     }
 
     // This is the proxy side, so we have the complete newest contents in data. Swap the new data
@@ -3150,3 +3259,119 @@ bool ReplayProxy::Tick(int type)
 
   return true;
 }
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+static bytebuf ApplyDeltaOps(const bytebuf &referenceData, const bytebuf &newData,
+                             const rdcarray<DeltaOp> &ops)
+{
+  bytebuf ret;
+  for(const DeltaOp &op : ops)
+  {
+    if(op.literal)
+      ret.append(newData.data() + op.offs, (size_t)op.length);
+    else
+      ret.append(referenceData.data() + op.offs, (size_t)op.length);
+  }
+  return ret;
+}
+
+TEST_CASE("Test proxy delta transfer", "[proxy]")
+{
+  bytebuf ref;
+  ref.resize(64 * 1024);
+
+  uint32_t seed = 0x12345678;
+  for(byte &b : ref)
+  {
+    seed = seed * 1664525U + 1013904223U;
+    b = byte(seed >> 24);
+  }
+
+  SECTION("FindFirstDiff")
+  {
+    bytebuf other = ref;
+
+    CHECK(FindFirstDiff(ref.data(), other.data(), ref.size()) == ref.size());
+    CHECK(FindFirstDiff(ref.data(), other.data(), 0) == 0);
+
+    other[0] ^= 0x40;
+    CHECK(FindFirstDiff(ref.data(), other.data(), ref.size()) == 0);
+    other[0] ^= 0x40;
+
+    for(size_t offs : {1, 15, 16, 63, 64, 100, 4095, 65535})
+    {
+      other[offs] ^= 0x40;
+      CHECK(FindFirstDiff(ref.data(), other.data(), ref.size()) == offs);
+      // unaligned pointers
+      CHECK(FindFirstDiff(ref.data() + 1, other.data() + 1, ref.size() - 1) == offs - 1);
+      other[offs] ^= 0x40;
+    }
+  }
+
+  SECTION("In-place changes")
+  {
+    bytebuf data = ref;
+    data[1000] ^= 0xff;
+    data[30000] ^= 0xff;
+
+    rdcarray<DeltaOp> ops;
+    CalcAlignedDeltas(ref, data, ops);
+
+    CHECK(CountLiteralBytes(ops) == 256);
+    CHECK((ApplyDeltaOps(ref, data, ops) == data));
+
+    ops.clear();
+    CalcAlignedDeltas(ref, ref, ops);
+
+    REQUIRE(ops.size() == 1);
+    CHECK(!ops[0].literal);
+    CHECK(ops[0].length == ref.size());
+  }
+
+  SECTION("Shifted and resized data")
+  {
+    bytebuf data;
+    data.append(ref.data() + 5000, ref.size() - 5000);
+    data.append(ref.data(), 333);
+    data.append(ref.data() + 10000, 7);
+
+    rdcarray<DeltaOp> ops;
+    CalcRollingDeltas(ref, data, ops);
+
+    CHECK(CountLiteralBytes(ops) < 64);
+    CHECK((ApplyDeltaOps(ref, data, ops) == data));
+
+    // data inserted in the middle
+    data = ref;
+    data.insert(20000, ref.data() + 100, 50);
+
+    ops.clear();
+    CalcRollingDeltas(ref, data, ops);
+
+    CHECK(CountLiteralBytes(ops) <= 50);
+    CHECK((ApplyDeltaOps(ref, data, ops) == data));
+  }
+
+  SECTION("Unrelated data")
+  {
+    bytebuf data;
+    data.resize(1000);
+    for(byte &b : data)
+    {
+      seed = seed * 1664525U + 1013904223U;
+      b = byte(seed >> 24);
+    }
+
+    rdcarray<DeltaOp> ops;
+    CalcRollingDeltas(ref, data, ops);
+
+    REQUIRE(ops.size() == 1);
+    CHECK(ops[0].literal);
+    CHECK((ApplyDeltaOps(ref, data, ops) == data));
+  }
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
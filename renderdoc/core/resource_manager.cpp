@@ -199,6 +199,73 @@ bool IsCompleteWriteFrameRef(FrameRefType refType)
   return refType == eFrameRef_CompleteWrite || refType == eFrameRef_CompleteWriteAndDiscard;
 }
 
+void SortedChunkList::Sort()
+{
+  m_Sorted.clear();
+  m_Sorted.reserve(m_Entries.size());
+
+  if(m_RunStarts.empty())
+  {
+    for(const Entry &e : m_Entries)
+      m_Sorted.push_back(e.chunk);
+  }
+  else
+  {
+    if(m_RunStarts.size() >= MaxMergeRuns)
+    {
+      // with many short runs merging is no better than sorting everything. The sort is stable so
+      // the last duplicate added remains the last.
+      std::stable_sort(m_Entries.begin(), m_Entries.end(),
+                       [](const Entry &a, const Entry &b) { return a.id < b.id; });
+    }
+    else
+    {
+      // merge neighbouring runs pairwise until only one is left. Each pass streams through the
+      // entries in order, which is much faster than picking one entry at a time from a heap of
+      // runs. Ties are taken from the earlier run first, so the last duplicate added stays last.
+      rdcarray<size_t> bounds;
+      bounds.reserve(m_RunStarts.size() + 2);
+      bounds.push_back(0);
+      bounds.append(m_RunStarts);
+      bounds.push_back(m_Entries.size());
+
+      rdcarray<Entry> merged;
+      merged.resize(m_Entries.size());
+
+      while(bounds.size() > 2)
+      {
+        size_t numBounds = 1;
+
+        for(size_t i = 0; i + 1 < bounds.size(); i += 2)
+        {
+          const size_t start = bounds[i], mid = bounds[i + 1];
+          const size_t end = i + 2 < bounds.size() ? bounds[i + 2] : mid;
+
+          std::merge(m_Entries.begin() + start, m_Entries.begin() + mid, m_Entries.begin() + mid,
+                     m_Entries.begin() + end, merged.begin() + start,
+                     [](const Entry &a, const Entry &b) { return a.id < b.id; });
+
+          // only ever overwrites bounds that have already been read
+          bounds[numBounds++] = end;
+        }
+
+        bounds.resize(numBounds);
+        m_Entries.swap(merged);
+      }
+    }
+
+    for(size_t i = 0; i < m_Entries.size(); i++)
+    {
+      if(i + 1 < m_Entries.size() && m_Entries[i + 1].id == m_Entries[i].id)
+        continue;
+      m_Sorted.push_back(m_Entries[i].chunk);
+    }
+  }
+
+  m_Entries.clear();
+  m_RunStarts.clear();
+}
+
 void ResourceRecord::AddResourceReferences(ResourceRecordHandler *mgr)
 {
   for(auto it = m_FrameRefs.begin(); it != m_FrameRefs.end(); ++it)
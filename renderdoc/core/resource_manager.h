@@ -34,6 +34,7 @@
 #include "api/replay/resourceid.h"
 #include "common/threading.h"
 #include "core/core.h"
+#include "core/sharded_id_map.h"
 #include "os/os_specific.h"
 #include "serialise/serialiser.h"
 
@@ -301,6 +302,42 @@ void SetReplayResourceIDs();
 
 struct ResourceRecord;
 
+// Gathers the chunks from resource records to be written out in ID order. Each record's chunks are
+// normally already sorted, so rather than inserting every chunk into a map they're collected as
+// sorted runs, and merged once all records have been added.
+class SortedChunkList
+{
+public:
+  // a chunk with an ID lower than or equal to the last one added starts a new run. If the same ID
+  // is added more than once, the last chunk added with it is kept.
+  void Add(int64_t id, Chunk *chunk)
+  {
+    if(!m_Entries.empty() && id <= m_Entries.back().id)
+      m_RunStarts.push_back(m_Entries.size());
+    m_Entries.push_back({id, chunk});
+  }
+
+  // merges everything added so far into ID order, after which the list can be iterated.
+  void Sort();
+
+  size_t size() const { return m_Entries.empty() ? m_Sorted.size() : m_Entries.size(); }
+  Chunk *const *begin() const { return m_Sorted.begin(); }
+  Chunk *const *end() const { return m_Sorted.end(); }
+private:
+  struct Entry
+  {
+    int64_t id;
+    Chunk *chunk;
+  };
+
+  rdcarray<Entry> m_Entries;
+  // the index in m_Entries where each run after the first begins
+  rdcarray<size_t> m_RunStarts;
+  // beyond this many runs, Sort() falls back to a plain sort instead of merging
+  static const size_t MaxMergeRuns = 64;
+  rdcarray<Chunk *> m_Sorted;
+};
+
 class ResourceRecordHandler
 {
 public:
@@ -371,7 +408,7 @@ struct ResourceRecord
   }
 
   void MarkDataUnwritten() { DataWritten = false; }
-  void Insert(std::map<int64_t, Chunk *> &recordlist)
+  void Insert(SortedChunkList &recordlist)
   {
     bool dataWritten = DataWritten;
 
@@ -388,7 +425,7 @@ struct ResourceRecord
     if(!dataWritten)
     {
       for(auto it = m_Chunks.begin(); it != m_Chunks.end(); ++it)
-        recordlist[it->id] = it->chunk;
+        recordlist.Add(it->id, it->chunk);
     }
   }
 
@@ -708,7 +745,8 @@ protected:
   void Prepare_InitialStateIfPostponed(ResourceId id, bool midframe);
   void SkipOrPostponeOrPrepare_InitialState(ResourceId id, FrameRefType refType);
 
-  // very coarse lock, protects EVERYTHING. This could certainly be improved and it may be a
+  // very coarse lock, protects everything except m_FrameReferencedResources and m_DirtyResources
+  // which are sharded with their own locks. This could certainly be improved and it may be a
   // bottleneck for performance. Given that the main use cases are write-rarely read-often the lock
   // should be optimised for that as we only want to make sure we're not modifying the objects
   // together, by far the most common operation is looking up data.
@@ -724,11 +762,13 @@ protected:
   // Unwrap)
   std::map<RealResourceType, WrappedResourceType> m_WrapperMap;
 
-  // used during capture - holds resources referenced in current frame (and how they're referenced)
-  std::unordered_map<ResourceId, FrameRefType> m_FrameReferencedResources;
+  // used during capture - holds resources referenced in current frame (and how they're referenced).
+  // This is updated by every thread recording commands, so it doesn't rely on m_Lock.
+  ShardedResourceIdMap<FrameRefType> m_FrameReferencedResources;
 
-  // used during capture - holds resources marked as dirty, needing initial contents
-  std::set<ResourceId> m_DirtyResources;
+  // used during capture - holds resources marked as dirty, needing initial contents. The value is
+  // unused
+  ShardedResourceIdMap<bool> m_DirtyResources;
 
   struct InitialContentStorage
   {
@@ -925,11 +965,25 @@ template <typename Compose>
 void ResourceManager<Configuration>::MarkResourceFrameReferenced(ResourceId id,
                                                                  FrameRefType refType, Compose comp)
 {
-  SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
-
   if(id == ResourceId())
     return;
 
+  // read references don't update write times or prepare postponed resources, and only the first
+  // reference in a frame can un-skip a resource. So a read when background capturing does nothing,
+  // and a read of a resource already referenced this frame only needs to update its reference,
+  // neither of which needs the global lock.
+  if(!IsDirtyFrameRef(refType))
+  {
+    if(IsBackgroundCapturing(m_State))
+      return;
+
+    if(m_FrameReferencedResources.UpdateExisting(
+           id, [comp, refType](FrameRefType &ref) { ref = comp(ref, refType); }))
+      return;
+  }
+
+  SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
+
   if(IsActiveCapturing(m_State))
   {
     SkipOrPostponeOrPrepare_InitialState(id, refType);
@@ -943,7 +997,8 @@ void ResourceManager<Configuration>::MarkResourceFrameReferenced(ResourceId id,
   if(IsBackgroundCapturing(m_State))
     return;
 
-  bool newRef = MarkReferenced(m_FrameReferencedResources, id, refType, comp);
+  bool newRef = m_FrameReferencedResources.Update(
+      id, refType, [comp, refType](FrameRefType &ref) { ref = comp(ref, refType); });
 
   if(newRef)
   {
@@ -963,23 +1018,19 @@ void ResourceManager<Configuration>::MarkResourceFrameReferenced(ResourceId id,
 template <typename Configuration>
 void ResourceManager<Configuration>::MarkDirtyResource(ResourceId res)
 {
-  SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
-
   if(res == ResourceId())
     return;
 
-  m_DirtyResources.insert(res);
+  m_DirtyResources.Insert(res, true);
 }
 
 template <typename Configuration>
 bool ResourceManager<Configuration>::IsResourceDirty(ResourceId res)
 {
-  SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
-
   if(res == ResourceId())
     return false;
 
-  return m_DirtyResources.find(res) != m_DirtyResources.end();
+  return m_DirtyResources.Contains(res);
 }
 
 template <typename Configuration>
@@ -1077,16 +1128,16 @@ void ResourceManager<Configuration>::Serialise_InitialContentsNeeded(WriteSerial
   rdcarray<WrittenRecord> NeededInitials;
 
   // reasonable estimate, and these records are small
-  NeededInitials.reserve(m_FrameReferencedResources.size() + m_InitialContents.size());
+  NeededInitials.reserve(m_FrameReferencedResources.Size() + m_InitialContents.size());
 
   // all resources that were recorded as being modified should be included in the list of those
   // needing initial contents
-  for(auto it = m_FrameReferencedResources.begin(); it != m_FrameReferencedResources.end(); ++it)
+  for(const rdcpair<ResourceId, FrameRefType> &ref : m_FrameReferencedResources.GetSorted())
   {
-    RecordType *record = GetResourceRecord(it->first);
-    if(IsDirtyFrameRef(it->second))
+    RecordType *record = GetResourceRecord(ref.first);
+    if(IsDirtyFrameRef(ref.second))
     {
-      WrittenRecord wr = {it->first, record ? record->DataInSerialiser : true};
+      WrittenRecord wr = {ref.first, record ? record->DataInSerialiser : true};
 
       NeededInitials.push_back(wr);
     }
@@ -1101,7 +1152,7 @@ void ResourceManager<Configuration>::Serialise_InitialContentsNeeded(WriteSerial
     bool include = RenderDoc::Inst().GetCaptureOptions().refAllResources;
 
     ResourceId id = it->first;
-    if(m_FrameReferencedResources.find(id) != m_FrameReferencedResources.end())
+    if(m_FrameReferencedResources.Contains(id))
       include = true;
 
     if(include)
@@ -1412,11 +1463,11 @@ void ResourceManager<Configuration>::MarkUnwrittenResources()
 template <typename Configuration>
 void ResourceManager<Configuration>::InsertReferencedChunks(WriteSerialiser &ser)
 {
-  std::map<int64_t, Chunk *> sortedChunks;
+  SortedChunkList sortedChunks;
 
   SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
 
-  RDCDEBUG("%u frame resource records", (uint32_t)m_FrameReferencedResources.size());
+  RDCDEBUG("%u frame resource records", (uint32_t)m_FrameReferencedResources.Size());
 
   if(RenderDoc::Inst().GetCaptureOptions().refAllResources)
   {
@@ -1430,7 +1481,7 @@ void ResourceManager<Configuration>::InsertReferencedChunks(WriteSerialiser &ser
       RenderDoc::Inst().SetProgress(CaptureProgress::AddReferencedResources, idx / num);
       idx += 1.0f;
 
-      if(m_FrameReferencedResources.find(it->first) == m_FrameReferencedResources.end() &&
+      if(!m_FrameReferencedResources.Contains(it->first) &&
          it->second->InternalResource)
         continue;
 
@@ -1439,24 +1490,28 @@ void ResourceManager<Configuration>::InsertReferencedChunks(WriteSerialiser &ser
   }
   else
   {
-    float num = float(m_FrameReferencedResources.size());
+    rdcarray<rdcpair<ResourceId, FrameRefType>> refs = m_FrameReferencedResources.GetSorted();
+
+    float num = float(refs.size());
     float idx = 0.0f;
 
-    for(auto it = m_FrameReferencedResources.begin(); it != m_FrameReferencedResources.end(); ++it)
+    for(const rdcpair<ResourceId, FrameRefType> &ref : refs)
     {
       RenderDoc::Inst().SetProgress(CaptureProgress::AddReferencedResources, idx / num);
       idx += 1.0f;
 
-      RecordType *record = GetResourceRecord(it->first);
+      RecordType *record = GetResourceRecord(ref.first);
       if(record)
         record->Insert(sortedChunks);
     }
   }
 
+  sortedChunks.Sort();
+
   RDCDEBUG("%u frame resource chunks", (uint32_t)sortedChunks.size());
 
-  for(auto it = sortedChunks.begin(); it != sortedChunks.end(); it++)
-    it->second->Write(ser);
+  for(Chunk *chunk : sortedChunks)
+    chunk->Write(ser);
 
   RDCDEBUG("inserted to serialiser");
 }
@@ -1466,19 +1521,21 @@ void ResourceManager<Configuration>::PrepareInitialContents()
 {
   SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
 
-  RDCLOG("Preparing up to %u potentially dirty resources", (uint32_t)m_DirtyResources.size());
+  rdcarray<rdcpair<ResourceId, bool>> dirty = m_DirtyResources.GetSorted();
+
+  RDCLOG("Preparing up to %u potentially dirty resources", (uint32_t)dirty.size());
   uint32_t prepared = 0;
   uint32_t postponed = 0;
   uint32_t skipped = 0;
 
-  float num = float(m_DirtyResources.size());
+  float num = float(dirty.size());
   float idx = 0.0f;
 
   Begin_PrepareInitialBatch();
 
-  for(auto it = m_DirtyResources.begin(); it != m_DirtyResources.end(); ++it)
+  for(const rdcpair<ResourceId, bool> &d : dirty)
   {
-    ResourceId id = *it;
+    ResourceId id = d.first;
 
     RenderDoc::Inst().SetProgress(CaptureProgress::PrepareInitialStates, idx / num);
     idx += 1.0f;
@@ -1535,7 +1592,7 @@ void ResourceManager<Configuration>::InsertInitialContentsChunks(WriteSerialiser
   uint32_t skipped = 0;
 
   RDCLOG("Checking %u resources with initial contents against %u referenced resources",
-         (uint32_t)m_InitialContents.size(), (uint32_t)m_FrameReferencedResources.size());
+         (uint32_t)m_InitialContents.size(), (uint32_t)m_FrameReferencedResources.Size());
 
   float num = float(m_InitialContents.size());
   float idx = 0.0f;
@@ -1546,7 +1603,7 @@ void ResourceManager<Configuration>::InsertInitialContentsChunks(WriteSerialiser
   {
     ResourceId id = it->first;
 
-    if(m_FrameReferencedResources.find(id) == m_FrameReferencedResources.end() &&
+    if(!m_FrameReferencedResources.Contains(id) &&
        !RenderDoc::Inst().GetCaptureOptions().refAllResources)
     {
       continue;
@@ -1573,7 +1630,7 @@ void ResourceManager<Configuration>::InsertInitialContentsChunks(WriteSerialiser
     RenderDoc::Inst().SetProgress(CaptureProgress::SerialiseInitialStates, idx / num);
     idx += 1.0f;
 
-    if(m_FrameReferencedResources.find(id) == m_FrameReferencedResources.end() &&
+    if(!m_FrameReferencedResources.Contains(id) &&
        !RenderDoc::Inst().GetCaptureOptions().refAllResources)
     {
 #if ENABLED(VERBOSE_DIRTY_RESOURCES)
@@ -1651,7 +1708,7 @@ void ResourceManager<Configuration>::ApplyInitialContentsNonChunks(WriteSerialis
   {
     ResourceId id = it->first;
 
-    if(m_FrameReferencedResources.find(id) == m_FrameReferencedResources.end() &&
+    if(!m_FrameReferencedResources.Contains(id) &&
        !RenderDoc::Inst().GetCaptureOptions().refAllResources)
     {
       continue;
@@ -1672,19 +1729,19 @@ void ResourceManager<Configuration>::ClearReferencedResources()
 {
   SCOPED_LOCK_OPTIONAL(m_Lock, m_Capturing);
 
-  for(auto it = m_FrameReferencedResources.begin(); it != m_FrameReferencedResources.end(); ++it)
+  for(const rdcpair<ResourceId, FrameRefType> &ref : m_FrameReferencedResources.GetSorted())
   {
-    RecordType *record = GetResourceRecord(it->first);
+    RecordType *record = GetResourceRecord(ref.first);
 
     if(record)
     {
-      if(IncludesWrite(it->second))
-        MarkDirtyResource(it->first);
+      if(IncludesWrite(ref.second))
+        MarkDirtyResource(ref.first);
       record->Delete(this);
     }
   }
 
-  m_FrameReferencedResources.clear();
+  m_FrameReferencedResources.Clear();
 }
 
 template <typename Configuration>
@@ -1961,7 +2018,7 @@ void ResourceManager<Configuration>::ReleaseCurrentResource(ResourceId id)
     Prepare_InitialStateIfPostponed(id, true);
 
   m_CurrentResourceMap.erase(id);
-  m_DirtyResources.erase(id);
+  m_DirtyResources.Erase(id);
 
   auto it = std::lower_bound(m_ResourceRefTimes.begin(), m_ResourceRefTimes.end(), id);
   if(it != m_ResourceRefTimes.end())
@@ -0,0 +1,424 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "common/globalconfig.h"
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include <map>
+#include <unordered_map>
+#include "common/timing.h"
+#include "serialise/serialiser.h"
+#include "resource_manager.h"
+
+#include "catch/catch.hpp"
+
+static rdcarray<Chunk *> CreateTestChunks(size_t count)
+{
+  rdcarray<Chunk *> ret;
+
+  WriteSerialiser ser(new StreamWriter(StreamWriter::DefaultScratchSize), Ownership::Stream);
+
+  for(uint32_t i = 0; i < count; i++)
+  {
+    ser.WriteChunk(1);
+    ser.Serialise("value"_lit, i);
+    ser.EndChunk();
+
+    ret.push_back(Chunk::Create(ser, 1));
+  }
+
+  return ret;
+}
+
+TEST_CASE("Test sorted chunk list", "[resourcemanager]")
+{
+  rdcarray<Chunk *> chunks = CreateTestChunks(12);
+
+  SECTION("Sorted runs are merged")
+  {
+    SortedChunkList list;
+
+    list.Add(3, chunks[3]);
+    list.Add(7, chunks[7]);
+    list.Add(8, chunks[8]);
+
+    list.Add(1, chunks[1]);
+    list.Add(4, chunks[4]);
+    list.Add(11, chunks[11]);
+
+    list.Add(2, chunks[2]);
+    list.Add(5, chunks[5]);
+
+    list.Sort();
+
+    rdcarray<Chunk *> expected = {chunks[1], chunks[2], chunks[3], chunks[4],
+                                  chunks[5], chunks[7], chunks[8], chunks[11]};
+
+    REQUIRE(list.size() == expected.size());
+
+    size_t i = 0;
+    for(Chunk *c : list)
+      CHECK(c == expected[i++]);
+  }
+
+  SECTION("Duplicate IDs keep the last chunk added")
+  {
+    SortedChunkList list;
+
+    list.Add(1, chunks[0]);
+    list.Add(2, chunks[1]);
+    list.Add(2, chunks[2]);
+    list.Add(3, chunks[3]);
+    list.Add(1, chunks[4]);
+
+    list.Sort();
+
+    rdcarray<Chunk *> expected = {chunks[4], chunks[2], chunks[3]};
+
+    REQUIRE(list.size() == expected.size());
+
+    size_t i = 0;
+    for(Chunk *c : list)
+      CHECK(c == expected[i++]);
+  }
+
+  SECTION("Many runs are sorted")
+  {
+    SortedChunkList list;
+
+    // descending IDs make every chunk its own run, with duplicates in later runs
+    for(int64_t id = 200; id > 0; id--)
+      list.Add(id % 12, chunks[(id + 1) % 12]);
+    list.Add(0, chunks[5]);
+
+    list.Sort();
+
+    REQUIRE(list.size() == 12);
+
+    size_t i = 0;
+    for(Chunk *c : list)
+    {
+      // the last chunk added for ID i was from the smallest id with that remainder (i itself), or
+      // the explicit add for 0
+      if(i == 0)
+        CHECK(c == chunks[5]);
+      else
+        CHECK(c == chunks[(i + 1) % 12]);
+      i++;
+    }
+  }
+
+  SECTION("Records and their parents")
+  {
+    ResourceRecord parent(ResourceId(), false);
+    ResourceRecord a(ResourceId(), false);
+    ResourceRecord b(ResourceId(), false);
+
+    parent.AddChunk(chunks[1], 1);
+    parent.AddChunk(chunks[5], 5);
+    parent.AddChunk(chunks[9], 9);
+
+    a.AddChunk(chunks[2], 2);
+    a.AddChunk(chunks[6], 6);
+    a.AddParent(&parent);
+
+    b.AddChunk(chunks[3], 3);
+    b.AddChunk(chunks[4], 4);
+    b.AddChunk(chunks[10], 10);
+    b.AddParent(&parent);
+
+    SortedChunkList list;
+
+    a.Insert(list);
+    b.Insert(list);
+
+    list.Sort();
+
+    // the parent is only inserted once
+    rdcarray<Chunk *> expected = {chunks[1], chunks[2], chunks[3], chunks[4],
+                                  chunks[5], chunks[6], chunks[9], chunks[10]};
+
+    REQUIRE(list.size() == expected.size());
+
+    size_t i = 0;
+    for(Chunk *c : list)
+      CHECK(c == expected[i++]);
+  }
+
+  for(Chunk *c : chunks)
+    c->Delete();
+}
+
+// the insertion used before SortedChunkList, walking parents the same way but inserting each chunk
+// into a map, for comparison.
+struct MapInsertRecord : public ResourceRecord
+{
+  MapInsertRecord() : ResourceRecord(ResourceId(), false) {}
+  void Insert(std::map<int64_t, Chunk *> &recordlist)
+  {
+    bool dataWritten = DataWritten;
+
+    DataWritten = true;
+
+    for(auto it = Parents.begin(); it != Parents.end(); ++it)
+    {
+      if(!(*it)->DataWritten)
+      {
+        ((MapInsertRecord *)(*it))->Insert(recordlist);
+      }
+    }
+
+    if(!dataWritten)
+    {
+      for(auto it = m_Chunks.begin(); it != m_Chunks.end(); ++it)
+        recordlist[it->id] = it->chunk;
+    }
+  }
+};
+
+TEST_CASE("Benchmark capture-end record insertion", "[.][resourcemanager][benchmark]")
+{
+  const size_t numRecords = 100000;
+  const size_t chunksPerRecord = 4;
+
+  // every record shares one chunk, only the IDs matter here
+  rdcarray<Chunk *> chunk = CreateTestChunks(1);
+
+  rdcarray<MapInsertRecord *> records;
+  records.reserve(numRecords);
+  for(size_t r = 0; r < numRecords; r++)
+    records.push_back(new MapInsertRecord());
+
+  bool interleaved = false;
+
+  SECTION("IDs interleaved across records")
+  {
+    // as if every record was being recorded at once. This gives a run per record, which is too many
+    // to merge so it measures the sort fallback
+    interleaved = true;
+
+    int64_t id = 1;
+    for(size_t c = 0; c < chunksPerRecord; c++)
+      for(size_t r = 0; r < numRecords; r++)
+        records[r]->AddChunk(chunk[0], id++);
+  }
+
+  SECTION("IDs contiguous within each record")
+  {
+    // each record's chunks are recorded together, but records were created in 32 interleaved
+    // batches so inserting them in order gives 32 sorted runs to merge
+    const size_t numBatches = 32;
+    const size_t batchSize = numRecords / numBatches;
+
+    for(size_t r = 0; r < numRecords; r++)
+    {
+      size_t block = (r % batchSize) * numBatches + r / batchSize;
+      for(size_t c = 0; c < chunksPerRecord; c++)
+        records[r]->AddChunk(chunk[0], int64_t(block * chunksPerRecord + c + 1));
+    }
+  }
+
+  // link each record to a couple of earlier ones
+  for(size_t r = 1; r < numRecords; r++)
+  {
+    records[r]->AddParent(records[((r * 7919) % numRecords) % r]);
+    records[r]->AddParent(records[r / 2]);
+  }
+
+  PerformanceTimer timer;
+
+  SortedChunkList list;
+  for(ResourceRecord *record : records)
+    record->Insert(list);
+
+  double gatherTime = timer.GetMilliseconds();
+
+  timer.Restart();
+
+  list.Sort();
+
+  double sortTime = timer.GetMilliseconds();
+
+  CHECK(list.size() == numRecords * chunksPerRecord);
+
+  for(MapInsertRecord *record : records)
+    record->MarkDataUnwritten();
+
+  timer.Restart();
+
+  std::map<int64_t, Chunk *> map;
+  for(MapInsertRecord *record : records)
+    record->Insert(map);
+
+  double mapTime = timer.GetMilliseconds();
+
+  CHECK(map.size() == numRecords * chunksPerRecord);
+
+  WARN((interleaved ? "Interleaved" : "Contiguous")
+       << " IDs: gathered " << list.size() << " chunks from " << numRecords << " records in "
+       << gatherTime << "ms and sorted in " << sortTime << "ms, map insertion took " << mapTime
+       << "ms");
+
+  for(MapInsertRecord *record : records)
+    delete record;
+
+  chunk[0]->Delete();
+}
+
+TEST_CASE("Test sharded resource ID map", "[resourcemanager]")
+{
+  rdcarray<ResourceId> ids;
+  for(size_t i = 0; i < 5000; i++)
+    ids.push_back(ResourceIDGen::GetNewUniqueID());
+
+  SECTION("Matches unordered_map through inserts, updates and erases")
+  {
+    ShardedResourceIdMap<uint32_t> sharded;
+    std::unordered_map<ResourceId, uint32_t> reference;
+
+    for(uint32_t i = 0; i < 20000; i++)
+    {
+      ResourceId id = ids[(i * 7919) % ids.size()];
+
+      if(i % 5 == 4)
+      {
+        bool erased = sharded.Erase(id);
+        CHECK(erased == (reference.erase(id) > 0));
+        continue;
+      }
+
+      bool added = sharded.Update(id, i, [i](uint32_t &v) { v += i; });
+
+      auto it = reference.find(id);
+      CHECK(added == (it == reference.end()));
+      if(it == reference.end())
+        reference[id] = i;
+      else
+        it->second += i;
+    }
+
+    CHECK(sharded.Size() == reference.size());
+
+    for(ResourceId id : ids)
+      CHECK(sharded.Contains(id) == (reference.find(id) != reference.end()));
+
+    rdcarray<rdcpair<ResourceId, uint32_t>> sorted = sharded.GetSorted();
+
+    REQUIRE(sorted.size() == reference.size());
+    for(size_t i = 0; i < sorted.size(); i++)
+    {
+      if(i > 0)
+        CHECK(sorted[i - 1].first < sorted[i].first);
+      CHECK(sorted[i].second == reference[sorted[i].first]);
+    }
+
+    sharded.Clear();
+    CHECK(sharded.Size() == 0);
+    CHECK_FALSE(sharded.Contains(ids[0]));
+  }
+
+  SECTION("Concurrent updates")
+  {
+    ShardedResourceIdMap<uint32_t> sharded;
+
+    const uint32_t numThreads = 8;
+
+    rdcarray<Threading::ThreadHandle> threads;
+    for(uint32_t t = 0; t < numThreads; t++)
+    {
+      threads.push_back(Threading::CreateThread([&sharded, &ids, t]() {
+        for(size_t i = 0; i < ids.size(); i++)
+          sharded.Update(ids[(i + t * 977) % ids.size()], 1U << t,
+                         [t](uint32_t &v) { v |= 1U << t; });
+      }));
+    }
+
+    for(Threading::ThreadHandle t : threads)
+    {
+      Threading::JoinThread(t);
+      Threading::CloseThread(t);
+    }
+
+    CHECK(sharded.Size() == ids.size());
+
+    // every thread touched every ID exactly once
+    for(const rdcpair<ResourceId, uint32_t> &entry : sharded.GetSorted())
+      CHECK(entry.second == (1U << numThreads) - 1);
+  }
+}
+
+TEST_CASE("Benchmark contended frame references", "[.][resourcemanager][benchmark]")
+{
+  // many threads recording commands that reference an overlapping set of resources, as when marking
+  // resources frame referenced
+  const uint32_t numThreads = 24;
+  const size_t refsPerThread = 200000;
+
+  rdcarray<ResourceId> ids;
+  for(size_t i = 0; i < 20000; i++)
+    ids.push_back(ResourceIDGen::GetNewUniqueID());
+
+  auto compose = [](FrameRefType &ref) { ref = ComposeFrameRefs(ref, eFrameRef_Read); };
+
+  auto run = [&](std::function<void(ResourceId)> reference) {
+    PerformanceTimer timer;
+
+    rdcarray<Threading::ThreadHandle> threads;
+    for(uint32_t t = 0; t < numThreads; t++)
+    {
+      threads.push_back(Threading::CreateThread([&ids, &reference, t]() {
+        for(size_t i = 0; i < refsPerThread; i++)
+          reference(ids[(i * 31 + t * 1009) % ids.size()]);
+      }));
+    }
+
+    for(Threading::ThreadHandle t : threads)
+    {
+      Threading::JoinThread(t);
+      Threading::CloseThread(t);
+    }
+
+    return timer.GetMilliseconds();
+  };
+
+  Threading::CriticalSection lock;
+  std::unordered_map<ResourceId, FrameRefType> locked;
+
+  double lockedTime = run([&](ResourceId id) {
+    SCOPED_LOCK(lock);
+    MarkReferenced(locked, id, eFrameRef_Read);
+  });
+
+  ShardedResourceIdMap<FrameRefType> sharded;
+
+  double shardedTime = run([&](ResourceId id) { sharded.Update(id, eFrameRef_Read, compose); });
+
+  CHECK(sharded.Size() == locked.size());
+
+  WARN(numThreads << " threads making " << refsPerThread << " references each: single lock took "
+                  << lockedTime << "ms, sharded map took " << shardedTime << "ms");
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -0,0 +1,263 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include "api/replay/rdcarray.h"
+#include "api/replay/rdcpair.h"
+#include "api/replay/resourceid.h"
+#include "common/common.h"
+#include "os/os_specific.h"
+
+// A ResourceId-keyed hash map split into independently locked shards, for data that's written
+// from many threads at once during capture. Each shard is an open-addressing table with linear
+// probing, using the null ResourceId to mark empty slots - so the null ID can't be stored.
+//
+// Every operation only locks the shard that the ID hashes to, so threads touching different
+// resources rarely contend. Operations that cover the whole map (Size, Clear, GetSorted) lock each
+// shard in turn, so they aren't atomic with respect to concurrent writers.
+template <typename ValueType>
+class ShardedResourceIdMap
+{
+public:
+  ShardedResourceIdMap() = default;
+  ShardedResourceIdMap(const ShardedResourceIdMap &) = delete;
+  ShardedResourceIdMap &operator=(const ShardedResourceIdMap &) = delete;
+
+  // adds id with the given value if it's not present. Returns true if it was added
+  bool Insert(ResourceId id, const ValueType &value)
+  {
+    return Update(id, value, [](ValueType &) {});
+  }
+
+  // adds id with the given value if it's not present and returns true, otherwise calls modify()
+  // on the existing value and returns false. modify() is called with the shard locked, so it
+  // mustn't access this map.
+  template <typename Modify>
+  bool Update(ResourceId id, const ValueType &value, Modify modify)
+  {
+    uint64_t hash = Hash(id);
+    Shard &shard = m_Shards[hash >> (64 - ShardBits)];
+
+    SCOPED_LOCK(shard.lock);
+
+    Slot *slot = shard.Find(id, hash);
+    if(slot)
+    {
+      modify(slot->value);
+      return false;
+    }
+
+    shard.Add(id, hash, value);
+    return true;
+  }
+
+  // calls modify() on the value for id if it's present, and returns whether it was
+  template <typename Modify>
+  bool UpdateExisting(ResourceId id, Modify modify)
+  {
+    uint64_t hash = Hash(id);
+    Shard &shard = m_Shards[hash >> (64 - ShardBits)];
+
+    SCOPED_LOCK(shard.lock);
+
+    Slot *slot = shard.Find(id, hash);
+    if(slot)
+      modify(slot->value);
+    return slot != NULL;
+  }
+
+  bool Contains(ResourceId id)
+  {
+    uint64_t hash = Hash(id);
+    Shard &shard = m_Shards[hash >> (64 - ShardBits)];
+
+    SCOPED_LOCK(shard.lock);
+
+    return shard.Find(id, hash) != NULL;
+  }
+
+  // removes id, returns true if it was present
+  bool Erase(ResourceId id)
+  {
+    uint64_t hash = Hash(id);
+    Shard &shard = m_Shards[hash >> (64 - ShardBits)];
+
+    SCOPED_LOCK(shard.lock);
+
+    return shard.Remove(id, hash);
+  }
+
+  size_t Size()
+  {
+    size_t ret = 0;
+    for(Shard &shard : m_Shards)
+    {
+      SCOPED_LOCK(shard.lock);
+      ret += shard.count;
+    }
+    return ret;
+  }
+
+  void Clear()
+  {
+    for(Shard &shard : m_Shards)
+    {
+      SCOPED_LOCK(shard.lock);
+      shard.slots.clear();
+      shard.count = 0;
+    }
+  }
+
+  // returns a copy of the contents sorted by ID. Used for iteration, so that callers are free to
+  // modify the map (or take other locks) while processing the entries.
+  rdcarray<rdcpair<ResourceId, ValueType>> GetSorted()
+  {
+    rdcarray<rdcpair<ResourceId, ValueType>> ret;
+    for(Shard &shard : m_Shards)
+    {
+      SCOPED_LOCK(shard.lock);
+      ret.reserve(ret.size() + shard.count);
+      for(const Slot &slot : shard.slots)
+        if(slot.id != ResourceId())
+          ret.push_back({slot.id, slot.value});
+    }
+
+    std::sort(ret.begin(), ret.end(),
+              [](const rdcpair<ResourceId, ValueType> &a, const rdcpair<ResourceId, ValueType> &b) {
+                return a.first < b.first;
+              });
+
+    return ret;
+  }
+
+private:
+  static const uint32_t ShardBits = 6;
+  static const size_t MinCapacity = 16;
+
+  struct Slot
+  {
+    ResourceId id;
+    ValueType value;
+  };
+
+  struct Shard
+  {
+    Threading::CriticalSection lock;
+    // power of two size, or empty before anything has been added
+    rdcarray<Slot> slots;
+    size_t count = 0;
+
+    // keep shards that are locked by different threads off the same cache line
+    byte padding[64];
+
+    size_t Mask() const { return slots.size() - 1; }
+    Slot *Find(ResourceId id, uint64_t hash)
+    {
+      if(slots.empty())
+        return NULL;
+
+      for(size_t i = size_t(hash) & Mask();; i = (i + 1) & Mask())
+      {
+        if(slots[i].id == id)
+          return &slots[i];
+        if(slots[i].id == ResourceId())
+          return NULL;
+      }
+    }
+
+    void Add(ResourceId id, uint64_t hash, const ValueType &value)
+    {
+      // grow at 50% load, so that probe sequences stay short
+      if((count + 1) * 2 > slots.size())
+        Grow();
+
+      size_t i = size_t(hash) & Mask();
+      while(slots[i].id != ResourceId())
+        i = (i + 1) & Mask();
+
+      slots[i].id = id;
+      slots[i].value = value;
+      count++;
+    }
+
+    bool Remove(ResourceId id, uint64_t hash)
+    {
+      Slot *slot = Find(id, hash);
+      if(!slot)
+        return false;
+
+      // backward shift deletion - move any later entries in the probe sequence into the hole so
+      // that lookups never need tombstones.
+      size_t hole = slot - slots.data();
+      for(size_t i = (hole + 1) & Mask(); slots[i].id != ResourceId(); i = (i + 1) & Mask())
+      {
+        size_t home = size_t(Hash(slots[i].id)) & Mask();
+
+        // the entry can move into the hole if its home isn't cyclically in (hole, i]
+        if(((i - home) & Mask()) >= ((i - hole) & Mask()))
+        {
+          slots[hole] = slots[i];
+          hole = i;
+        }
+      }
+
+      slots[hole] = Slot();
+      count--;
+      return true;
+    }
+
+    void Grow()
+    {
+      rdcarray<Slot> old;
+      old.swap(slots);
+      slots.resize(RDCMAX(size_t(MinCapacity), old.size() * 2));
+
+      for(const Slot &slot : old)
+      {
+        if(slot.id == ResourceId())
+          continue;
+
+        size_t i = size_t(Hash(slot.id)) & Mask();
+        while(slots[i].id != ResourceId())
+          i = (i + 1) & Mask();
+        slots[i] = slot;
+      }
+    }
+  };
+
+  static uint64_t Hash(ResourceId id)
+  {
+    // IDs are mostly sequential, so mix them to spread them over both the shards (using the top
+    // bits) and the slots within a shard (using the bottom bits).
+    uint64_t h = uint64_t(std::hash<ResourceId>()(id));
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+  }
+
+  Shard m_Shards[1 << ShardBits];
+};
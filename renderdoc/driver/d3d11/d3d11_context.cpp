@@ -1259,6 +1259,7 @@ RDResult WrappedID3D11DeviceContext::ReplayLog(CaptureState readType, uint32_t s
   {
     ser.ConfigureStructuredExport(&GetChunkName, IsStructuredExporting(m_State),
                                   m_pDevice->GetTimeBase(), m_pDevice->GetTimeFrequency());
+    ser.SetCallstackTable(m_pDevice->GetCallstackTable());
 
     ser.GetStructuredFile().Swap(*m_pDevice->GetStructuredFile());
 
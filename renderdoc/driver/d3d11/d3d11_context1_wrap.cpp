@@ -188,7 +188,7 @@ bool WrappedID3D11DeviceContext::Serialise_UpdateSubresource1(
       }
     }
 
-    SERIALISE_ELEMENT_ARRAY(pSrcData, SourceDataLength).Important();
+    SERIALISE_ELEMENT_ARRAY_VIEW(pSrcData, SourceDataLength).Important();
     SERIALISE_ELEMENT(SourceDataLength);
 
     SERIALISE_CHECK_READ_ERRORS();
@@ -1352,6 +1352,9 @@ RDResult WrappedID3D11Device::ReadLogInitialisation(RDCFile *rdc, bool storeStru
 
   ser.ConfigureStructuredExport(&GetChunkName, storeStructuredBuffers, m_TimeBase, m_TimeFrequency);
 
+  rdc->GetCallstackTable(m_Callstacks);
+  ser.SetCallstackTable(&m_Callstacks);
+
   m_StructuredFile = &ser.GetStructuredFile();
 
   m_StoredStructuredData->version = m_StructuredFile->version = m_SectionVersion;
@@ -2241,7 +2244,7 @@ bool WrappedID3D11Device::EndFrameCapture(DeviceOwnedWindow devWnd)
       SectionProperties props;
 
       // Compress with LZ4 so that it's fast
-      props.flags = SectionFlags::LZ4Compressed;
+      props.flags = SectionFlags::LZ4Compressed | SectionFlags::IndexedBlocks;
       props.version = m_SectionVersion;
       props.type = SectionType::FrameCapture;
 
@@ -2253,11 +2256,16 @@ bool WrappedID3D11Device::EndFrameCapture(DeviceOwnedWindow devWnd)
     }
 
     uint64_t captureSectionSize = 0;
+    rdcarray<ChunkIndexEntry> chunkIndex;
+    // callstacks of the chunks written into this capture, which refer to them by index
+    CallstackTable callstacks;
 
     {
       WriteSerialiser ser(captureWriter, Ownership::Stream);
 
       ser.SetChunkMetadataRecording(m_ScratchSerialiser.GetChunkMetadataRecording());
+      ser.SetChunkIndexRecording(true);
+      ser.SetCallstackTable(&callstacks);
 
       ser.SetUserData(GetResourceManager());
 
@@ -2304,19 +2312,21 @@ bool WrappedID3D11Device::EndFrameCapture(DeviceOwnedWindow devWnd)
 
         RDCDEBUG("Accumulating context resource list");
 
-        std::map<int64_t, Chunk *> recordlist;
+        SortedChunkList recordlist;
         record->Insert(recordlist);
 
         RDCDEBUG("Flushing %u records to file serialiser", (uint32_t)recordlist.size());
 
+        recordlist.Sort();
+
         float num = float(recordlist.size());
         float idx = 0.0f;
 
-        for(auto it = recordlist.begin(); it != recordlist.end(); ++it)
+        for(Chunk *chunk : recordlist)
         {
           RenderDoc::Inst().SetProgress(CaptureProgress::SerialiseFrameContents, idx / num);
           idx += 1.0f;
-          it->second->Write(ser);
+          chunk->Write(ser);
         }
 
         RDCDEBUG("Done");
@@ -2325,11 +2335,19 @@ bool WrappedID3D11Device::EndFrameCapture(DeviceOwnedWindow devWnd)
       UnlockForChunkFlushing();
 
       captureSectionSize = captureWriter->GetOffset();
+
+      chunkIndex.swap(ser.GetChunkIndex());
     }
 
     RDCLOG("Captured D3D11 frame with %f MB capture section in %f seconds",
            double(captureSectionSize) / (1024.0 * 1024.0), m_CaptureTimer.GetMilliseconds() / 1000.0);
 
+    if(rdc)
+    {
+      rdc->WriteChunkIndex(chunkIndex);
+      rdc->WriteCallstackTable(callstacks);
+    }
+
     RenderDoc::Inst().FinishCaptureWriting(rdc, m_CapturedFrames.back().frameNumber);
 
     m_State = CaptureState::BackgroundCapturing;
@@ -33,6 +33,7 @@
 #include "driver/dxgi/dxgi_wrapped.h"
 #include "driver/ihv/amd/ags_wrapper.h"
 #include "driver/ihv/nv/nvapi_wrapper.h"
+#include "serialise/callstack_table.h"
 #include "d3d11_common.h"
 #include "d3d11_manager.h"
 #include "d3d11_video.h"
@@ -566,6 +567,8 @@ private:
 
   WriteSerialiser m_ScratchSerialiser;
   std::set<rdcstr> m_StringDB;
+  // callstacks that chunks in the capture refer to by index
+  CallstackTable m_Callstacks;
 
   ResourceId m_ResourceID;
   D3D11ResourceRecord *m_DeviceRecord;
@@ -693,6 +696,7 @@ public:
   }
   uint64_t GetTimeBase() { return m_TimeBase; }
   double GetTimeFrequency() { return m_TimeFrequency; }
+  CallstackTable *GetCallstackTable() { return &m_Callstacks; }
   void FirstFrame(IDXGISwapper *swapper);
 
   void HandleOOM(bool handle)
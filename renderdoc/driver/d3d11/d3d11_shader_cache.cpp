@@ -82,15 +82,10 @@ struct D3DBlobShaderCallbacks
 } D3D11ShaderCacheCallbacks;
 
 D3D11ShaderCache::D3D11ShaderCache(WrappedID3D11Device *wrapper)
+    : m_ShaderCache("d3dshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion)
 {
   m_pDevice = wrapper;
 
-  bool success = LoadShaderCache("d3dshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion,
-                                 m_ShaderCache, D3D11ShaderCacheCallbacks);
-
-  // if we failed to load from the cache
-  m_ShaderCacheDirty = !success;
-
   m_CompileFlags = D3DCOMPILE_WARNINGS_ARE_ERRORS;
 
   static const GUID IRenderDoc_uuid = {
@@ -112,16 +107,7 @@ D3D11ShaderCache::D3D11ShaderCache(WrappedID3D11Device *wrapper)
 
 D3D11ShaderCache::~D3D11ShaderCache()
 {
-  if(m_ShaderCacheDirty)
-  {
-    SaveShaderCache("d3dshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion, m_ShaderCache,
-                    D3D11ShaderCacheCallbacks);
-  }
-  else
-  {
-    for(auto it = m_ShaderCache.begin(); it != m_ShaderCache.end(); ++it)
-      D3D11ShaderCacheCallbacks.Destroy(it->second);
-  }
+  m_ShaderCache.Shutdown(D3D11ShaderCacheCallbacks);
 }
 
 rdcstr D3D11ShaderCache::GetShaderBlob(const char *source, const char *entry,
@@ -137,16 +123,15 @@ rdcstr D3D11ShaderCache::GetShaderBlob(const char *source, const char *entry,
                                                 {"hlsl_cbuffers.h", cbuffers},
                                             });
 
-  uint32_t hash = strhash(source);
-  hash = strhash(entry, hash);
-  hash = strhash(profile, hash);
-  hash = strhash(cbuffers.c_str(), hash);
-  hash = strhash(texsample.c_str(), hash);
+  uint64_t hash = strhash64(source);
+  hash = strhash64(entry, hash);
+  hash = strhash64(profile, hash);
+  hash = strhash64(cbuffers.c_str(), hash);
+  hash = strhash64(texsample.c_str(), hash);
   hash ^= compileFlags;
 
-  if(m_ShaderCache.find(hash) != m_ShaderCache.end())
+  if(m_ShaderCache.Find(hash, *srcblob, D3D11ShaderCacheCallbacks))
   {
-    *srcblob = m_ShaderCache[hash];
     (*srcblob)->AddRef();
     return "";
   }
@@ -198,9 +183,8 @@ rdcstr D3D11ShaderCache::GetShaderBlob(const char *source, const char *entry,
 
   if(m_CacheShaders)
   {
-    m_ShaderCache[hash] = byteBlob;
+    m_ShaderCache.Insert(hash, byteBlob, D3D11ShaderCacheCallbacks);
     byteBlob->AddRef();
-    m_ShaderCacheDirty = true;
   }
 
   SAFE_RELEASE(errBlob);
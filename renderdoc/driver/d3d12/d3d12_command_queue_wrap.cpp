@@ -974,8 +974,8 @@ void WrappedID3D12CommandQueue::ExecuteCommandListsInternal(UINT NumCommandLists
         // here AND serialise them there, but we'll play it safe.
         res->LockMaps();
 
-        size_t diffStart = 0, diffEnd = 0;
-        bool found = true;
+        DiffRange ranges[16];
+        size_t numRanges = 0;
 
         byte *ref = res->GetShadow(subres);
         byte *data = res->GetMap(subres);
@@ -1009,18 +1009,21 @@ void WrappedID3D12CommandQueue::ExecuteCommandListsInternal(UINT NumCommandLists
             data = queueReadback.readbackMapped;
           }
 
+          // each changed range is written separately, so that a few small writes far apart don't
+          // cause the whole resource to be serialised.
           if(ref)
-            found = FindDiffRange(data, ref, size, diffStart, diffEnd);
+          {
+            numRanges = FindDiffRanges(data, ref, size, ranges, ARRAY_COUNT(ranges));
+          }
           else
-            diffEnd = size;
-
-          if(found)
           {
-            RDCLOG("Persistent map flush forced for %s (%llu -> %llu)",
-                   ToStr(res->GetResourceID()).c_str(), (uint64_t)diffStart, (uint64_t)diffEnd);
-
-            D3D12_RANGE range = {diffStart, diffEnd};
+            ranges[0].start = 0;
+            ranges[0].end = size;
+            numRanges = 1;
+          }
 
+          if(numRanges > 0)
+          {
             if(ref == NULL)
             {
               res->AllocShadow(subres, size);
@@ -1028,9 +1031,18 @@ void WrappedID3D12CommandQueue::ExecuteCommandListsInternal(UINT NumCommandLists
               ref = res->GetShadow(subres);
             }
 
-            // passing true here asks the serialisation function to update the shadow pointer for
-            // this resource
-            m_pDevice->MapDataWrite(res, subres, data, range, true);
+            for(size_t r = 0; r < numRanges; r++)
+            {
+              RDCLOG("Persistent map flush forced for %s (%llu -> %llu)",
+                     ToStr(res->GetResourceID()).c_str(), (uint64_t)ranges[r].start,
+                     (uint64_t)ranges[r].end);
+
+              D3D12_RANGE range = {ranges[r].start, ranges[r].end};
+
+              // passing true here asks the serialisation function to update the shadow pointer for
+              // this resource
+              m_pDevice->MapDataWrite(res, subres, data, range, true);
+            }
 
             GetResourceManager()->MarkDirtyResource(res->GetResourceID());
           }
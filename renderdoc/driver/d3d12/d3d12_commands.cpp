@@ -1126,6 +1126,7 @@ RDResult WrappedID3D12CommandQueue::ReplayLog(CaptureState readType, uint32_t st
   {
     ser.ConfigureStructuredExport(&GetChunkName, IsStructuredExporting(m_State),
                                   m_pDevice->GetTimeBase(), m_pDevice->GetTimeFrequency());
+    ser.SetCallstackTable(m_pDevice->GetCallstackTable());
 
     ser.GetStructuredFile().Swap(*m_pDevice->GetStructuredFile());
 
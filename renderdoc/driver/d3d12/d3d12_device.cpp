@@ -2265,7 +2265,7 @@ bool WrappedID3D12Device::Serialise_WriteToSubresource(SerialiserType &ser, ID3D
     }
   }
 
-  SERIALISE_ELEMENT_ARRAY(pSrcData, dataSize).Important();
+  SERIALISE_ELEMENT_ARRAY_VIEW(pSrcData, dataSize).Important();
   SERIALISE_ELEMENT(dataSize).Hidden();
 
   SERIALISE_ELEMENT(SrcRowPitch);
@@ -2969,7 +2969,7 @@ bool WrappedID3D12Device::EndFrameCapture(DeviceOwnedWindow devWnd)
     SectionProperties props;
 
     // Compress with LZ4 so that it's fast
-    props.flags = SectionFlags::LZ4Compressed;
+    props.flags = SectionFlags::LZ4Compressed | SectionFlags::IndexedBlocks;
     props.version = m_SectionVersion;
     props.type = SectionType::FrameCapture;
 
@@ -2981,11 +2981,16 @@ bool WrappedID3D12Device::EndFrameCapture(DeviceOwnedWindow devWnd)
   }
 
   uint64_t captureSectionSize = 0;
+  rdcarray<ChunkIndexEntry> chunkIndex;
+  // callstacks of the chunks written into this capture, which refer to them by index
+  CallstackTable callstacks;
 
   {
     WriteSerialiser ser(captureWriter, Ownership::Stream);
 
     ser.SetChunkMetadataRecording(GetThreadSerialiser().GetChunkMetadataRecording());
+    ser.SetChunkIndexRecording(true);
+    ser.SetCallstackTable(&callstacks);
 
     ser.SetUserData(GetResourceManager());
 
@@ -3024,7 +3029,7 @@ bool WrappedID3D12Device::EndFrameCapture(DeviceOwnedWindow devWnd)
     // in capframe (the transition is thread-protected) so nothing will be
     // pushed to the vector
 
-    std::map<int64_t, Chunk *> recordlist;
+    SortedChunkList recordlist;
 
     for(auto it = queues.begin(); it != queues.end(); ++it)
     {
@@ -3056,19 +3061,23 @@ bool WrappedID3D12Device::EndFrameCapture(DeviceOwnedWindow devWnd)
     RDCDEBUG("Flushing %u chunks to file serialiser from context record",
              (uint32_t)recordlist.size());
 
+    recordlist.Sort();
+
     float num = float(recordlist.size());
     float idx = 0.0f;
 
-    for(auto it = recordlist.begin(); it != recordlist.end(); ++it)
+    for(Chunk *chunk : recordlist)
     {
       RenderDoc::Inst().SetProgress(CaptureProgress::SerialiseFrameContents, idx / num);
       idx += 1.0f;
-      it->second->Write(ser);
+      chunk->Write(ser);
     }
 
     RDCDEBUG("Done");
 
     captureSectionSize = captureWriter->GetOffset();
+
+    chunkIndex.swap(ser.GetChunkIndex());
   }
 
   RDCLOG("Captured D3D12 frame with %f MB capture section in %f seconds",
@@ -3127,6 +3136,12 @@ bool WrappedID3D12Device::EndFrameCapture(DeviceOwnedWindow devWnd)
     }
   }
 
+  if(rdc)
+  {
+    rdc->WriteChunkIndex(chunkIndex);
+    rdc->WriteCallstackTable(callstacks);
+  }
+
   RenderDoc::Inst().FinishCaptureWriting(rdc, m_CapturedFrames.back().frameNumber);
 
   m_HeaderChunk->Delete();
@@ -4871,6 +4886,9 @@ RDResult WrappedID3D12Device::ReadLogInitialisation(RDCFile *rdc, bool storeStru
 
   ser.ConfigureStructuredExport(&GetChunkName, storeStructuredBuffers, m_TimeBase, m_TimeFrequency);
 
+  rdc->GetCallstackTable(m_Callstacks);
+  ser.SetCallstackTable(&m_Callstacks);
+
   m_StructuredFile = &ser.GetStructuredFile();
 
   m_StoredStructuredData->version = m_StructuredFile->version = m_SectionVersion;
@@ -4994,6 +5012,9 @@ RDResult WrappedID3D12Device::ReadLogInitialisation(RDCFile *rdc, bool storeStru
         // save any debug messages we built up
         savedDebugMessages.swap(m_DebugMessages);
 
+        // every pipeline has now been created so the shaders' extension slots are final
+        WrappedID3D12Shader::QueueReflections();
+
         ApplyInitialContents();
 
         {
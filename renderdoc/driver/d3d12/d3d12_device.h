@@ -34,6 +34,7 @@
 #include "driver/ihv/amd/ags_wrapper.h"
 #include "driver/ihv/nv/nvapi_wrapper.h"
 #include "replay/replay_driver.h"
+#include "serialise/callstack_table.h"
 #include "d3d12_common.h"
 #include "d3d12_manager.h"
 
@@ -736,6 +737,8 @@ private:
   Chunk *m_HeaderChunk;
 
   std::set<rdcstr> m_StringDB;
+  // callstacks that chunks in the capture refer to by index
+  CallstackTable m_Callstacks;
 
   ResourceId m_ResourceID;
   D3D12ResourceRecord *m_DeviceRecord;
@@ -1040,6 +1043,7 @@ public:
   }
   uint64_t GetTimeBase() { return m_TimeBase; }
   double GetTimeFrequency() { return m_TimeFrequency; }
+  CallstackTable *GetCallstackTable() { return &m_Callstacks; }
   // interface for DXGI
   virtual IUnknown *GetRealIUnknown() { return GetReal(); }
   void *GetFrameCapturerDevice() { return (ID3D12Device *)this; }
@@ -597,6 +597,23 @@ WrappedID3D12DescriptorHeap::~WrappedID3D12DescriptorHeap()
   SAFE_DELETE_ARRAY(mutableDescriptorBitmask);
 }
 
+void WrappedID3D12PipelineState::ShaderEntry::QueueReflections()
+{
+  if(!Threading::JobSystem::CanAddJobs())
+    return;
+
+  // the jobs are synced at the end of loading, before any pipeline (and so shader) is released
+  for(auto it = m_Shaders.begin(); it != m_Shaders.end(); ++it)
+  {
+    ShaderEntry *shader = it->second;
+    if(shader->m_InternalResources)
+      continue;
+
+    Threading::JobSystem::AddJob([shader]() { shader->GetDetails(); }, {},
+                                 "D3D12 shader reflection");
+  }
+}
+
 void WrappedID3D12PipelineState::ShaderEntry::BuildReflection()
 {
   RDCCOMPILE_ASSERT(
@@ -882,6 +882,8 @@ public:
 
     void SetShaderExtSlot(uint32_t slot, uint32_t space)
     {
+      SCOPED_LOCK(m_Lock);
+
       // it doesn't make sense to build the same DXBC with different slots/spaces since it's baked
       // in.
 
@@ -900,6 +902,11 @@ public:
       m_ShaderExtSpace = space;
     }
 
+    // parse and reflect every shader on the job system, so they're ready by the time they're first
+    // used. Must only be called once all shaders are created, as the shader extension slot set by
+    // a later pipeline is baked into the reflection. Does nothing if the job system isn't available
+    static void QueueReflections();
+
     DXBCKey GetKey() { return m_Key; }
     D3D12_SHADER_BYTECODE GetDesc()
     {
@@ -911,6 +918,7 @@ public:
 
     DXBC::DXBCContainer *GetDXBC()
     {
+      SCOPED_LOCK(m_Lock);
       if(m_DXBCFile == NULL && !m_Bytecode.empty())
       {
         m_DXBCFile = new DXBC::DXBCContainer(m_Bytecode, rdcstr(), GraphicsAPI::D3D12,
@@ -920,6 +928,7 @@ public:
     }
     ShaderReflection &GetDetails()
     {
+      SCOPED_LOCK(m_Lock);
       if(!m_Built && GetDXBC() != NULL)
         BuildReflection();
       m_Built = true;
@@ -936,6 +945,9 @@ public:
     bytebuf m_Bytecode;
     uint32_t m_ShaderExtSlot = ~0U, m_ShaderExtSpace = ~0U;
 
+    // protects the lazily built DXBC and reflection, which may be built on a job
+    Threading::CriticalSection m_Lock;
+
     bool m_Built;
     DXBC::DXBCContainer *m_DXBCFile;
     ShaderReflection *m_Details;
@@ -338,13 +338,8 @@ private:
 };
 
 D3D12ShaderCache::D3D12ShaderCache(WrappedID3D12Device *device)
+    : m_ShaderCache("d3dshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion)
 {
-  bool success = LoadShaderCache("d3dshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion,
-                                 m_ShaderCache, D3D12ShaderCacheCallbacks);
-
-  // if we failed to load from the cache
-  m_ShaderCacheDirty = !success;
-
   static const GUID IRenderDoc_uuid = {
       0xa7aa6116, 0x9c8d, 0x4bba, {0x90, 0x83, 0xb4, 0xd8, 0x16, 0xb7, 0x1b, 0x78}};
 
@@ -364,16 +359,7 @@ D3D12ShaderCache::D3D12ShaderCache(WrappedID3D12Device *device)
 
 D3D12ShaderCache::~D3D12ShaderCache()
 {
-  if(m_ShaderCacheDirty)
-  {
-    SaveShaderCache("d3dshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion, m_ShaderCache,
-                    D3D12ShaderCacheCallbacks);
-  }
-  else
-  {
-    for(auto it = m_ShaderCache.begin(); it != m_ShaderCache.end(); ++it)
-      D3D12ShaderCacheCallbacks.Destroy(it->second);
-  }
+  m_ShaderCache.Shutdown(D3D12ShaderCacheCallbacks);
 }
 
 rdcstr D3D12ShaderCache::GetShaderBlob(const char *source, const char *entry,
@@ -384,20 +370,19 @@ rdcstr D3D12ShaderCache::GetShaderBlob(const char *source, const char *entry,
   rdcstr cbuffers = GetEmbeddedResource(hlsl_cbuffers_h);
   rdcstr texsample = GetEmbeddedResource(hlsl_texsample_h);
 
-  uint32_t hash = strhash(source);
-  hash = strhash(entry, hash);
-  hash = strhash(profile, hash);
-  hash = strhash(cbuffers.c_str(), hash);
-  hash = strhash(texsample.c_str(), hash);
+  uint64_t hash = strhash64(source);
+  hash = strhash64(entry, hash);
+  hash = strhash64(profile, hash);
+  hash = strhash64(cbuffers.c_str(), hash);
+  hash = strhash64(texsample.c_str(), hash);
   for(const ShaderCompileFlag &f : compileFlags.flags)
   {
-    hash = strhash(f.name.c_str(), hash);
-    hash = strhash(f.value.c_str(), hash);
+    hash = strhash64(f.name.c_str(), hash);
+    hash = strhash64(f.value.c_str(), hash);
   }
 
-  if(m_ShaderCache.find(hash) != m_ShaderCache.end())
+  if(m_ShaderCache.Find(hash, *srcblob, D3D12ShaderCacheCallbacks))
   {
-    *srcblob = m_ShaderCache[hash];
     (*srcblob)->AddRef();
     return "";
   }
@@ -597,9 +582,8 @@ rdcstr D3D12ShaderCache::GetShaderBlob(const char *source, const char *entry,
 
   if(m_CacheShaders && byteBlob)
   {
-    m_ShaderCache[hash] = byteBlob;
+    m_ShaderCache.Insert(hash, byteBlob, D3D12ShaderCacheCallbacks);
     byteBlob->AddRef();
-    m_ShaderCacheDirty = true;
   }
 
   SAFE_RELEASE(errBlob);
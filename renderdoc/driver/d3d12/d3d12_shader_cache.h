@@ -24,7 +24,7 @@
 
 #pragma once
 
-#include <map>
+#include "common/shader_cache.h"
 #include "driver/dx/official/d3d11_4.h"
 #include "d3d12_common.h"
 
@@ -63,6 +63,6 @@ private:
 
   uint32_t m_CompileFlags = 0;
 
-  bool m_ShaderCacheDirty = false, m_CacheShaders = false;
-  std::map<uint32_t, ID3DBlob *> m_ShaderCache;
+  bool m_CacheShaders = false;
+  ShaderCache<ID3DBlob *> m_ShaderCache;
 };
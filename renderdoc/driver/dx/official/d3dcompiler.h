@@ -322,10 +322,10 @@ D3DReflect(_In_reads_bytes_(SrcDataSize) LPCVOID pSrcData,
 //----------------------------------------------------------------------------
 
 HRESULT WINAPI
-D3DReflectLibrary(__in_bcount(SrcDataSize) LPCVOID pSrcData,
-                  __in SIZE_T SrcDataSize,
-	              __in REFIID riid,
-                  __out LPVOID * ppReflector);
+D3DReflectLibrary(_In_reads_bytes_(SrcDataSize) LPCVOID pSrcData,
+                  _In_ SIZE_T SrcDataSize,
+	              _In_ REFIID riid,
+                  _Out_ LPVOID * ppReflector);
 
 //----------------------------------------------------------------------------
 // D3DDisassemble:
@@ -370,7 +370,7 @@ D3DDisassembleRegion(_In_reads_bytes_(SrcDataSize) LPCVOID pSrcData,
 // Shader linking and Function Linking Graph (FLG) APIs
 //----------------------------------------------------------------------------
 HRESULT WINAPI
-D3DCreateLinker(__out interface ID3D11Linker ** ppLinker);
+D3DCreateLinker(_Out_ interface ID3D11Linker ** ppLinker);
 
 HRESULT WINAPI
 D3DLoadModule(_In_ LPCVOID pSrcData,
@@ -0,0 +1,300 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+// Minimal subset of the Windows SDK types and macros needed to compile the D3D shader headers and
+// the DXBC/DXIL shader libraries on non-Windows platforms. Only what those headers actually use is
+// declared here, this is not a general purpose Win32 compatibility layer.
+
+#pragma once
+
+#if defined(_WIN32)
+#error "This header should only be used on non-Windows platforms"
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef uint64_t QWORD;
+typedef int32_t INT;
+typedef uint32_t UINT;
+typedef int8_t INT8;
+typedef uint8_t UINT8;
+typedef int16_t INT16;
+typedef uint16_t UINT16;
+typedef int32_t INT32;
+typedef uint32_t UINT32;
+typedef int64_t INT64;
+typedef uint64_t UINT64;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef int32_t BOOL;
+typedef BYTE BOOLEAN;
+typedef float FLOAT;
+typedef char CHAR;
+typedef wchar_t WCHAR;
+typedef size_t SIZE_T;
+typedef intptr_t INT_PTR;
+typedef uintptr_t UINT_PTR;
+typedef intptr_t LONG_PTR;
+typedef uintptr_t ULONG_PTR;
+typedef int32_t HRESULT;
+
+typedef void VOID;
+typedef void *PVOID;
+typedef void *LPVOID;
+typedef const void *LPCVOID;
+typedef char *LPSTR;
+typedef const char *LPCSTR;
+typedef WCHAR *LPWSTR;
+typedef const WCHAR *LPCWSTR;
+typedef WCHAR *BSTR;
+typedef const WCHAR *LPCOLESTR;
+
+typedef void *HANDLE;
+typedef void *HMODULE;
+typedef struct HWND__ *HWND;
+typedef void *HMONITOR;
+typedef void *HDC;
+typedef void *RPC_IF_HANDLE;
+
+typedef union _LARGE_INTEGER
+{
+  struct
+  {
+    DWORD LowPart;
+    LONG HighPart;
+  } u;
+  LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct _LUID
+{
+  DWORD LowPart;
+  LONG HighPart;
+} LUID;
+
+typedef struct tagRECT
+{
+  LONG left;
+  LONG top;
+  LONG right;
+  LONG bottom;
+} RECT;
+
+typedef struct tagPOINT
+{
+  LONG x;
+  LONG y;
+} POINT;
+
+typedef struct _SECURITY_ATTRIBUTES SECURITY_ATTRIBUTES;
+
+#ifndef GUID_DEFINED
+#define GUID_DEFINED
+typedef struct _GUID
+{
+  uint32_t Data1;
+  uint16_t Data2;
+  uint16_t Data3;
+  uint8_t Data4[8];
+} GUID;
+#endif
+
+typedef GUID IID;
+typedef GUID CLSID;
+typedef const GUID &REFGUID;
+typedef const IID &REFIID;
+typedef const CLSID &REFCLSID;
+
+inline bool operator==(const GUID &a, const GUID &b)
+{
+  return memcmp(&a, &b, sizeof(GUID)) == 0;
+}
+
+inline bool operator!=(const GUID &a, const GUID &b)
+{
+  return !(a == b);
+}
+
+#define TRUE 1
+#define FALSE 0
+
+#define S_OK ((HRESULT)0L)
+#define S_FALSE ((HRESULT)1L)
+#define E_FAIL ((HRESULT)0x80004005L)
+#define E_INVALIDARG ((HRESULT)0x80070057L)
+#define E_NOINTERFACE ((HRESULT)0x80004002L)
+#define E_NOTIMPL ((HRESULT)0x80004001L)
+#define E_OUTOFMEMORY ((HRESULT)0x8007000EL)
+#define E_POINTER ((HRESULT)0x80004003L)
+
+#define _stricmp strcasecmp
+
+#define SUCCEEDED(hr) (((HRESULT)(hr)) >= 0)
+#define FAILED(hr) (((HRESULT)(hr)) < 0)
+
+#define WINAPI
+#define APIENTRY
+#define CALLBACK
+#define __stdcall
+#define __cdecl
+#define STDMETHODCALLTYPE
+#define STDMETHODVCALLTYPE
+#define STDAPICALLTYPE
+#define __declspec(x)
+#define DECLSPEC_UUID(x)
+#define DECLSPEC_NOVTABLE
+#define DECLSPEC_SELECTANY
+#define DECLSPEC_XFGVIRT(base, func)
+#define BEGIN_INTERFACE
+#define END_INTERFACE
+#define CONST const
+#define PURE = 0
+#define THIS_
+#define THIS void
+
+#ifdef __cplusplus
+#define EXTERN_C extern "C"
+#else
+#define EXTERN_C extern
+#endif
+
+#define interface struct
+#define MIDL_INTERFACE(x) struct
+#define STDMETHOD(method) virtual HRESULT STDMETHODCALLTYPE method
+#define STDMETHOD_(type, method) virtual type STDMETHODCALLTYPE method
+#define STDAPI EXTERN_C HRESULT STDAPICALLTYPE
+#define STDAPI_(type) EXTERN_C type STDAPICALLTYPE
+#define DECLARE_INTERFACE(iface) interface iface
+#define DECLARE_INTERFACE_(iface, baseiface) interface iface : public baseiface
+
+// GUIDs declared by the headers are never referenced by the shader libraries, so only a
+// declaration is emitted.
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) EXTERN_C const GUID name
+
+#define __RPCNDR_H_VERSION__ 500
+#define __REQUIRED_RPCNDR_H_VERSION__ 500
+#define COM_NO_WINDOWS_H
+
+// SAL annotations used by the D3D headers
+#define _In_
+#define _In_z_
+#define _In_opt_
+#define _In_opt_z_
+#define _In_bytecount_(s)
+#define _In_range_(lb, ub)
+#define _In_reads_(s)
+#define _In_reads_opt_(s)
+#define _In_reads_bytes_(s)
+#define _In_reads_bytes_opt_(s)
+#define _In_count_(s)
+#define _In_opt_count_(s)
+#define _Out_
+#define _Out_opt_
+#define _Out_writes_(s)
+#define _Out_writes_opt_(s)
+#define _Out_writes_all_(s)
+#define _Out_writes_all_opt_(s)
+#define _Out_writes_bytes_(s)
+#define _Out_writes_bytes_opt_(s)
+#define _Out_writes_bytes_to_(s, c)
+#define _Out_writes_to_opt_(s, c)
+#define _Inout_
+#define _Inout_opt_
+#define _Inout_opt_bytecount_(s)
+#define _Inout_updates_bytes_(s)
+#define _Outptr_
+#define _Outptr_opt_
+#define _Outptr_result_maybenull_
+#define _Outptr_opt_result_maybenull_
+#define _Outptr_opt_result_z_
+#define _Outptr_result_nullonfailure_
+#define _Outptr_result_bytebuffer_(s)
+#define _Outptr_opt_result_bytebuffer_(s)
+#define _COM_Outptr_
+#define _COM_Outptr_opt_
+#define _COM_Outptr_opt_result_maybenull_
+#define _COM_Outptr_result_maybenull_
+#define _Maybenull_
+#define _Field_size_(s)
+#define _Field_size_opt_(s)
+#define _Field_size_full_(s)
+#define _Field_size_full_opt_(s)
+#define _Field_size_bytes_full_(s)
+#define _Field_size_bytes_full_opt_(s)
+#define _Always_(x)
+#define _Inexpressible_(x)
+#define _Return_type_success_(x)
+#define _Check_return_
+#define _Success_(x)
+#define _Null_terminated_
+#define _Ret_maybenull_
+
+inline unsigned char BitScanForward(DWORD *index, DWORD mask)
+{
+  if(mask == 0)
+    return 0;
+  *index = (DWORD)__builtin_ctz(mask);
+  return 1;
+}
+
+inline unsigned char BitScanReverse(DWORD *index, DWORD mask)
+{
+  if(mask == 0)
+    return 0;
+  *index = 31 - (DWORD)__builtin_clz(mask);
+  return 1;
+}
+
+inline unsigned char _BitScanForward(unsigned long *index, unsigned long mask)
+{
+  if(mask == 0)
+    return 0;
+  *index = (unsigned long)__builtin_ctzl(mask);
+  return 1;
+}
+
+inline unsigned char _BitScanReverse(unsigned long *index, unsigned long mask)
+{
+  if(mask == 0)
+    return 0;
+  *index = sizeof(unsigned long) * 8 - 1 - (unsigned long)__builtin_clzl(mask);
+  return 1;
+}
+
+#ifdef __cplusplus
+struct IUnknown
+{
+  virtual HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void **ppvObject) = 0;
+  virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+  virtual ULONG STDMETHODCALLTYPE Release() = 0;
+};
+#endif
@@ -25,10 +25,12 @@
 
 #include "gl_driver.h"
 #include <algorithm>
+#include <memory>
 #include "common/common.h"
 #include "core/settings.h"
 #include "driver/shaders/spirv/spirv_compile.h"
 #include "jpeg-compressor/jpge.h"
+#include "serialise/lazy_chunks.h"
 #include "serialise/rdcfile.h"
 #include "strings/string_utils.h"
 #include "gl_replay.h"
@@ -954,6 +956,9 @@ WrappedOpenGL::~WrappedOpenGL()
 
   SAFE_DELETE(m_FrameReader);
 
+  if(m_LazyChunks)
+    m_LazyChunks->Release();
+
   SAFE_DELETE(m_StoredStructuredData);
 
   GetResourceManager()->ClearReferencedResources();
@@ -2348,7 +2353,7 @@ bool WrappedOpenGL::EndFrameCapture(DeviceOwnedWindow devWnd)
       SectionProperties props;
 
       // Compress with LZ4 so that it's fast
-      props.flags = SectionFlags::LZ4Compressed;
+      props.flags = SectionFlags::LZ4Compressed | SectionFlags::IndexedBlocks;
       props.version = m_SectionVersion;
       props.type = SectionType::FrameCapture;
 
@@ -2360,11 +2365,16 @@ bool WrappedOpenGL::EndFrameCapture(DeviceOwnedWindow devWnd)
     }
 
     uint64_t captureSectionSize = 0;
+    rdcarray<ChunkIndexEntry> chunkIndex;
+    // callstacks of the chunks written into this capture, which refer to them by index
+    CallstackTable callstacks;
 
     {
       WriteSerialiser ser(captureWriter, Ownership::Stream);
 
       ser.SetChunkMetadataRecording(m_ScratchSerialiser.GetChunkMetadataRecording());
+      ser.SetChunkIndexRecording(true);
+      ser.SetCallstackTable(&callstacks);
 
       ser.SetUserData(GetResourceManager());
 
@@ -2415,7 +2425,7 @@ bool WrappedOpenGL::EndFrameCapture(DeviceOwnedWindow devWnd)
       {
         RDCDEBUG("Accumulating context resource list");
 
-        std::map<int64_t, Chunk *> recordlist;
+        SortedChunkList recordlist;
         m_ContextRecord->Insert(recordlist);
 
         for(auto it = m_ContextData.begin(); it != m_ContextData.end(); ++it)
@@ -2434,25 +2444,35 @@ bool WrappedOpenGL::EndFrameCapture(DeviceOwnedWindow devWnd)
 
         RDCDEBUG("Flushing %u records to file serialiser", (uint32_t)recordlist.size());
 
+        recordlist.Sort();
+
         float num = float(recordlist.size());
         float idx = 0.0f;
 
-        for(auto it = recordlist.begin(); it != recordlist.end(); ++it)
+        for(Chunk *chunk : recordlist)
         {
           RenderDoc::Inst().SetProgress(CaptureProgress::SerialiseFrameContents, idx / num);
           idx += 1.0f;
-          it->second->Write(ser);
+          chunk->Write(ser);
         }
 
         RDCDEBUG("Done");
       }
 
       captureSectionSize = captureWriter->GetOffset();
+
+      chunkIndex.swap(ser.GetChunkIndex());
     }
 
     RDCLOG("Captured GL frame with %f MB capture section in %f seconds",
            double(captureSectionSize) / (1024.0 * 1024.0), m_CaptureTimer.GetMilliseconds() / 1000.0);
 
+    if(rdc)
+    {
+      rdc->WriteChunkIndex(chunkIndex);
+      rdc->WriteCallstackTable(callstacks);
+    }
+
     RenderDoc::Inst().FinishCaptureWriting(rdc, m_CapturedFrames.back().frameNumber);
 
     m_State = CaptureState::BackgroundCapturing;
@@ -3380,6 +3400,59 @@ void WrappedOpenGL::AddResourceInitChunk(GLResource res)
   }
 }
 
+// placeholder chunks can outlive the driver that loaded them, so they're read by a separate
+// structured exporting instance owned by the processor
+struct GLLazyChunkExporter
+{
+  GLLazyChunkExporter(uint64_t sectionVersion) : device(platform)
+  {
+    device.SetStructuredExport(sectionVersion);
+  }
+
+  GLDummyPlatform platform;
+  WrappedOpenGL device;
+};
+
+static LazyChunkSource::ChunkProcessor MakeLazyChunkProcessor(uint64_t sectionVersion)
+{
+  std::shared_ptr<GLLazyChunkExporter> exporter;
+
+  return [exporter, sectionVersion](ReadSerialiser &ser) mutable {
+    if(!exporter)
+      exporter.reset(new GLLazyChunkExporter(sectionVersion));
+
+    return exporter->device.ProcessLazyChunk(ser);
+  };
+}
+
+bool WrappedOpenGL::ProcessLazyChunk(ReadSerialiser &ser)
+{
+  ser.SetStringDatabase(&m_StringDB);
+  ser.SetUserData(GetResourceManager());
+  ser.SetVersion(m_SectionVersion);
+
+  // chunk metadata was already converted when the placeholder was created
+  ser.ConfigureStructuredExport(&GetChunkName, false, 0, 1.0);
+
+  SDFile *prevFile = m_StructuredFile;
+  m_StructuredFile = &ser.GetStructuredFile();
+
+  GLChunk context = ser.ReadChunk<GLChunk>();
+
+  bool success = true;
+
+  if((SystemChunk)context == SystemChunk::CaptureBegin)
+    Serialise_BeginCaptureFrame(ser);
+  else
+    success = ProcessChunk(ser, context);
+
+  ser.EndChunk();
+
+  m_StructuredFile = prevFile;
+
+  return success && !ser.IsErrored();
+}
+
 RDResult WrappedOpenGL::ReadLogInitialisation(RDCFile *rdc, bool storeStructuredBuffers)
 {
   int sectionIdx = rdc->SectionIndex(SectionType::FrameCapture);
@@ -3415,6 +3488,19 @@ RDResult WrappedOpenGL::ReadLogInitialisation(RDCFile *rdc, bool storeStructured
 
   ser.ConfigureStructuredExport(&GetChunkName, storeStructuredBuffers, m_TimeBase, m_TimeFrequency);
 
+  rdc->GetCallstackTable(m_Callstacks);
+  ser.SetCallstackTable(&m_Callstacks);
+
+  // chunks are read again for structured data on demand, so buffers would be lost
+  if(IsLoading(m_State) && !storeStructuredBuffers)
+  {
+    m_LazyChunks =
+        LazyChunkSource::Create(rdc, sectionIdx, MakeLazyChunkProcessor(m_SectionVersion));
+
+    if(m_LazyChunks)
+      ser.ConfigureLazyStructuredExport(m_LazyChunks, 0);
+  }
+
   m_StructuredFile = &ser.GetStructuredFile();
 
   m_StoredStructuredData->version = m_StructuredFile->version = m_SectionVersion;
@@ -3474,6 +3560,7 @@ RDResult WrappedOpenGL::ReadLogInitialisation(RDCFile *rdc, bool storeStructured
       // read the remaining data into memory and pass to immediate context
       frameDataSize = reader->GetSize() - reader->GetOffset();
 
+      m_FrameReaderOffset = reader->GetOffset();
       m_FrameReader = new StreamReader(reader, frameDataSize);
 
       rdcarray<DebugMessage> savedDebugMessages;
@@ -5192,6 +5279,10 @@ RDResult WrappedOpenGL::ContextReplayLog(CaptureState readType, uint32_t startEv
   {
     ser.ConfigureStructuredExport(&GetChunkName, IsStructuredExporting(m_State), m_TimeBase,
                                   m_TimeFrequency);
+    ser.SetCallstackTable(&m_Callstacks);
+
+    if(m_LazyChunks && IsLoading(m_State))
+      ser.ConfigureLazyStructuredExport(m_LazyChunks, m_FrameReaderOffset);
 
     ser.GetStructuredFile().Swap(*m_StructuredFile);
 
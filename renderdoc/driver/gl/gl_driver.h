@@ -29,6 +29,7 @@
 #include "common/timing.h"
 #include "core/core.h"
 #include "driver/shaders/spirv/spirv_reflect.h"
+#include "serialise/callstack_table.h"
 #include "gl_common.h"
 #include "gl_dispatch_table.h"
 #include "gl_manager.h"
@@ -178,8 +179,15 @@ private:
 
   WriteSerialiser m_ScratchSerialiser;
   std::set<rdcstr> m_StringDB;
+  // callstacks that chunks in the capture refer to by index
+  CallstackTable m_Callstacks;
 
   StreamReader *m_FrameReader = NULL;
+  // offset in the capture section that m_FrameReader starts from
+  uint64_t m_FrameReaderOffset = 0;
+
+  // when loading with lazy structured data this backs the placeholder chunks. Can be NULL
+  LazyChunkSource *m_LazyChunks = NULL;
 
   static std::map<uint64_t, GLWindowingData> m_ActiveContexts;
 
@@ -671,6 +679,8 @@ public:
   void Initialise(GLInitParams &params, uint64_t sectionVersion, const ReplayOptions &opts);
   void ReplayLog(uint32_t startEventID, uint32_t endEventID, ReplayLogType replayType);
   RDResult ReadLogInitialisation(RDCFile *rdc, bool storeStructuredBuffers);
+  // read a single chunk into structured data while structured exporting, for lazy structured data
+  bool ProcessLazyChunk(ReadSerialiser &ser);
 
   GLuint GetFakeVAO0() { return m_Global_VAO0; }
   GLuint GetCurrentDefaultFBO() { return m_CurrentDefaultFBO; }
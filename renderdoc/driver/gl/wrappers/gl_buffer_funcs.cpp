@@ -423,7 +423,7 @@ bool WrappedOpenGL::Serialise_glNamedBufferStorageEXT(SerialiserType &ser, GLuin
   SERIALISE_ELEMENT_LOCAL(buffer, BufferRes(GetCtx(), bufferHandle));
 
   SERIALISE_ELEMENT_LOCAL(bytesize, (uint64_t)size);
-  SERIALISE_ELEMENT_ARRAY(data, bytesize);
+  SERIALISE_ELEMENT_ARRAY_VIEW(data, bytesize);
 
   if(ser.IsWriting())
   {
@@ -575,7 +575,7 @@ bool WrappedOpenGL::Serialise_glNamedBufferDataEXT(SerialiserType &ser, GLuint b
   SERIALISE_ELEMENT_LOCAL(buffer, BufferRes(GetCtx(), bufferHandle));
 
   SERIALISE_ELEMENT_LOCAL(bytesize, (uint64_t)size);
-  SERIALISE_ELEMENT_ARRAY(data, bytesize);
+  SERIALISE_ELEMENT_ARRAY_VIEW(data, bytesize);
 
   if(ser.IsWriting())
   {
@@ -961,7 +961,7 @@ bool WrappedOpenGL::Serialise_glNamedBufferSubDataEXT(SerialiserType &ser, GLuin
   SERIALISE_ELEMENT_LOCAL(offset, (uint64_t)offsetPtr).OffsetOrSize();
 
   SERIALISE_ELEMENT_LOCAL(bytesize, (uint64_t)size).OffsetOrSize();
-  SERIALISE_ELEMENT_ARRAY(data, bytesize).Important();
+  SERIALISE_ELEMENT_ARRAY_VIEW(data, bytesize).Important();
 
   SERIALISE_CHECK_READ_ERRORS();
 
@@ -3070,19 +3070,26 @@ void WrappedOpenGL::PersistentMapMemoryBarrier(const std::set<GLResourceRecord *
 
     if(record->Map.ptr)
     {
-      size_t diffStart = 0, diffEnd = record->Map.length;
-      bool found = true;
+      DiffRange ranges[16];
+      size_t numRanges = 1;
 
+      ranges[0].start = 0;
+      ranges[0].end = (size_t)record->Map.length;
+
+      // each changed range is flushed separately, so that a few small writes far apart don't cause
+      // the whole buffer to be serialised.
       if(record->GetShadowPtr(0))
-        found = FindDiffRange(record->GetShadowPtr(0), record->Map.ptr, (size_t)record->Map.length,
-                              diffStart, diffEnd);
+        numRanges = FindDiffRanges(record->GetShadowPtr(0), record->Map.ptr,
+                                   (size_t)record->Map.length, ranges, ARRAY_COUNT(ranges));
+
+      if(numRanges > 0 && record->GetShadowPtr(0) == NULL)
+        record->AllocShadowStorage(record->Map.length);
 
-      if(found && diffEnd > diffStart)
+      for(size_t r = 0; r < numRanges; r++)
       {
-        // update the modified region in the 'comparison' shadow buffer for next check
-        if(record->GetShadowPtr(0) == NULL)
-          record->AllocShadowStorage(record->Map.length);
+        size_t diffStart = ranges[r].start, diffEnd = ranges[r].end;
 
+        // update the modified region in the 'comparison' shadow buffer for next check
         memcpy(record->GetShadowPtr(0) + diffStart, record->Map.ptr + diffStart, diffEnd - diffStart);
 
         // we use our own flush function so it will serialise chunks when necessary, and it
@@ -673,7 +673,7 @@ bool WrappedMTLDevice::EndFrameCapture(DeviceOwnedWindow devWnd)
     SectionProperties props;
 
     // Compress with LZ4 so that it's fast
-    props.flags = SectionFlags::LZ4Compressed;
+    props.flags = SectionFlags::LZ4Compressed | SectionFlags::IndexedBlocks;
     props.version = m_SectionVersion;
     props.type = SectionType::FrameCapture;
 
@@ -685,11 +685,13 @@ bool WrappedMTLDevice::EndFrameCapture(DeviceOwnedWindow devWnd)
   }
 
   uint64_t captureSectionSize = 0;
+  rdcarray<ChunkIndexEntry> chunkIndex;
 
   {
     WriteSerialiser ser(captureWriter, Ownership::Stream);
 
     ser.SetChunkMetadataRecording(GetThreadSerialiser().GetChunkMetadataRecording());
+    ser.SetChunkIndexRecording(true);
     ser.SetUserData(GetResourceManager());
 
     {
@@ -723,7 +725,7 @@ bool WrappedMTLDevice::EndFrameCapture(DeviceOwnedWindow devWnd)
     // nothing will be pushed to the vector
 
     {
-      std::map<int64_t, Chunk *> recordlist;
+      SortedChunkList recordlist;
       size_t countCmdBuffers = m_CaptureCommandBuffersSubmitted.size();
       // ensure all command buffer records within the frame even if recorded before
       // serialised order must be preserved
@@ -740,22 +742,29 @@ bool WrappedMTLDevice::EndFrameCapture(DeviceOwnedWindow devWnd)
       RDCDEBUG("Adding %zu/%zu frame capture chunks to file serialiser",
                recordlist.size() - prevSize, recordlist.size());
 
+      recordlist.Sort();
+
       float num = float(recordlist.size());
       float idx = 0.0f;
 
-      for(auto it = recordlist.begin(); it != recordlist.end(); ++it)
+      for(Chunk *chunk : recordlist)
       {
         RenderDoc::Inst().SetProgress(CaptureProgress::SerialiseFrameContents, idx / num);
         idx += 1.0f;
-        it->second->Write(ser);
+        chunk->Write(ser);
       }
     }
     captureSectionSize = captureWriter->GetOffset();
+
+    chunkIndex.swap(ser.GetChunkIndex());
   }
 
   RDCLOG("Captured Metal frame with %f MB capture section in %f seconds",
          double(captureSectionSize) / (1024.0 * 1024.0), m_CaptureTimer.GetMilliseconds() / 1000.0);
 
+  if(rdc)
+    rdc->WriteChunkIndex(chunkIndex);
+
   RenderDoc::Inst().FinishCaptureWriting(rdc, m_CapturedFrames.back().frameNumber);
 
   // delete tracked cmd buffers - had to keep them alive until after serialiser flush.
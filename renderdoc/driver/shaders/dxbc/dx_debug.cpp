@@ -23,6 +23,8 @@
  ******************************************************************************/
 
 #include "dx_debug.h"
+#include <math.h>
+#include "common/common.h"
 #include "common/formatting.h"
 #include "dxbc_common.h"
 
@@ -24,16 +24,18 @@
 
 #pragma once
 
+#include "api/replay/shader_types.h"
+
 namespace DXBC
 {
-enum ResourceRetType;
+enum ResourceRetType : uint8_t;
 enum class InterpolationMode : uint8_t;
 };
 
 namespace DXBCBytecode
 {
-enum ResourceDimension;
-enum SamplerMode;
+enum ResourceDimension : uint8_t;
+enum SamplerMode : uint32_t;
 };
 
 namespace DXDebug
@@ -523,7 +523,7 @@ enum MinimumPrecision : uint8_t
   NUM_PRECISIONS,
 };
 
-enum SamplerMode
+enum SamplerMode : uint32_t
 {
   SAMPLER_MODE_DEFAULT = 0,
   SAMPLER_MODE_COMPARISON,
@@ -1148,8 +1148,6 @@ public:
   static D3D_PRIMITIVE_TOPOLOGY GetOutputTopology(const byte *bytes, size_t length);
 
 protected:
-  friend class Program;
-
   Program(const rdcarray<uint32_t> &words);
   void DecodeProgram();
   rdcarray<uint32_t> EncodeProgram();
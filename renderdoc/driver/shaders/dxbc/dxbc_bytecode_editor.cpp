@@ -416,7 +416,8 @@ Edit::ResourceIdentifier ProgramEditor::DeclareUAV(const ResourceDecl &desc, uin
 
 };    // namespace DXBCBytecode
 
-#if ENABLED(ENABLE_UNIT_TESTS)
+// these tests compile their shaders with fxc, which is only available on windows
+#if ENABLED(ENABLE_UNIT_TESTS) && ENABLED(RDOC_WIN32)
 
 #include "catch/catch.hpp"
 
@@ -28,6 +28,8 @@
 #include "os/os_specific.h"
 #include "strings/string_utils.h"
 
+#if ENABLED(RDOC_WIN32)
+
 static HMODULE GetLocalD3DCompiler()
 {
   rdcstr dllFile;
@@ -80,3 +82,13 @@ HMODULE GetD3DCompiler()
 
   return ret;
 }
+
+#else
+
+HMODULE GetD3DCompiler()
+{
+  // there is no d3dcompiler available on other platforms
+  return NULL;
+}
+
+#endif
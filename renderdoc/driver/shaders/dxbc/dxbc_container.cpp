@@ -24,6 +24,7 @@
  ******************************************************************************/
 
 #include "dxbc_container.h"
+#include <ctype.h>
 #include <algorithm>
 #include "api/app/renderdoc_app.h"
 #include "common/common.h"
@@ -335,7 +336,7 @@ rdcstr TypeName(CBufferVariableType desc)
 {
   rdcstr ret;
 
-  char *type = "";
+  const char *type = "";
   switch(desc.varType)
   {
     case VarType::Bool: type = "bool"; break;
@@ -2116,7 +2117,7 @@ DXBCContainer::DXBCContainer(const bytebuf &ByteCode, const rdcstr &debugInfoPat
         for(uint32_t j = 0; j < sign->numElems; j++)
         {
           SigParameter &b = (*sig)[j];
-          if(i != j && a.semanticName == b.semanticName || a.semanticIndex != 0)
+          if((i != j && a.semanticName == b.semanticName) || a.semanticIndex != 0)
           {
             a.needSemanticIndex = true;
             break;
@@ -2328,7 +2329,7 @@ uint32_t DecodeFlags(const ShaderCompileFlags &compileFlags)
 {
   uint32_t ret = 0;
 
-  for(const ShaderCompileFlag flag : compileFlags.flags)
+  for(const ShaderCompileFlag &flag : compileFlags.flags)
   {
     if(flag.name == "@cmdline")
     {
@@ -2369,7 +2370,7 @@ uint32_t DecodeFlags(const ShaderCompileFlags &compileFlags)
 
 rdcstr GetProfile(const ShaderCompileFlags &compileFlags)
 {
-  for(const ShaderCompileFlag flag : compileFlags.flags)
+  for(const ShaderCompileFlag &flag : compileFlags.flags)
   {
     if(flag.name == "@cmdline")
     {
@@ -2478,7 +2479,7 @@ TEST_CASE("Check DXBC hash algorithm", "[dxbc]")
     if(!d3dcompiler)
       return;
 
-    pD3DCompile compileFunc = (pD3DCompile)GetProcAddress(d3dcompiler, "D3DCompile");
+    pD3DCompile compileFunc = (pD3DCompile)Process::GetFunctionAddress(d3dcompiler, "D3DCompile");
 
     if(compileFunc == NULL)
     {
@@ -2583,7 +2584,7 @@ float4 main(float input : INPUT) : SV_Target0
     }
 
     // check that we've tested every length, mod 64.
-    for(int i = 0; i < ARRAY_COUNT(dwordLength); i++)
+    for(size_t i = 0; i < ARRAY_COUNT(dwordLength); i++)
       CHECK(dwordLength[i]);
   }
 
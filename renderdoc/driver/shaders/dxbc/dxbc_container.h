@@ -32,6 +32,7 @@
 #include "api/replay/rdcstr.h"
 #include "common/common.h"
 #include "driver/dx/official/d3dcommon.h"
+#include "os/os_specific.h"
 #include "dxbc_common.h"
 
 namespace DXBC
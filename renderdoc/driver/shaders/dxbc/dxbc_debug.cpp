@@ -24,14 +24,20 @@
  ******************************************************************************/
 
 #include "dxbc_debug.h"
+#include <ctype.h>
+#include <math.h>
 #include <algorithm>
 #include "common/formatting.h"
-#include "driver/dxgi/dxgi_common.h"
 #include "maths/formatpacking.h"
 #include "replay/replay_driver.h"
 #include "dxbc_bytecode.h"
 #include "dxbc_container.h"
 
+// the DXGI helpers are only built alongside the D3D drivers
+#if ENABLED(RDOC_WIN32)
+#include "driver/dxgi/dxgi_common.h"
+#endif
+
 using namespace DXBCBytecode;
 using namespace DXDebug;
 
@@ -1076,9 +1082,22 @@ ThreadState::ThreadState(int workgroupIdx, GlobalState &globalState, const DXBC:
   program->SetupRegisterFile(variables);
 }
 
+void ThreadState::UpdateSnapshot(ThreadState &snapshot)
+{
+  for(const rdcpair<uint32_t, uint32_t> &reg : writtenRegisters)
+  {
+    if(reg.second == ~0U)
+      snapshot.variables[reg.first] = variables[reg.first];
+    else
+      snapshot.variables[reg.first].members[reg.second] = variables[reg.first].members[reg.second];
+  }
+
+  writtenRegisters.clear();
+}
+
 bool ThreadState::Finished() const
 {
-  return program && (done || nextInstruction >= (int)program->GetNumInstructions());
+  return program && (done || nextInstruction >= program->GetNumInstructions());
 }
 
 ShaderEvents ThreadState::AssignValue(ShaderVariable &dst, uint32_t dstIndex,
@@ -1111,6 +1130,7 @@ void ThreadState::SetDst(ShaderDebugState *state, const Operand &dstoper, const
                          const ShaderVariable &val)
 {
   ShaderVariable *v = NULL;
+  uint32_t regIndex = ~0U, elemIndex = ~0U;
 
   uint32_t indices[4] = {0};
 
@@ -1145,7 +1165,10 @@ void ThreadState::SetDst(ShaderDebugState *state, const Operand &dstoper, const
       uint32_t idx = program->GetRegisterIndex(dstoper.type, indices[0]);
 
       if(idx < variables.size())
+      {
         v = &variables[idx];
+        regIndex = idx;
+      }
       break;
     }
     case TYPE_INPUT:
@@ -1178,7 +1201,10 @@ void ThreadState::SetDst(ShaderDebugState *state, const Operand &dstoper, const
     {
       RDCASSERT(indices[1] < (uint32_t)v->members.size(), indices[1], v->members.size());
       if(indices[1] < (uint32_t)v->members.size())
+      {
         v = &v->members[indices[1]];
+        elemIndex = indices[1];
+      }
     }
   }
 
@@ -1206,7 +1232,12 @@ void ThreadState::SetDst(ShaderDebugState *state, const Operand &dstoper, const
   if(op.saturate())
     right = sat(right, OperationType(op.operation));
 
-  ShaderVariableChange change = {*changeVar};
+  ShaderVariableChange change;
+  if(state)
+    change.before = *changeVar;
+
+  if(trackWrites)
+    writtenRegisters.push_back({regIndex, elemIndex});
 
   ShaderEvents flags = ShaderEvents::NoEvent;
 
@@ -4070,7 +4101,7 @@ void ThreadState::StepNext(ShaderDebugState *state, DebugAPIWrapper *apiWrapper,
         // break out (jump to next endloop/endswitch)
         int depth = 1;
 
-        for(; nextInstruction < (int)program->GetNumInstructions(); nextInstruction++)
+        for(; nextInstruction < program->GetNumInstructions(); nextInstruction++)
         {
           if(program->GetInstruction(nextInstruction).operation == OPCODE_LOOP ||
              program->GetInstruction(nextInstruction).operation == OPCODE_SWITCH)
@@ -4110,7 +4141,7 @@ void ThreadState::StepNext(ShaderDebugState *state, DebugAPIWrapper *apiWrapper,
         // skip back one to the if that we're processing
         nextInstruction--;
 
-        for(; nextInstruction < (int)program->GetNumInstructions(); nextInstruction++)
+        for(; nextInstruction < program->GetNumInstructions(); nextInstruction++)
         {
           if(program->GetInstruction(nextInstruction).operation == OPCODE_IF)
             depth++;
@@ -4141,7 +4172,7 @@ void ThreadState::StepNext(ShaderDebugState *state, DebugAPIWrapper *apiWrapper,
       // next endif)
       int depth = 1;
 
-      for(; nextInstruction < (int)program->GetNumInstructions(); nextInstruction++)
+      for(; nextInstruction < program->GetNumInstructions(); nextInstruction++)
       {
         if(program->GetInstruction(nextInstruction).operation == OPCODE_IF)
           depth++;
@@ -4666,6 +4697,7 @@ void ApplyAllDerivatives(GlobalState &global, rdcarray<ThreadState> &quad, int d
   }
 }
 
+#if ENABLED(RDOC_WIN32)
 void FillViewFmt(DXGI_FORMAT format, GlobalState::ViewFmt &viewFmt)
 {
   if(format != DXGI_FORMAT_UNKNOWN)
@@ -4682,6 +4714,7 @@ void FillViewFmt(DXGI_FORMAT format, GlobalState::ViewFmt &viewFmt)
       viewFmt.byteWidth = 10;
   }
 }
+#endif
 
 void LookupSRVFormatFromShaderReflection(const DXBC::Reflection &reflection,
                                          const BindingSlot &slot, GlobalState::ViewFmt &viewFmt)
@@ -5225,7 +5258,20 @@ rdcarray<ShaderDebugState> InterpretDebugger::ContinueDebug(DXBCDebug::DebugAPIW
     steps++;
   }
 
-  rdcarray<DXBCDebug::ThreadState> oldworkgroup = workgroup;
+  // only pixel shaders have cross-workgroup operations (derivatives), other stages can read their
+  // own workgroup without needing to preserve any state from before the step
+  const bool needsSnapshot = dxbc->GetDXBCByteCode()->GetShaderType() == DXBC::ShaderType::Pixel;
+
+  // take the snapshot once, on the first continue so that any inputs the driver filled out after
+  // BeginDebug are included. After this only registers written by each step are copied across
+  if(needsSnapshot && prevWorkgroup.empty())
+  {
+    prevWorkgroup = workgroup;
+    for(DXBCDebug::ThreadState &lane : workgroup)
+      lane.TrackWrites();
+  }
+
+  const rdcarray<DXBCDebug::ThreadState> &oldworkgroup = needsSnapshot ? prevWorkgroup : workgroup;
 
   rdcarray<bool> activeMask;
 
@@ -5239,8 +5285,11 @@ rdcarray<ShaderDebugState> InterpretDebugger::ContinueDebug(DXBCDebug::DebugAPIW
     // set up the old workgroup so that cross-workgroup/cross-quad operations (e.g. DDX/DDY) get
     // consistent results even when we step the quad out of order. Otherwise if an operation reads
     // and writes from the same register we'd trash data needed for other workgroup elements.
-    for(size_t i = 0; i < oldworkgroup.size(); i++)
-      oldworkgroup[i].variables = workgroup[i].variables;
+    if(needsSnapshot)
+    {
+      for(size_t i = 0; i < workgroup.size(); i++)
+        workgroup[i].UpdateSnapshot(prevWorkgroup[i]);
+    }
 
     // calculate the current mask of which threads are active
     CalcActiveMask(activeMask);
@@ -5277,6 +5326,8 @@ rdcarray<ShaderDebugState> InterpretDebugger::ContinueDebug(DXBCDebug::DebugAPIW
 
 #include <limits>
 #include "catch/catch.hpp"
+#include "common/timing.h"
+#include "dxbc_bytecode_editor.h"
 
 using namespace DXBCDebug;
 
@@ -5355,4 +5406,133 @@ TEST_CASE("DXBC debugging helpers", "[program]")
   };
 };
 
+// an API wrapper with nothing bound, for headless stepping of shaders that only do ALU work
+class NullDebugAPIWrapper : public DXBCDebug::DebugAPIWrapper
+{
+public:
+  void SetCurrentInstruction(uint32_t instruction) override {}
+  void AddDebugMessage(MessageCategory c, MessageSeverity sv, MessageSource src, rdcstr d) override
+  {
+  }
+
+  void FetchSRV(const BindingSlot &slot) override {}
+  void FetchUAV(const BindingSlot &slot) override {}
+
+  bool CalculateMathIntrinsic(DXBCBytecode::OpcodeType opcode, const ShaderVariable &input,
+                              ShaderVariable &output1, ShaderVariable &output2) override
+  {
+    return false;
+  }
+
+  ShaderVariable GetSampleInfo(DXBCBytecode::OperandType type, bool isAbsoluteResource,
+                               const BindingSlot &slot, const char *opString) override
+  {
+    return ShaderVariable();
+  }
+
+  ShaderVariable GetBufferInfo(DXBCBytecode::OperandType type, const BindingSlot &slot,
+                               const char *opString) override
+  {
+    return ShaderVariable();
+  }
+  ShaderVariable GetResourceInfo(DXBCBytecode::OperandType type, const BindingSlot &slot,
+                                 uint32_t mipLevel, int &dim) override
+  {
+    return ShaderVariable();
+  }
+
+  bool CalculateSampleGather(DXBCBytecode::OpcodeType opcode, SampleGatherResourceData resourceData,
+                             SampleGatherSamplerData samplerData, const ShaderVariable &uvIn,
+                             const ShaderVariable &ddxCalcIn, const ShaderVariable &ddyCalcIn,
+                             const int8_t texelOffsets[3], int multisampleIndex,
+                             float lodOrCompareValue, const uint8_t swizzle[4],
+                             GatherChannel gatherChannel, const char *opString,
+                             ShaderVariable &output) override
+  {
+    return false;
+  }
+};
+
+// build a stripped shader with a long ALU chain over many temps, with derivatives in pixel shaders
+static bytebuf MakeALUShader(DXBC::ShaderType type, uint32_t numTemps, uint32_t numOps)
+{
+  using namespace DXBCBytecode;
+  using namespace DXBCBytecode::Edit;
+
+  // version token with the program type in the upper 16 bits, then length, then just a ret
+  const uint32_t programType = type == DXBC::ShaderType::Pixel ? 0 : 1;
+  const uint32_t tokens[] = {(programType << 16) | 0x50, 3, OPCODE_RET | (1U << 24)};
+
+  bytebuf base =
+      DXBC::DXBCContainer::MakeContainerForChunk(DXBC::FOURCC_SHEX, (const byte *)tokens, 12);
+
+  DXBC::DXBCContainer container(base, rdcstr(), GraphicsAPI::D3D11, ~0U, ~0U);
+
+  bytebuf ret;
+  {
+    ProgramEditor editor(&container, ret);
+
+    for(uint32_t t = 0; t < numTemps; t++)
+      editor.AddTemp();
+
+    for(uint32_t i = 0; i < numOps; i++)
+    {
+      const uint32_t dst = i % numTemps;
+      const uint32_t src = (i + 1) % numTemps;
+
+      if(type == DXBC::ShaderType::Pixel && (i % 8) == 7)
+        editor.InsertOperation(i, oper(OPCODE_DERIV_RTX_COARSE, {temp(dst), temp(src)}));
+      else
+        editor.InsertOperation(i, oper(OPCODE_IADD, {temp(dst), temp(src), imm(1, 2, 3, 4)}));
+    }
+  }
+
+  return ret;
+}
+
+TEST_CASE("Benchmark DXBC debugger stepping", "[.][dxbc][benchmark]")
+{
+  const uint32_t numTemps = 256;
+  const uint32_t numOps = 2000;
+  const uint32_t numRuns = 5;
+
+  NullDebugAPIWrapper apiWrapper;
+
+  for(DXBC::ShaderType type : {DXBC::ShaderType::Pixel, DXBC::ShaderType::Vertex})
+  {
+    bytebuf blob = MakeALUShader(type, numTemps, numOps);
+
+    DXBC::DXBCContainer container(blob, rdcstr(), GraphicsAPI::D3D11, ~0U, ~0U);
+    REQUIRE(container.GetDXBCByteCode());
+
+    ShaderReflection refl;
+    refl.stage = type == DXBC::ShaderType::Pixel ? ShaderStage::Pixel : ShaderStage::Vertex;
+
+    PerformanceTimer timer;
+
+    size_t numStates = 0;
+    for(uint32_t r = 0; r < numRuns; r++)
+    {
+      InterpretDebugger debugger;
+      ShaderDebugTrace *trace = debugger.BeginDebug(&container, refl, 0);
+
+      rdcarray<ShaderDebugState> states;
+      do
+      {
+        states = debugger.ContinueDebug(&apiWrapper);
+        numStates += states.size();
+      } while(!states.empty());
+
+      delete trace;
+    }
+
+    const double ms = timer.GetMilliseconds();
+
+    CHECK(numStates >= numRuns * numOps);
+
+    WARN("Stepped " << numOps << " instruction " << ToStr(refl.stage) << " shader with "
+                    << numTemps << " temps " << numRuns << " times in " << ms << "ms");
+  }
+}
+
 #endif    // ENABLED(ENABLE_UNIT_TESTS)
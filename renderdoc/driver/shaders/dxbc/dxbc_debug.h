@@ -26,6 +26,7 @@
 #pragma once
 
 #include "common/common.h"
+#include "driver/dx/official/dxgiformat.h"
 #include "dx_debug.h"
 #include "dxbc_bytecode.h"
 
@@ -44,7 +45,6 @@ enum OperandType : uint8_t;
 }
 
 class WrappedID3D11Device;
-enum DXGI_FORMAT;
 
 namespace DXBCDebug
 {
@@ -173,7 +173,9 @@ public:
 void FlattenSingleVariable(uint32_t byteOffset, const rdcstr &basename, const ShaderVariable &v,
                            rdcarray<ShaderVariable> &outvars);
 
+#if ENABLED(RDOC_WIN32)
 void FillViewFmt(DXGI_FORMAT format, GlobalState::ViewFmt &viewFmt);
+#endif
 
 void LookupSRVFormatFromShaderReflection(const DXBC::Reflection &reflection,
                                          const BindingSlot &slot, GlobalState::ViewFmt &viewFmt);
@@ -237,11 +239,21 @@ public:
   void StepNext(ShaderDebugState *state, DebugAPIWrapper *apiWrapper,
                 const rdcarray<ThreadState> &prevWorkgroup);
 
+  // start recording which registers are written, so that a snapshot copied from this thread can
+  // be brought up to date with UpdateSnapshot without copying the whole register file
+  void TrackWrites() { trackWrites = true; }
+  void UpdateSnapshot(ThreadState &snapshot);
+
 private:
   // index in the pixel quad
   int workgroupIndex;
   bool done;
 
+  // registers written since the last UpdateSnapshot, as the register index and the element index
+  // for indexable temps (or ~0U if the whole register was written)
+  bool trackWrites = false;
+  rdcarray<rdcpair<uint32_t, uint32_t>> writtenRegisters;
+
   // validates assignment for generation of non-normal values
   ShaderEvents AssignValue(ShaderVariable &dst, uint32_t dstIndex, const ShaderVariable &src,
                            uint32_t srcIndex, bool flushDenorm);
@@ -283,6 +295,10 @@ struct InterpretDebugger : public DXBCContainerDebugger
 
   rdcarray<ThreadState> workgroup;
 
+  // the workgroup as of the start of the current step, for cross-quad operations. Only needed
+  // for pixel shaders, and updated with just the registers written in each step
+  rdcarray<ThreadState> prevWorkgroup;
+
   // convenience for access to active lane
   ThreadState &activeLane() { return workgroup[activeLaneIndex]; }
   int activeLaneIndex = 0;
@@ -27,7 +27,20 @@
 #include "common/formatting.h"
 #include "dxbc_container.h"
 
+#if ENABLED(RDOC_WIN32)
 #include "official/cvinfo.h"
+#else
+// cvinfo.h assumes the LLP64 data model where long is 32-bit, and MSVC's sized integer keywords
+#define long int
+#define __int8 char
+#define __int32 int
+#define __int64 int64_t
+#include "official/cvinfo.h"
+#undef long
+#undef __int8
+#undef __int32
+#undef __int64
+#endif
 #include "os/os_specific.h"
 #include "dxbc_spdb.h"
 
@@ -447,7 +460,7 @@ SPDBChunk::SPDBChunk(byte *data, uint32_t spdblength)
                 uint16_t *byteoffset = (uint16_t *)member->offset;
                 char *name = (char *)(byteoffset + 1);
 
-                char *access = "???";
+                const char *access = "???";
 
                 if(member->attr.access == 1)
                   access = "private";
@@ -481,7 +494,7 @@ SPDBChunk::SPDBChunk(byte *data, uint32_t spdblength)
                 char *name = (char *)iter;
                 iter += strlen(name) + 1;
 
-                char *access = "???";
+                const char *access = "???";
 
                 if(method->attr.access == 1)
                   access = "private";
@@ -511,7 +524,7 @@ SPDBChunk::SPDBChunk(byte *data, uint32_t spdblength)
               {
                 lfBClass *binterface = (lfBClass *)iter;
 
-                char *access = "???";
+                const char *access = "???";
 
                 if(binterface->attr.access == 1)
                   access = "private";
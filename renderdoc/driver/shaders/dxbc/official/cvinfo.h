@@ -3035,7 +3035,7 @@ typedef struct CV_PROCFLAGS {
     union {
         unsigned char   bAll;
         unsigned char   grfAll;
-        struct s {
+        struct {
             unsigned char CV_PFLAG_NOFPO     :1; // frame pointer present
             unsigned char CV_PFLAG_INT       :1; // interrupt return
             unsigned char CV_PFLAG_FAR       :1; // far return
@@ -3054,7 +3054,7 @@ typedef struct CV_EXPROCFLAGS {
     CV_PROCFLAGS cvpf;
     union {
         unsigned char   grfAll;
-        struct s {
+        struct {
             unsigned char   __reserved_byte      :8; // must be zero
         };
     };
@@ -30,8 +30,7 @@
 #include "llvm_encoder.h"
 
 typedef HRESULT(WINAPI *pD3DCreateBlob)(SIZE_T Size, ID3DBlob **ppBlob);
-typedef DXC_API_IMPORT HRESULT(__stdcall *pDxcCreateInstance)(REFCLSID rclsid, REFIID riid,
-                                                              LPVOID *ppv);
+typedef HRESULT(__stdcall *pDxcCreateInstance)(REFCLSID rclsid, REFIID riid, LPVOID *ppv);
 
 namespace DXIL
 {
@@ -154,7 +153,7 @@ ProgramEditor::~ProgramEditor()
     DXBC::DXBCContainer::SetRuntimeData(m_OutBlob, m_RDAT);
   }
 
-#if ENABLED(RDOC_DEVEL) && 1
+#if ENABLED(RDOC_DEVEL) && ENABLED(RDOC_WIN32) && 1
   // on debug builds, run through dxil for "validation" if it's available.
   // we need BOTH of htese because dxil.dll's interface is incomplete, it lacks the library
   // functionality that we only need to create blobs
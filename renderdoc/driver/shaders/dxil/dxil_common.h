@@ -24,6 +24,11 @@
 
 #pragma once
 
+#include <stdint.h>
+#include "api/replay/rdcstr.h"
+#include "api/replay/replay_enums.h"
+#include "api/replay/stringise.h"
+
 namespace DXBC
 {
 enum class ShaderType : uint8_t;
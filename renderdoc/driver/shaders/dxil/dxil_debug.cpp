@@ -22,8 +22,6 @@
  * THE SOFTWARE.
  ******************************************************************************/
 
-#pragma once
-
 #include "dxil_debug.h"
 #include "common/formatting.h"
 #include "maths/formatpacking.h"
@@ -1141,19 +1139,25 @@ ThreadState::ThreadState(uint32_t workgroupIndex, Debugger &debugger, const Glob
   m_Semantics.coverage = ~0U;
   m_Semantics.isFrontFace = false;
   m_Semantics.primID = ~0U;
+
+  const uint32_t numSSAIds = debugger.GetNumSSAIds();
+  m_Variables.resize(numSSAIds);
+  m_Scopes.resize(numSSAIds);
+  m_StackAllocs.resize(numSSAIds);
+  m_StackAllocPointers.resize(numSSAIds);
 }
 
 ThreadState::~ThreadState()
 {
-  for(auto it : m_StackAllocs)
-    free(it.second.backingMemory);
+  for(const StackAlloc &alloc : m_StackAllocs)
+    free(alloc.backingMemory);
 }
 
 void ThreadState::InitialiseHelper(const ThreadState &activeState)
 {
   m_Input = activeState.m_Input;
   m_Semantics = activeState.m_Semantics;
-  m_LiveVariables = activeState.m_LiveVariables;
+  m_Variables = activeState.m_Variables;
 }
 
 bool ThreadState::Finished() const
@@ -1177,7 +1181,7 @@ void ThreadState::ProcessScopeChange(const rdcarray<Id> &oldLive, const rdcarray
     if(liveGlobals.contains(id))
       continue;
 
-    m_State->changes.push_back({m_LiveVariables[id]});
+    m_State->changes.push_back({GetNamedVariable(id)});
   }
 
   for(const Id &id : newLive)
@@ -1185,10 +1189,25 @@ void ThreadState::ProcessScopeChange(const rdcarray<Id> &oldLive, const rdcarray
     if(liveGlobals.contains(id))
       continue;
 
-    m_State->changes.push_back({ShaderVariable(), m_LiveVariables[id]});
+    m_State->changes.push_back({ShaderVariable(), GetNamedVariable(id)});
   }
 }
 
+ShaderVariable ThreadState::GetNamedVariable(const Id &id) const
+{
+  ShaderVariable var = m_Variables[id];
+  // resources and the fake output keep their own names
+  if(var.name.empty())
+    var.name = m_Debugger.GetSSAName(id);
+  return var;
+}
+
+void ThreadState::SetScope(const rdcarray<Id> &ids, VariableScope scope)
+{
+  for(const Id &id : ids)
+    m_Scopes[id] = scope;
+}
+
 void ThreadState::EnterFunction(const Function *function, const rdcarray<Value *> &args)
 {
   StackFrame *frame = new StackFrame(function);
@@ -1205,8 +1224,11 @@ void ThreadState::EnterFunction(const Function *function, const rdcarray<Value *
   }
 
   // start with just globals
+  SetScope(m_Live, VariableScope::None);
+  SetScope(m_Dormant, VariableScope::None);
   m_Live = m_Debugger.GetLiveGlobals();
   m_Dormant.clear();
+  SetScope(m_Live, VariableScope::Live);
   m_Block = 0;
   m_PreviousBlock = ~0U;
 
@@ -1250,7 +1272,6 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
   const Type *retType = inst.type;
   // Sensible defaults
   ShaderVariable result;
-  Program::MakeResultId(inst, result.name);
   result.rows = 1;
   result.columns = 1;
   result.type = ConvertDXILTypeToVarType(retType);
@@ -1718,7 +1739,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
             // AnnotateHandle(res,props)
             // CreateHandle(resourceClass,rangeId,index,nonUniformIndex
             // CreateHandleFromBinding(bind,index,nonUniformIndex)
-            rdcstr baseResource = result.name;
+            rdcstr baseResource = m_Debugger.GetSSAName(resultId);
             if(dxOpCode == DXOp::AnnotateHandle)
               baseResource = GetArgumentName(1);
 
@@ -1780,10 +1801,8 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
             uint32_t regIndex = arg.value.u32v[0];
 
             Id handleId = GetArgumentId(1);
-            RDCASSERT(m_Live.contains(handleId));
-            auto itVar = m_LiveVariables.find(handleId);
-            RDCASSERT(itVar != m_LiveVariables.end());
-            result.value = itVar->second.members[regIndex].value;
+            RDCASSERT(m_Scopes[handleId] == VariableScope::Live);
+            result.value = m_Variables[handleId].members[regIndex].value;
 
             // DXIL will create a vector of a single type with total size of 16-bytes
             // The vector element type will change to match what value will be extracted
@@ -1898,6 +1917,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
               result.value.s32v[0] = RDCMIN(a.value.s32v[0], b.value.s32v[0]);
             else if(dxOpCode == DXOp::IMax)
               result.value.s32v[0] = RDCMAX(a.value.s32v[0], b.value.s32v[0]);
+            break;
           }
           case DXOp::UMin:
           case DXOp::UMax:
@@ -2466,7 +2486,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
     {
       // TODO: need helper function to convert DXIL::Type* -> ShaderVariable
       Id src = GetArgumentId(0);
-      const ShaderVariable &srcVal = m_LiveVariables[src];
+      const ShaderVariable &srcVal = m_Variables[src];
       RDCASSERT(srcVal.members.empty());
       // TODO: handle greater than one index
       RDCASSERTEQUAL(inst.args.size(), 2);
@@ -2506,7 +2526,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       // Currently only supporting Stack allocated pointers
       // Load(ptr)
       Id ptrId = GetArgumentId(0);
-      RDCASSERT(m_StackAllocPointers.count(ptrId) == 1);
+      RDCASSERT(m_StackAllocPointers[ptrId].backingMemory);
       ShaderVariable arg;
       RDCASSERT(GetShaderVariable(inst.args[0], opCode, dxOpCode, arg));
       result.value = arg.value;
@@ -2523,22 +2543,18 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       size_t allocSize = 0;
       void *allocMemoryBackingPtr = NULL;
       Id ptrId = GetArgumentId(0);
-      auto itPtr = m_StackAllocPointers.find(ptrId);
-      RDCASSERT(itPtr != m_StackAllocPointers.end());
-
-      const StackAllocPointer &ptr = itPtr->second;
+      const StackAllocPointer &ptr = m_StackAllocPointers[ptrId];
       baseMemoryId = ptr.baseMemoryId;
       baseMemoryBackingPtr = ptr.backingMemory;
 
-      auto itAlloc = m_StackAllocs.find(baseMemoryId);
-      RDCASSERT(itAlloc != m_StackAllocs.end());
-      StackAlloc &alloc = itAlloc->second;
-      allocSize = alloc.size;
-      allocMemoryBackingPtr = alloc.backingMemory;
-
       RDCASSERT(baseMemoryBackingPtr);
       RDCASSERTNOTEQUAL(baseMemoryId, DXILDebug::INVALID_ID);
 
+      const StackAlloc &alloc = m_StackAllocs[baseMemoryId];
+      RDCASSERT(alloc.backingMemory);
+      allocSize = alloc.size;
+      allocMemoryBackingPtr = alloc.backingMemory;
+
       ShaderVariable val;
       RDCASSERT(GetShaderVariable(inst.args[1], opCode, dxOpCode, val));
       RDCASSERTEQUAL(resultId, DXILDebug::INVALID_ID);
@@ -2546,19 +2562,22 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       UpdateBackingMemoryFromVariable(baseMemoryBackingPtr, allocSize, val);
 
       ShaderVariableChange change;
-      change.before = m_LiveVariables[baseMemoryId];
+      if(m_State)
+        change.before = GetNamedVariable(baseMemoryId);
 
       UpdateMemoryVariableFromBackingMemory(baseMemoryId, allocMemoryBackingPtr);
 
       // record the change to the base memory variable
-      change.after = m_LiveVariables[baseMemoryId];
       if(m_State)
+      {
+        change.after = GetNamedVariable(baseMemoryId);
         m_State->changes.push_back(change);
+      }
 
       // Update the ptr variable value
       // Set the result to be the ptr variable which will then be recorded as a change
       resultId = ptrId;
-      result = m_LiveVariables[resultId];
+      result = m_Variables[resultId];
       result.value = val.value;
       break;
     }
@@ -2588,8 +2607,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       // Add the SSA to m_StackAllocs with its backing memory and size
       size_t size = countElems * GetElementByteSize(baseType);
       void *backingMem = malloc(size);
-      StackAlloc &alloc = m_StackAllocs[resultId];
-      alloc = {backingMem, size};
+      m_StackAllocs[resultId] = {backingMem, size};
 
       // For non-array allocs set the backing memory now instead of in GetElementPtr
       m_StackAllocPointers[resultId] = {resultId, backingMem, size};
@@ -2601,8 +2619,8 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       Id ptrId = GetArgumentId(0);
 
       // Only handling stack allocations at the moment
-      RDCASSERT(m_StackAllocs.count(ptrId) == 1);
-      RDCASSERT(m_LiveVariables.count(ptrId) == 1);
+      RDCASSERT(m_StackAllocs[ptrId].backingMemory);
+      RDCASSERT(m_Scopes[ptrId] == VariableScope::Live);
 
       // arg[1..] : indecies 1...N
       rdcarray<uint64_t> indexes;
@@ -2619,7 +2637,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       uint64_t offset = 0;
 
       // TODO: Resolve indexes to a single offset
-      const ShaderVariable &basePtr = m_LiveVariables[ptrId];
+      const ShaderVariable &basePtr = m_Variables[ptrId];
       if(indexes.size() > 1)
         offset += indexes[1] * GetElementByteSize(basePtr.type);
       RDCASSERT(indexes.size() <= 2);
@@ -2633,7 +2651,7 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       size_t size = countElems * GetElementByteSize(baseType);
 
       // Copy from the backing memory to the result
-      StackAlloc &alloc = m_StackAllocs[ptrId];
+      const StackAlloc &alloc = m_StackAllocs[ptrId];
       uint8_t *backingMemory = (uint8_t *)alloc.backingMemory;
 
       result.type = baseType;
@@ -3480,25 +3498,23 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       Id baseMemoryId = DXILDebug::INVALID_ID;
       Id ptrId = GetArgumentId(0);
       {
-        auto itPtr = m_StackAllocPointers.find(ptrId);
-        RDCASSERT(itPtr != m_StackAllocPointers.end());
-
-        const StackAllocPointer &ptr = itPtr->second;
+        const StackAllocPointer &ptr = m_StackAllocPointers[ptrId];
         baseMemoryId = ptr.baseMemoryId;
         baseMemoryBackingPtr = ptr.backingMemory;
-
-        auto itAlloc = m_StackAllocs.find(baseMemoryId);
-        RDCASSERT(itAlloc != m_StackAllocs.end());
-        StackAlloc &alloc = itAlloc->second;
-        allocSize = alloc.size;
-        allocMemoryBackingPtr = alloc.backingMemory;
       }
 
       RDCASSERT(baseMemoryBackingPtr);
       RDCASSERTNOTEQUAL(baseMemoryId, DXILDebug::INVALID_ID);
 
+      {
+        const StackAlloc &alloc = m_StackAllocs[baseMemoryId];
+        RDCASSERT(alloc.backingMemory);
+        allocSize = alloc.size;
+        allocMemoryBackingPtr = alloc.backingMemory;
+      }
+
       RDCASSERTEQUAL(resultId, DXILDebug::INVALID_ID);
-      ShaderVariable a = m_LiveVariables[baseMemoryId];
+      const ShaderVariable &a = m_Variables[baseMemoryId];
 
       ShaderVariable b;
       RDCASSERT(GetShaderVariable(inst.args[1], opCode, dxOpCode, b));
@@ -3601,19 +3617,22 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       UpdateBackingMemoryFromVariable(baseMemoryBackingPtr, allocSize, res);
 
       ShaderVariableChange change;
-      change.before = m_LiveVariables[baseMemoryId];
+      if(m_State)
+        change.before = GetNamedVariable(baseMemoryId);
 
       UpdateMemoryVariableFromBackingMemory(baseMemoryId, allocMemoryBackingPtr);
 
       // record the change to the base memory variable
-      change.after = m_LiveVariables[baseMemoryId];
       if(m_State)
+      {
+        change.after = GetNamedVariable(baseMemoryId);
         m_State->changes.push_back(change);
+      }
 
       // Update the ptr variable value
       // Set the result to be the ptr variable which will then be recorded as a change
       resultId = ptrId;
-      result = m_LiveVariables[resultId];
+      result = m_Variables[resultId];
       result.value = res.value;
       break;
     }
@@ -3624,89 +3643,79 @@ bool ThreadState::ExecuteInstruction(DebugAPIWrapper *apiWrapper,
       break;
   };
 
-  // Remove variables which have gone out of scope
-  rdcarray<Id> liveIdsToRemove;
-  for(const Id &id : m_Live)
+  // Remove variables which have gone out of scope, compacting the live list in place. The values
+  // stay in the register file while they are dormant
+  const InstructionRangePerId &ranges = m_FunctionInfo->rangePerId;
+  size_t countLive = 0;
+  for(size_t i = 0; i < m_Live.size(); ++i)
   {
-    // The fake output variable is always in scope
-    if(id == m_OutputSSAId)
-      continue;
+    const Id id = m_Live[i];
 
-    auto itRange = m_FunctionInfo->rangePerId.find(id);
-    RDCASSERT(itRange != m_FunctionInfo->rangePerId.end());
-    const uint32_t maxInstruction = itRange->second.max;
-    if(m_FunctionInstructionIdx > maxInstruction)
+    // The fake output variable is always in scope
+    if(id != m_OutputSSAId && m_FunctionInstructionIdx > ranges[id].max)
     {
       RDCASSERTNOTEQUAL(id, resultId);
-      liveIdsToRemove.push_back(id);
-      m_DormantVariables[id] = m_LiveVariables[id];
-      if(!m_Dormant.contains(id))
-        m_Dormant.push_back(id);
+      m_Scopes[id] = VariableScope::Dormant;
+      m_Dormant.push_back(id);
 
       if(m_State)
       {
         ShaderVariableChange change;
-        change.before = m_LiveVariables[id];
+        change.before = GetNamedVariable(id);
         m_State->changes.push_back(change);
       }
-
-      m_LiveVariables.erase(id);
+      continue;
     }
+    m_Live[countLive++] = id;
   }
-  for(const Id &id : liveIdsToRemove)
-    m_Live.removeOne(id);
+  m_Live.resize(countLive);
 
   if(!m_Ended)
   {
     const Instruction &nextInst = *m_FunctionInfo->function->instructions[m_FunctionInstructionIdx];
     Id nextResultId = nextInst.slot;
     // Bring back dormant variables which are now in scope
-    rdcarray<Id> dormantIdsToRemove;
-    for(const Id &id : m_Dormant)
+    size_t countDormant = 0;
+    for(size_t i = 0; i < m_Dormant.size(); ++i)
     {
-      auto itRange = m_FunctionInfo->rangePerId.find(id);
-      RDCASSERT(itRange != m_FunctionInfo->rangePerId.end());
-      const uint32_t minInstruction = itRange->second.min;
-      if(m_FunctionInstructionIdx >= minInstruction)
+      const Id id = m_Dormant[i];
+      const InstructionRange &range = ranges[id];
+      if(m_FunctionInstructionIdx >= range.min && m_FunctionInstructionIdx <= range.max)
       {
-        const uint32_t maxInstruction = itRange->second.max;
-        if(m_FunctionInstructionIdx <= maxInstruction)
-        {
-          dormantIdsToRemove.push_back(id);
-          m_LiveVariables[id] = m_DormantVariables[id];
-          m_DormantVariables.erase(id);
+        m_Scopes[id] = VariableScope::Live;
+        m_Live.push_back(id);
 
-          // Do not record the change for the resultId of the next instruction
-          if(m_State && (id != nextResultId))
-          {
-            ShaderVariableChange change;
-            change.after = m_LiveVariables[id];
-            m_State->changes.push_back(change);
-          }
+        // Do not record the change for the resultId of the next instruction
+        if(m_State && (id != nextResultId))
+        {
+          ShaderVariableChange change;
+          change.after = GetNamedVariable(id);
+          m_State->changes.push_back(change);
         }
+        continue;
       }
+      m_Dormant[countDormant++] = id;
     }
-    for(const Id &id : dormantIdsToRemove)
-    {
-      m_Dormant.removeOne(id);
-      if(!m_Live.contains(id))
-        m_Live.push_back(id);
-    }
+    m_Dormant.resize(countDormant);
   }
 
   // Update the result variable after the dormant variables have been brought back
-  RDCASSERT(!(result.name.empty() ^ (resultId == DXILDebug::INVALID_ID)));
-  if(!result.name.empty() && resultId != DXILDebug::INVALID_ID)
+  if(resultId != DXILDebug::INVALID_ID)
   {
     if(recordChange)
       SetResult(resultId, result, opCode, dxOpCode, eventFlags);
 
     // Fake Output results won't be in the referencedIds
-    RDCASSERT(resultId == m_OutputSSAId || m_FunctionInfo->referencedIds.count(resultId) == 1);
+    RDCASSERT(resultId == m_OutputSSAId || m_FunctionInfo->referencedIds[resultId]);
 
-    if(!m_Live.contains(resultId))
+    if(m_Scopes[resultId] != VariableScope::Live)
+    {
+      if(m_Scopes[resultId] == VariableScope::Dormant)
+        m_Dormant.removeOne(resultId);
+      m_Scopes[resultId] = VariableScope::Live;
       m_Live.push_back(resultId);
-    m_LiveVariables[resultId] = result;
+    }
+    m_Variables[resultId] = result;
   }
 
   return true;
@@ -3837,9 +3846,8 @@ bool ThreadState::GetShaderVariable(const DXIL::Value *dxilValue, Operation op,
 
 bool ThreadState::GetVariable(const Id &id, Operation op, DXOp dxOpCode, ShaderVariable &var) const
 {
-  RDCASSERT(m_Live.contains(id));
-  RDCASSERTEQUAL(m_LiveVariables.count(id), 1);
-  var = m_LiveVariables.at(id);
+  RDCASSERT(m_Scopes[id] == VariableScope::Live);
+  var = m_Variables[id];
 
   bool flushDenorm = OperationFlushing(op, dxOpCode);
   if(var.type == VarType::Double)
@@ -3867,8 +3875,11 @@ void ThreadState::SetResult(const Id &id, ShaderVariable &result, Operation op,
   {
     ShaderVariableChange change;
     m_State->flags |= flags;
-    change.before = m_LiveVariables[id];
+    if(m_Scopes[id] == VariableScope::Live)
+      change.before = GetNamedVariable(id);
     change.after = result;
+    if(change.after.name.empty())
+      change.after.name = m_Debugger.GetSSAName(id);
     m_State->changes.push_back(change);
   }
 }
@@ -3930,7 +3941,7 @@ void ThreadState::UpdateBackingMemoryFromVariable(void *ptr, size_t allocSize,
 
 void ThreadState::UpdateMemoryVariableFromBackingMemory(Id memoryId, const void *ptr)
 {
-  ShaderVariable &baseMemory = m_LiveVariables[memoryId];
+  ShaderVariable &baseMemory = m_Variables[memoryId];
   // Memory copy from backing memory to base memory variable
   size_t elementSize = GetElementByteSize(baseMemory.type);
   const uint8_t *src = (const uint8_t *)ptr;
@@ -5385,6 +5396,13 @@ ShaderDebugTrace *Debugger::BeginDebug(uint32_t eventId, const DXBC::DXBCContain
   DXIL::Program *program = ((DXIL::Program *)m_Program);
   program->BuildReflection();
 
+  // One register per SSA Id, plus the fake output variable which uses the next free Id
+  m_NumSSAIds = m_Program->m_NextSSAId + 1;
+  m_SSAInstructions.clear();
+  m_SSAInstructions.resize(m_NumSSAIds);
+  m_SSANames.clear();
+  m_SSANames.resize(m_NumSSAIds);
+
   ShaderDebugTrace *ret = new ShaderDebugTrace;
   ret->stage = shaderStage;
 
@@ -5538,6 +5556,10 @@ ShaderDebugTrace *Debugger::BeginDebug(uint32_t eventId, const DXBC::DXBCContain
 
       ReferencedIds &ssaRefs = info.referencedIds;
       InstructionRangePerId &ssaRange = info.rangePerId;
+      ssaRefs.resize(m_NumSSAIds);
+      ssaRange.resize(m_NumSSAIds);
+      uint32_t countRefs = 0;
+      uint32_t countRanges = 0;
 
       for(uint32_t i = 0; i < countInstructions; ++i)
       {
@@ -5552,24 +5574,21 @@ ShaderDebugTrace *Debugger::BeginDebug(uint32_t eventId, const DXBC::DXBCContain
           if(resultId != DXILDebug::INVALID_ID)
           {
             // The result SSA should not have been referenced before
-            RDCASSERTEQUAL(ssaRefs.count(resultId), 0);
-            ssaRefs.insert(resultId);
+            RDCASSERT(!ssaRefs[resultId]);
+            ssaRefs[resultId] = true;
+            countRefs++;
+            m_SSAInstructions[resultId] = &inst;
 
             // For assignment track maximum and minimum (as current instruction plus one)
-            auto itRange = ssaRange.find(resultId);
-            if(itRange == ssaRange.end())
-            {
-              ssaRange[resultId] = {i + 1, maxInst};
-            }
-            else
-            {
-              itRange->second.min = RDCMIN(i + 1, itRange->second.min);
-              itRange->second.max = RDCMAX(maxInst, itRange->second.max);
-            }
+            InstructionRange &range = ssaRange[resultId];
+            if(range.min == ~0U)
+              countRanges++;
+            range.min = RDCMIN(i + 1, range.min);
+            range.max = RDCMAX(maxInst, range.max);
 
             // Stack allocations last until the end of the function
             if(inst.op == Operation::Alloca)
-              itRange->second.max = countInstructions;
+              range.max = countInstructions;
           }
         }
         // Track min and max when SSA is referenced
@@ -5583,29 +5602,27 @@ ShaderDebugTrace *Debugger::BeginDebug(uint32_t eventId, const DXBC::DXBCContain
             // Add GlobalVar args to the SSA refs (they won't be the result of an instruction)
             if(cast<GlobalVar>(arg))
             {
-              if(ssaRefs.count(argId) == 0)
-                ssaRefs.insert(argId);
+              if(!ssaRefs[argId])
+              {
+                ssaRefs[argId] = true;
+                countRefs++;
+              }
             }
             if(!isPhiNode)
             {
               // For non phi-nodes the argument SSA should already exist as the result of a previous operation
-              RDCASSERTEQUAL(ssaRefs.count(argId), 1);
-            }
-            auto itRange = ssaRange.find(argId);
-            if(itRange == ssaRange.end())
-            {
-              ssaRange[argId] = {i, maxInst};
-            }
-            else
-            {
-              itRange->second.min = RDCMIN(i, itRange->second.min);
-              itRange->second.max = RDCMAX(maxInst, itRange->second.max);
+              RDCASSERT(ssaRefs[argId]);
             }
+            InstructionRange &range = ssaRange[argId];
+            if(range.min == ~0U)
+              countRanges++;
+            range.min = RDCMIN(i, range.min);
+            range.max = RDCMAX(maxInst, range.max);
           }
         }
       }
       // If these do not match in size that means there is a result SSA that is never read
-      RDCASSERTEQUAL(ssaRefs.size(), ssaRange.size());
+      RDCASSERTEQUAL(countRefs, countRanges);
     }
   }
 
@@ -5956,4 +5973,337 @@ const FunctionInfo *Debugger::GetFunctionInfo(const DXIL::Function *function) co
   RDCASSERT(m_FunctionInfos.count(function) != 0);
   return &m_FunctionInfos.at(function);
 }
+
+const rdcstr &Debugger::GetSSAName(const Id id)
+{
+  rdcstr &name = m_SSANames[id];
+  if(name.empty() && m_SSAInstructions[id])
+    Program::MakeResultId(*m_SSAInstructions[id], name);
+  return name;
+}
 };    // namespace DXILDebug
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+#include "common/timing.h"
+#include "dxil_bytecode_editor.h"
+
+// an API wrapper with nothing bound, for headless stepping of shaders that don't access resources
+class NullDebugAPIWrapper : public DXILDebug::DebugAPIWrapper
+{
+public:
+  void FetchSRV(const BindingSlot &slot) override {}
+  void FetchUAV(const BindingSlot &slot) override {}
+
+  bool CalculateMathIntrinsic(DXIL::DXOp dxOp, const ShaderVariable &input,
+                              ShaderVariable &output) override
+  {
+    return false;
+  }
+  bool CalculateSampleGather(DXIL::DXOp dxOp, SampleGatherResourceData resourceData,
+                             SampleGatherSamplerData samplerData, const ShaderVariable &uv,
+                             const ShaderVariable &ddxCalc, const ShaderVariable &ddyCalc,
+                             const int8_t texelOffsets[3], int multisampleIndex, float lodValue,
+                             float compareValue, const uint8_t swizzle[4],
+                             GatherChannel gatherChannel, DXBC::ShaderType shaderType,
+                             uint32_t instructionIdx, const char *opString,
+                             ShaderVariable &output) override
+  {
+    return false;
+  }
+  ShaderVariable GetResourceInfo(DXIL::ResourceClass resClass, const DXDebug::BindingSlot &slot,
+                                 uint32_t mipLevel, const DXBC::ShaderType shaderType,
+                                 int &dim) override
+  {
+    return ShaderVariable();
+  }
+  ShaderVariable GetSampleInfo(DXIL::ResourceClass resClass, const DXDebug::BindingSlot &slot,
+                               const DXBC::ShaderType shaderType, const char *opString) override
+  {
+    return ShaderVariable();
+  }
+  ShaderVariable GetRenderTargetSampleInfo(const DXBC::ShaderType shaderType,
+                                           const char *opString) override
+  {
+    return ShaderVariable();
+  }
+  bool IsResourceBound(DXIL::ResourceClass resClass, const DXDebug::BindingSlot &slot) override
+  {
+    return false;
+  }
+};
+
+// a fixed recorded vertex shader which writes constants to SV_Position, as we can't compile
+// shaders with dxc here. Tests extend it with the instructions they need using ProgramEditor
+static bytebuf GetConstantPositionVS()
+{
+  bytebuf dxil = {
+      0x44, 0x58, 0x42, 0x43, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0xef, 0x05, 0x00, 0x00, 0x06, 0x00,
+      0x00, 0x00, 0x38, 0x00, 0x00, 0x00, 0x48, 0x00, 0x00, 0x00, 0x7f, 0x00, 0x00, 0x00, 0xbb,
+      0x00, 0x00, 0x00, 0x37, 0x01, 0x00, 0x00, 0x53, 0x01, 0x00, 0x00, 0x53, 0x46, 0x49, 0x30,
+      0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x49, 0x53, 0x47,
+      0x31, 0x2f, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x28, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x49, 0x4e, 0x50, 0x55, 0x54, 0x41, 0x00, 0x4f, 0x53, 0x47, 0x31, 0x34, 0x00, 0x00, 0x00,
+      0x01, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x28, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x0f, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x53, 0x56, 0x5f, 0x50, 0x6f,
+      0x73, 0x69, 0x74, 0x69, 0x6f, 0x6e, 0x00, 0x50, 0x53, 0x56, 0x30, 0x74, 0x00, 0x00, 0x00,
+      0x24, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0x01, 0x00,
+      0x00, 0x00, 0x01, 0x01, 0x00, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08,
+      0x00, 0x00, 0x00, 0x00, 0x49, 0x4e, 0x50, 0x55, 0x54, 0x41, 0x00, 0x01, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x01, 0x00, 0x41, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x01, 0x00, 0x44, 0x03, 0x03, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x48, 0x41, 0x53, 0x48,
+      0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x22, 0x28, 0x08, 0x8c, 0xa0, 0xf5, 0x45,
+      0x32, 0x63, 0x6a, 0x19, 0x1b, 0xa0, 0xf6, 0xc4, 0x76, 0x44, 0x58, 0x49, 0x4c, 0x94, 0x04,
+      0x00, 0x00, 0x60, 0x00, 0x01, 0x00, 0x25, 0x01, 0x00, 0x00, 0x44, 0x58, 0x49, 0x4c, 0x00,
+      0x01, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0x7c, 0x04, 0x00, 0x00, 0x42, 0x43, 0xc0, 0xde,
+      0x21, 0x0c, 0x00, 0x00, 0x1c, 0x01, 0x00, 0x00, 0x0b, 0x82, 0x20, 0x00, 0x02, 0x00, 0x00,
+      0x00, 0x13, 0x00, 0x00, 0x00, 0x07, 0x81, 0x23, 0x91, 0x41, 0xc8, 0x04, 0x49, 0x06, 0x10,
+      0x32, 0x39, 0x92, 0x01, 0x84, 0x0c, 0x25, 0x05, 0x08, 0x19, 0x1e, 0x04, 0x8b, 0x62, 0x80,
+      0x10, 0x45, 0x02, 0x42, 0x92, 0x0b, 0x42, 0x84, 0x10, 0x32, 0x14, 0x38, 0x08, 0x18, 0x4b,
+      0x0a, 0x32, 0x42, 0x88, 0x48, 0x90, 0x14, 0x20, 0x43, 0x46, 0x88, 0xa5, 0x00, 0x19, 0x32,
+      0x42, 0xe4, 0x48, 0x0e, 0x90, 0x11, 0x22, 0xc4, 0x50, 0x41, 0x51, 0x81, 0x8c, 0xe1, 0x83,
+      0xe5, 0x8a, 0x04, 0x21, 0x46, 0x06, 0x51, 0x18, 0x00, 0x00, 0x03, 0x00, 0x00, 0x00, 0x1b,
+      0x88, 0xe0, 0xff, 0xff, 0xff, 0xff, 0x07, 0x40, 0x02, 0x00, 0x00, 0x49, 0x18, 0x00, 0x00,
+      0x01, 0x00, 0x00, 0x00, 0x13, 0x82, 0x00, 0x00, 0x89, 0x20, 0x00, 0x00, 0x0e, 0x00, 0x00,
+      0x00, 0x32, 0x22, 0x08, 0x09, 0x20, 0x64, 0x85, 0x04, 0x13, 0x22, 0xa4, 0x84, 0x04, 0x13,
+      0x22, 0xe3, 0x84, 0xa1, 0x90, 0x14, 0x12, 0x4c, 0x88, 0x8c, 0x0b, 0x84, 0x84, 0x4c, 0x10,
+      0x28, 0x23, 0x00, 0x25, 0x00, 0x8a, 0x39, 0x02, 0x30, 0x98, 0x23, 0x40, 0x66, 0x00, 0x8a,
+      0x01, 0x33, 0x43, 0x45, 0x36, 0x10, 0x90, 0x03, 0x03, 0x00, 0x00, 0x00, 0x13, 0x14, 0x72,
+      0xc0, 0x87, 0x74, 0x60, 0x87, 0x36, 0x68, 0x87, 0x79, 0x68, 0x03, 0x72, 0xc0, 0x87, 0x0d,
+      0xaf, 0x50, 0x0e, 0x6d, 0xd0, 0x0e, 0x7a, 0x50, 0x0e, 0x6d, 0x00, 0x0f, 0x7a, 0x30, 0x07,
+      0x72, 0xa0, 0x07, 0x73, 0x20, 0x07, 0x6d, 0x90, 0x0e, 0x71, 0xa0, 0x07, 0x73, 0x20, 0x07,
+      0x6d, 0x90, 0x0e, 0x78, 0xa0, 0x07, 0x73, 0x20, 0x07, 0x6d, 0x90, 0x0e, 0x71, 0x60, 0x07,
+      0x7a, 0x30, 0x07, 0x72, 0xd0, 0x06, 0xe9, 0x30, 0x07, 0x72, 0xa0, 0x07, 0x73, 0x20, 0x07,
+      0x6d, 0x90, 0x0e, 0x76, 0x40, 0x07, 0x7a, 0x60, 0x07, 0x74, 0xd0, 0x06, 0xe6, 0x10, 0x07,
+      0x76, 0xa0, 0x07, 0x73, 0x20, 0x07, 0x6d, 0x60, 0x0e, 0x73, 0x20, 0x07, 0x7a, 0x30, 0x07,
+      0x72, 0xd0, 0x06, 0xe6, 0x60, 0x07, 0x74, 0xa0, 0x07, 0x76, 0x40, 0x07, 0x6d, 0xe0, 0x0e,
+      0x78, 0xa0, 0x07, 0x71, 0x60, 0x07, 0x7a, 0x30, 0x07, 0x72, 0xa0, 0x07, 0x76, 0x40, 0x07,
+      0x43, 0x9e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x86, 0x3c,
+      0x06, 0x10, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x64, 0x81, 0x00, 0x00,
+      0x0b, 0x00, 0x00, 0x00, 0x32, 0x1e, 0x98, 0x10, 0x19, 0x11, 0x4c, 0x90, 0x8c, 0x09, 0x26,
+      0x47, 0xc6, 0x04, 0x43, 0x9a, 0x12, 0x18, 0x01, 0x28, 0x85, 0x62, 0x28, 0x83, 0xf2, 0x20,
+      0x2a, 0x89, 0x11, 0x80, 0x12, 0x28, 0x83, 0x42, 0xa0, 0x1c, 0x6b, 0x08, 0x08, 0x00, 0x00,
+      0x00, 0x00, 0x00, 0x79, 0x18, 0x00, 0x00, 0x45, 0x00, 0x00, 0x00, 0x1a, 0x03, 0x4c, 0x90,
+      0x46, 0x02, 0x13, 0x44, 0x35, 0x18, 0x63, 0x0b, 0x73, 0x3b, 0x03, 0xb1, 0x2b, 0x93, 0x9b,
+      0x4b, 0x7b, 0x73, 0x03, 0x99, 0x71, 0xb9, 0x01, 0x41, 0xa1, 0x0b, 0x3b, 0x9b, 0x7b, 0x91,
+      0x2a, 0x62, 0x2a, 0x0a, 0x9a, 0x2a, 0xfa, 0x9a, 0xb9, 0x81, 0x79, 0x31, 0x4b, 0x73, 0x0b,
+      0x63, 0x4b, 0xd9, 0x10, 0x04, 0x13, 0x84, 0x41, 0x98, 0x20, 0x0c, 0xc3, 0x06, 0x61, 0x20,
+      0x26, 0x08, 0x03, 0xb1, 0x41, 0x18, 0x0c, 0x0a, 0x76, 0x73, 0x13, 0x84, 0xa1, 0xd8, 0x30,
+      0x20, 0x09, 0x31, 0x41, 0x48, 0x9a, 0x0d, 0xc1, 0x32, 0x41, 0x10, 0x00, 0x12, 0x6d, 0x61,
+      0x69, 0x6e, 0x34, 0x92, 0x9c, 0xa0, 0xaa, 0xa8, 0x82, 0x26, 0x08, 0x04, 0x32, 0x41, 0x20,
+      0x92, 0x0d, 0x01, 0x31, 0x41, 0x20, 0x94, 0x0d, 0x0b, 0xf1, 0x40, 0x91, 0x14, 0x0d, 0x13,
+      0x11, 0x01, 0x1b, 0x02, 0x8a, 0xcb, 0x94, 0xd5, 0x17, 0xd4, 0xdb, 0x5c, 0x1a, 0x5d, 0xda,
+      0x9b, 0xdb, 0x04, 0x81, 0x58, 0x26, 0x08, 0x04, 0x33, 0x41, 0x18, 0x8c, 0x09, 0xc2, 0x70,
+      0x6c, 0x10, 0x32, 0x6d, 0xc3, 0x42, 0x58, 0xd0, 0x25, 0x61, 0x03, 0x46, 0x44, 0xdb, 0x86,
+      0x80, 0xdb, 0x30, 0x54, 0x1d, 0xb0, 0xa1, 0x68, 0x1c, 0x0f, 0x00, 0xaa, 0xb0, 0xb1, 0xd9,
+      0xb5, 0xb9, 0xa4, 0x91, 0x95, 0xb9, 0xd1, 0x4d, 0x09, 0x82, 0x2a, 0x64, 0x78, 0x2e, 0x76,
+      0x65, 0x72, 0x73, 0x69, 0x6f, 0x6e, 0x53, 0x02, 0xa2, 0x09, 0x19, 0x9e, 0x8b, 0x5d, 0x18,
+      0x9b, 0x5d, 0x99, 0xdc, 0x94, 0xc0, 0xa8, 0x43, 0x86, 0xe7, 0x32, 0x87, 0x16, 0x46, 0x56,
+      0x26, 0xd7, 0xf4, 0x46, 0x56, 0xc6, 0x36, 0x25, 0x48, 0xea, 0x90, 0xe1, 0xb9, 0xd8, 0xa5,
+      0x95, 0xdd, 0x25, 0x91, 0x4d, 0xd1, 0x85, 0xd1, 0x95, 0x4d, 0x09, 0x96, 0x3a, 0x64, 0x78,
+      0x2e, 0x65, 0x6e, 0x74, 0x72, 0x79, 0x50, 0x6f, 0x69, 0x6e, 0x74, 0x73, 0x53, 0x02, 0x0f,
+      0x00, 0x00, 0x79, 0x18, 0x00, 0x00, 0x4c, 0x00, 0x00, 0x00, 0x33, 0x08, 0x80, 0x1c, 0xc4,
+      0xe1, 0x1c, 0x66, 0x14, 0x01, 0x3d, 0x88, 0x43, 0x38, 0x84, 0xc3, 0x8c, 0x42, 0x80, 0x07,
+      0x79, 0x78, 0x07, 0x73, 0x98, 0x71, 0x0c, 0xe6, 0x00, 0x0f, 0xed, 0x10, 0x0e, 0xf4, 0x80,
+      0x0e, 0x33, 0x0c, 0x42, 0x1e, 0xc2, 0xc1, 0x1d, 0xce, 0xa1, 0x1c, 0x66, 0x30, 0x05, 0x3d,
+      0x88, 0x43, 0x38, 0x84, 0x83, 0x1b, 0xcc, 0x03, 0x3d, 0xc8, 0x43, 0x3d, 0x8c, 0x03, 0x3d,
+      0xcc, 0x78, 0x8c, 0x74, 0x70, 0x07, 0x7b, 0x08, 0x07, 0x79, 0x48, 0x87, 0x70, 0x70, 0x07,
+      0x7a, 0x70, 0x03, 0x76, 0x78, 0x87, 0x70, 0x20, 0x87, 0x19, 0xcc, 0x11, 0x0e, 0xec, 0x90,
+      0x0e, 0xe1, 0x30, 0x0f, 0x6e, 0x30, 0x0f, 0xe3, 0xf0, 0x0e, 0xf0, 0x50, 0x0e, 0x33, 0x10,
+      0xc4, 0x1d, 0xde, 0x21, 0x1c, 0xd8, 0x21, 0x1d, 0xc2, 0x61, 0x1e, 0x66, 0x30, 0x89, 0x3b,
+      0xbc, 0x83, 0x3b, 0xd0, 0x43, 0x39, 0xb4, 0x03, 0x3c, 0xbc, 0x83, 0x3c, 0x84, 0x03, 0x3b,
+      0xcc, 0xf0, 0x14, 0x76, 0x60, 0x07, 0x7b, 0x68, 0x07, 0x37, 0x68, 0x87, 0x72, 0x68, 0x07,
+      0x37, 0x80, 0x87, 0x70, 0x90, 0x87, 0x70, 0x60, 0x07, 0x76, 0x28, 0x07, 0x76, 0xf8, 0x05,
+      0x76, 0x78, 0x87, 0x77, 0x80, 0x87, 0x5f, 0x08, 0x87, 0x71, 0x18, 0x87, 0x72, 0x98, 0x87,
+      0x79, 0x98, 0x81, 0x2c, 0xee, 0xf0, 0x0e, 0xee, 0xe0, 0x0e, 0xf5, 0xc0, 0x0e, 0xec, 0x30,
+      0x03, 0x62, 0xc8, 0xa1, 0x1c, 0xe4, 0xa1, 0x1c, 0xcc, 0xa1, 0x1c, 0xe4, 0xa1, 0x1c, 0xdc,
+      0x61, 0x1c, 0xca, 0x21, 0x1c, 0xc4, 0x81, 0x1d, 0xca, 0x61, 0x06, 0xd6, 0x90, 0x43, 0x39,
+      0xc8, 0x43, 0x39, 0x98, 0x43, 0x39, 0xc8, 0x43, 0x39, 0xb8, 0xc3, 0x38, 0x94, 0x43, 0x38,
+      0x88, 0x03, 0x3b, 0x94, 0xc3, 0x2f, 0xbc, 0x83, 0x3c, 0xfc, 0x82, 0x3b, 0xd4, 0x03, 0x3b,
+      0xb0, 0xc3, 0x0c, 0xc4, 0x21, 0x07, 0x7c, 0x70, 0x03, 0x7a, 0x28, 0x87, 0x76, 0x80, 0x87,
+      0x19, 0xd1, 0x43, 0x0e, 0xf8, 0xe0, 0x06, 0xe4, 0x20, 0x0e, 0xe7, 0xe0, 0x06, 0xf6, 0x10,
+      0x0e, 0xf2, 0xc0, 0x0e, 0xe1, 0x90, 0x0f, 0xef, 0x50, 0x0f, 0xf4, 0x00, 0x00, 0x00, 0x71,
+      0x20, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x16, 0x50, 0x0d, 0x97, 0xef, 0x3c, 0xbe, 0x34,
+      0x39, 0x11, 0x81, 0x52, 0xd3, 0x43, 0x4d, 0x7e, 0x71, 0xdb, 0x06, 0x40, 0x30, 0x00, 0xd2,
+      0x00, 0x61, 0x20, 0x00, 0x00, 0x18, 0x00, 0x00, 0x00, 0x13, 0x04, 0x41, 0x2c, 0x10, 0x00,
+      0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x44, 0x45, 0x40, 0x35, 0x46, 0x00, 0x82, 0x20, 0x88,
+      0x7f, 0x63, 0x04, 0x20, 0x08, 0x82, 0x20, 0x18, 0x8c, 0x11, 0x80, 0x20, 0x08, 0x92, 0x60,
+      0x30, 0x46, 0x00, 0x82, 0x20, 0x88, 0x82, 0x01, 0x00, 0x00, 0x00, 0x00, 0x23, 0x06, 0x09,
+      0x00, 0x82, 0x60, 0x60, 0x48, 0x0f, 0x04, 0x29, 0xc4, 0x88, 0x41, 0x02, 0x80, 0x20, 0x18,
+      0x18, 0xd2, 0x03, 0x41, 0xc9, 0x30, 0x62, 0x90, 0x00, 0x20, 0x08, 0x06, 0x86, 0xf4, 0x40,
+      0x50, 0x21, 0x8c, 0x18, 0x24, 0x00, 0x08, 0x82, 0x81, 0x21, 0x3d, 0x10, 0x84, 0x04, 0x08,
+      0x00, 0x00, 0x00, 0x00,
+  };
+
+  DXBC::DXBCContainer::HashContainer(dxil.data(), dxil.size());
+
+  return dxil;
+}
+
+static ShaderReflection GetConstantPositionVSReflection()
+{
+  ShaderReflection refl;
+  refl.stage = ShaderStage::Vertex;
+  refl.entryPoint = "main";
+  return refl;
+}
+
+TEST_CASE("DXIL debugger and disassembly of integer and float ops", "[dxil]")
+{
+  bytebuf patched;
+  {
+    DXBC::DXBCContainer container(GetConstantPositionVS(), rdcstr(), GraphicsAPI::D3D12, ~0U, ~0U);
+
+    DXIL::ProgramEditor editor(&container, patched);
+
+    DXIL::Function *f = editor.GetFunctionByName("main");
+    REQUIRE(f);
+
+    const DXIL::Type *i32 = editor.GetInt32Type();
+    const DXIL::Type *i8 = editor.GetInt8Type();
+    const DXIL::Type *i1 = editor.GetBoolType();
+
+    const DXIL::Function *binary =
+        editor.DeclareFunction("dx.op.binary.i32", i32, {i32, i32, i32},
+                               DXIL::Attribute::NoUnwind | DXIL::Attribute::ReadNone);
+
+    // -5 and 3, which order differently when compared as signed or unsigned
+    DXIL::Value *neg = editor.CreateConstant(0xFFFFFFFBU);
+    DXIL::Value *pos = editor.CreateConstant(3U);
+    DXIL::Value *fl = f->instructions[0]->args[4];
+
+    // insert before the ret
+    size_t idx = f->instructions.size() - 1;
+    editor.InsertInstruction(f, idx++,
+                             editor.CreateInstruction(binary, DXIL::DXOp::IMin, {neg, pos}));
+    editor.InsertInstruction(f, idx++,
+                             editor.CreateInstruction(binary, DXIL::DXOp::IMax, {neg, pos}));
+    editor.InsertInstruction(f, idx++,
+                             editor.CreateInstruction(DXIL::Operation::Trunc, i8, {neg}));
+    editor.InsertInstruction(
+        f, idx++, editor.CreateInstruction(DXIL::Operation::FUnordEqual, i1, {fl, fl}));
+  }
+
+  DXBC::DXBCContainer container(patched, rdcstr(), GraphicsAPI::D3D12, ~0U, ~0U);
+  REQUIRE(container.GetDXILByteCode());
+
+  SECTION("Disassembly")
+  {
+    rdcstr disasm = container.GetDisassembly(false);
+
+    CHECK(disasm.contains("truncate "));
+    CHECK(!disasm.contains("truncate zero extend"));
+    CHECK(disasm.contains(" == "));
+  };
+
+  SECTION("Signed min and max")
+  {
+    // as when debugging on replay, disassemble first so that the SSA ids are settled
+    container.GetDisassembly(false);
+
+    ShaderReflection refl = GetConstantPositionVSReflection();
+
+    DXILDebug::Debugger debugger;
+    ShaderDebugTrace *trace = debugger.BeginDebug(0, &container, refl, 0);
+
+    NullDebugAPIWrapper apiWrapper;
+
+    rdcarray<ShaderVariable> results;
+    rdcarray<ShaderDebugState> states;
+    do
+    {
+      states = debugger.ContinueDebug(&apiWrapper);
+      for(const ShaderDebugState &s : states)
+        for(const ShaderVariableChange &c : s.changes)
+          if(c.after.type == VarType::SInt)
+            results.push_back(c.after);
+    } while(!states.empty());
+
+    delete trace;
+
+    // an unsigned comparison would give 3 for the min and -5 for the max
+    REQUIRE(results.size() == 2);
+    CHECK(results[0].value.s32v[0] == -5);
+    CHECK(results[1].value.s32v[0] == 3);
+  };
+}
+
+TEST_CASE("Benchmark DXIL debugger stepping", "[.][dxil][benchmark]")
+{
+  bytebuf dxil = GetConstantPositionVS();
+
+  // lengthen the shader with a long chain of dependent ALU to stand in for a real-world shader, so
+  // that stepping is dominated by the debugger's per-instruction overhead
+  const uint32_t numALU = 2000;
+
+  bytebuf patched;
+  {
+    DXBC::DXBCContainer container(dxil, rdcstr(), GraphicsAPI::D3D12, ~0U, ~0U);
+
+    DXIL::ProgramEditor editor(&container, patched);
+
+    DXIL::Function *f = editor.GetFunctionByName("main");
+    REQUIRE(f);
+
+    // the last instruction is the ret, the ones before store each component of the position
+    DXIL::Instruction *store = f->instructions[f->instructions.size() - 2];
+    DXIL::Value *a = store->args[4];
+    DXIL::Value *b = f->instructions[0]->args[4];
+    const DXIL::Type *floatType = a->type;
+
+    DXIL::Value *v = a;
+    size_t idx = f->instructions.size() - 2;
+    for(uint32_t i = 0; i < numALU; i++)
+    {
+      DXIL::Operation op = (i % 2) ? DXIL::Operation::FAdd : DXIL::Operation::FSub;
+      v = editor.InsertInstruction(f, idx++, editor.CreateInstruction(op, floatType, {v, b}));
+    }
+
+    store->args[4] = v;
+  }
+
+  DXBC::DXBCContainer container(patched, rdcstr(), GraphicsAPI::D3D12, ~0U, ~0U);
+  REQUIRE(container.GetDXILByteCode());
+
+  // as when debugging on replay, disassemble first so that the SSA ids are settled
+  container.GetDisassembly(false);
+
+  ShaderReflection refl = GetConstantPositionVSReflection();
+
+  NullDebugAPIWrapper apiWrapper;
+
+  PerformanceTimer timer;
+
+  const uint32_t numRuns = 20;
+  size_t numStates = 0;
+  for(uint32_t r = 0; r < numRuns; r++)
+  {
+    DXILDebug::Debugger debugger;
+    ShaderDebugTrace *trace = debugger.BeginDebug(0, &container, refl, 0);
+
+    rdcarray<ShaderDebugState> states;
+    do
+    {
+      states = debugger.ContinueDebug(&apiWrapper);
+      numStates += states.size();
+    } while(!states.empty());
+
+    delete trace;
+  }
+
+  const double ms = timer.GetMilliseconds();
+
+  CHECK(numStates >= numRuns * numALU);
+
+  WARN("Stepped " << numALU << " instruction shader " << numRuns << " times in " << ms << "ms");
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -24,7 +24,6 @@
 
 #pragma once
 
-#include <set>
 #include "common/common.h"
 #include "driver/shaders/dxbc/dx_debug.h"
 #include "driver/shaders/dxbc/dxbc_bytecode.h"
@@ -48,13 +47,14 @@ struct GlobalState;
 
 struct InstructionRange
 {
-  uint32_t min;
-  uint32_t max;
+  uint32_t min = ~0U;
+  uint32_t max = 0;
 };
 
 typedef std::map<ShaderBuiltin, ShaderVariable> BuiltinInputs;
-typedef std::set<Id> ReferencedIds;
-typedef std::map<Id, InstructionRange> InstructionRangePerId;
+// Per-function SSA data is stored densely, indexed by SSA Id
+typedef rdcarray<bool> ReferencedIds;
+typedef rdcarray<InstructionRange> InstructionRangePerId;
 
 void GetInterpolationModeForInputParams(const rdcarray<SigParameter> &stageInputSig,
                                         const DXIL::Program *program,
@@ -129,6 +129,14 @@ public:
 
 struct ThreadState
 {
+  // The scope of each SSA Id, mirrors membership of m_Live and m_Dormant
+  enum class VariableScope : uint8_t
+  {
+    None,
+    Live,
+    Dormant,
+  };
+
   ThreadState(uint32_t workgroupIndex, Debugger &debugger, const GlobalState &globalState);
   ~ThreadState();
 
@@ -165,20 +173,22 @@ struct ThreadState
                   const rdcarray<ThreadState> &quad, const Id &id) const;
 
   void ProcessScopeChange(const rdcarray<Id> &oldLive, const rdcarray<Id> &newLive);
+  ShaderVariable GetNamedVariable(const Id &id) const;
+  void SetScope(const rdcarray<Id> &ids, VariableScope scope);
 
   void InitialiseHelper(const ThreadState &activeState);
 
   struct StackAlloc
   {
-    void *backingMemory;
-    size_t size;
+    void *backingMemory = NULL;
+    size_t size = 0;
   };
 
   struct StackAllocPointer
   {
-    Id baseMemoryId;
-    void *backingMemory;
-    size_t size;
+    Id baseMemoryId = INVALID_ID;
+    void *backingMemory = NULL;
+    size_t size = 0;
   };
 
   struct
@@ -199,10 +209,11 @@ struct ThreadState
   ShaderVariable m_Output;
   uint32_t m_OutputSSAId = ~0U;
 
-  // Known active SSA ShaderVariables
-  std::map<Id, ShaderVariable> m_LiveVariables;
-  // Known dormant SSA ShaderVariables
-  std::map<Id, ShaderVariable> m_DormantVariables;
+  // SSA ShaderVariables indexed by Id, pre-sized to the number of SSA Ids in the program.
+  // Variables are stored unnamed, names are only resolved when recording changes
+  rdcarray<ShaderVariable> m_Variables;
+  // The scope of each SSA Id, indexed by Id
+  rdcarray<VariableScope> m_Scopes;
   // Live variables at the current scope
   rdcarray<Id> m_Live;
   // Dormant variables at the current scope
@@ -214,8 +225,9 @@ struct ThreadState
   // Track stack allocations
   // A single global stack, do not bother popping when leaving functions
   size_t m_StackAllocTop = 0;
-  std::map<Id, StackAlloc> m_StackAllocs;
-  std::map<Id, StackAllocPointer> m_StackAllocPointers;
+  // Both indexed by SSA Id, entries with NULL backing memory are not stack allocations
+  rdcarray<StackAlloc> m_StackAllocs;
+  rdcarray<StackAllocPointer> m_StackAllocPointers;
 
   // The instruction index within the current function
   uint32_t m_FunctionInstructionIdx = ~0U;
@@ -416,9 +428,11 @@ public:
   static rdcstr GetResourceReferenceName(const DXIL::Program *program, DXIL::ResourceClass resClass,
                                          const BindingSlot &slot);
   const DXIL::Program &GetProgram() const { return *m_Program; }
-  const DXBC::DXBCContainer *const GetDXBCContainer() { return m_DXBC; }
+  const DXBC::DXBCContainer *GetDXBCContainer() { return m_DXBC; }
   uint32_t GetEventId() { return m_EventId; }
   const FunctionInfo *GetFunctionInfo(const DXIL::Function *function) const;
+  uint32_t GetNumSSAIds() const { return m_NumSSAIds; }
+  const rdcstr &GetSSAName(const Id id);
 
 private:
   void CalcActiveMask(rdcarray<bool> &activeMask);
@@ -426,7 +440,7 @@ private:
   void ParseDbgOpValue(const DXIL::Instruction &inst, uint32_t instructionIndex);
   size_t AddScopedDebugData(const DXIL::Metadata *scopeMD, uint32_t instructionIndex);
   size_t FindScopedDebugDataIndex(const DXIL::Metadata *md) const;
-  size_t Debugger::FindScopedDebugDataIndex(const uint32_t instructionIndex) const;
+  size_t FindScopedDebugDataIndex(const uint32_t instructionIndex) const;
   const TypeData &AddDebugType(const DXIL::Metadata *typeMD);
   void AddLocalVariable(const DXIL::Metadata *localVariableMD, uint32_t instructionIndex,
                         bool isDeclare, int32_t byteOffset, uint32_t countBytes,
@@ -439,6 +453,11 @@ private:
   // the live mutable global variables, to initialise a stack frame's live list
   rdcarray<Id> m_LiveGlobals;
 
+  // SSA names are only needed when recording changes, so they are formatted on first use
+  uint32_t m_NumSSAIds = 0;
+  rdcarray<const DXIL::Instruction *> m_SSAInstructions;
+  rdcarray<rdcstr> m_SSANames;
+
   GlobalState m_GlobalState;
 
   struct DebugInfo
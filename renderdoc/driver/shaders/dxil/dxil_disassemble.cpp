@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  ******************************************************************************/
 
+#include <ctype.h>
 #include <math.h>
 #include <stdlib.h>
 #include <algorithm>
@@ -80,7 +81,7 @@ bool isUndef(const Value *v)
 }
 
 // Detect the DXC output which uses a load from global variable called "dx.nothing.*" instead of a Nop
-bool DXIL::IsDXCNop(const Instruction &inst)
+bool IsDXCNop(const Instruction &inst)
 {
   if(inst.op != Operation::Load)
     return false;
@@ -100,13 +101,13 @@ bool DXIL::IsDXCNop(const Instruction &inst)
   return false;
 }
 
-bool DXIL::IsLLVMDebugCall(const Instruction &inst)
+bool IsLLVMDebugCall(const Instruction &inst)
 {
   return ((inst.op == Operation::Call) && (inst.getFuncCall()->family == FunctionFamily::LLVMDbg));
 }
 
 // true if the Value is an SSA value i.e. from an instruction, not a constant etc.
-bool DXIL::IsSSA(const Value *dxilValue)
+bool IsSSA(const Value *dxilValue)
 {
   if(const Instruction *inst = cast<Instruction>(dxilValue))
     return true;
@@ -127,7 +128,7 @@ bool DXIL::IsSSA(const Value *dxilValue)
   return false;
 }
 
-DXILDebug::Id DXIL::GetSSAId(const DXIL::Value *value)
+DXILDebug::Id GetSSAId(const DXIL::Value *value)
 {
   if(const Instruction *inst = cast<Instruction>(value))
     return inst->slot;
@@ -4135,7 +4136,7 @@ void Program::MakeRDDisassemblyString(const DXBC::Reflection *reflection)
             }
             switch(inst.op)
             {
-              case Operation::Trunc: commentStr += "truncate ";
+              case Operation::Trunc: commentStr += "truncate "; break;
               case Operation::ZExt: commentStr += "zero extend "; break;
               case Operation::SExt: commentStr += "signed extend "; break;
               case Operation::UToF: commentStr += "unsigned "; break;
@@ -4355,7 +4356,7 @@ void Program::MakeRDDisassemblyString(const DXBC::Reflection *reflection)
               commentStr += "inbounds ";
             break;
           }
-          case Operation::LoadAtomic: commentStr += "atomic ";
+          case Operation::LoadAtomic: commentStr += "atomic "; DELIBERATE_FALLTHROUGH();
           case Operation::Load:
           {
             lineStr += "*";
@@ -4374,7 +4375,7 @@ void Program::MakeRDDisassemblyString(const DXBC::Reflection *reflection)
               commentStr += StringFormat::Fmt("align %u ", (1U << inst.align) >> 1);
             break;
           }
-          case Operation::StoreAtomic: commentStr += "atomic ";
+          case Operation::StoreAtomic: commentStr += "atomic "; DELIBERATE_FALLTHROUGH();
           case Operation::Store:
           {
             if(inst.opFlags() & InstructionFlags::Volatile)
@@ -4409,7 +4410,7 @@ void Program::MakeRDDisassemblyString(const DXBC::Reflection *reflection)
               case Operation::FOrdLess: opStr = " < "; break;
               case Operation::FOrdLessEqual: opStr = " <= "; break;
               case Operation::FOrdNotEqual: opStr = " != "; break;
-              case Operation::FUnordEqual: opStr = " == ";
+              case Operation::FUnordEqual: opStr = " == "; break;
               case Operation::FUnordGreater: opStr = " > "; break;
               case Operation::FUnordGreaterEqual: opStr = " >= "; break;
               case Operation::FUnordLess: opStr = " < "; break;
@@ -5179,6 +5180,7 @@ rdcstr Type::toString(bool dxcStyleFormatting) const
             default: return StringFormat::Fmt("fp%u", bitWidth);
           }
       }
+      return "unknown_type";
     }
     case Vector:
     {
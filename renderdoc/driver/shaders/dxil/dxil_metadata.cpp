@@ -348,7 +348,7 @@ static void BakeRuntimeTablePart(rdcarray<bytebuf> &parts, DXIL::RDATData::Part
   const uint32_t alignedEntriesSize = (uint32_t)AlignUp4(entries.byteSize());
   const RuntimePartTableHeader tableHeader = {(uint32_t)entries.count(),
                                               (uint32_t)AlignUp4(sizeof(TableType))};
-  const RuntimePartHeader header = {part, alignedEntriesSize + sizeof(tableHeader)};
+  const RuntimePartHeader header = {part, alignedEntriesSize + (uint32_t)sizeof(tableHeader)};
 
   bytebuf b;
   b.resize(alignedEntriesSize + sizeof(header) + sizeof(tableHeader));
@@ -1123,7 +1123,7 @@ void DXBCContainer::SetRuntimeData(bytebuf &ByteCode, const DXIL::RDATData &rdat
           info.type,
           info.payloadBytes,
           info.attribBytes,
-          {uint32_t(info.featureFlags) & 0xffffffff, uint64_t(info.featureFlags) >> 32},
+          {uint32_t(info.featureFlags) & 0xffffffff, uint32_t(uint64_t(info.featureFlags) >> 32)},
           info.shaderCompatMask,
           info.minShaderModel,
           info.minType,
@@ -1164,7 +1164,7 @@ void DXBCContainer::SetRuntimeData(bytebuf &ByteCode, const DXIL::RDATData &rdat
               info.type,
               info.payloadBytes,
               info.attribBytes,
-              {uint32_t(info.featureFlags) & 0xffffffff, uint64_t(info.featureFlags) >> 32},
+              {uint32_t(info.featureFlags) & 0xffffffff, uint32_t(uint64_t(info.featureFlags) >> 32)},
               info.shaderCompatMask,
               info.minShaderModel,
               info.minType,
@@ -24,6 +24,7 @@
 
 #pragma once
 
+#include "common/common.h"
 #include "driver/dx/official/d3dcommon.h"
 #include "driver/shaders/dxbc/dxbc_common.h"
 #include "dxil_common.h"
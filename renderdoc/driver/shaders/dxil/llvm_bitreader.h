@@ -24,8 +24,10 @@
 
 #pragma once
 
+#include "api/replay/replay_enums.h"
 #include "common/common.h"
 #include "common/formatting.h"
+#include "common/result.h"
 
 namespace LLVMBC
 {
@@ -23,6 +23,7 @@
  ******************************************************************************/
 
 #include "llvm_encoder.h"
+#include <limits.h>
 #include "os/os_specific.h"
 
 namespace LLVMBC
@@ -424,6 +424,12 @@ private:
   void MakeSignatureNames(const rdcarray<SPIRVInterfaceAccess> &sigList, rdcarray<rdcstr> &sigNames);
 
   void FillCallstack(ThreadState &thread, ShaderDebugState &state);
+
+  void CalcLaneLocalInstructions();
+  bool IsLaneLocal(const ThreadState &lane) const;
+  bool StepLanesInParallel(const rdcarray<bool> &activeMask, int stepEnd,
+                           rdcarray<ShaderDebugState> &ret);
+  void StepActiveLane(ThreadState &thread, rdcarray<ShaderDebugState> &ret);
   void FillDebugSourceVars(rdcarray<InstructionSourceInfo> &instInfo);
   void FillDefaultSourceVars(rdcarray<InstructionSourceInfo> &instInfo);
 
@@ -437,6 +443,10 @@ private:
 
   Id convergeBlock;
 
+  // for each instruction, whether it only touches the executing lane's own state. Runs of these
+  // can be stepped for each lane independently, see StepLanesInParallel
+  rdcarray<bool> laneLocalInstructions;
+
   uint32_t activeLaneIndex = 0;
   ShaderStage stage;
 
@@ -24,6 +24,7 @@
 
 #include "spirv_debug.h"
 #include "common/formatting.h"
+#include "common/threading.h"
 #include "core/settings.h"
 #include "replay/common/var_dispatch_helpers.h"
 #include "spirv_op_helpers.h"
@@ -36,6 +37,10 @@ RDOC_CONFIG(bool, Vulkan_Hack_AllowNonUniformSubgroups, false,
             "Allow shaders to be debugged with subgroup ops. Most subgroup ops will break, this "
             "will only work for a limited set and not with the 'real' subgroup.");
 
+RDOC_CONFIG(bool, Vulkan_Debug_ParallelLaneStepping, true,
+            "When debugging a shader with multiple lanes, step the other lanes on worker threads "
+            "through runs of instructions that don't interact with other lanes.");
+
 // this could be cleaner if ShaderVariable wasn't a very public struct, but it's not worth it so
 // we just reserve value slots that we know won't be used in opaque variables.
 // there's significant wasted space to keep things simple with one property = one slot
@@ -895,6 +900,9 @@ ShaderDebugTrace *Debugger::BeginDebug(DebugAPIWrapper *api, const ShaderStage s
   for(uint32_t i = 0; i < workgroupSize; i++)
     workgroup.push_back(ThreadState(i, *this, global));
 
+  if(workgroupSize > 1)
+    CalcLaneLocalInstructions();
+
   ThreadState &active = GetActiveLane();
 
   active.nextInstruction = instructionOffsets.indexOf(functions[entryId].begin);
@@ -2388,6 +2396,9 @@ rdcarray<ShaderDebugState> Debugger::ContinueDebug()
     // calculate the current mask of which threads are active
     CalcActiveMask(activeMask);
 
+    if(StepLanesInParallel(activeMask, stepEnd, ret))
+      continue;
+
     // step all active members of the workgroup
     for(size_t lane = 0; lane < workgroup.size(); lane++)
     {
@@ -2405,100 +2416,313 @@ rdcarray<ShaderDebugState> Debugger::ContinueDebug()
 
         if(lane == activeLaneIndex)
         {
-          ShaderDebugState state;
+          StepActiveLane(thread, ret);
+        }
+        else
+        {
+          thread.StepNext(NULL, workgroup);
+        }
+      }
+    }
+  }
 
-          size_t instOffs = instructionOffsets[thread.nextInstruction];
+  return ret;
+}
 
-          // see if we're retiring any IDs at this state
-          for(size_t l = 0; l < thread.live.size();)
-          {
-            Id id = thread.live[l];
-            if(idLiveRange[id].second < instOffs)
-            {
-              thread.live.erase(l);
-              ShaderVariableChange change;
-              change.before = GetPointerValue(thread.ids[id]);
-              state.changes.push_back(change);
+void Debugger::CalcLaneLocalInstructions()
+{
+  laneLocalInstructions.resize(instructionOffsets.size());
 
-              continue;
-            }
+  for(size_t i = 0; i < instructionOffsets.size(); i++)
+  {
+    Iter it(m_SPIRV, instructionOffsets[i]);
 
-            l++;
-          }
+    bool local = false;
 
-          uint32_t funcRet = ~0U;
-          size_t prevStackSize = thread.callstack.size();
+    // only opcodes that read and write the lane's own IDs and memory can be stepped independently.
+    // Anything that reads other lanes (derivatives, group ops), can change the lanes' convergence
+    // (conditional branches, kills, returns), or goes through the API wrapper (resources, buffer
+    // memory, extended instructions) has to be stepped in lockstep.
+    switch(it.opcode())
+    {
+      case Op::IAdd:
+      case Op::FAdd:
+      case Op::ISub:
+      case Op::FSub:
+      case Op::IMul:
+      case Op::FMul:
+      case Op::UDiv:
+      case Op::SDiv:
+      case Op::FDiv:
+      case Op::UMod:
+      case Op::SRem:
+      case Op::SMod:
+      case Op::FRem:
+      case Op::FMod:
+      case Op::SNegate:
+      case Op::FNegate:
+      case Op::IAddCarry:
+      case Op::ISubBorrow:
+      case Op::UMulExtended:
+      case Op::SMulExtended:
+      case Op::VectorTimesScalar:
+      case Op::MatrixTimesScalar:
+      case Op::VectorTimesMatrix:
+      case Op::MatrixTimesVector:
+      case Op::MatrixTimesMatrix:
+      case Op::OuterProduct:
+      case Op::Dot:
+      case Op::Transpose:
+      case Op::ShiftLeftLogical:
+      case Op::ShiftRightArithmetic:
+      case Op::ShiftRightLogical:
+      case Op::BitwiseOr:
+      case Op::BitwiseAnd:
+      case Op::BitwiseXor:
+      case Op::Not:
+      case Op::BitFieldInsert:
+      case Op::BitFieldSExtract:
+      case Op::BitFieldUExtract:
+      case Op::BitReverse:
+      case Op::BitCount:
+      case Op::LogicalEqual:
+      case Op::LogicalNotEqual:
+      case Op::LogicalOr:
+      case Op::LogicalAnd:
+      case Op::LogicalNot:
+      case Op::Any:
+      case Op::All:
+      case Op::IsNan:
+      case Op::IsInf:
+      case Op::Select:
+      case Op::IEqual:
+      case Op::INotEqual:
+      case Op::UGreaterThan:
+      case Op::SGreaterThan:
+      case Op::UGreaterThanEqual:
+      case Op::SGreaterThanEqual:
+      case Op::ULessThan:
+      case Op::SLessThan:
+      case Op::ULessThanEqual:
+      case Op::SLessThanEqual:
+      case Op::FOrdEqual:
+      case Op::FUnordEqual:
+      case Op::FOrdNotEqual:
+      case Op::FUnordNotEqual:
+      case Op::FOrdLessThan:
+      case Op::FUnordLessThan:
+      case Op::FOrdGreaterThan:
+      case Op::FUnordGreaterThan:
+      case Op::FOrdLessThanEqual:
+      case Op::FUnordLessThanEqual:
+      case Op::FOrdGreaterThanEqual:
+      case Op::FUnordGreaterThanEqual:
+      case Op::ConvertFToU:
+      case Op::ConvertFToS:
+      case Op::ConvertSToF:
+      case Op::ConvertUToF:
+      case Op::UConvert:
+      case Op::SConvert:
+      case Op::FConvert:
+      case Op::Bitcast:
+      case Op::QuantizeToF16:
+      case Op::VectorExtractDynamic:
+      case Op::VectorInsertDynamic:
+      case Op::VectorShuffle:
+      case Op::CompositeConstruct:
+      case Op::CompositeExtract:
+      case Op::CompositeInsert:
+      case Op::CopyObject:
+      case Op::CopyLogical:
+      case Op::Phi:
+      // unconditional branches take every lane to the same place, so they can't diverge
+      case Op::Branch: local = true; break;
+      case Op::Load:
+      case Op::Store:
+      case Op::AccessChain:
+      case Op::InBoundsAccessChain:
+      {
+        // pointer operations are fine as long as the memory is private to the lane. The storage
+        // class is static so every lane makes the same decision
+        Id pointer;
+        if(it.opcode() == Op::Load)
+          pointer = OpLoad(it).pointer;
+        else if(it.opcode() == Op::Store)
+          pointer = OpStore(it).pointer;
+        else
+          pointer = OpAccessChain(it).base;
 
-          if(!thread.callstack.empty())
-            funcRet = thread.callstack.back()->funcCallInstruction;
+        const DataType &type = dataTypes[idTypes[pointer]];
+        if(type.type == DataType::PointerType)
+        {
+          StorageClass storage = type.pointerType.storage;
+          local = storage == StorageClass::Function || storage == StorageClass::Private ||
+                  storage == StorageClass::Input || storage == StorageClass::Output;
+        }
+        break;
+      }
+      default: break;
+    }
 
-          state.stepIndex = steps;
-          thread.StepNext(&state, workgroup);
+    laneLocalInstructions[i] = local;
+  }
+}
 
-          if(thread.callstack.size() > prevStackSize)
-            instOffs =
-                instructionOffsets[GetInstructionForFunction(thread.callstack.back()->function)];
+bool Debugger::IsLaneLocal(const ThreadState &lane) const
+{
+  return !lane.Finished() && lane.nextInstruction < laneLocalInstructions.size() &&
+         laneLocalInstructions[lane.nextInstruction];
+}
 
-          else if(thread.callstack.size() < prevStackSize && funcRet != ~0U)
-            instOffs = instructionOffsets[funcRet];
+bool Debugger::StepLanesInParallel(const rdcarray<bool> &activeMask, int stepEnd,
+                                   rdcarray<ShaderDebugState> &ret)
+{
+  if(!Vulkan_Debug_ParallelLaneStepping() || !Threading::JobSystem::CanAddJobs())
+    return false;
 
-          FillCallstack(thread, state);
+  ThreadState &active = GetActiveLane();
 
-          if(m_DebugInfo.valid)
-          {
-            size_t endOffs = instructionOffsets[thread.nextInstruction - 1];
+  // if we're waiting for lanes to converge then they're not in lockstep
+  if(!activeMask[activeLaneIndex] || convergeBlock != Id() || !IsLaneLocal(active))
+    return false;
 
-            // append any inlined functions to the top of the stack
-            InlineData *inlined = m_DebugInfo.lineInline[endOffs];
+  // every other active lane must be about to execute the same instruction. Since the run of
+  // lane-local instructions is the same for all lanes, they will all stop at the same point having
+  // taken the same number of steps, and we're back in lockstep
+  rdcarray<ThreadState *> lanes;
+  for(size_t lane = 0; lane < workgroup.size(); lane++)
+  {
+    if(lane == activeLaneIndex || !activeMask[lane])
+      continue;
 
-            size_t insertPoint = state.callstack.size();
+    if(workgroup[lane].nextInstruction != active.nextInstruction)
+      return false;
 
-            // start with the current scope, it refers to the *inlined* function
-            if(inlined)
-            {
-              const ScopeData *scope = GetScope(endOffs);
-              // find the function parent of the current scope
-              while(scope && scope->parent && scope->type == DebugScope::Block)
-                scope = scope->parent;
+    lanes.push_back(&workgroup[lane]);
+  }
 
-              state.callstack.insert(insertPoint, scope->name);
-            }
+  if(lanes.empty())
+    return false;
 
-            // if this instruction has no scope, don't give it a callstack
-            if(GetScope(endOffs) == NULL)
-            {
-              state.callstack.clear();
-            }
+  const int maxSteps = stepEnd - steps;
 
-            // move to the next inline up on our inline stack. If we reach an actual function
-            // call, this parent will be NULL as there was no more inlining - the final scope will
-            // refer to the real function which is already on our stack
-            while(inlined && inlined->parent)
-            {
-              const ScopeData *scope = inlined->scope;
-              // find the function parent of the current scope
-              while(scope && scope->parent && scope->type == DebugScope::Block)
-                scope = scope->parent;
+  // the other lanes don't record any changes, so they only run until the end of the run
+  rdcarray<Threading::JobSystem::Job *> jobs;
+  for(ThreadState *lane : lanes)
+  {
+    jobs.push_back(Threading::JobSystem::AddJob(
+        [this, lane, maxSteps]() {
+          for(int i = 0; i < maxSteps && IsLaneLocal(*lane); i++)
+            lane->StepNext(NULL, workgroup);
+        },
+        {}, "Shader debug lane"));
+  }
 
-              state.callstack.insert(insertPoint, scope->name);
+  // meanwhile step the active lane with full change tracking
+  int stepped = 0;
+  while(steps < stepEnd && IsLaneLocal(active))
+  {
+    StepActiveLane(active, ret);
+    stepped++;
+  }
 
-              inlined = inlined->parent;
-            }
-          }
+  // free the jobs as soon as they're done so they don't build up over a long debugging session
+  Threading::JobSystem::FreeJobs(jobs);
 
-          ret.push_back(std::move(state));
+  for(ThreadState *lane : lanes)
+    RDCASSERTEQUAL(lane->nextInstruction, active.nextInstruction);
 
-          steps++;
-        }
-        else
-        {
-          thread.StepNext(NULL, workgroup);
-        }
-      }
+  // the caller already ticked the clock for the first step
+  global.clock += stepped - 1;
+
+  return true;
+}
+
+void Debugger::StepActiveLane(ThreadState &thread, rdcarray<ShaderDebugState> &ret)
+{
+  ShaderDebugState state;
+
+  size_t instOffs = instructionOffsets[thread.nextInstruction];
+
+  // see if we're retiring any IDs at this state
+  for(size_t l = 0; l < thread.live.size();)
+  {
+    Id id = thread.live[l];
+    if(idLiveRange[id].second < instOffs)
+    {
+      thread.live.erase(l);
+      ShaderVariableChange change;
+      change.before = GetPointerValue(thread.ids[id]);
+      state.changes.push_back(change);
+
+      continue;
     }
+
+    l++;
   }
 
-  return ret;
+  uint32_t funcRet = ~0U;
+  size_t prevStackSize = thread.callstack.size();
+
+  if(!thread.callstack.empty())
+    funcRet = thread.callstack.back()->funcCallInstruction;
+
+  state.stepIndex = steps;
+  thread.StepNext(&state, workgroup);
+
+  if(thread.callstack.size() > prevStackSize)
+    instOffs = instructionOffsets[GetInstructionForFunction(thread.callstack.back()->function)];
+
+  else if(thread.callstack.size() < prevStackSize && funcRet != ~0U)
+    instOffs = instructionOffsets[funcRet];
+
+  FillCallstack(thread, state);
+
+  if(m_DebugInfo.valid)
+  {
+    size_t endOffs = instructionOffsets[thread.nextInstruction - 1];
+
+    // append any inlined functions to the top of the stack
+    InlineData *inlined = m_DebugInfo.lineInline[endOffs];
+
+    size_t insertPoint = state.callstack.size();
+
+    // start with the current scope, it refers to the *inlined* function
+    if(inlined)
+    {
+      const ScopeData *scope = GetScope(endOffs);
+      // find the function parent of the current scope
+      while(scope && scope->parent && scope->type == DebugScope::Block)
+        scope = scope->parent;
+
+      state.callstack.insert(insertPoint, scope->name);
+    }
+
+    // if this instruction has no scope, don't give it a callstack
+    if(GetScope(endOffs) == NULL)
+    {
+      state.callstack.clear();
+    }
+
+    // move to the next inline up on our inline stack. If we reach an actual function
+    // call, this parent will be NULL as there was no more inlining - the final scope will
+    // refer to the real function which is already on our stack
+    while(inlined && inlined->parent)
+    {
+      const ScopeData *scope = inlined->scope;
+      // find the function parent of the current scope
+      while(scope && scope->parent && scope->type == DebugScope::Block)
+        scope = scope->parent;
+
+      state.callstack.insert(insertPoint, scope->name);
+
+      inlined = inlined->parent;
+    }
+  }
+
+  ret.push_back(std::move(state));
+
+  steps++;
 }
 
 ShaderVariable Debugger::MakeTypedPointer(uint64_t value, const DataType &type) const
@@ -4410,6 +4634,9 @@ void Debugger::RegisterOp(Iter it)
 #if ENABLED(ENABLE_UNIT_TESTS)
 
 #include "catch/catch.hpp"
+#include "common/timing.h"
+#include "core/core.h"
+#include "spirv_compile.h"
 
 TEST_CASE("Check SPIRV Id naming", "[tostr]")
 {
@@ -4437,4 +4664,209 @@ TEST_CASE("Check SPIRV Id naming", "[tostr]")
   };
 }
 
+// an API wrapper with nothing bound, that provides a fixed input for location 0 and a fixed
+// derivative so that the quad's lanes all see different values
+class InputOnlyDebugAPIWrapper : public rdcspv::DebugAPIWrapper
+{
+public:
+  void AddDebugMessage(MessageCategory c, MessageSeverity sv, MessageSource src, rdcstr d) override
+  {
+  }
+  ResourceId GetShaderID() override { return ResourceId(); }
+  uint64_t GetBufferLength(ShaderBindIndex bind) override { return 0; }
+  void ReadBufferValue(ShaderBindIndex bind, uint64_t offset, uint64_t byteSize, void *dst) override
+  {
+  }
+  void WriteBufferValue(ShaderBindIndex bind, uint64_t offset, uint64_t byteSize,
+                        const void *src) override
+  {
+  }
+  void ReadAddress(uint64_t address, uint64_t byteSize, void *dst) override {}
+  void WriteAddress(uint64_t address, uint64_t byteSize, const void *src) override {}
+  bool ReadTexel(ShaderBindIndex imageBind, const ShaderVariable &coord, uint32_t sample,
+                 ShaderVariable &output) override
+  {
+    return false;
+  }
+  bool WriteTexel(ShaderBindIndex imageBind, const ShaderVariable &coord, uint32_t sample,
+                  const ShaderVariable &value) override
+  {
+    return false;
+  }
+  void FillInputValue(ShaderVariable &var, ShaderBuiltin builtin, uint32_t location,
+                      uint32_t component) override
+  {
+    for(uint32_t c = 0; c < 4; c++)
+      var.value.f32v[c] = 1.5f + c;
+  }
+  bool CalculateSampleGather(rdcspv::ThreadState &lane, rdcspv::Op opcode, TextureType texType,
+                             ShaderBindIndex imageBind, ShaderBindIndex samplerBind,
+                             const ShaderVariable &uv, const ShaderVariable &ddxCalc,
+                             const ShaderVariable &ddyCalc, const ShaderVariable &compare,
+                             rdcspv::GatherChannel gatherChannel,
+                             const rdcspv::ImageOperandsAndParamDatas &operands,
+                             ShaderVariable &output) override
+  {
+    return false;
+  }
+  bool CalculateMathOp(rdcspv::ThreadState &lane, rdcspv::GLSLstd450 op,
+                       const rdcarray<ShaderVariable> &params, ShaderVariable &output) override
+  {
+    return false;
+  }
+  DerivativeDeltas GetDerivative(ShaderBuiltin builtin, uint32_t location, uint32_t component,
+                                 VarType type) override
+  {
+    DerivativeDeltas ret;
+    ret.ddxcoarse = ret.ddxfine = ShaderVariable(rdcstr(), 0.25f, 0.5f, 0.75f, 1.0f);
+    ret.ddycoarse = ret.ddyfine = ShaderVariable(rdcstr(), -1.0f, 0.5f, -0.25f, 2.0f);
+    return ret;
+  }
+};
+
+// a pixel shader with a long run of lane-local ALU, ending in a derivative so the active lane's
+// final result depends on what the other lanes in the quad computed
+static rdcstr GetLaneLocalPixelShader(uint32_t numALU)
+{
+  rdcstr source = R"(#version 450 core
+
+layout(location = 0) in vec4 inVal;
+layout(location = 0) out vec4 outCol;
+
+void main()
+{
+  vec4 acc = inVal;
+  float f = inVal.x;
+)";
+
+  for(uint32_t i = 0; i < numALU; i++)
+  {
+    if(i % 3 == 0)
+      source += StringFormat::Fmt("  acc = acc * inVal.yzwx + vec4(%u.0);\n", i % 7);
+    else if(i % 3 == 1)
+      source += "  f = f * 0.5 + acc.y;\n";
+    else
+      source += "  acc = acc - vec4(f) * 0.125;\n";
+  }
+
+  source += R"(
+  outCol = acc + dFdx(acc) + dFdy(vec4(f));
+}
+)";
+
+  return source;
+}
+
+static rdcarray<ShaderDebugState> DebugQuad(const rdcarray<uint32_t> &spirv, uint32_t activeLane,
+                                            bool parallel)
+{
+  SDObject *setting = RenderDoc::Inst().SetConfigSetting("Vulkan_Debug_ParallelLaneStepping");
+  REQUIRE(setting);
+  const bool prevSetting = setting->data.basic.b;
+  setting->data.basic.b = parallel;
+
+  rdcspv::Reflector spv;
+  spv.Parse(spirv);
+
+  ShaderReflection refl;
+  SPIRVPatchData patchData;
+  spv.MakeReflection(GraphicsAPI::Vulkan, ShaderStage::Pixel, "main", {}, refl, patchData);
+
+  rdcspv::Debugger *debugger = new rdcspv::Debugger;
+  debugger->Parse(spirv);
+  ShaderDebugTrace *trace =
+      debugger->BeginDebug(new InputOnlyDebugAPIWrapper, ShaderStage::Pixel, "main", {}, {},
+                           patchData, activeLane);
+
+  rdcarray<ShaderDebugState> ret;
+  rdcarray<ShaderDebugState> states;
+  do
+  {
+    states = debugger->ContinueDebug();
+    ret.append(states);
+  } while(!states.empty());
+
+  delete debugger;
+  delete trace;
+
+  setting->data.basic.b = prevSetting;
+
+  return ret;
+}
+
+static rdcarray<uint32_t> CompilePixelShader(const rdcstr &source)
+{
+  rdcspv::Init();
+  RenderDoc::Inst().RegisterShutdownFunction(&rdcspv::Shutdown);
+
+  rdcarray<uint32_t> spirv;
+  rdcspv::CompilationSettings settings(rdcspv::InputLanguage::VulkanGLSL,
+                                       rdcspv::ShaderStage::Fragment);
+  rdcstr errors = rdcspv::Compile(settings, {source}, spirv);
+
+  INFO("SPIR-V compile output: " << errors);
+
+  REQUIRE(!spirv.empty());
+
+  return spirv;
+}
+
+TEST_CASE("SPIR-V debugger steps quad lanes in parallel the same as in lockstep",
+          "[spirv][debugger]")
+{
+  Threading::JobSystem::Init(4);
+
+  rdcarray<uint32_t> spirv = CompilePixelShader(GetLaneLocalPixelShader(200));
+
+  for(uint32_t lane = 0; lane < 4; lane++)
+  {
+    INFO("Active lane " << lane);
+
+    rdcarray<ShaderDebugState> lockstep = DebugQuad(spirv, lane, false);
+    rdcarray<ShaderDebugState> parallel = DebugQuad(spirv, lane, true);
+
+    REQUIRE(lockstep.size() > 200);
+    REQUIRE(lockstep.size() == parallel.size());
+
+    for(size_t i = 0; i < lockstep.size(); i++)
+    {
+      INFO("Step " << i);
+      CHECK(lockstep[i].nextInstruction == parallel[i].nextInstruction);
+      CHECK(lockstep[i].stepIndex == parallel[i].stepIndex);
+      CHECK((lockstep[i].changes == parallel[i].changes));
+    }
+  }
+
+  Threading::JobSystem::Shutdown();
+}
+
+TEST_CASE("Benchmark SPIR-V debugger quad stepping", "[.][spirv][debugger][benchmark]")
+{
+  Threading::JobSystem::Init();
+
+  const uint32_t numALU = 500;
+
+  rdcarray<uint32_t> spirv = CompilePixelShader(GetLaneLocalPixelShader(numALU));
+
+  const uint32_t numRuns = 5;
+
+  for(bool parallel : {false, true})
+  {
+    PerformanceTimer timer;
+
+    size_t numStates = 0;
+    for(uint32_t r = 0; r < numRuns; r++)
+      numStates += DebugQuad(spirv, 0, parallel).size();
+
+    const double ms = timer.GetMilliseconds();
+
+    CHECK(numStates >= numRuns * numALU);
+
+    WARN("Stepped " << numALU << " ALU quad " << numRuns << " times "
+                    << (parallel ? "in parallel" : "in lockstep") << " in " << ms << "ms");
+  }
+
+  Threading::JobSystem::Shutdown();
+}
+
 #endif
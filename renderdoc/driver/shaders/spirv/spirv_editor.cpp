@@ -152,6 +152,8 @@ Editor::~Editor()
     AddConstant(op);
   m_DeferredConstants.clear();
 
+  ApplyPendingOperations();
+
   m_ExternalSPIRV.clear();
   m_ExternalSPIRV.reserve(m_SPIRV.size());
 
@@ -201,38 +203,18 @@ void Editor::DecorateStorageBufferStruct(Id id)
 
 void Editor::SetName(Id id, const rdcstr &name)
 {
-  Operation op = OpName(id, name);
-
-  Iter it;
-
-  // OpName/OpMemberName must be before OpModuleProcessed.
-  for(it = Begin(Section::DebugNames); it < End(Section::DebugNames); ++it)
-  {
-    if(it.opcode() == Op::ModuleProcessed)
-      break;
-  }
-
-  op.insertInto(m_SPIRV, it.offs());
-  RegisterOp(Iter(m_SPIRV, it.offs()));
-  addWords(it.offs(), op.size());
+  // OpModuleProcessed is in its own section after this, so OpName/OpMemberName stay before it
+  AddPendingOperation(Section::DebugNames, OpName(id, name));
 }
 
 void Editor::SetMemberName(Id id, uint32_t member, const rdcstr &name)
 {
-  Operation op = OpMemberName(id, member, name);
-
-  size_t offset = m_Sections[Section::DebugNames].endOffset;
-  op.insertInto(m_SPIRV, offset);
-  RegisterOp(Iter(m_SPIRV, offset));
-  addWords(offset, op.size());
+  AddPendingOperation(Section::DebugNames, OpMemberName(id, member, name));
 }
 
 void Editor::AddDecoration(const Operation &op)
 {
-  size_t offset = m_Sections[Section::Annotations].endOffset;
-  op.insertInto(m_SPIRV, offset);
-  RegisterOp(Iter(m_SPIRV, offset));
-  addWords(offset, op.size());
+  AddPendingOperation(Section::Annotations, op);
 }
 
 void Editor::AddCapability(Capability cap)
@@ -241,11 +223,7 @@ void Editor::AddCapability(Capability cap)
   if(HasCapability(cap))
     return;
 
-  // insert the operation at the very start
-  Operation op(Op::Capability, {(uint32_t)cap});
-  op.insertInto(m_SPIRV, FirstRealWord);
-  RegisterOp(Iter(m_SPIRV, FirstRealWord));
-  addWords(FirstRealWord, op.size());
+  AddPendingOperation(Section::Capabilities, Operation(Op::Capability, {(uint32_t)cap}));
 }
 
 bool Editor::HasCapability(Capability cap)
@@ -259,32 +237,18 @@ void Editor::AddExtension(const rdcstr &extension)
   if(extensions.find(extension) != extensions.end())
     return;
 
-  // start at the beginning
-  Iter it(m_SPIRV, FirstRealWord);
-
-  // skip past any capabilities
-  while(it.opcode() == Op::Capability)
-    it++;
-
-  // insert the extension instruction
+  // add the extension instruction
   size_t sz = extension.size();
   rdcarray<uint32_t> uintName;
   uintName.resize((sz / 4) + 1);
   memcpy(&uintName[0], extension.c_str(), sz);
 
-  Operation op(Op::Extension, uintName);
-  op.insertInto(m_SPIRV, it.offs());
-  RegisterOp(it);
-  addWords(it.offs(), op.size());
+  AddPendingOperation(Section::Extensions, Operation(Op::Extension, uintName));
 }
 
 void Editor::AddExecutionMode(const Operation &mode)
 {
-  size_t offset = m_Sections[Section::ExecutionMode].endOffset;
-
-  mode.insertInto(m_SPIRV, offset);
-  RegisterOp(Iter(m_SPIRV, offset));
-  addWords(offset, mode.size());
+  AddPendingOperation(Section::ExecutionMode, mode);
 }
 
 Id Editor::HasExtInst(const char *setname)
@@ -306,14 +270,7 @@ Id Editor::ImportExtInst(const char *setname)
       return it->first;
   }
 
-  // start at the beginning
-  Iter it(m_SPIRV, FirstRealWord);
-
-  // skip past any capabilities and extensions
-  while(it.opcode() == Op::Capability || it.opcode() == Op::Extension)
-    it++;
-
-  // insert the import instruction
+  // add the import instruction
   Id ret = MakeId();
 
   size_t sz = strlen(setname);
@@ -323,10 +280,7 @@ Id Editor::ImportExtInst(const char *setname)
 
   uintName.insert(0, ret.value());
 
-  Operation op(Op::ExtInstImport, uintName);
-  op.insertInto(m_SPIRV, it.offs());
-  RegisterOp(it);
-  addWords(it.offs(), op.size());
+  AddPendingOperation(Section::ExtInst, Operation(Op::ExtInstImport, uintName));
 
   extSets[ret] = setname;
 
@@ -335,35 +289,20 @@ Id Editor::ImportExtInst(const char *setname)
 
 Id Editor::AddType(const Operation &op)
 {
-  size_t offset = m_Sections[Section::Types].endOffset;
-
-  Id id = Id::fromWord(op[1]);
-  op.insertInto(m_SPIRV, offset);
-  RegisterOp(Iter(m_SPIRV, offset));
-  addWords(offset, op.size());
-  return id;
+  AddPendingOperation(Section::Types, op);
+  return Id::fromWord(op[1]);
 }
 
 Id Editor::AddVariable(const Operation &op)
 {
-  size_t offset = m_Sections[Section::Variables].endOffset;
-
-  Id id = Id::fromWord(op[2]);
-  op.insertInto(m_SPIRV, offset);
-  RegisterOp(Iter(m_SPIRV, offset));
-  addWords(offset, op.size());
-  return id;
+  AddPendingOperation(Section::Variables, op);
+  return Id::fromWord(op[2]);
 }
 
 Id Editor::AddConstant(const Operation &op)
 {
-  size_t offset = m_Sections[Section::Constants].endOffset;
-
-  Id id = Id::fromWord(op[2]);
-  op.insertInto(m_SPIRV, offset);
-  RegisterOp(Iter(m_SPIRV, offset));
-  addWords(offset, op.size());
-  return id;
+  AddPendingOperation(Section::Constants, op);
+  return Id::fromWord(op[2]);
 }
 
 void Editor::AddFunction(const OperationList &ops)
@@ -378,6 +317,8 @@ void Editor::AddFunction(const OperationList &ops)
 
 Iter Editor::GetID(Id id)
 {
+  ApplyPendingOperations();
+
   size_t offs = idOffsets[id];
 
   if(offs)
@@ -388,6 +329,8 @@ Iter Editor::GetID(Id id)
 
 Iter Editor::GetEntry(Id id)
 {
+  ApplyPendingOperations();
+
   Iter it(m_SPIRV, m_Sections[Section::EntryPoints].startOffset);
   Iter end(m_SPIRV, m_Sections[Section::EntryPoints].endOffset);
 
@@ -680,6 +623,77 @@ void Editor::addWords(size_t offs, int32_t num)
       o += num;
 }
 
+void Editor::AddPendingOperation(Section::Type section, const Operation &op)
+{
+  rdcarray<uint32_t> &pending = m_PendingWords[section];
+
+  size_t offset = pending.size();
+  op.appendTo(pending);
+  m_NumPendingWords += op.size();
+
+  Iter it(pending, offset);
+  RegisterOp(it);
+
+  // the operation doesn't have an offset in the module until it's inserted
+  OpDecoder opdata(it);
+  if(opdata.result != Id())
+    idOffsets[opdata.result] = 0;
+}
+
+void Editor::ApplyPendingOperations()
+{
+  if(m_NumPendingWords == 0)
+    return;
+
+  // pending operations go at the end of their section, so anything from the end of a section
+  // onwards moves by the number of words pending for that section and all earlier ones. Pending
+  // operations don't have an offset yet so are skipped.
+  for(size_t &o : idOffsets)
+  {
+    if(o == 0)
+      continue;
+
+    size_t shift = 0;
+    for(uint32_t s = Section::First; s < Section::Count && m_Sections[s].endOffset <= o; s++)
+      shift += m_PendingWords[s].size();
+    o += shift;
+  }
+
+  rdcarray<uint32_t> spirv;
+  spirv.reserve(m_SPIRV.size() + m_NumPendingWords);
+
+  size_t copied = 0, shift = 0;
+  for(uint32_t s = Section::First; s < Section::Count; s++)
+  {
+    LogicalSection &section = m_Sections[s];
+    rdcarray<uint32_t> &pending = m_PendingWords[s];
+
+    spirv.append(m_SPIRV.data() + copied, section.endOffset - copied);
+    copied = section.endOffset;
+
+    for(size_t offs = 0; offs < pending.size(); offs += pending[offs] >> WordCountShift)
+    {
+      OpDecoder opdata(ConstIter(pending, offs));
+      if(opdata.result != Id())
+        idOffsets[opdata.result] = spirv.size() + offs;
+    }
+
+    spirv.append(pending);
+
+    section.startOffset += shift;
+    shift += pending.size();
+    section.endOffset += shift;
+
+    pending.clear();
+  }
+
+  // anything past the end of the last section, i.e. functions appended with AddFunction
+  spirv.append(m_SPIRV.data() + copied, m_SPIRV.size() - copied);
+
+  m_SPIRV.swap(spirv);
+  m_NumPendingWords = 0;
+}
+
 Operation Editor::MakeDeclaration(const Scalar &s)
 {
   if(s.type == Op::TypeVoid)
@@ -960,4 +974,209 @@ void main() {
   }
 }
 
+TEST_CASE("Test SPIR-V editor batched global edits", "[spirv]")
+{
+  rdcspv::Init();
+  RenderDoc::Inst().RegisterShutdownFunction(&rdcspv::Shutdown);
+
+  rdcspv::CompilationSettings settings;
+  settings.entryPoint = "main";
+  settings.lang = rdcspv::InputLanguage::VulkanGLSL;
+  settings.stage = rdcspv::ShaderStage::Fragment;
+
+  rdcarray<rdcstr> sources = {
+      R"(#version 450 core
+
+layout(binding = 0) uniform block {
+	vec4 val;
+};
+
+layout(location = 0) out vec4 col;
+
+void main() {
+  col = val * gl_FragCoord.x;
+}
+)",
+  };
+
+  rdcarray<uint32_t> spirv;
+  rdcstr errors = rdcspv::Compile(settings, sources, spirv);
+
+  INFO("SPIR-V compilation - " << errors);
+
+  REQUIRE(spirv.size() > 0);
+
+  rdcspv::Id var, constant, vec3Type;
+
+  {
+    rdcspv::Editor ed(spirv);
+
+    ed.Prepare();
+
+    // an iterator into the functions remains valid while global edits are pending
+    rdcspv::Id entryId = ed.GetEntries()[0].id;
+    rdcspv::Iter func = ed.GetID(entryId);
+
+    ed.AddCapability(rdcspv::Capability::Int64);
+    ed.AddExtension("SPV_KHR_storage_buffer_storage_class");
+    vec3Type = ed.DeclareType(rdcspv::Vector(rdcspv::scalar<float>(), 3));
+    rdcspv::Id ptrType = ed.DeclareType(rdcspv::Pointer(vec3Type, rdcspv::StorageClass::Private));
+    var = ed.AddVariable(rdcspv::OpVariable(ptrType, ed.MakeId(), rdcspv::StorageClass::Private));
+    ed.AddDecoration(rdcspv::OpDecorate(
+        var, rdcspv::DecorationParam<rdcspv::Decoration::DescriptorSet>(7)));
+    ed.SetName(var, "batched");
+    constant = ed.AddConstantImmediate<uint32_t>(1234U);
+
+    CHECK(func.opcode() == rdcspv::Op::Function);
+    CHECK(rdcspv::OpFunction(func).result == entryId);
+
+    // everything registered is available before the operations are inserted
+    CHECK(ed.HasCapability(rdcspv::Capability::Int64));
+    CHECK(ed.GetType(rdcspv::Vector(rdcspv::scalar<float>(), 3)) == vec3Type);
+    CHECK(ed.GetBinding(var).set == 7);
+    CHECK(ed.GetIDType(var) == ptrType);
+
+    // looking up an ID inserts the pending operations
+    rdcspv::Iter it = ed.GetID(var);
+    REQUIRE(it.opcode() == rdcspv::Op::Variable);
+    CHECK(rdcspv::OpVariable(it).result == var);
+
+    it = ed.GetID(constant);
+    REQUIRE(it.opcode() == rdcspv::Op::Constant);
+    CHECK(it.word(3) == 1234U);
+
+    CHECK(ed.GetID(entryId).offs() == ed.Begin(rdcspv::Section::Functions).offs());
+
+    for(uint32_t s = rdcspv::Section::First + 1; s < rdcspv::Section::Count; s++)
+      CHECK(ed.Begin((rdcspv::Section::Type)s).offs() ==
+            ed.End((rdcspv::Section::Type)(s - 1)).offs());
+
+    // adding more after that is fine too
+    ed.SetMemberName(vec3Type, 0, "unused");
+  }
+
+  // re-parse to check everything ended up where it should
+  rdcspv::Editor ed(spirv);
+
+  ed.Prepare();
+
+  CHECK(ed.HasCapability(rdcspv::Capability::Int64));
+  CHECK(ed.GetType(rdcspv::Vector(rdcspv::scalar<float>(), 3)) == vec3Type);
+  CHECK(ed.GetBinding(var).set == 7);
+  CHECK(ed.GetID(constant).opcode() == rdcspv::Op::Constant);
+
+  rdcstr name;
+  for(rdcspv::Iter it = ed.Begin(rdcspv::Section::DebugNames),
+                   end = ed.End(rdcspv::Section::DebugNames);
+      it < end; ++it)
+  {
+    if(it.opcode() == rdcspv::Op::Name && rdcspv::OpName(it).target == var)
+      name = rdcspv::OpName(it).name;
+  }
+
+  CHECK(name == "batched");
+}
+
+TEST_CASE("Benchmark SPIR-V editor patching", "[.][spirv][benchmark]")
+{
+  rdcspv::Init();
+  RenderDoc::Inst().RegisterShutdownFunction(&rdcspv::Shutdown);
+
+  rdcspv::CompilationSettings settings;
+  settings.entryPoint = "main";
+  settings.lang = rdcspv::InputLanguage::VulkanGLSL;
+  settings.stage = rdcspv::ShaderStage::Fragment;
+
+  // generate a large shader with many functions and globals to stand in for a real-world corpus
+  const uint32_t numFuncs = 400;
+
+  rdcstr source = R"(#version 450 core
+
+layout(location = 0) out vec4 col;
+layout(binding = 0) uniform sampler2D tex;
+)";
+
+  for(uint32_t f = 0; f < numFuncs; f++)
+  {
+    source += StringFormat::Fmt(
+        "layout(binding = %u) uniform block%u { vec4 a%u; vec4 b%u; };\n"
+        "vec4 func%u(vec4 v) {\n"
+        "  vec4 r = v * a%u + b%u;\n"
+        "  for(int i = 0; i < %u; i++) r = sin(r) * texture(tex, r.xy + float(i));\n"
+        "  return r;\n"
+        "}\n",
+        f + 1, f, f, f, f, f, f, f % 7 + 1);
+  }
+
+  source += "void main() {\n  vec4 v = gl_FragCoord;\n";
+  for(uint32_t f = 0; f < numFuncs; f++)
+    source += StringFormat::Fmt("  v = func%u(v);\n", f);
+  source += "  col = v;\n}\n";
+
+  rdcarray<uint32_t> spirv;
+  rdcstr errors = rdcspv::Compile(settings, {source}, spirv);
+
+  INFO("SPIR-V compilation - " << errors);
+
+  REQUIRE(spirv.size() > 0);
+
+  const size_t origSize = spirv.size();
+
+  PerformanceTimer timer;
+
+  const uint32_t numPatches = 20;
+  for(uint32_t p = 0; p < numPatches; p++)
+  {
+    rdcarray<uint32_t> patched = spirv;
+
+    rdcspv::Editor ed(patched);
+
+    ed.Prepare();
+
+    // similar to the feedback and pixel history patching - decorate and name new globals and
+    // declare constants, then instrument every function
+    rdcspv::Id uintType = ed.DeclareType(rdcspv::scalar<uint32_t>());
+    rdcspv::Id ptrType = ed.DeclareType(rdcspv::Pointer(uintType, rdcspv::StorageClass::Private));
+
+    for(uint32_t i = 0; i < numFuncs * 4; i++)
+    {
+      rdcspv::Id var =
+          ed.AddVariable(rdcspv::OpVariable(ptrType, ed.MakeId(), rdcspv::StorageClass::Private));
+      ed.SetName(var, StringFormat::Fmt("patch%u", i));
+      ed.AddDecoration(rdcspv::OpDecorate(var, rdcspv::Decoration::RelaxedPrecision));
+      ed.AddConstantImmediate<uint32_t>(i + 1000);
+    }
+
+    for(const rdcspv::Variable &var : ed.GetGlobals())
+      if(var.storage == rdcspv::StorageClass::Uniform)
+        ed.AddDecoration(rdcspv::OpDecorate(var.id, rdcspv::Decoration::NonWritable));
+
+    rdcarray<rdcspv::Id> funcs;
+    for(rdcspv::Iter it = ed.Begin(rdcspv::Section::Functions); it; ++it)
+      if(it.opcode() == rdcspv::Op::Function)
+        funcs.push_back(rdcspv::OpFunction(it).result);
+
+    rdcarray<rdcspv::Operation> stores;
+    for(rdcspv::Id func : funcs)
+    {
+      rdcspv::Id var =
+          ed.AddVariable(rdcspv::OpVariable(ptrType, ed.MakeId(), rdcspv::StorageClass::Private));
+      stores.push_back(rdcspv::OpStore(var, ed.AddConstantImmediate<uint32_t>(func.value())));
+    }
+
+    for(size_t f = 0; f < funcs.size(); f++)
+    {
+      rdcspv::Iter it = ed.GetID(funcs[f]);
+      while(it.opcode() != rdcspv::Op::Label)
+        ++it;
+      ++it;
+      ed.AddOperation(it, stores[f]);
+    }
+  }
+
+  double time = timer.GetMilliseconds();
+
+  WARN("Patched " << origSize << " word module " << numPatches << " times in " << time << "ms");
+}
+
 #endif
@@ -64,6 +64,15 @@ using TypeToId = std::pair<SPIRVType, Id>;
 template <typename SPIRVType>
 using TypeToIds = rdcarray<TypeToId<SPIRVType>>;
 
+// Operations added to the global sections (capabilities, names, decorations, types and so on) are
+// held in a list per section and only inserted into the module when something next needs to
+// iterate over it - GetID, GetEntry, Begin or End - or when the editor is destroyed. Patching a
+// shader usually adds many global operations in a row, and this lets them all be inserted in a
+// single pass over the module instead of shifting every later word and offset for each one.
+//
+// The information from these operations (types, decorations, capabilities, etc) is available
+// immediately. Iterators are invalidated whenever pending operations are inserted, in the same way
+// as they would be by inserting the operations directly.
 class Editor : public Processor
 {
 public:
@@ -113,8 +122,16 @@ public:
   // the entry point has 'two' opcodes, the entrypoint declaration and the function.
   // This returns the first, GetID returns the second.
   Iter GetEntry(Id id);
-  Iter Begin(Section::Type section) { return Iter(m_SPIRV, m_Sections[section].startOffset); }
-  Iter End(Section::Type section) { return Iter(m_SPIRV, m_Sections[section].endOffset); }
+  Iter Begin(Section::Type section)
+  {
+    ApplyPendingOperations();
+    return Iter(m_SPIRV, m_Sections[section].startOffset);
+  }
+  Iter End(Section::Type section)
+  {
+    ApplyPendingOperations();
+    return Iter(m_SPIRV, m_Sections[section].endOffset);
+  }
   // fetches the id of this type. If it exists already the old ID will be returned, otherwise it
   // will be declared and the new ID returned
   template <typename SPIRVType>
@@ -245,6 +262,10 @@ private:
   inline void addWords(size_t offs, size_t num) { addWords(offs, (int32_t)num); }
   void addWords(size_t offs, int32_t num);
 
+  // append an operation to the end of a section, deferred until ApplyPendingOperations
+  void AddPendingOperation(Section::Type section, const Operation &op);
+  void ApplyPendingOperations();
+
   Operation MakeDeclaration(const Scalar &s);
   Operation MakeDeclaration(const Vector &v);
   Operation MakeDeclaration(const Matrix &m);
@@ -291,6 +312,10 @@ private:
 
   OperationList m_DeferredConstants;
 
+  // words for operations to be appended to the end of each section
+  rdcarray<uint32_t> m_PendingWords[Section::Count];
+  size_t m_NumPendingWords = 0;
+
   rdcarray<uint32_t> &m_ExternalSPIRV;
 };
 
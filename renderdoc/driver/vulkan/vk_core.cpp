@@ -25,11 +25,13 @@
 #include "vk_core.h"
 #include <ctype.h>
 #include <algorithm>
+#include <memory>
 #include "core/settings.h"
 #include "driver/ihv/amd/amd_rgp.h"
 #include "driver/shaders/spirv/spirv_compile.h"
 #include "jpeg-compressor/jpge.h"
 #include "maths/formatpacking.h"
+#include "serialise/lazy_chunks.h"
 #include "serialise/rdcfile.h"
 #include "strings/string_utils.h"
 #include "vk_debug.h"
@@ -203,6 +205,9 @@ WrappedVulkan::~WrappedVulkan()
 
   SAFE_DELETE(m_FrameReader);
 
+  if(m_LazyChunks)
+    m_LazyChunks->Release();
+
   for(size_t i = 0; i < m_ThreadSerialisers.size(); i++)
     delete m_ThreadSerialisers[i];
 
@@ -2502,6 +2507,8 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
       SCOPED_LOCK(m_CoherentMapsLock);
       for(auto it = m_CoherentMaps.begin(); it != m_CoherentMaps.end(); ++it)
       {
+        WriteTracking::EndTracking((*it)->memMapState->writeTracking);
+        (*it)->memMapState->writeTracking = NULL;
         FreeAlignedBuffer((*it)->memMapState->refData);
         (*it)->memMapState->refData = NULL;
         (*it)->memMapState->needRefData = false;
@@ -2724,7 +2731,7 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
     SectionProperties props;
 
     // Compress with LZ4 so that it's fast
-    props.flags = SectionFlags::LZ4Compressed;
+    props.flags = SectionFlags::LZ4Compressed | SectionFlags::IndexedBlocks;
     props.version = m_SectionVersion;
     props.type = SectionType::FrameCapture;
 
@@ -2736,11 +2743,16 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
   }
 
   uint64_t captureSectionSize = 0;
+  rdcarray<ChunkIndexEntry> chunkIndex;
+  // callstacks of the chunks written into this capture, which refer to them by index
+  CallstackTable callstacks;
 
   {
     WriteSerialiser ser(captureWriter, Ownership::Stream);
 
     ser.SetChunkMetadataRecording(GetThreadSerialiser().GetChunkMetadataRecording());
+    ser.SetChunkIndexRecording(true);
+    ser.SetCallstackTable(&callstacks);
 
     ser.SetUserData(GetResourceManager());
 
@@ -2786,7 +2798,7 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
       RDCDEBUG("Flushing %u command buffer records to file serialiser",
                (uint32_t)m_CmdBufferRecords.size());
 
-      std::map<int64_t, Chunk *> recordlist;
+      SortedChunkList recordlist;
 
       // ensure all command buffer records within the frame evne if recorded before, but
       // otherwise order must be preserved (vs. queue submits and desc set updates)
@@ -2816,14 +2828,16 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
       RDCDEBUG("Flushing %u chunks to file serialiser from context record",
                (uint32_t)recordlist.size());
 
+      recordlist.Sort();
+
       float num = float(recordlist.size());
       float idx = 0.0f;
 
-      for(auto it = recordlist.begin(); it != recordlist.end(); ++it)
+      for(Chunk *chunk : recordlist)
       {
         RenderDoc::Inst().SetProgress(CaptureProgress::SerialiseFrameContents, idx / num);
         idx += 1.0f;
-        it->second->Write(ser);
+        chunk->Write(ser);
       }
 
       m_FrameCaptureRecord->DeleteChunks();
@@ -2832,6 +2846,8 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
     }
 
     captureSectionSize = captureWriter->GetOffset();
+
+    chunkIndex.swap(ser.GetChunkIndex());
   }
 
   if(m_CaptureFailure)
@@ -2847,6 +2863,12 @@ bool WrappedVulkan::EndFrameCapture(DeviceOwnedWindow devWnd)
 
   m_CaptureFailure = false;
 
+  if(rdc)
+  {
+    rdc->WriteChunkIndex(chunkIndex);
+    rdc->WriteCallstackTable(callstacks);
+  }
+
   RenderDoc::Inst().FinishCaptureWriting(rdc, m_CapturedFrames.back().frameNumber);
 
   m_State = CaptureState::BackgroundCapturing;
@@ -2904,6 +2926,8 @@ bool WrappedVulkan::DiscardFrameCapture(DeviceOwnedWindow devWnd)
       SCOPED_LOCK(m_CoherentMapsLock);
       for(auto it = m_CoherentMaps.begin(); it != m_CoherentMaps.end(); ++it)
       {
+        WriteTracking::EndTracking((*it)->memMapState->writeTracking);
+        (*it)->memMapState->writeTracking = NULL;
         FreeAlignedBuffer((*it)->memMapState->refData);
         (*it)->memMapState->refData = NULL;
         (*it)->memMapState->needRefData = false;
@@ -3046,6 +3070,59 @@ void WrappedVulkan::AddResourceCurChunk(ResourceId id)
   AddResourceCurChunk(GetReplay()->GetResourceDesc(id));
 }
 
+// placeholder chunks can outlive the driver that loaded them, so they're read by a separate
+// structured exporting instance owned by the processor
+static LazyChunkSource::ChunkProcessor MakeLazyChunkProcessor(uint64_t sectionVersion)
+{
+  std::shared_ptr<WrappedVulkan> exporter;
+
+  return [exporter, sectionVersion](ReadSerialiser &ser) mutable {
+    if(!exporter)
+    {
+      exporter.reset(new WrappedVulkan());
+      exporter->SetStructuredExport(sectionVersion);
+    }
+
+    return exporter->ProcessLazyChunk(ser);
+  };
+}
+
+bool WrappedVulkan::ProcessLazyChunk(ReadSerialiser &ser)
+{
+  ser.SetStringDatabase(&m_StringDB);
+  ser.SetUserData(GetResourceManager());
+  ser.SetVersion(m_SectionVersion);
+
+  // chunk metadata was already converted when the placeholder was created
+  ser.ConfigureStructuredExport(&GetChunkName, false, 0, 1.0);
+
+  SDFile *prevFile = m_StructuredFile;
+  m_StructuredFile = &ser.GetStructuredFile();
+
+  VulkanChunk context = ser.ReadChunk<VulkanChunk>();
+
+  bool success = true;
+
+  if((SystemChunk)context == SystemChunk::CaptureBegin)
+  {
+#if ENABLED(RDOC_RELEASE)
+    ser.SkipCurrentChunk();
+#else
+    Serialise_BeginCaptureFrame(ser);
+#endif
+  }
+  else
+  {
+    success = ProcessChunk(ser, context);
+  }
+
+  ser.EndChunk();
+
+  m_StructuredFile = prevFile;
+
+  return success && !ser.IsErrored();
+}
+
 RDResult WrappedVulkan::ReadLogInitialisation(RDCFile *rdc, bool storeStructuredBuffers)
 {
   int sectionIdx = rdc->SectionIndex(SectionType::FrameCapture);
@@ -3083,6 +3160,19 @@ RDResult WrappedVulkan::ReadLogInitialisation(RDCFile *rdc, bool storeStructured
 
   ser.ConfigureStructuredExport(&GetChunkName, storeStructuredBuffers, m_TimeBase, m_TimeFrequency);
 
+  rdc->GetCallstackTable(m_Callstacks);
+  ser.SetCallstackTable(&m_Callstacks);
+
+  // chunks are read again for structured data on demand, so buffers would be lost
+  if(IsLoading(m_State) && !storeStructuredBuffers)
+  {
+    m_LazyChunks =
+        LazyChunkSource::Create(rdc, sectionIdx, MakeLazyChunkProcessor(m_SectionVersion));
+
+    if(m_LazyChunks)
+      ser.ConfigureLazyStructuredExport(m_LazyChunks, 0);
+  }
+
   m_StructuredFile = &ser.GetStructuredFile();
 
   m_StoredStructuredData->version = m_StructuredFile->version = m_SectionVersion;
@@ -3204,6 +3294,7 @@ RDResult WrappedVulkan::ReadLogInitialisation(RDCFile *rdc, bool storeStructured
         }
       }
 
+      m_FrameReaderOffset = reader->GetOffset();
       m_FrameReader = new StreamReader(reader, frameDataSize);
 
       for(auto it = m_CreationInfo.m_Memory.begin(); it != m_CreationInfo.m_Memory.end(); ++it)
@@ -3309,6 +3400,11 @@ RDResult WrappedVulkan::ContextReplayLog(CaptureState readType, uint32_t startEv
     ser.ConfigureStructuredExport(&GetChunkName, IsStructuredExporting(m_State), m_TimeBase,
                                   m_TimeFrequency);
 
+    ser.SetCallstackTable(&m_Callstacks);
+
+    if(m_LazyChunks && IsLoading(m_State))
+      ser.ConfigureLazyStructuredExport(m_LazyChunks, m_FrameReaderOffset);
+
     ser.GetStructuredFile().Swap(*m_StructuredFile);
 
     m_StructuredFile = &ser.GetStructuredFile();
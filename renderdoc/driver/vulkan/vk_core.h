@@ -26,6 +26,7 @@
 
 #include "common/timing.h"
 #include "core/gpu_address_range_tracker.h"
+#include "serialise/callstack_table.h"
 #include "serialise/serialiser.h"
 #include "vk_acceleration_structure.h"
 #include "vk_common.h"
@@ -363,6 +364,14 @@ private:
   uint64_t m_SectionVersion;
 
   StreamReader *m_FrameReader = NULL;
+  // offset in the capture section that m_FrameReader starts from
+  uint64_t m_FrameReaderOffset = 0;
+
+  // when loading with lazy structured data this backs the placeholder chunks. Can be NULL
+  LazyChunkSource *m_LazyChunks = NULL;
+
+  // callstacks that chunks in the capture refer to by index
+  CallstackTable m_Callstacks;
 
   std::set<rdcstr> m_StringDB;
 
@@ -1240,6 +1249,8 @@ public:
   void ReplayLog(uint32_t startEventID, uint32_t endEventID, ReplayLogType replayType);
   void ReplayDraw(VkCommandBuffer cmd, const ActionDescription &action);
   RDResult ReadLogInitialisation(RDCFile *rdc, bool storeStructuredBuffers);
+  // read a single chunk into structured data while structured exporting, for lazy structured data
+  bool ProcessLazyChunk(ReadSerialiser &ser);
 
   SDFile *GetStructuredFile() { return m_StructuredFile; }
   SDFile *DetachStructuredFile()
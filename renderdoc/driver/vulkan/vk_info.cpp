@@ -1050,8 +1050,8 @@ void VulkanCreationInfo::ShaderObject::Init(VulkanResourceManager *resourceMan,
 
   ShaderModuleReflection &reflData = info.m_ShaderModule[id].m_Reflections[key];
 
-  reflData.Init(resourceMan, id, info.m_ShaderModule[id].spirv, shad.entryPoint, pCreateInfo->stage,
-                shad.specialization);
+  reflData.Init(resourceMan->GetOriginalID(id), info.m_ShaderModule[id].spirv, shad.entryPoint,
+                pCreateInfo->stage, shad.specialization);
 
   shad.refl = reflData.refl;
   shad.patchData = &reflData.patchData;
@@ -1067,7 +1067,8 @@ void VulkanCreationInfo::ShaderObject::Init(VulkanResourceManager *resourceMan,
 
 void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan,
                                         VulkanCreationInfo &info, ResourceId id,
-                                        const VkGraphicsPipelineCreateInfo *pCreateInfo)
+                                        const VkGraphicsPipelineCreateInfo *pCreateInfo,
+                                        bool deferReflection)
 {
   flags = pCreateInfo->flags;
 
@@ -1133,6 +1134,8 @@ void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan,
       dynamicStates[VkDynamicScissor] = false;
   }
 
+  rdcarray<StageReflection> stageReflections;
+
   // VkPipelineShaderStageCreateInfo
   for(uint32_t i = 0; i < pCreateInfo->stageCount; i++)
   {
@@ -1176,13 +1179,14 @@ void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan,
       }
     }
 
-    ShaderModuleReflection &reflData = info.m_ShaderModule[shadid].m_Reflections[key];
-
-    reflData.Init(resourceMan, shadid, info.m_ShaderModule[shadid].spirv, shad.entryPoint,
-                  pCreateInfo->pStages[i].stage, shad.specialization);
+    ShaderModule &module = info.m_ShaderModule[shadid];
+    ShaderModuleReflection &reflData = module.m_Reflections[key];
 
     shad.refl = reflData.refl;
     shad.patchData = &reflData.patchData;
+
+    stageReflections.push_back({(size_t)stageIndex, pCreateInfo->pStages[i].stage,
+                                resourceMan->GetOriginalID(shadid), &module, &reflData});
   }
 
   if(pCreateInfo->pVertexInputState)
@@ -1737,18 +1741,13 @@ void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan,
     }
   }
 
-  rdcarray<const DescSetLayout *> setLayoutInfos;
-  for(ResourceId setLayout : descSetLayouts)
-    setLayoutInfos.push_back(&info.m_DescSetLayout[setLayout]);
-
-  for(const ShaderEntry &shad : shaders)
-    shad.ProcessStaticDescriptorAccess(info.pushConstantDescriptorStorage,
-                                       resourceMan->GetOriginalID(id), staticDescriptorAccess,
-                                       setLayoutInfos);
+  ReflectShaders(resourceMan, info, id, stageReflections, deferReflection);
 }
 
-void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan, VulkanCreationInfo &info,
-                                        ResourceId id, const VkComputePipelineCreateInfo *pCreateInfo)
+void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan,
+                                        VulkanCreationInfo &info, ResourceId id,
+                                        const VkComputePipelineCreateInfo *pCreateInfo,
+                                        bool deferReflection)
 {
   flags = pCreateInfo->flags;
 
@@ -1760,6 +1759,8 @@ void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan, Vulk
 
   // need to figure out which states are valid to be NULL
 
+  rdcarray<StageReflection> stageReflections;
+
   // VkPipelineShaderStageCreateInfo
   {
     ResourceId shadid = GetResID(pCreateInfo->stage.module);
@@ -1798,13 +1799,14 @@ void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan, Vulk
       }
     }
 
-    ShaderModuleReflection &reflData = info.m_ShaderModule[shadid].m_Reflections[key];
-
-    reflData.Init(resourceMan, shadid, info.m_ShaderModule[shadid].spirv, shad.entryPoint,
-                  pCreateInfo->stage.stage, shad.specialization);
+    ShaderModule &module = info.m_ShaderModule[shadid];
+    ShaderModuleReflection &reflData = module.m_Reflections[key];
 
     shad.refl = reflData.refl;
     shad.patchData = &reflData.patchData;
+
+    stageReflections.push_back({5, pCreateInfo->stage.stage, resourceMan->GetOriginalID(shadid),
+                                &module, &reflData});
   }
 
   topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -1847,14 +1849,83 @@ void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan, Vulk
   logicOpEnable = false;
   logicOp = VK_LOGIC_OP_NO_OP;
 
+  ReflectShaders(resourceMan, info, id, stageReflections, deferReflection);
+}
+
+void VulkanCreationInfo::Pipeline::ReflectShaders(VulkanResourceManager *resourceMan,
+                                                  VulkanCreationInfo &info, ResourceId id,
+                                                  const rdcarray<StageReflection> &stages,
+                                                  bool deferReflection)
+{
   rdcarray<const DescSetLayout *> setLayoutInfos;
   for(ResourceId setLayout : descSetLayouts)
     setLayoutInfos.push_back(&info.m_DescSetLayout[setLayout]);
 
-  for(const ShaderEntry &shad : shaders)
-    shad.ProcessStaticDescriptorAccess(info.pushConstantDescriptorStorage,
-                                       resourceMan->GetOriginalID(id), staticDescriptorAccess,
-                                       setLayoutInfos);
+  const ResourceId pushStorage = info.pushConstantDescriptorStorage;
+  const ResourceId specStorage = resourceMan->GetOriginalID(id);
+
+  // everything the reflection needs is looked up above, the resource manager and the creation
+  // info maps aren't safe to access from a job. Pipelines, modules and layouts live in node-based
+  // maps and none are removed while loading so these pointers stay valid
+  Pipeline *pipe = this;
+  auto reflect = [pipe, stages, setLayoutInfos, pushStorage, specStorage]() {
+    for(const StageReflection &s : stages)
+    {
+      const ShaderEntry &shad = pipe->shaders[s.stageIndex];
+
+      SCOPED_LOCK(s.reflData->initLock);
+      s.reflData->Init(s.origModule, s.module->spirv, shad.entryPoint, s.stage,
+                       shad.specialization);
+    }
+
+    for(const ShaderEntry &shad : pipe->shaders)
+      shad.ProcessStaticDescriptorAccess(pushStorage, specStorage, pipe->staticDescriptorAccess,
+                                         setLayoutInfos);
+  };
+
+  if(!deferReflection || !Threading::JobSystem::CanAddJobs())
+  {
+    for(const StageReflection &s : stages)
+      s.module->WaitForJobs();
+
+    reflect();
+    return;
+  }
+
+  // the reflection can't start until the modules are parsed, and shaders pulled in from libraries
+  // are reflected by the library's own job
+  rdcarray<Threading::JobSystem::Job *> parents;
+  for(const StageReflection &s : stages)
+  {
+    if(Atomic::CmpExch32(&s.module->parsing, 0, 0) != 0)
+      parents.push_back(s.module->parseJob);
+  }
+  for(ResourceId lib : parentLibraries)
+  {
+    if(info.m_Pipeline[lib].reflectJob)
+      parents.push_back(info.m_Pipeline[lib].reflectJob);
+  }
+
+  for(const StageReflection &s : stages)
+  {
+    // once nothing is reflecting from a module its old jobs may be freed, so forget them
+    if(Atomic::CmpExch32(&s.module->reflecting, 0, 0) == 0)
+      s.module->reflectJobs.clear();
+    Atomic::Inc32(&s.module->reflecting);
+  }
+
+  reflectJob = Threading::JobSystem::AddJob(
+      [reflect, stages]() {
+        reflect();
+
+        // after this the modules must not be touched
+        for(const StageReflection &s : stages)
+          Atomic::Dec32(&s.module->reflecting);
+      },
+      parents, "Vulkan pipeline reflection");
+
+  for(const StageReflection &s : stages)
+    s.module->reflectJobs.push_back(reflectJob);
 }
 
 void VulkanCreationInfo::Pipeline::Init(VulkanResourceManager *resourceMan,
@@ -2501,7 +2572,8 @@ void VulkanCreationInfo::ImageView::Init(VulkanResourceManager *resourceMan, Vul
 
 void VulkanCreationInfo::ShaderModule::Init(VulkanResourceManager *resourceMan,
                                             VulkanCreationInfo &info,
-                                            const VkShaderModuleCreateInfo *pCreateInfo)
+                                            const VkShaderModuleCreateInfo *pCreateInfo,
+                                            bool deferParse)
 {
   const uint32_t SPIRVMagic = 0x07230203;
   if(pCreateInfo->codeSize < 4 || memcmp(pCreateInfo->pCode, &SPIRVMagic, sizeof(SPIRVMagic)) != 0)
@@ -2511,11 +2583,46 @@ void VulkanCreationInfo::ShaderModule::Init(VulkanResourceManager *resourceMan,
   else
   {
     RDCASSERT(pCreateInfo->codeSize % sizeof(uint32_t) == 0);
-    spirv.Parse(rdcarray<uint32_t>((uint32_t *)(pCreateInfo->pCode),
-                                   pCreateInfo->codeSize / sizeof(uint32_t)));
+    rdcarray<uint32_t> code((uint32_t *)(pCreateInfo->pCode),
+                            pCreateInfo->codeSize / sizeof(uint32_t));
+
+    if(deferParse && Threading::JobSystem::CanAddJobs())
+    {
+      // modules live in a node-based map so this pointer stays valid as other modules are added,
+      // and none are removed while loading
+      ShaderModule *mod = this;
+      parsing = 1;
+      parseJob = Threading::JobSystem::AddJob(
+          [mod, code]() {
+            mod->spirv.Parse(code);
+
+            // after this the module must not be touched
+            Atomic::Dec32(&mod->parsing);
+          },
+          {}, "SPIR-V parse");
+    }
+    else
+    {
+      spirv.Parse(code);
+    }
   }
 }
 
+void VulkanCreationInfo::ShaderModule::WaitForJobs()
+{
+  // the jobs can't have been freed while they're still running. Waiting on a job runs it here if
+  // no worker has got to it yet
+  if(Atomic::CmpExch32(&parsing, 0, 0) != 0)
+    Threading::JobSystem::WaitForJob(parseJob);
+
+  parseJob = NULL;
+
+  if(Atomic::CmpExch32(&reflecting, 0, 0) != 0)
+    Threading::JobSystem::WaitForJobs(reflectJobs);
+
+  reflectJobs.clear();
+}
+
 void VulkanCreationInfo::ShaderModule::Reinit()
 {
   bool lz4 = false;
@@ -2637,8 +2744,8 @@ void VulkanCreationInfo::ShaderModule::Reinit()
   FileIO::fclose(originalShaderFile);
 }
 
-void VulkanCreationInfo::ShaderModuleReflection::Init(VulkanResourceManager *resourceMan,
-                                                      ResourceId id, const rdcspv::Reflector &spv,
+void VulkanCreationInfo::ShaderModuleReflection::Init(ResourceId origModule,
+                                                      const rdcspv::Reflector &spv,
                                                       const rdcstr &entry,
                                                       VkShaderStageFlagBits stage,
                                                       const rdcarray<SpecConstant> &specInfo)
@@ -2651,7 +2758,7 @@ void VulkanCreationInfo::ShaderModuleReflection::Init(VulkanResourceManager *res
     spv.MakeReflection(GraphicsAPI::Vulkan, ShaderStage(stageIndex), entryPoint, specInfo, *refl,
                        patchData);
 
-    refl->resourceId = resourceMan->GetOriginalID(id);
+    refl->resourceId = origModule;
   }
 }
 
@@ -223,9 +223,12 @@ struct VulkanCreationInfo
     SPIRVPatchData patchData;
     std::map<size_t, uint32_t> instructionLines;
 
-    void Init(VulkanResourceManager *resourceMan, ResourceId id, const rdcspv::Reflector &spv,
-              const rdcstr &entry, VkShaderStageFlagBits stage,
-              const rdcarray<SpecConstant> &specInfo);
+    // pipelines reflected on jobs while loading can share a reflection, the first to get here
+    // builds it
+    Threading::CriticalSection initLock;
+
+    void Init(ResourceId origModule, const rdcspv::Reflector &spv, const rdcstr &entry,
+              VkShaderStageFlagBits stage, const rdcarray<SpecConstant> &specInfo);
 
     void PopulateDisassembly(const rdcspv::Reflector &spirv);
   };
@@ -248,12 +251,16 @@ struct VulkanCreationInfo
                                        rdcarray<const DescSetLayout *> setLayoutInfos) const;
   };
 
+  struct ShaderModule;
+
   struct Pipeline
   {
+    // if deferReflection is set while loading, the shaders are reflected on a job. The refl and
+    // patchData pointers are valid immediately but their contents aren't until jobs are synced
     void Init(VulkanResourceManager *resourceMan, VulkanCreationInfo &info, ResourceId id,
-              const VkGraphicsPipelineCreateInfo *pCreateInfo);
+              const VkGraphicsPipelineCreateInfo *pCreateInfo, bool deferReflection = false);
     void Init(VulkanResourceManager *resourceMan, VulkanCreationInfo &info, ResourceId id,
-              const VkComputePipelineCreateInfo *pCreateInfo);
+              const VkComputePipelineCreateInfo *pCreateInfo, bool deferReflection = false);
     void Init(VulkanResourceManager *resourceMan, VulkanCreationInfo &info, ResourceId id,
               const VkRayTracingPipelineCreateInfoKHR *pCreateInfo);
 
@@ -304,6 +311,10 @@ struct VulkanCreationInfo
 
     rdcarray<DescriptorAccess> staticDescriptorAccess;
 
+    // the job reflecting this pipeline's shaders if it was deferred while loading. Only valid until
+    // the end of loading when all jobs are synced
+    Threading::JobSystem::Job *reflectJob = NULL;
+
     // VkPipelineVertexInputStateCreateInfo
     struct VertBinding
     {
@@ -431,6 +442,19 @@ struct VulkanCreationInfo
 
     // VkPipelineRasterizationProvokingVertexStateCreateInfoEXT
     VkProvokingVertexModeEXT provokingVertex;
+
+    // a shader stage this pipeline declared itself, rather than pulled in from a library
+    struct StageReflection
+    {
+      size_t stageIndex;
+      VkShaderStageFlagBits stage;
+      ResourceId origModule;
+      ShaderModule *module;
+      ShaderModuleReflection *reflData;
+    };
+
+    void ReflectShaders(VulkanResourceManager *resourceMan, VulkanCreationInfo &info, ResourceId id,
+                        const rdcarray<StageReflection> &stages, bool deferReflection);
   };
   std::unordered_map<ResourceId, Pipeline> m_Pipeline;
 
@@ -704,10 +728,15 @@ struct VulkanCreationInfo
   struct ShaderModule
   {
     void Init(VulkanResourceManager *resourceMan, VulkanCreationInfo &info,
-              const VkShaderModuleCreateInfo *pCreateInfo);
+              const VkShaderModuleCreateInfo *pCreateInfo, bool deferParse = false);
 
     void Reinit();
 
+    // if the SPIR-V is being parsed, or pipelines using it are being reflected, on jobs while
+    // loading then wait for those to finish. Must be called before accessing or modifying spirv
+    // while loading, afterwards all jobs are known to be complete
+    void WaitForJobs();
+
     ShaderModuleReflection &GetReflection(ShaderStage stage, const rdcstr &entry, ResourceId pipe)
     {
       auto redirIt = m_PipeReferences.find(pipe);
@@ -725,6 +754,14 @@ struct VulkanCreationInfo
 
     rdcspv::Reflector spirv;
 
+    // 1 while the SPIR-V is being parsed on parseJob
+    int32_t parsing = 0;
+    Threading::JobSystem::Job *parseJob = NULL;
+
+    // the number of pipeline reflection jobs in reflectJobs still reading spirv
+    int32_t reflecting = 0;
+    rdcarray<Threading::JobSystem::Job *> reflectJobs;
+
     rdcstr unstrippedPath;
 
     std::map<ShaderModuleReflectionKey, ShaderModuleReflection> m_Reflections;
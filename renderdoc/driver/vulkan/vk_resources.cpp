@@ -3975,6 +3975,7 @@ VkResourceRecord::~VkResourceRecord()
 
   if(resType == eResDeviceMemory && memMapState)
   {
+    WriteTracking::EndTracking(memMapState->writeTracking);
     FreeAlignedBuffer(memMapState->refData);
 
     SAFE_DELETE(memMapState);
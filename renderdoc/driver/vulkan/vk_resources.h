@@ -1233,6 +1233,9 @@ struct MemMapState
   // flush this may point to the readback memory so that we read from that fast copy instead of the
   // slow actual pointer.
   byte *cpuReadPtr = NULL;
+  // if enabled, tracks which pages of the map have been written since the last flush so that only
+  // those need to be compared against refData.
+  WriteTracking::Region *writeTracking = NULL;
   Threading::CriticalSection mrLock;
 };
 
@@ -227,14 +227,8 @@ struct VkPipeCacheHeader
 };
 
 VulkanShaderCache::VulkanShaderCache(WrappedVulkan *driver)
+    : m_ShaderCache("vkshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion)
 {
-  // Load shader cache, if present
-  bool success = LoadShaderCache("vkshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion,
-                                 m_ShaderCache, VulkanShaderCacheCallbacks);
-
-  // if we failed to load from the cache
-  m_ShaderCacheDirty = !success;
-
   m_pDriver = driver;
   m_Device = driver->GetDev();
 
@@ -295,19 +289,18 @@ VulkanShaderCache::VulkanShaderCache(WrappedVulkan *driver)
         SPIRVBlob &blob = m_BuiltinShaderBlobs[i][baseType][textureType];
         rdcstr source = GetDynamicEmbeddedResource(config.resource);
 
-        uint32_t inputHash = strhash(source.c_str());
-        inputHash = strhash(defines.c_str(), inputHash);
+        uint64_t inputHash = strhash64(source.c_str());
+        inputHash = strhash64(defines.c_str(), inputHash);
 
         // bump this version if anything inside GenerateGLSLShader changes. This is used to
         // determine if we can skip the call to GenerateGLSLShader (which calls out to glslang).
         // Otherwise we'll use the cached SPIR-V generated by the previous call using the same
         // source & defines.
-        inputHash = strhash("inputHashVersion1", inputHash);
+        inputHash = strhash64("inputHashVersion1", inputHash);
 
         rdcstr err;
 
-        if(m_ShaderCache.find(inputHash) != m_ShaderCache.end())
-          blob = m_ShaderCache[inputHash];
+        m_ShaderCache.Find(inputHash, blob, VulkanShaderCacheCallbacks);
 
         if(blob == NULL)
         {
@@ -316,10 +309,8 @@ VulkanShaderCache::VulkanShaderCache(WrappedVulkan *driver)
 
           // if we missed the inputHash, make a copy there too.
           if(m_CacheShaders && blob)
-          {
-            m_ShaderCache[inputHash] = new rdcarray<uint32_t>(*blob);
-            m_ShaderCacheDirty = true;
-          }
+            m_ShaderCache.Insert(inputHash, new rdcarray<uint32_t>(*blob),
+                                 VulkanShaderCacheCallbacks);
         }
 
         if(!err.empty() || blob == VK_NULL_HANDLE)
@@ -439,16 +430,7 @@ VulkanShaderCache::~VulkanShaderCache()
     m_pDriver->vkDestroyPipelineCache(m_Device, m_PipelineCache, NULL);
   }
 
-  if(m_ShaderCacheDirty)
-  {
-    SaveShaderCache("vkshaders.cache", m_ShaderCacheMagic, m_ShaderCacheVersion, m_ShaderCache,
-                    VulkanShaderCacheCallbacks);
-  }
-  else
-  {
-    for(auto it = m_ShaderCache.begin(); it != m_ShaderCache.end(); ++it)
-      VulkanShaderCacheCallbacks.Destroy(it->second);
-  }
+  m_ShaderCache.Shutdown(VulkanShaderCacheCallbacks);
 
   for(size_t i = 0; i < ARRAY_COUNT(m_BuiltinShaderModules); i++)
     for(size_t b = 0; b < ARRAY_COUNT(m_BuiltinShaderModules[0]); b++)
@@ -461,18 +443,15 @@ rdcstr VulkanShaderCache::GetSPIRVBlob(const rdcspv::CompilationSettings &settin
 {
   RDCASSERT(!src.empty());
 
-  uint32_t hash = strhash(src.c_str());
+  uint64_t hash = strhash64(src.c_str());
 
   char typestr[3] = {'a', 'a', 0};
   typestr[0] += (char)settings.stage;
   typestr[1] += (char)settings.lang;
-  hash = strhash(typestr, hash);
+  hash = strhash64(typestr, hash);
 
-  if(m_ShaderCache.find(hash) != m_ShaderCache.end())
-  {
-    outBlob = m_ShaderCache[hash];
+  if(m_ShaderCache.Find(hash, outBlob, VulkanShaderCacheCallbacks))
     return "";
-  }
 
   SPIRVBlob spirv = new rdcarray<uint32_t>();
   rdcstr errors = rdcspv::Compile(settings, {src}, *spirv);
@@ -493,10 +472,7 @@ rdcstr VulkanShaderCache::GetSPIRVBlob(const rdcspv::CompilationSettings &settin
   outBlob = spirv;
 
   if(m_CacheShaders)
-  {
-    m_ShaderCache[hash] = spirv;
-    m_ShaderCacheDirty = true;
-  }
+    m_ShaderCache.Insert(hash, spirv, VulkanShaderCacheCallbacks);
 
   return errors;
 }
@@ -505,16 +481,15 @@ void VulkanShaderCache::GetPipeCacheBlob()
 {
   m_PipeCacheBlob.clear();
 
-  uint32_t hash = strhash(StringFormat::Fmt("PipelineCache%x%x", m_pDriver->GetDeviceProps().vendorID,
-                                            m_pDriver->GetDeviceProps().deviceID)
-                              .c_str());
+  uint64_t hash =
+      strhash64(StringFormat::Fmt("PipelineCache%x%x", m_pDriver->GetDeviceProps().vendorID,
+                                  m_pDriver->GetDeviceProps().deviceID)
+                    .c_str());
 
-  auto it = m_ShaderCache.find(hash);
+  SPIRVBlob blob = NULL;
 
-  if(it != m_ShaderCache.end())
+  if(m_ShaderCache.Find(hash, blob, VulkanShaderCacheCallbacks))
   {
-    SPIRVBlob blob = it->second;
-
     // first uint32_t is the real byte size, since we rounded up to the nearest uint32 to store in a
     // SPIRVBlob
     uint32_t size = blob->at(0);
@@ -535,8 +510,8 @@ void VulkanShaderCache::SetPipeCacheBlob(bytebuf &blob)
 
   VkPipeCacheHeader *header = (VkPipeCacheHeader *)blob.data();
 
-  uint32_t hash =
-      strhash(StringFormat::Fmt("PipelineCache%x%x", header->vendorID, header->deviceID).c_str());
+  uint64_t hash =
+      strhash64(StringFormat::Fmt("PipelineCache%x%x", header->vendorID, header->deviceID).c_str());
 
   rdcarray<uint32_t> *spirvBlob = new rdcarray<uint32_t>();
 
@@ -547,8 +522,7 @@ void VulkanShaderCache::SetPipeCacheBlob(bytebuf &blob)
   (*spirvBlob)[0] = (uint32_t)blob.size();
   memcpy(spirvBlob->data() + 1, blob.data(), blob.size());
 
-  m_ShaderCache[hash] = spirvBlob;
-  m_ShaderCacheDirty = true;
+  m_ShaderCache.Insert(hash, spirvBlob, VulkanShaderCacheCallbacks);
 }
 
 void VulkanShaderCache::MakeGraphicsPipelineInfo(VkGraphicsPipelineCreateInfo &pipeCreateInfo,
@@ -270,6 +270,8 @@ public:
   virtual void AddDebugMessage(MessageCategory c, MessageSeverity sv, MessageSource src,
                                rdcstr d) override
   {
+    // lanes can be stepped on worker threads
+    SCOPED_LOCK(m_DebugMessageLock);
     m_pDriver->AddDebugMessage(c, sv, src, d);
   }
 
@@ -1494,6 +1496,8 @@ private:
   uint32_t m_EventID;
   ResourceId m_ShaderID;
 
+  Threading::CriticalSection m_DebugMessageLock;
+
   rdcarray<DescriptorAccess> m_Access;
   rdcarray<Descriptor> m_Descriptors;
   rdcarray<SamplerDescriptor> m_SamplerDescriptors;
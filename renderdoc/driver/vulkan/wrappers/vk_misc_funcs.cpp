@@ -2213,8 +2213,10 @@ bool WrappedVulkan::Serialise_SetShaderDebugPath(SerialiserType &ser, VkShaderMo
 
   if(IsReplayingAndReading())
   {
-    m_CreationInfo.m_ShaderModule[GetResID(ShaderObject)].unstrippedPath = DebugPath;
-    m_CreationInfo.m_ShaderModule[GetResID(ShaderObject)].Reinit();
+    VulkanCreationInfo::ShaderModule &mod = m_CreationInfo.m_ShaderModule[GetResID(ShaderObject)];
+    mod.WaitForJobs();
+    mod.unstrippedPath = DebugPath;
+    mod.Reinit();
 
     AddResourceCurChunk(GetResourceManager()->GetOriginalID(GetResID(ShaderObject)));
   }
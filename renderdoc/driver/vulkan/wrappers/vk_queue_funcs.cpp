@@ -30,6 +30,12 @@
 RDOC_EXTERN_CONFIG(bool, Vulkan_Debug_VerboseCommandRecording);
 RDOC_EXTERN_CONFIG(bool, Vulkan_Debug_SingleSubmitFlushing);
 
+RDOC_CONFIG(bool, Vulkan_Capture_TrackCoherentMapWrites, false,
+            "While capturing, write-protect coherent maps to track which pages the application "
+            "writes, so that only those pages are compared on each submit. Where supported, this "
+            "trades a page fault on the first write to each page for a full comparison of the map. "
+            "Applications that pass mapped pointers to system calls may break with this enabled.");
+
 template <typename SerialiserType>
 bool WrappedVulkan::Serialise_vkGetDeviceQueue(SerialiserType &ser, VkDevice device,
                                                uint32_t queueFamilyIndex, uint32_t queueIndex,
@@ -1179,8 +1185,8 @@ void WrappedVulkan::CaptureQueueSubmit(VkQueue queue,
           continue;
         }
 
-        size_t diffStart = 0, diffEnd = 0;
-        bool found = true;
+        DiffRange ranges[16];
+        size_t numRanges = 0;
 
         // this causes vkFlushMappedMemoryRanges call to allocate and copy to refData
         // from serialised buffer. We want to copy *precisely* the serialised data,
@@ -1285,35 +1291,76 @@ void WrappedVulkan::CaptureQueueSubmit(VkQueue queue,
 
         // if we have a previous set of data, compare.
         // otherwise just serialise it all
-        if(state.refData)
-          found = FindDiffRange(((byte *)state.cpuReadPtr) + state.mapOffset, state.refData,
-                                (size_t)state.mapSize, diffStart, diffEnd);
-        else
-          diffEnd = (size_t)state.mapSize;
+        // each changed range is flushed separately, so that a few small writes far apart don't cause
+        // the whole map to be serialised.
+        if(state.refData && state.writeTracking)
+        {
+          // only the pages written since the last flush can be different
+          rdcarray<rdcpair<size_t, size_t>> written;
+          WriteTracking::GetWrittenRanges(state.writeTracking, written);
+
+          const byte *cur = ((byte *)state.cpuReadPtr) + state.mapOffset;
+
+          for(size_t w = 0; w < written.size(); w++)
+          {
+            // keep one range spare to cover all of the remaining pages, unless this is it
+            const size_t slots = ARRAY_COUNT(ranges) - numRanges;
+            const bool last = (slots == 1 || w + 1 == written.size());
+
+            const size_t start = written[w].first;
+            const size_t end = last ? written.back().second : written[w].second;
+
+            size_t found = FindDiffRanges(cur + start, state.refData + start, end - start,
+                                          ranges + numRanges, last ? slots : slots - 1);
 
-        // sanitise diff start/end. Since the mapped pointer might be written on another thread
-        // (or even the GPU) this could cause a difference to appear and disappear transiently. In
-        // this case FindDiffRange could find the difference when locating the start but not find
-        // it when locating the end. In this case we don't need to write the difference (the
-        // application is responsible for ensuring it's not writing to memory the GPU might need)
-        if(diffEnd <= diffStart)
-          found = false;
+            for(size_t r = numRanges; r < numRanges + found; r++)
+            {
+              ranges[r].start += start;
+              ranges[r].end += start;
+            }
+
+            numRanges += found;
+
+            if(last)
+              break;
+          }
+        }
+        else if(state.refData)
+        {
+          numRanges = FindDiffRanges(((byte *)state.cpuReadPtr) + state.mapOffset, state.refData,
+                                     (size_t)state.mapSize, ranges, ARRAY_COUNT(ranges));
+        }
+        else
+        {
+          // start tracking before the whole map is serialised below, so that any write after the
+          // snapshot is taken is caught. With GPU readback the snapshot has already been taken.
+          if(Vulkan_Capture_TrackCoherentMapWrites() && !state.readbackOnGPU &&
+             !state.writeTracking)
+            state.writeTracking = WriteTracking::BeginTracking(state.mappedPtr + state.mapOffset,
+                                                               (size_t)state.mapSize);
+
+          ranges[0].start = 0;
+          ranges[0].end = (size_t)state.mapSize;
+          numRanges = 1;
+        }
 
-        if(found)
+        if(numRanges > 0)
         {
           // MULTIDEVICE should find the device for this queue.
           // MULTIDEVICE only want to flush maps associated with this queue
           VkDevice dev = GetDev();
 
+          for(size_t r = 0; r < numRanges; r++)
           {
             RDCLOG("Persistent map flush forced for %s (%llu -> %llu)",
-                   ToStr(record->GetResourceID()).c_str(), (uint64_t)diffStart, (uint64_t)diffEnd);
+                   ToStr(record->GetResourceID()).c_str(), (uint64_t)ranges[r].start,
+                   (uint64_t)ranges[r].end);
             VkMappedMemoryRange range = {
                 VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
                 NULL,
                 (VkDeviceMemory)(uint64_t)record->Resource,
-                state.mapOffset + diffStart,
-                diffEnd - diffStart,
+                state.mapOffset + ranges[r].start,
+                ranges[r].end - ranges[r].start,
             };
             InternalFlushMemoryRange(dev, range, true, capframe);
           }
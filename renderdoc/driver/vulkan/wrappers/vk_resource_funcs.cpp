@@ -816,6 +816,9 @@ void WrappedVulkan::vkFreeMemory(VkDevice device, VkDeviceMemory memory, const V
     if(memMapState)
     {
       // there is an implicit unmap on free, so make sure to tidy up
+      WriteTracking::EndTracking(memMapState->writeTracking);
+      memMapState->writeTracking = NULL;
+
       if(memMapState->refData)
       {
         FreeAlignedBuffer(memMapState->refData);
@@ -1116,6 +1119,9 @@ void WrappedVulkan::vkUnmapMemory(VkDevice device, VkDeviceMemory mem)
       state.cpuReadPtr = state.mappedPtr = NULL;
     }
 
+    WriteTracking::EndTracking(state.writeTracking);
+    state.writeTracking = NULL;
+
     FreeAlignedBuffer(state.refData);
     state.refData = NULL;
   }
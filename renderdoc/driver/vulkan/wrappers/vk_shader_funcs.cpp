@@ -425,7 +425,10 @@ bool WrappedVulkan::Serialise_vkCreateShaderModule(SerialiserType &ser, VkDevice
         live = GetResourceManager()->WrapResource(Unwrap(device), sh);
         GetResourceManager()->AddLiveResource(ShaderModule, sh);
 
-        m_CreationInfo.m_ShaderModule[live].Init(GetResourceManager(), m_CreationInfo, &CreateInfo);
+        // parse the SPIR-V in the background while loading, pipelines that use it will wait
+        m_CreationInfo.m_ShaderModule[live].Init(
+            GetResourceManager(), m_CreationInfo, &CreateInfo,
+            IsLoading(m_State) && !Replay_Debug_SingleThreadedCompilation());
       }
     }
 
@@ -830,7 +833,8 @@ bool WrappedVulkan::Serialise_vkCreateGraphicsPipelines(
 
     VulkanCreationInfo::Pipeline &pipeInfo = m_CreationInfo.m_Pipeline[live];
 
-    pipeInfo.Init(GetResourceManager(), m_CreationInfo, live, &shadInstantiatedInfo);
+    pipeInfo.Init(GetResourceManager(), m_CreationInfo, live, &shadInstantiatedInfo,
+                  IsLoading(m_State) && !Replay_Debug_SingleThreadedCompilation());
 
     ResourceId renderPassID = GetResID(origRP);
 
@@ -1147,8 +1151,9 @@ bool WrappedVulkan::Serialise_vkCreateComputePipelines(SerialiserType &ser, VkDe
     VkComputePipelineCreateInfo shadInstantiatedInfo = OrigCreateInfo;
     shadInstantiatedInfo.stage = shadInstantiated;
 
-    m_CreationInfo.m_Pipeline[live].Init(GetResourceManager(), m_CreationInfo, live,
-                                         &shadInstantiatedInfo);
+    m_CreationInfo.m_Pipeline[live].Init(
+        GetResourceManager(), m_CreationInfo, live, &shadInstantiatedInfo,
+        IsLoading(m_State) && !Replay_Debug_SingleThreadedCompilation());
 
     if(Replay_Debug_SingleThreadedCompilation())
     {
@@ -275,6 +275,15 @@ class StackResolver
 public:
   virtual ~StackResolver() {}
   virtual AddressDetails GetAddr(uint64_t addr) = 0;
+  // resolvers that can look up many addresses more cheaply than one at a time override this
+  virtual rdcarray<AddressDetails> GetAddrs(const rdcarray<uint64_t> &addrs)
+  {
+    rdcarray<AddressDetails> ret;
+    ret.reserve(addrs.size());
+    for(uint64_t addr : addrs)
+      ret.push_back(GetAddr(addr));
+    return ret;
+  }
 };
 
 void Init();
@@ -339,12 +348,27 @@ void fseek64(FILE *f, uint64_t offset, int origin);
 
 void ftruncateat(FILE *f, uint64_t length);
 
+// advisory exclusive lock between processes that cooperate by taking it too. Blocks until the lock
+// is acquired and returns false if the file can't be locked. Closing the file releases the lock.
+bool flockexclusive(FILE *f);
+void funlock(FILE *f);
+
 bool fflush(FILE *f);
 
 bool feof(FILE *f);
 
 int fclose(FILE *f);
 
+// read-only memory mapped views of a region of a file. The view holds the mapping open
+// independently of the FILE it was created from, so it stays valid after the file is closed. Views
+// are reference counted so they can be shared, the last mapview_close unmaps the memory.
+// mapview_open returns NULL if the region can't be mapped, and callers should fall back to reading.
+struct MappedView;
+MappedView *mapview_open(FILE *f, uint64_t offset, uint64_t length);
+const byte *mapview_data(MappedView *view);
+void mapview_addref(MappedView *view);
+void mapview_close(MappedView *view);
+
 // functions for atomically appending to a log that may be in use in multiple
 // processes
 struct LogFileHandle;
@@ -475,6 +499,22 @@ rdcwstr UTF82Wide(const rdcstr &s);
 void Shutdown();
 };
 
+// tracks which pages of a range of memory are written, by write-protecting them and catching the
+// faults. Not supported on all platforms, in which case BeginTracking returns NULL and callers
+// should fall back to comparing against a copy. It also returns NULL for a range that shares a page
+// with one that's already being tracked.
+namespace WriteTracking
+{
+struct Region;
+
+Region *BeginTracking(void *base, size_t size);
+// returns [start, end) byte ranges relative to base covering every page written since tracking
+// began or the last call, and re-protects those pages. Ranges are page granular, except where
+// they're clipped to the tracked range.
+void GetWrittenRanges(Region *region, rdcarray<rdcpair<size_t, size_t>> &ranges);
+void EndTracking(Region *region);
+};
+
 namespace OSUtility
 {
 inline void ForceCrash();
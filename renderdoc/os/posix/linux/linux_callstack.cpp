@@ -29,16 +29,96 @@
 
 #include <execinfo.h>
 #include <link.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <string.h>
+#include <algorithm>
 #include <map>
+#include <unordered_map>
 #include "common/common.h"
 #include "common/formatting.h"
+#include "core/settings.h"
 #include "os/os_specific.h"
+#include "linux_symbols.h"
+
+RDOC_CONFIG(bool, Linux_FramePointerCallstacks, true,
+            "Collect callstacks by walking frame pointers, only falling back to the unwind tables "
+            "if the chain breaks inside RenderDoc. Disable if the application is built without "
+            "frame pointers and its callstacks are incomplete or wrong.");
 
 void *renderdocBase = NULL;
 void *renderdocEnd = NULL;
 
+// the top of the current thread's stack, looked up the first time the thread collects a callstack
+static uint64_t stackTopTLSSlot = 0;
+
+// walk the chain of frame records, each holding the caller's frame pointer and the return address.
+// This stops at the first frame pointer that doesn't lie further up the current thread's stack than
+// the last, which is either the outermost frame or a frame that didn't maintain a frame pointer.
+static size_t FramePointerWalk(void **frames, size_t maxFrames)
+{
+#if defined(__x86_64__) || defined(__aarch64__)
+  uintptr_t stackTop = 0;
+  if(stackTopTLSSlot)
+    stackTop = (uintptr_t)Threading::GetTLSValue(stackTopTLSSlot);
+
+  if(stackTop == 0)
+  {
+    pthread_attr_t attr;
+    if(pthread_getattr_np(pthread_self(), &attr) != 0)
+      return 0;
+
+    void *stackAddr = NULL;
+    size_t stackSize = 0;
+    int err = pthread_attr_getstack(&attr, &stackAddr, &stackSize);
+    pthread_attr_destroy(&attr);
+
+    if(err != 0)
+      return 0;
+
+    stackTop = (uintptr_t)stackAddr + stackSize;
+
+    if(stackTopTLSSlot)
+      Threading::SetTLSValue(stackTopTLSSlot, (void *)stackTop);
+  }
+
+  // using __builtin_frame_address forces this function to have a frame pointer, so the first one
+  // is always valid
+  uintptr_t fp = (uintptr_t)__builtin_frame_address(0);
+  uintptr_t prev = fp;
+  size_t numFrames = 0;
+
+  while(numFrames < maxFrames)
+  {
+    if(fp < prev || fp > stackTop - sizeof(uintptr_t) * 2 || (fp & (sizeof(uintptr_t) - 1)) != 0)
+      break;
+
+    const uintptr_t *record = (const uintptr_t *)fp;
+
+    // a null or otherwise implausible return address is as good as the end of the chain
+    if(record[1] < 0x1000)
+      break;
+
+    frames[numFrames++] = (void *)record[1];
+
+    prev = fp + sizeof(uintptr_t) * 2;
+    fp = record[0];
+  }
+
+  return numFrames;
+#else
+  return 0;
+#endif
+}
+
+static size_t CountRenderDocFrames(void *const *frames, size_t numFrames)
+{
+  size_t count = 0;
+  while(count < numFrames && frames[count] >= renderdocBase && frames[count] < renderdocEnd)
+    count++;
+  return count;
+}
+
 class LinuxCallstack : public Callstack::Stackwalk
 {
 public:
@@ -66,21 +146,29 @@ private:
   {
     void *addrs_ptr[ARRAY_COUNT(addrs)];
 
-    int ret = backtrace(addrs_ptr, ARRAY_COUNT(addrs));
-
     numLevels = 0;
-    if(ret > 0)
-      numLevels = (size_t)ret;
+    size_t offs = 0;
 
-    int offs = 0;
-    // if we want to trim levels of the stack, we can do that here
-    // by incrementing offs and decrementing numLevels
-    while(numLevels > 0 && addrs_ptr[offs] >= renderdocBase && addrs_ptr[offs] < renderdocEnd)
+    // walking frame pointers is far cheaper than backtrace(), which takes the loader lock and
+    // parses unwind tables. RenderDoc itself is built with frame pointers, so if the chain breaks
+    // before reaching the application's frames something is unusual and we fall back.
+    if(Linux_FramePointerCallstacks())
     {
-      offs++;
-      numLevels--;
+      numLevels = FramePointerWalk(addrs_ptr, ARRAY_COUNT(addrs));
+      offs = CountRenderDocFrames(addrs_ptr, numLevels);
     }
 
+    if(numLevels - offs < 2)
+    {
+      int ret = backtrace(addrs_ptr, ARRAY_COUNT(addrs));
+
+      numLevels = ret > 0 ? (size_t)ret : 0;
+      offs = CountRenderDocFrames(addrs_ptr, numLevels);
+    }
+
+    // trim our own frames off the top of the stack
+    numLevels -= offs;
+
     for(size_t i = 0; i < numLevels; i++)
       addrs[i] = (uint64_t)addrs_ptr[i + offs];
   }
@@ -93,6 +181,8 @@ namespace Callstack
 {
 void Init()
 {
+  stackTopTLSSlot = Threading::AllocateTLSSlot();
+
   // look for our own line
   FILE *f = FileIO::fopen("/proc/self/maps", FileIO::ReadText);
 
@@ -194,86 +284,93 @@ struct LookupModule
 class LinuxResolver : public Callstack::StackResolver
 {
 public:
-  LinuxResolver(rdcarray<LookupModule> modules) { m_Modules = modules; }
-  Callstack::AddressDetails GetAddr(uint64_t addr)
+  LinuxResolver(rdcarray<LookupModule> modules)
   {
-    EnsureCached(addr);
-
-    return m_Cache[addr];
+    m_Modules = modules;
+    std::sort(m_Modules.begin(), m_Modules.end(),
+              [](const LookupModule &a, const LookupModule &b) { return a.base < b.base; });
+  }
+  ~LinuxResolver()
+  {
+    for(auto it = m_Symbolisers.begin(); it != m_Symbolisers.end(); ++it)
+      delete it->second;
   }
 
-private:
-  void EnsureCached(uint64_t addr)
+  Callstack::AddressDetails GetAddr(uint64_t addr) { return GetAddrs({addr})[0]; }
+  rdcarray<Callstack::AddressDetails> GetAddrs(const rdcarray<uint64_t> &addrs)
   {
-    auto it = m_Cache.insert(
-        std::pair<uint64_t, Callstack::AddressDetails>(addr, Callstack::AddressDetails()));
-    if(!it.second)
-      return;
+    // resolve everything not yet cached in address order, so each module is only looked up once
+    // per batch and neighbouring lookups hit the same parts of its tables
+    rdcarray<uint64_t> missing;
+    for(uint64_t addr : addrs)
+      if(m_Cache.find(addr) == m_Cache.end())
+        missing.push_back(addr);
 
-    Callstack::AddressDetails &ret = it.first->second;
+    std::sort(missing.begin(), missing.end());
 
-    ret.filename = "Unknown";
-    ret.line = 0;
-    ret.function = StringFormat::Fmt("0x%08llx", addr);
+    const LookupModule *mod = NULL;
+    ELFSymboliser *symbols = NULL;
 
-    for(size_t i = 0; i < m_Modules.size(); i++)
+    for(size_t i = 0; i < missing.size(); i++)
     {
-      if(addr >= m_Modules[i].base && addr < m_Modules[i].end)
-      {
-        RDCLOG("%llx relative to module %llx-%llx, with offset %llx", addr, m_Modules[i].base,
-               m_Modules[i].end, m_Modules[i].offset);
-        uint64_t relative = addr - m_Modules[i].base + m_Modules[i].offset;
-        rdcstr cmd = StringFormat::Fmt("addr2line -fCe \"%s\" 0x%llx", m_Modules[i].path, relative);
-
-        RDCLOG(": %s", cmd.c_str());
+      uint64_t addr = missing[i];
+      if(i > 0 && missing[i - 1] == addr)
+        continue;
 
-        FILE *f = ::popen(cmd.c_str(), "r");
+      Callstack::AddressDetails &details = m_Cache[addr];
+      details.filename = "Unknown";
+      details.line = 0;
+      details.function = StringFormat::Fmt("0x%08llx", addr);
 
-        char result[2048] = {0};
-        fread(result, 1, 2047, f);
-
-        ::pclose(f);
-
-        char *line2 = strchr(result, '\n');
-        if(line2)
-        {
-          *line2 = 0;
-          line2++;
-        }
+      if(mod == NULL || addr < mod->base || addr >= mod->end)
+      {
+        mod = FindModule(addr);
+        symbols = mod ? GetSymboliser(mod->path) : NULL;
+      }
 
-        ret.function = result;
+      if(symbols)
+        symbols->Resolve(addr - mod->base + mod->offset, details);
+    }
 
-        if(line2)
-        {
-          char *linenum = line2 + strlen(line2) - 1;
-          while(linenum > line2 && *linenum != ':')
-            linenum--;
+    rdcarray<Callstack::AddressDetails> ret;
+    ret.reserve(addrs.size());
+    for(uint64_t addr : addrs)
+      ret.push_back(m_Cache[addr]);
+    return ret;
+  }
 
-          ret.line = 0;
+private:
+  const LookupModule *FindModule(uint64_t addr)
+  {
+    auto it = std::upper_bound(m_Modules.begin(), m_Modules.end(), addr,
+                               [](uint64_t a, const LookupModule &m) { return a < m.base; });
+    if(it == m_Modules.begin())
+      return NULL;
+    --it;
+    return addr < it->end ? it : NULL;
+  }
 
-          if(*linenum == ':')
-          {
-            *linenum = 0;
-            linenum++;
+  ELFSymboliser *GetSymboliser(const char *path)
+  {
+    auto it = m_Symbolisers.find(path);
+    if(it != m_Symbolisers.end())
+      return it->second;
 
-            while(*linenum >= '0' && *linenum <= '9')
-            {
-              ret.line *= 10;
-              ret.line += (uint32_t(*linenum) - uint32_t('0'));
-              linenum++;
-            }
-          }
+    // modules that fail to load are remembered as NULL so they're only tried once
+    ELFSymboliser *ret = ELFSymboliser::Open(path);
 
-          ret.filename = line2;
-        }
+    if(ret)
+      RDCLOG("Loaded symbols for %s%s", path, ret->HasLineInfo() ? "" : " (no line information)");
+    else
+      RDCWARN("Couldn't load symbols for %s", path);
 
-        break;
-      }
-    }
+    m_Symbolisers[path] = ret;
+    return ret;
   }
 
   rdcarray<LookupModule> m_Modules;
-  std::map<uint64_t, Callstack::AddressDetails> m_Cache;
+  std::map<rdcstr, ELFSymboliser *> m_Symbolisers;
+  std::unordered_map<uint64_t, Callstack::AddressDetails> m_Cache;
 };
 
 StackResolver *MakeResolver(bool interactive, byte *moduleDB, size_t DBSize,
@@ -363,3 +460,31 @@ StackResolver *MakeResolver(bool interactive, byte *moduleDB, size_t DBSize,
   return new LinuxResolver(modules);
 }
 };
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+TEST_CASE("Frame pointer walk matches backtrace", "[osspecific][callstack]")
+{
+  void *walked[32] = {};
+  void *unwound[32] = {};
+
+  size_t numWalked = FramePointerWalk(walked, ARRAY_COUNT(walked));
+  int numUnwound = backtrace(unwound, ARRAY_COUNT(unwound));
+
+  // the first frame is the return address in this function, which differs between the two calls.
+  // Beyond that the frames in RenderDoc are built with frame pointers so should match exactly.
+  REQUIRE(numUnwound > 4);
+
+  size_t start = 0;
+  while(start < numWalked && walked[start] != unwound[1])
+    start++;
+
+  REQUIRE(start + 3 < numWalked);
+
+  for(size_t i = 0; i < 3; i++)
+    CHECK(walked[start + i] == unwound[i + 1]);
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -0,0 +1,1357 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "linux_symbols.h"
+#include <cxxabi.h>
+#include <elf.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <type_traits>
+#include "common/common.h"
+#include "common/formatting.h"
+#include "miniz/miniz.h"
+#include "strings/string_utils.h"
+
+namespace
+{
+// DWARF constants we need, to avoid depending on a system dwarf.h
+enum DWARFConstants
+{
+  DW_TAG_compile_unit = 0x11,
+  DW_TAG_partial_unit = 0x3c,
+  DW_TAG_skeleton_unit = 0x4a,
+
+  DW_AT_stmt_list = 0x10,
+  DW_AT_comp_dir = 0x1b,
+  DW_AT_str_offsets_base = 0x72,
+
+  DW_UT_compile = 0x01,
+  DW_UT_partial = 0x03,
+  DW_UT_skeleton = 0x04,
+
+  DW_LNCT_path = 0x1,
+  DW_LNCT_directory_index = 0x2,
+};
+
+enum DWARFForm
+{
+  DW_FORM_addr = 0x01,
+  DW_FORM_block2 = 0x03,
+  DW_FORM_block4 = 0x04,
+  DW_FORM_data2 = 0x05,
+  DW_FORM_data4 = 0x06,
+  DW_FORM_data8 = 0x07,
+  DW_FORM_string = 0x08,
+  DW_FORM_block = 0x09,
+  DW_FORM_block1 = 0x0a,
+  DW_FORM_data1 = 0x0b,
+  DW_FORM_flag = 0x0c,
+  DW_FORM_sdata = 0x0d,
+  DW_FORM_strp = 0x0e,
+  DW_FORM_udata = 0x0f,
+  DW_FORM_ref_addr = 0x10,
+  DW_FORM_ref1 = 0x11,
+  DW_FORM_ref2 = 0x12,
+  DW_FORM_ref4 = 0x13,
+  DW_FORM_ref8 = 0x14,
+  DW_FORM_ref_udata = 0x15,
+  DW_FORM_indirect = 0x16,
+  DW_FORM_sec_offset = 0x17,
+  DW_FORM_exprloc = 0x18,
+  DW_FORM_flag_present = 0x19,
+  DW_FORM_strx = 0x1a,
+  DW_FORM_addrx = 0x1b,
+  DW_FORM_ref_sup4 = 0x1c,
+  DW_FORM_strp_sup = 0x1d,
+  DW_FORM_data16 = 0x1e,
+  DW_FORM_line_strp = 0x1f,
+  DW_FORM_ref_sig8 = 0x20,
+  DW_FORM_implicit_const = 0x21,
+  DW_FORM_loclistx = 0x22,
+  DW_FORM_rnglistx = 0x23,
+  DW_FORM_ref_sup8 = 0x24,
+  DW_FORM_strx1 = 0x25,
+  DW_FORM_strx2 = 0x26,
+  DW_FORM_strx3 = 0x27,
+  DW_FORM_strx4 = 0x28,
+  DW_FORM_addrx1 = 0x29,
+  DW_FORM_addrx2 = 0x2a,
+  DW_FORM_addrx3 = 0x2b,
+  DW_FORM_addrx4 = 0x2c,
+  DW_FORM_GNU_addr_index = 0x1f01,
+  DW_FORM_GNU_str_index = 0x1f02,
+  DW_FORM_GNU_ref_alt = 0x1f20,
+  DW_FORM_GNU_strp_alt = 0x1f21,
+};
+
+enum DWARFLineOp
+{
+  DW_LNS_copy = 1,
+  DW_LNS_advance_pc = 2,
+  DW_LNS_advance_line = 3,
+  DW_LNS_set_file = 4,
+  DW_LNS_const_add_pc = 8,
+  DW_LNS_fixed_advance_pc = 9,
+
+  DW_LNE_end_sequence = 1,
+  DW_LNE_set_address = 2,
+  DW_LNE_define_file = 3,
+};
+
+// bounds-checked little-endian reader. Reading past the end returns zeroes and flags an error,
+// so parsing can check once at a convenient point instead of on every read
+struct DataReader
+{
+  DataReader(const byte *d, uint64_t size) : cur(d), end(d + size) {}
+  const byte *cur;
+  const byte *end;
+  bool error = false;
+
+  uint64_t Remaining() const { return uint64_t(end - cur); }
+  bool AtEnd() const { return cur >= end; }
+  bool Skip(uint64_t n)
+  {
+    if(n > Remaining())
+    {
+      error = true;
+      cur = end;
+      return false;
+    }
+    cur += n;
+    return true;
+  }
+
+  uint64_t ReadN(uint32_t n)
+  {
+    uint64_t ret = 0;
+    if(n > Remaining() || n > 8)
+    {
+      error = true;
+      cur = end;
+      return 0;
+    }
+    for(uint32_t i = 0; i < n; i++)
+      ret |= uint64_t(cur[i]) << (i * 8);
+    cur += n;
+    return ret;
+  }
+  uint8_t u8() { return (uint8_t)ReadN(1); }
+  uint16_t u16() { return (uint16_t)ReadN(2); }
+  uint32_t u32() { return (uint32_t)ReadN(4); }
+  uint64_t u64() { return ReadN(8); }
+  uint64_t uleb()
+  {
+    uint64_t ret = 0;
+    uint32_t shift = 0;
+    while(cur < end)
+    {
+      byte b = *cur++;
+      if(shift < 64)
+        ret |= uint64_t(b & 0x7f) << shift;
+      shift += 7;
+      if((b & 0x80) == 0)
+        return ret;
+    }
+    error = true;
+    return ret;
+  }
+  int64_t sleb()
+  {
+    int64_t ret = 0;
+    uint32_t shift = 0;
+    while(cur < end)
+    {
+      byte b = *cur++;
+      if(shift < 64)
+        ret |= int64_t(b & 0x7f) << shift;
+      shift += 7;
+      if((b & 0x80) == 0)
+      {
+        if(shift < 64 && (b & 0x40))
+          ret |= -(int64_t(1) << shift);
+        return ret;
+      }
+    }
+    error = true;
+    return ret;
+  }
+  const char *cstr()
+  {
+    const char *ret = (const char *)cur;
+    const byte *term = (const byte *)memchr(cur, 0, (size_t)Remaining());
+    if(!term)
+    {
+      error = true;
+      cur = end;
+      return "";
+    }
+    cur = term + 1;
+    return ret;
+  }
+  // reads the initial length of a DWARF unit, returning a reader over the unit's contents
+  DataReader Unit(uint32_t &offsetSize)
+  {
+    uint64_t length = u32();
+    offsetSize = 4;
+    if(length == 0xffffffffULL)
+    {
+      length = u64();
+      offsetSize = 8;
+    }
+    const byte *start = cur;
+    Skip(length);
+    DataReader ret(start, uint64_t(cur - start));
+    ret.error = error;
+    return ret;
+  }
+};
+
+const char *SectionString(const ELFSymboliser::Section &sec, uint64_t offset)
+{
+  if(sec.data == NULL || offset >= sec.size)
+    return "";
+  if(memchr(sec.data + offset, 0, size_t(sec.size - offset)) == NULL)
+    return "";
+  return (const char *)sec.data + offset;
+}
+
+// skips or reads the value of an attribute. Returns false for unknown forms, since the size of
+// the remaining data can't be known
+bool ReadForm(DataReader &r, uint64_t form, uint32_t offsetSize, uint32_t addrSize,
+              uint16_t version, uint64_t &value, const char *&str)
+{
+  value = 0;
+  str = NULL;
+
+  switch(form)
+  {
+    case DW_FORM_flag_present:
+    case DW_FORM_implicit_const: return true;
+    case DW_FORM_addr: value = r.ReadN(addrSize); return true;
+    case DW_FORM_data1:
+    case DW_FORM_ref1:
+    case DW_FORM_flag:
+    case DW_FORM_strx1:
+    case DW_FORM_addrx1: value = r.u8(); return true;
+    case DW_FORM_data2:
+    case DW_FORM_ref2:
+    case DW_FORM_strx2:
+    case DW_FORM_addrx2: value = r.u16(); return true;
+    case DW_FORM_strx3:
+    case DW_FORM_addrx3: value = r.ReadN(3); return true;
+    case DW_FORM_data4:
+    case DW_FORM_ref4:
+    case DW_FORM_ref_sup4:
+    case DW_FORM_strx4:
+    case DW_FORM_addrx4: value = r.u32(); return true;
+    case DW_FORM_data8:
+    case DW_FORM_ref8:
+    case DW_FORM_ref_sig8:
+    case DW_FORM_ref_sup8: value = r.u64(); return true;
+    case DW_FORM_data16: r.Skip(16); return true;
+    case DW_FORM_sdata: value = (uint64_t)r.sleb(); return true;
+    case DW_FORM_udata:
+    case DW_FORM_ref_udata:
+    case DW_FORM_strx:
+    case DW_FORM_addrx:
+    case DW_FORM_loclistx:
+    case DW_FORM_rnglistx:
+    case DW_FORM_GNU_addr_index:
+    case DW_FORM_GNU_str_index: value = r.uleb(); return true;
+    case DW_FORM_strp:
+    case DW_FORM_line_strp:
+    case DW_FORM_sec_offset:
+    case DW_FORM_strp_sup:
+    case DW_FORM_GNU_ref_alt:
+    case DW_FORM_GNU_strp_alt: value = r.ReadN(offsetSize); return true;
+    case DW_FORM_ref_addr: value = r.ReadN(version <= 2 ? addrSize : offsetSize); return true;
+    case DW_FORM_string: str = r.cstr(); return true;
+    case DW_FORM_block1: r.Skip(r.u8()); return true;
+    case DW_FORM_block2: r.Skip(r.u16()); return true;
+    case DW_FORM_block4: r.Skip(r.u32()); return true;
+    case DW_FORM_block:
+    case DW_FORM_exprloc: r.Skip(r.uleb()); return true;
+    case DW_FORM_indirect:
+      return ReadForm(r, r.uleb(), offsetSize, addrSize, version, value, str);
+    default: return false;
+  }
+}
+
+bool IsStrxForm(uint64_t form)
+{
+  return form == DW_FORM_strx || form == DW_FORM_strx1 || form == DW_FORM_strx2 ||
+         form == DW_FORM_strx3 || form == DW_FORM_strx4 || form == DW_FORM_GNU_str_index;
+}
+
+// find the compilation directory of each line table, keyed by its offset in .debug_line. Only
+// needed for DWARF versions before 5, where it isn't in the line table itself
+std::map<uint64_t, rdcstr> ReadCompDirs(const ELFSymboliser::Section &info,
+                                        const ELFSymboliser::Section &abbrev,
+                                        const ELFSymboliser::Section &str,
+                                        const ELFSymboliser::Section &lineStr,
+                                        const ELFSymboliser::Section &strOffsets)
+{
+  std::map<uint64_t, rdcstr> ret;
+
+  DataReader units(info.data, info.size);
+
+  while(!units.AtEnd() && !units.error)
+  {
+    uint32_t offsetSize = 4;
+    DataReader cu = units.Unit(offsetSize);
+    if(cu.error)
+      break;
+
+    uint16_t version = cu.u16();
+    uint64_t abbrevOffset = 0;
+    uint8_t addrSize = 0;
+
+    if(version >= 5)
+    {
+      uint8_t unitType = cu.u8();
+      addrSize = cu.u8();
+      abbrevOffset = cu.ReadN(offsetSize);
+      if(unitType == DW_UT_skeleton)
+        cu.u64();
+      else if(unitType != DW_UT_compile && unitType != DW_UT_partial)
+        continue;
+    }
+    else if(version >= 2)
+    {
+      abbrevOffset = cu.ReadN(offsetSize);
+      addrSize = cu.u8();
+    }
+    else
+    {
+      continue;
+    }
+
+    uint64_t code = cu.uleb();
+    if(code == 0 || abbrevOffset >= abbrev.size)
+      continue;
+
+    // find the abbreviation for the unit's DIE
+    DataReader ab(abbrev.data + abbrevOffset, abbrev.size - abbrevOffset);
+    uint64_t tag = 0;
+    bool found = false;
+    while(!ab.AtEnd() && !ab.error)
+    {
+      uint64_t abCode = ab.uleb();
+      if(abCode == 0)
+        break;
+      tag = ab.uleb();
+      ab.u8();
+      if(abCode == code)
+      {
+        found = true;
+        break;
+      }
+      for(;;)
+      {
+        uint64_t attr = ab.uleb();
+        uint64_t form = ab.uleb();
+        if(form == DW_FORM_implicit_const)
+          ab.sleb();
+        if((attr == 0 && form == 0) || ab.error)
+          break;
+      }
+    }
+
+    if(!found ||
+       (tag != DW_TAG_compile_unit && tag != DW_TAG_partial_unit && tag != DW_TAG_skeleton_unit))
+      continue;
+
+    uint64_t stmtList = ~0ULL;
+    rdcstr compDir;
+    uint64_t compDirStrx = ~0ULL;
+    uint64_t strOffsetsBase = 8;
+
+    for(;;)
+    {
+      uint64_t attr = ab.uleb();
+      uint64_t form = ab.uleb();
+      if(form == DW_FORM_implicit_const)
+        ab.sleb();
+      if((attr == 0 && form == 0) || ab.error)
+        break;
+
+      uint64_t value = 0;
+      const char *s = NULL;
+      if(!ReadForm(cu, form, offsetSize, addrSize, version, value, s) || cu.error)
+        break;
+
+      if(attr == DW_AT_stmt_list)
+      {
+        stmtList = value;
+      }
+      else if(attr == DW_AT_str_offsets_base)
+      {
+        strOffsetsBase = value;
+      }
+      else if(attr == DW_AT_comp_dir)
+      {
+        if(s)
+          compDir = s;
+        else if(form == DW_FORM_strp)
+          compDir = SectionString(str, value);
+        else if(form == DW_FORM_line_strp)
+          compDir = SectionString(lineStr, value);
+        else if(IsStrxForm(form))
+          compDirStrx = value;
+      }
+    }
+
+    if(compDirStrx != ~0ULL)
+    {
+      uint64_t offs = strOffsetsBase + compDirStrx * offsetSize;
+      if(strOffsets.data && offs + offsetSize <= strOffsets.size)
+      {
+        DataReader r(strOffsets.data + offs, offsetSize);
+        compDir = SectionString(str, r.ReadN(offsetSize));
+      }
+    }
+
+    if(stmtList != ~0ULL)
+      ret[stmtList] = compDir;
+  }
+
+  return ret;
+}
+
+rdcstr JoinPath(const rdcstr &dir, const rdcstr &file)
+{
+  if(dir.empty() || file.beginsWith("/"))
+    return file;
+  if(dir.endsWith("/"))
+    return dir + file;
+  return dir + "/" + file;
+}
+
+template <typename Ehdr, typename Shdr>
+bool ReadSections(ELFSymboliser::Image &image)
+{
+  if(image.size < sizeof(Ehdr))
+    return false;
+
+  Ehdr ehdr;
+  memcpy(&ehdr, image.data, sizeof(ehdr));
+
+  if(ehdr.e_shoff == 0 || ehdr.e_shentsize < sizeof(Shdr))
+    return false;
+
+  uint64_t numSections = ehdr.e_shnum;
+  uint32_t strIndex = ehdr.e_shstrndx;
+
+  // extended section numbering keeps the real values in the first section header
+  if(ehdr.e_shoff + sizeof(Shdr) <= image.size)
+  {
+    Shdr first;
+    memcpy(&first, image.data + ehdr.e_shoff, sizeof(first));
+    if(numSections == 0)
+      numSections = first.sh_size;
+    if(strIndex == SHN_XINDEX)
+      strIndex = first.sh_link;
+  }
+
+  if(ehdr.e_shoff + numSections * ehdr.e_shentsize > image.size || strIndex >= numSections)
+    return false;
+
+  rdcarray<Shdr> shdrs;
+  shdrs.resize((size_t)numSections);
+  for(size_t i = 0; i < shdrs.size(); i++)
+    memcpy(&shdrs[i], image.data + ehdr.e_shoff + i * ehdr.e_shentsize, sizeof(Shdr));
+
+  const Shdr &strtab = shdrs[strIndex];
+  if(strtab.sh_offset + strtab.sh_size > image.size)
+    return false;
+
+  ELFSymboliser::Section names;
+  names.data = image.data + strtab.sh_offset;
+  names.size = strtab.sh_size;
+
+  for(const Shdr &shdr : shdrs)
+  {
+    if(shdr.sh_type == SHT_NOBITS || shdr.sh_type == SHT_NULL)
+      continue;
+    if(shdr.sh_offset + shdr.sh_size > image.size)
+      continue;
+
+    rdcstr name = SectionString(names, shdr.sh_name);
+
+    ELFSymboliser::Section sec;
+    sec.data = image.data + shdr.sh_offset;
+    sec.size = shdr.sh_size;
+
+    uint64_t uncompressedSize = 0;
+    const byte *compressed = NULL;
+    uint64_t compressedSize = 0;
+
+    if(shdr.sh_flags & SHF_COMPRESSED)
+    {
+      typedef typename std::conditional<sizeof(Ehdr) == sizeof(Elf64_Ehdr), Elf64_Chdr,
+                                        Elf32_Chdr>::type Chdr;
+      Chdr chdr;
+      if(sec.size < sizeof(chdr))
+        continue;
+      memcpy(&chdr, sec.data, sizeof(chdr));
+      if(chdr.ch_type != ELFCOMPRESS_ZLIB)
+        continue;
+      uncompressedSize = chdr.ch_size;
+      compressed = sec.data + sizeof(chdr);
+      compressedSize = sec.size - sizeof(chdr);
+    }
+    else if(name.beginsWith(".zdebug_"))
+    {
+      // legacy GNU compressed sections: "ZLIB" then a big-endian 64-bit size
+      if(sec.size < 12 || memcmp(sec.data, "ZLIB", 4) != 0)
+        continue;
+      for(int i = 0; i < 8; i++)
+        uncompressedSize = (uncompressedSize << 8) | sec.data[4 + i];
+      compressed = sec.data + 12;
+      compressedSize = sec.size - 12;
+      name = "." + name.substr(2);
+    }
+
+    if(compressed)
+    {
+      bytebuf *out = new bytebuf;
+      out->resize((size_t)uncompressedSize);
+      image.decompressed.push_back(out);
+
+      mz_ulong outSize = (mz_ulong)uncompressedSize;
+      if(mz_uncompress(out->data(), &outSize, compressed, (mz_ulong)compressedSize) != MZ_OK ||
+         outSize != uncompressedSize)
+      {
+        RDCWARN("Couldn't decompress section %s", name.c_str());
+        continue;
+      }
+      sec.data = out->data();
+      sec.size = uncompressedSize;
+    }
+
+    image.sections[name] = sec;
+  }
+
+  return true;
+}
+
+template <typename Sym>
+void ReadSymbolTable(const ELFSymboliser::Section &symtab, const ELFSymboliser::Section &strtab,
+                     rdcarray<ELFSymboliser::Symbol> &symbols, rdcarray<char> &names)
+{
+  size_t count = size_t(symtab.size / sizeof(Sym));
+
+  for(size_t i = 0; i < count; i++)
+  {
+    Sym sym;
+    memcpy(&sym, symtab.data + i * sizeof(Sym), sizeof(sym));
+
+    uint32_t type = sym.st_info & 0xf;
+    uint32_t bind = sym.st_info >> 4;
+
+    if((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_shndx == SHN_UNDEF ||
+       sym.st_value == 0)
+      continue;
+
+    const char *name = SectionString(strtab, sym.st_name);
+    if(name[0] == 0)
+      continue;
+
+    ELFSymboliser::Symbol s;
+    s.addr = sym.st_value;
+    s.size = sym.st_size;
+    s.name = (uint32_t)names.size();
+    s.global = (bind == STB_GLOBAL || bind == STB_WEAK);
+    names.append(name, strlen(name) + 1);
+    symbols.push_back(s);
+  }
+}
+};
+
+ELFSymboliser::Image::~Image()
+{
+  for(bytebuf *buf : decompressed)
+    delete buf;
+  if(view)
+    FileIO::mapview_close(view);
+}
+
+ELFSymboliser::Image *ELFSymboliser::LoadImage(const rdcstr &path)
+{
+  FILE *f = FileIO::fopen(path, FileIO::ReadBinary);
+
+  if(!f)
+    return NULL;
+
+  Image *image = new Image;
+
+  uint64_t size = FileIO::GetFileSize(path);
+
+  image->view = FileIO::mapview_open(f, 0, size);
+  if(image->view)
+  {
+    image->data = FileIO::mapview_data(image->view);
+  }
+  else
+  {
+    image->contents.resize((size_t)size);
+    size = FileIO::fread(image->contents.data(), 1, (size_t)size, f);
+    image->data = image->contents.data();
+  }
+
+  image->size = size;
+
+  FileIO::fclose(f);
+
+  bool valid = false;
+
+  if(size >= EI_NIDENT && memcmp(image->data, ELFMAG, SELFMAG) == 0 &&
+     image->data[EI_DATA] == ELFDATA2LSB)
+  {
+    if(image->data[EI_CLASS] == ELFCLASS64)
+      valid = ReadSections<Elf64_Ehdr, Elf64_Shdr>(*image);
+    else if(image->data[EI_CLASS] == ELFCLASS32)
+      valid = ReadSections<Elf32_Ehdr, Elf32_Shdr>(*image);
+  }
+
+  if(!valid)
+  {
+    delete image;
+    return NULL;
+  }
+
+  return image;
+}
+
+rdcstr ELFSymboliser::FindDebugFile(const rdcstr &path, const Image &image)
+{
+  rdcarray<rdcstr> candidates;
+
+  auto it = image.sections.find(".note.gnu.build-id");
+  if(it != image.sections.end())
+  {
+    DataReader r(it->second.data, it->second.size);
+    uint32_t nameSize = r.u32();
+    uint32_t descSize = r.u32();
+    uint32_t type = r.u32();
+    r.Skip(AlignUp4(nameSize));
+
+    if(!r.error && type == NT_GNU_BUILD_ID && descSize > 1 && descSize <= r.Remaining())
+    {
+      rdcstr hex;
+      for(uint32_t i = 0; i < descSize; i++)
+      {
+        hex += StringFormat::Fmt("%02x", r.cur[i]);
+        if(i == 0)
+          hex += "/";
+      }
+      candidates.push_back("/usr/lib/debug/.build-id/" + hex + ".debug");
+    }
+  }
+
+  it = image.sections.find(".gnu_debuglink");
+  if(it != image.sections.end())
+  {
+    rdcstr link = SectionString(it->second, 0);
+    if(!link.empty())
+    {
+      rdcstr dir = get_dirname(path);
+      candidates.push_back(dir + "/" + link);
+      candidates.push_back(dir + "/.debug/" + link);
+      candidates.push_back("/usr/lib/debug" + dir + "/" + link);
+    }
+  }
+
+  for(const rdcstr &c : candidates)
+  {
+    // a debuglink can have the same name as the module itself
+    if(c != path && FileIO::exists(c))
+      return c;
+  }
+
+  return rdcstr();
+}
+
+ELFSymboliser *ELFSymboliser::Open(const rdcstr &path)
+{
+  Image *image = LoadImage(path);
+
+  if(!image)
+    return NULL;
+
+  ELFSymboliser *ret = new ELFSymboliser;
+
+  ret->ReadSymbols(*image);
+  ret->ReadLines(*image);
+
+  if(!ret->HasLineInfo())
+  {
+    rdcstr debugPath = FindDebugFile(path, *image);
+
+    Image *debugImage = debugPath.empty() ? NULL : LoadImage(debugPath);
+    if(debugImage)
+    {
+      RDCLOG("Reading debug information for %s from %s", path.c_str(), debugPath.c_str());
+
+      // the separate file usually has the full symbol table where the module only has .dynsym
+      if(debugImage->sections.find(".symtab") != debugImage->sections.end())
+      {
+        ret->m_Symbols.clear();
+        ret->m_Names.clear();
+        ret->ReadSymbols(*debugImage);
+      }
+
+      ret->ReadLines(*debugImage);
+
+      delete debugImage;
+    }
+  }
+
+  delete image;
+
+  // names are copied out and line rows are self-contained, so the image isn't needed any more
+  return ret;
+}
+
+ELFSymboliser::~ELFSymboliser()
+{
+}
+
+void ELFSymboliser::ReadSymbols(const Image &image)
+{
+  auto symtab = image.sections.find(".symtab");
+  auto strtab = image.sections.find(".strtab");
+
+  if(symtab == image.sections.end() || strtab == image.sections.end())
+  {
+    symtab = image.sections.find(".dynsym");
+    strtab = image.sections.find(".dynstr");
+  }
+
+  if(symtab == image.sections.end() || strtab == image.sections.end())
+    return;
+
+  if(image.data[EI_CLASS] == ELFCLASS64)
+    ReadSymbolTable<Elf64_Sym>(symtab->second, strtab->second, m_Symbols, m_Names);
+  else
+    ReadSymbolTable<Elf32_Sym>(symtab->second, strtab->second, m_Symbols, m_Names);
+
+  // sort by address, preferring global symbols when aliases share an address
+  std::sort(m_Symbols.begin(), m_Symbols.end(), [](const Symbol &a, const Symbol &b) {
+    if(a.addr != b.addr)
+      return a.addr < b.addr;
+    return a.global && !b.global;
+  });
+
+  rdcarray<Symbol> unique;
+  unique.reserve(m_Symbols.size());
+  for(const Symbol &s : m_Symbols)
+  {
+    if(unique.empty() || unique.back().addr != s.addr)
+      unique.push_back(s);
+  }
+  m_Symbols.swap(unique);
+}
+
+uint32_t ELFSymboliser::AddFile(const rdcstr &file)
+{
+  auto it = m_FileLookup.find(file);
+  if(it != m_FileLookup.end())
+    return it->second;
+
+  uint32_t ret = (uint32_t)m_Files.size();
+  m_Files.push_back(file);
+  m_FileLookup[file] = ret;
+  return ret;
+}
+
+void ELFSymboliser::ReadLines(const Image &image)
+{
+  auto find = [&image](const char *name) {
+    auto it = image.sections.find(name);
+    return it == image.sections.end() ? Section() : it->second;
+  };
+
+  Section line = find(".debug_line");
+  if(line.data == NULL)
+    return;
+
+  Section str = find(".debug_str");
+  Section lineStr = find(".debug_line_str");
+
+  std::map<uint64_t, rdcstr> compDirs = ReadCompDirs(
+      find(".debug_info"), find(".debug_abbrev"), str, lineStr, find(".debug_str_offsets"));
+
+  DataReader units(line.data, line.size);
+
+  rdcarray<LineRow> sequence;
+
+  while(!units.AtEnd() && !units.error)
+  {
+    uint64_t unitOffset = uint64_t(units.cur - line.data);
+
+    uint32_t offsetSize = 4;
+    DataReader unit = units.Unit(offsetSize);
+    if(unit.error)
+      break;
+
+    uint16_t version = unit.u16();
+    if(version < 2 || version > 5)
+      continue;
+
+    uint8_t addrSize = 8;
+    if(version >= 5)
+    {
+      addrSize = unit.u8();
+      unit.u8();    // segment selector size
+    }
+
+    uint64_t headerLength = unit.ReadN(offsetSize);
+    DataReader program(unit.cur, unit.Remaining());
+    program.Skip(headerLength);
+
+    uint8_t minInstLength = unit.u8();
+    if(version >= 4)
+      unit.u8();    // maximum operations per instruction, only used for VLIW
+    unit.u8();    // default is_stmt, we don't distinguish statements
+    int8_t lineBase = (int8_t)unit.u8();
+    uint8_t lineRange = unit.u8();
+    uint8_t opcodeBase = unit.u8();
+
+    if(lineRange == 0 || opcodeBase == 0)
+      continue;
+
+    rdcarray<uint8_t> opcodeLengths;
+    for(uint8_t i = 1; i < opcodeBase; i++)
+      opcodeLengths.push_back(unit.u8());
+
+    rdcarray<rdcstr> dirs;
+    rdcarray<uint32_t> files;
+
+    rdcstr compDir;
+    auto it = compDirs.find(unitOffset);
+    if(it != compDirs.end())
+      compDir = it->second;
+
+    if(version >= 5)
+    {
+      // directory and file entries are described by a list of (content type, form) pairs
+      for(int pass = 0; pass < 2; pass++)
+      {
+        rdcarray<rdcpair<uint64_t, uint64_t>> format;
+        uint8_t formatCount = unit.u8();
+        for(uint8_t i = 0; i < formatCount; i++)
+        {
+          uint64_t type = unit.uleb();
+          uint64_t form = unit.uleb();
+          format.push_back({type, form});
+        }
+
+        uint64_t count = unit.uleb();
+        for(uint64_t i = 0; i < count && !unit.error; i++)
+        {
+          rdcstr path;
+          uint64_t dirIndex = 0;
+
+          for(const rdcpair<uint64_t, uint64_t> &f : format)
+          {
+            uint64_t value = 0;
+            const char *s = NULL;
+            if(!ReadForm(unit, f.second, offsetSize, addrSize, version, value, s))
+            {
+              unit.error = true;
+              break;
+            }
+
+            if(f.first == DW_LNCT_path)
+            {
+              if(s)
+                path = s;
+              else if(f.second == DW_FORM_line_strp)
+                path = SectionString(lineStr, value);
+              else if(f.second == DW_FORM_strp)
+                path = SectionString(str, value);
+            }
+            else if(f.first == DW_LNCT_directory_index)
+            {
+              dirIndex = value;
+            }
+          }
+
+          if(pass == 0)
+          {
+            // directory 0 is the compilation directory, others are relative to it
+            dirs.push_back(dirs.empty() ? path : JoinPath(dirs[0], path));
+          }
+          else
+          {
+            rdcstr dir = dirIndex < dirs.size() ? dirs[(size_t)dirIndex] : rdcstr();
+            files.push_back(AddFile(JoinPath(dir, path)));
+          }
+        }
+      }
+    }
+    else
+    {
+      dirs.push_back(compDir);
+      for(;;)
+      {
+        const char *dir = unit.cstr();
+        if(dir[0] == 0 || unit.error)
+          break;
+        dirs.push_back(JoinPath(compDir, dir));
+      }
+
+      // file indices start at 1 before DWARF 5
+      files.push_back(~0U);
+      for(;;)
+      {
+        const char *file = unit.cstr();
+        if(file[0] == 0 || unit.error)
+          break;
+        uint64_t dirIndex = unit.uleb();
+        unit.uleb();    // modification time
+        unit.uleb();    // file size
+        rdcstr dir = dirIndex < dirs.size() ? dirs[(size_t)dirIndex] : rdcstr();
+        files.push_back(AddFile(JoinPath(dir, file)));
+      }
+    }
+
+    if(unit.error || program.error)
+      continue;
+
+    // run the line number program
+    uint64_t address = 0;
+    uint64_t file = 1;
+    int64_t lineNum = 1;
+
+    auto emitRow = [&]() {
+      LineRow row;
+      row.addr = address;
+      row.file = file < files.size() ? files[(size_t)file] : ~0U;
+      row.line = (uint32_t)lineNum;
+      // rows with no valid file still terminate the previous row's range
+      if(row.file == ~0U)
+        row.line = 0;
+      sequence.push_back(row);
+    };
+
+    auto endSequence = [&]() {
+      // sequences from functions the linker discarded are left at address 0 or all ones
+      if(!sequence.empty() && sequence[0].addr != 0 && sequence[0].addr != ~0ULL &&
+         (addrSize != 4 || sequence[0].addr != 0xffffffffULL))
+      {
+        LineRow end;
+        end.addr = address;
+        end.file = ~0U;
+        end.line = 0;
+        m_Lines.append(sequence);
+        m_Lines.push_back(end);
+      }
+      sequence.clear();
+      address = 0;
+      file = 1;
+      lineNum = 1;
+    };
+
+    while(!program.AtEnd() && !program.error)
+    {
+      uint8_t op = program.u8();
+
+      if(op >= opcodeBase)
+      {
+        uint8_t adjusted = op - opcodeBase;
+        address += uint64_t(adjusted / lineRange) * minInstLength;
+        lineNum += lineBase + (adjusted % lineRange);
+        emitRow();
+      }
+      else if(op == 0)
+      {
+        uint64_t len = program.uleb();
+        if(len == 0)
+          continue;
+        const byte *next = program.cur + RDCMIN(len, program.Remaining());
+        uint8_t sub = program.u8();
+
+        if(sub == DW_LNE_end_sequence)
+          endSequence();
+        else if(sub == DW_LNE_set_address)
+          address = program.ReadN(uint32_t(RDCMIN(len - 1, (uint64_t)8)));
+        else if(sub == DW_LNE_define_file)
+          files.push_back(AddFile(JoinPath(compDir, program.cstr())));
+
+        program.cur = next;
+      }
+      else if(op == DW_LNS_copy)
+      {
+        emitRow();
+      }
+      else if(op == DW_LNS_advance_pc)
+      {
+        address += program.uleb() * minInstLength;
+      }
+      else if(op == DW_LNS_advance_line)
+      {
+        lineNum += program.sleb();
+      }
+      else if(op == DW_LNS_set_file)
+      {
+        file = program.uleb();
+      }
+      else if(op == DW_LNS_const_add_pc)
+      {
+        address += uint64_t((255 - opcodeBase) / lineRange) * minInstLength;
+      }
+      else if(op == DW_LNS_fixed_advance_pc)
+      {
+        address += program.u16();
+      }
+      else
+      {
+        // other standard opcodes only change state we don't track, skip their operands
+        for(uint8_t i = 0; i < opcodeLengths[op - 1]; i++)
+          program.uleb();
+      }
+    }
+
+    // drop any unterminated sequence
+    sequence.clear();
+  }
+
+  // end-of-sequence rows sort first so a sequence starting where another ends takes precedence
+  std::stable_sort(m_Lines.begin(), m_Lines.end(), [](const LineRow &a, const LineRow &b) {
+    if(a.addr != b.addr)
+      return a.addr < b.addr;
+    return a.file == ~0U && b.file != ~0U;
+  });
+}
+
+const rdcstr &ELFSymboliser::Demangle(const Symbol &sym)
+{
+  auto it = m_Demangled.find(sym.name);
+  if(it != m_Demangled.end())
+    return it->second;
+
+  const char *mangled = m_Names.data() + sym.name;
+
+  int status = 0;
+  char *demangled = abi::__cxa_demangle(mangled, NULL, NULL, &status);
+
+  rdcstr &ret = m_Demangled[sym.name];
+  if(status == 0 && demangled)
+    ret = demangled;
+  else
+    ret = mangled;
+
+  free(demangled);
+
+  return ret;
+}
+
+void ELFSymboliser::Resolve(uint64_t addr, Callstack::AddressDetails &details)
+{
+  {
+    Symbol key = {};
+    key.addr = addr;
+    auto it = std::upper_bound(m_Symbols.begin(), m_Symbols.end(), key);
+    if(it != m_Symbols.begin())
+    {
+      --it;
+      // symbols without a size cover everything up to the next symbol
+      if(it->size == 0 || addr < it->addr + it->size)
+        details.function = Demangle(*it);
+    }
+  }
+
+  {
+    LineRow key = {};
+    key.addr = addr;
+    auto it = std::upper_bound(m_Lines.begin(), m_Lines.end(), key,
+                               [](const LineRow &a, const LineRow &b) { return a.addr < b.addr; });
+    if(it != m_Lines.begin())
+    {
+      --it;
+      if(it->file != ~0U)
+      {
+        details.filename = m_Files[it->file];
+        details.line = it->line;
+      }
+    }
+  }
+}
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+namespace
+{
+struct TestWriter
+{
+  bytebuf data;
+
+  template <typename T>
+  void write(const T &val)
+  {
+    data.append((const byte *)&val, sizeof(T));
+  }
+  void bytes(std::initializer_list<byte> b) { data.append(b.begin(), b.size()); }
+  void str(const char *s) { data.append((const byte *)s, strlen(s) + 1); }
+  void patch32(size_t offs, uint32_t val) { memcpy(data.data() + offs, &val, sizeof(val)); }
+};
+
+// builds a minimal ELF with a symbol table, a DWARF 4 line table and a compile unit giving the
+// compilation directory
+bytebuf MakeTestELF(bool compressLines)
+{
+  TestWriter strtab;
+  strtab.str("");
+  strtab.str("_Z3fooi");
+  strtab.str("foo_local_alias");
+  strtab.str("bar");
+
+  TestWriter symtab;
+  {
+    Elf64_Sym sym = {};
+    symtab.write(sym);
+
+    sym.st_name = 1;
+    sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+    sym.st_shndx = 1;
+    sym.st_value = 0x401000;
+    sym.st_size = 0x40;
+    symtab.write(sym);
+
+    sym.st_name = 9;
+    sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_FUNC);
+    symtab.write(sym);
+
+    sym.st_name = 25;
+    sym.st_value = 0x401040;
+    sym.st_size = 0x20;
+    symtab.write(sym);
+  }
+
+  TestWriter line;
+  {
+    line.write<uint32_t>(0);
+    line.write<uint16_t>(4);
+    size_t headerLengthOffs = line.data.size();
+    line.write<uint32_t>(0);
+    // min inst length, max ops, default is_stmt, line base, line range, opcode base
+    line.bytes({1, 1, 1, byte(-5), 14, 13});
+    line.bytes({0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1});
+    line.str("src");
+    line.str("");
+    line.str("a.cpp");
+    line.bytes({1, 0, 0});
+    line.str("b.h");
+    line.bytes({0, 0, 0});
+    line.str("");
+    line.patch32(headerLengthOffs, uint32_t(line.data.size() - headerLengthOffs - 4));
+
+    // set address 0x401000, line 10, copy
+    line.bytes({0, 9, DW_LNE_set_address});
+    line.write<uint64_t>(0x401000);
+    line.bytes({DW_LNS_advance_line, 9, DW_LNS_copy});
+    // special opcode: address += 4, line += 1
+    line.bytes({(1 + 5) + 14 * 4 + 13});
+    // address 0x401040, file 2, line 5, copy
+    line.bytes(
+        {DW_LNS_advance_pc, 0x3c, DW_LNS_set_file, 2, DW_LNS_advance_line, 0x7a, DW_LNS_copy});
+    line.bytes({DW_LNS_advance_pc, 0x20, 0, 1, DW_LNE_end_sequence});
+
+    // a sequence for a discarded function, left at address 0
+    line.bytes({0, 9, DW_LNE_set_address});
+    line.write<uint64_t>(0);
+    line.bytes({DW_LNS_copy, DW_LNS_advance_pc, 0x10, 0, 1, DW_LNE_end_sequence});
+
+    line.patch32(0, uint32_t(line.data.size() - 4));
+  }
+
+  if(compressLines)
+  {
+    Elf64_Chdr chdr = {};
+    chdr.ch_type = ELFCOMPRESS_ZLIB;
+    chdr.ch_size = line.data.size();
+    chdr.ch_addralign = 1;
+
+    mz_ulong compSize = mz_compressBound((mz_ulong)line.data.size());
+    bytebuf comp;
+    comp.resize((size_t)compSize);
+    mz_compress(comp.data(), &compSize, line.data.data(), (mz_ulong)line.data.size());
+    comp.resize((size_t)compSize);
+
+    line.data.clear();
+    line.write(chdr);
+    line.data.append(comp);
+  }
+
+  TestWriter abbrev;
+  abbrev.bytes({1, DW_TAG_compile_unit, 0, DW_AT_stmt_list, DW_FORM_sec_offset, DW_AT_comp_dir,
+                DW_FORM_string, 0, 0, 0});
+
+  TestWriter info;
+  info.write<uint32_t>(0);
+  info.write<uint16_t>(4);
+  info.write<uint32_t>(0);
+  info.bytes({8, 1});
+  info.write<uint32_t>(0);
+  info.str("/build");
+  info.patch32(0, uint32_t(info.data.size() - 4));
+
+  TestWriter shstrtab;
+  shstrtab.str("");
+  rdcarray<uint32_t> nameOffsets;
+  for(const char *name : {".text", ".symtab", ".strtab", ".debug_line", ".debug_abbrev",
+                          ".debug_info", ".shstrtab"})
+  {
+    nameOffsets.push_back((uint32_t)shstrtab.data.size());
+    shstrtab.str(name);
+  }
+
+  TestWriter elf;
+  elf.data.resize(sizeof(Elf64_Ehdr));
+
+  rdcarray<Elf64_Shdr> shdrs;
+  shdrs.push_back(Elf64_Shdr());
+
+  {
+    Elf64_Shdr text = {};
+    text.sh_name = nameOffsets[0];
+    text.sh_type = SHT_NOBITS;
+    text.sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+    text.sh_addr = 0x401000;
+    text.sh_size = 0x100;
+    shdrs.push_back(text);
+  }
+
+  TestWriter *contents[] = {&symtab, &strtab, &line, &abbrev, &info, &shstrtab};
+  uint32_t types[] = {SHT_SYMTAB, SHT_STRTAB, SHT_PROGBITS, SHT_PROGBITS, SHT_PROGBITS, SHT_STRTAB};
+  for(size_t i = 0; i < ARRAY_COUNT(contents); i++)
+  {
+    Elf64_Shdr shdr = {};
+    shdr.sh_name = nameOffsets[i + 1];
+    shdr.sh_type = types[i];
+    shdr.sh_offset = elf.data.size();
+    shdr.sh_size = contents[i]->data.size();
+    if(types[i] == SHT_SYMTAB)
+    {
+      shdr.sh_link = 3;
+      shdr.sh_entsize = sizeof(Elf64_Sym);
+    }
+    if(contents[i] == &line && compressLines)
+      shdr.sh_flags = SHF_COMPRESSED;
+    elf.data.append(contents[i]->data);
+    shdrs.push_back(shdr);
+  }
+
+  Elf64_Ehdr ehdr = {};
+  memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = ET_EXEC;
+  ehdr.e_machine = EM_X86_64;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+  ehdr.e_shentsize = sizeof(Elf64_Shdr);
+  ehdr.e_shnum = (uint16_t)shdrs.size();
+  ehdr.e_shstrndx = (uint16_t)(shdrs.size() - 1);
+  ehdr.e_shoff = elf.data.size();
+
+  for(const Elf64_Shdr &shdr : shdrs)
+    elf.write(shdr);
+
+  memcpy(elf.data.data(), &ehdr, sizeof(ehdr));
+
+  return elf.data;
+}
+};
+
+TEST_CASE("Test ELF symbol and line lookup", "[osspecific][callstack]")
+{
+  bool compressed = false;
+
+  SECTION("uncompressed line table")
+  {
+    compressed = false;
+  }
+
+  SECTION("compressed line table")
+  {
+    compressed = true;
+  }
+
+  rdcstr path = FileIO::GetTempFolderFilename() + "/renderdoc_elf_symbols_test";
+
+  bytebuf elf = MakeTestELF(compressed);
+  FILE *f = FileIO::fopen(path, FileIO::WriteBinary);
+  REQUIRE(f);
+  FileIO::fwrite(elf.data(), 1, elf.size(), f);
+  FileIO::fclose(f);
+
+  ELFSymboliser *symbols = ELFSymboliser::Open(path);
+  REQUIRE(symbols);
+
+  CHECK(symbols->HasSymbols());
+  CHECK(symbols->HasLineInfo());
+
+  Callstack::AddressDetails details;
+
+  // the global name is preferred over a local alias
+  symbols->Resolve(0x401000, details);
+  CHECK(details.function == "foo(int)");
+  CHECK(details.filename == "/build/src/a.cpp");
+  CHECK(details.line == 10);
+
+  symbols->Resolve(0x401006, details);
+  CHECK(details.function == "foo(int)");
+  CHECK(details.line == 11);
+
+  symbols->Resolve(0x401050, details);
+  CHECK(details.function == "bar");
+  CHECK(details.filename == "/build/b.h");
+  CHECK(details.line == 5);
+
+  // past the end of both the symbols and the line sequence, nothing is filled in
+  details = Callstack::AddressDetails();
+  symbols->Resolve(0x401080, details);
+  CHECK(details.function == "");
+  CHECK(details.filename == "");
+  CHECK(details.line == 0);
+
+  // the discarded sequence at address 0 isn't used
+  symbols->Resolve(0x8, details);
+  CHECK(details.filename == "");
+
+  delete symbols;
+
+  FileIO::Delete(path);
+
+  CHECK(ELFSymboliser::Open(path) == NULL);
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
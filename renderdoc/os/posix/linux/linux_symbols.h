@@ -0,0 +1,108 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <map>
+#include "os/os_specific.h"
+
+// Symbolises addresses in an ELF module in-process, from its symbol table for function names and
+// its DWARF line table for file and line. Everything needed is parsed once when the module is
+// opened, into arrays sorted by address so each lookup is a binary search.
+//
+// If the module itself has no line table, a separate debug file is looked for by build-id and
+// then by .gnu_debuglink in the usual locations.
+class ELFSymboliser
+{
+public:
+  // returns NULL if the file can't be read or isn't a little-endian ELF file
+  static ELFSymboliser *Open(const rdcstr &path);
+
+  ~ELFSymboliser();
+
+  bool HasSymbols() const { return !m_Symbols.empty(); }
+  bool HasLineInfo() const { return !m_Lines.empty(); }
+  // resolve a virtual address within the module. Details that aren't available are left as-is
+  void Resolve(uint64_t addr, Callstack::AddressDetails &details);
+
+  // the parsed form of the module, only public for the parsing helpers
+  struct Symbol
+  {
+    uint64_t addr;
+    uint64_t size;
+    // offset in m_Names
+    uint32_t name;
+    bool global;
+
+    bool operator<(const Symbol &o) const { return addr < o.addr; }
+  };
+
+  struct LineRow
+  {
+    uint64_t addr;
+    // index in m_Files, or ~0U for the end of a sequence
+    uint32_t file;
+    uint32_t line;
+  };
+
+  struct Section
+  {
+    const byte *data = NULL;
+    uint64_t size = 0;
+  };
+
+  struct Image
+  {
+    bytebuf contents;
+    FileIO::MappedView *view = NULL;
+    const byte *data = NULL;
+    uint64_t size = 0;
+
+    std::map<rdcstr, Section> sections;
+    // decompressed copies of compressed sections
+    rdcarray<bytebuf *> decompressed;
+
+    ~Image();
+  };
+
+private:
+  ELFSymboliser() = default;
+
+  static Image *LoadImage(const rdcstr &path);
+  static rdcstr FindDebugFile(const rdcstr &path, const Image &image);
+
+  void ReadSymbols(const Image &image);
+  void ReadLines(const Image &image);
+
+  uint32_t AddFile(const rdcstr &file);
+  const rdcstr &Demangle(const Symbol &sym);
+
+  rdcarray<Symbol> m_Symbols;
+  rdcarray<char> m_Names;
+  std::map<uint32_t, rdcstr> m_Demangled;
+
+  rdcarray<LineRow> m_Lines;
+  rdcarray<rdcstr> m_Files;
+  std::map<rdcstr, uint32_t> m_FileLookup;
+};
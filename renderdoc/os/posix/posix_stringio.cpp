@@ -32,6 +32,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <time.h>
@@ -446,6 +447,24 @@ void ftruncateat(FILE *f, uint64_t length)
   ::ftruncate(fd, (off_t)length);
 }
 
+bool flockexclusive(FILE *f)
+{
+  int fd = ::fileno(f);
+  int ret = 0;
+  do
+  {
+    ret = ::flock(fd, LOCK_EX);
+  } while(ret != 0 && errno == EINTR);
+
+  return ret == 0;
+}
+
+void funlock(FILE *f)
+{
+  ::fflush(f);
+  ::flock(::fileno(f), LOCK_UN);
+}
+
 bool fflush(FILE *f)
 {
   return ::fflush(f) == 0;
@@ -456,6 +475,66 @@ int fclose(FILE *f)
   return ::fclose(f);
 }
 
+struct MappedView
+{
+  void *base;
+  size_t mappedSize;
+  const byte *data;
+  int32_t refcount;
+};
+
+MappedView *mapview_open(FILE *f, uint64_t offset, uint64_t length)
+{
+  if(f == NULL || length == 0)
+    return NULL;
+
+  // mmap offsets must be page aligned, so map from the page containing the offset
+  uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+  uint64_t alignedOffset = offset - (offset % pageSize);
+  uint64_t mappedSize = length + (offset - alignedOffset);
+
+  if(mappedSize != (uint64_t)(size_t)mappedSize)
+    return NULL;
+
+  int fd = ::fileno(f);
+
+  void *base =
+      mmap(NULL, (size_t)mappedSize, PROT_READ, MAP_PRIVATE, fd, (off_t)alignedOffset);
+
+  if(base == MAP_FAILED)
+  {
+    RDCWARN("Couldn't map %llu bytes at %llu: %s", length, offset, strerror(errno));
+    return NULL;
+  }
+
+  MappedView *ret = new MappedView;
+  ret->base = base;
+  ret->mappedSize = (size_t)mappedSize;
+  ret->data = (const byte *)base + (offset - alignedOffset);
+  ret->refcount = 1;
+  return ret;
+}
+
+const byte *mapview_data(MappedView *view)
+{
+  return view ? view->data : NULL;
+}
+
+void mapview_addref(MappedView *view)
+{
+  if(view)
+    Atomic::Inc32(&view->refcount);
+}
+
+void mapview_close(MappedView *view)
+{
+  if(view && Atomic::Dec32(&view->refcount) == 0)
+  {
+    munmap(view->base, view->mappedSize);
+    delete view;
+  }
+}
+
 bool IsUntrustedFile(const rdcstr &filename)
 {
   // do android/linux have any way of marking files as potentially unsafe?
@@ -0,0 +1,496 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "common/common.h"
+#include "common/threading.h"
+#include "os/os_specific.h"
+
+#if ENABLED(RDOC_LINUX)
+
+namespace WriteTracking
+{
+struct Region
+{
+  // these are read by the fault handler, which only looks at active slots. They're set before a
+  // slot is marked active and cleared after it's released.
+  byte *base = NULL;
+  size_t size = 0;
+  uint64_t *dirty = NULL;
+  size_t dirtyWords = 0;
+  int32_t active = 0;
+
+  // the range that was requested, relative to base
+  size_t offset = 0;
+  size_t requestedSize = 0;
+};
+
+// the fault handler can't take locks or allocate, so regions live in a fixed table. Slots are only
+// claimed and released under the lock, and the handler only reads them.
+static const size_t MaxRegions = 256;
+static Region regionTable[MaxRegions];
+static Threading::CriticalSection regionLock;
+static struct sigaction prevAction;
+static bool handlerInstalled = false;
+static size_t pageSize = 0;
+
+// incremented each time a region is released, after its pages are writeable again
+static int32_t releaseCount = 0;
+
+// the last fault on this thread that didn't match any region, see WriteFaultHandler. Initial-exec
+// TLS is never lazily allocated, so it's safe to access from the handler
+static __thread byte *unmatchedFaultAddr __attribute__((tls_model("initial-exec"))) = NULL;
+static __thread int32_t unmatchedFaultReleases __attribute__((tls_model("initial-exec"))) = 0;
+
+// set while passing a fault on, in case the handler we chain to passes it back to us
+static __thread int32_t chainingFault __attribute__((tls_model("initial-exec"))) = 0;
+
+static void ChainFault(int signum, siginfo_t *info, void *context)
+{
+  if(chainingFault)
+  {
+    // nobody wants it, crash as normal
+    signal(signum, SIG_DFL);
+    return;
+  }
+
+  chainingFault = 1;
+
+  // pass it on to whoever was installed before us
+  if(prevAction.sa_flags & SA_SIGINFO)
+  {
+    prevAction.sa_sigaction(signum, info, context);
+  }
+  else if(prevAction.sa_handler == SIG_DFL)
+  {
+    // restore the default handler, returning will re-run the faulting instruction and crash as
+    // normal
+    signal(signum, SIG_DFL);
+  }
+  else if(prevAction.sa_handler != SIG_IGN)
+  {
+    prevAction.sa_handler(signum);
+  }
+
+  chainingFault = 0;
+}
+
+static void WriteFaultHandler(int signum, siginfo_t *info, void *context)
+{
+  // we only write-protect mapped pages, so anything other than a permissions fault isn't ours
+  if(info->si_code != SEGV_ACCERR)
+  {
+    ChainFault(signum, info, context);
+    return;
+  }
+
+  byte *addr = (byte *)info->si_addr;
+
+  const int32_t releases = __atomic_load_n(&releaseCount, __ATOMIC_ACQUIRE);
+
+  for(size_t i = 0; i < MaxRegions; i++)
+  {
+    Region &r = regionTable[i];
+
+    if(!__atomic_load_n(&r.active, __ATOMIC_ACQUIRE))
+      continue;
+
+    byte *base = r.base;
+    if(addr < base || addr >= base + r.size)
+      continue;
+
+    // mark the page as dirty before unprotecting it, so that a concurrent GetWrittenRanges can't
+    // miss it.
+    size_t page = size_t(addr - base) / pageSize;
+    __atomic_fetch_or(&r.dirty[page / 64], 1ULL << (page % 64), __ATOMIC_ACQ_REL);
+
+    mprotect(base + page * pageSize, pageSize, PROT_READ | PROT_WRITE);
+    unmatchedFaultAddr = NULL;
+    return;
+  }
+
+  // a region may have been released between the fault and us looking for it, in which case its
+  // pages are already writeable and retrying the write will succeed. Retry once, and if the same
+  // write faults again without any region being released in between then it isn't ours.
+  if(unmatchedFaultAddr != addr || unmatchedFaultReleases != releases)
+  {
+    unmatchedFaultAddr = addr;
+    unmatchedFaultReleases = releases;
+    return;
+  }
+
+  unmatchedFaultAddr = NULL;
+  ChainFault(signum, info, context);
+}
+
+Region *BeginTracking(void *base, size_t size)
+{
+  if(base == NULL || size == 0)
+    return NULL;
+
+  SCOPED_LOCK(regionLock);
+
+  if(!handlerInstalled)
+    pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+  // someone else may have installed a handler since we did, e.g. a crash reporter. Put ours back in
+  // front of it, since we can't track anything without it
+  struct sigaction current = {};
+  sigaction(SIGSEGV, NULL, &current);
+
+  if(!handlerInstalled || !(current.sa_flags & SA_SIGINFO) ||
+     current.sa_sigaction != &WriteFaultHandler)
+  {
+    struct sigaction action = {};
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    action.sa_sigaction = &WriteFaultHandler;
+
+    if(sigaction(SIGSEGV, &action, &prevAction) != 0)
+    {
+      RDCERR("Couldn't install write tracking fault handler: %d", errno);
+      return NULL;
+    }
+
+    handlerInstalled = true;
+  }
+
+  byte *alignedBase = (byte *)(uintptr_t(base) & ~uintptr_t(pageSize - 1));
+  size_t offset = size_t((byte *)base - alignedBase);
+  size_t alignedSize = AlignUp(offset + size, pageSize);
+  size_t numWords = AlignUp(alignedSize / pageSize, (size_t)64) / 64;
+
+  Region *region = NULL;
+  for(size_t i = 0; i < MaxRegions; i++)
+  {
+    Region &r = regionTable[i];
+
+    if(r.active == 0)
+    {
+      if(region == NULL)
+        region = &r;
+      continue;
+    }
+
+    // protection is per-page, so two regions sharing a page would re-protect or unprotect it
+    // behind each other's back and lose writes. Only one region can track any given page.
+    if(alignedBase < r.base + r.size && r.base < alignedBase + alignedSize)
+    {
+      RDCDEBUG("%p (%zu bytes) shares pages with another tracked region, falling back to diffing",
+               base, size);
+      return NULL;
+    }
+  }
+
+  if(region == NULL)
+  {
+    RDCWARN("Too many regions with write tracking, falling back to diffing");
+    return NULL;
+  }
+
+  // bitmaps stay with their slot and are only reallocated when a bigger region reuses it, so a
+  // handler that was still running when the previous region was released can't touch freed memory.
+  if(region->dirtyWords < numWords)
+  {
+    delete[] region->dirty;
+    region->dirty = new uint64_t[numWords];
+    region->dirtyWords = numWords;
+  }
+
+  memset(region->dirty, 0, numWords * sizeof(uint64_t));
+
+  region->base = alignedBase;
+  region->size = alignedSize;
+  region->offset = offset;
+  region->requestedSize = size;
+  __atomic_store_n(&region->active, 1, __ATOMIC_RELEASE);
+
+  if(mprotect(alignedBase, alignedSize, PROT_READ) != 0)
+  {
+    RDCWARN("Couldn't write-protect %p (%zu bytes): %d, falling back to diffing", alignedBase,
+            alignedSize, errno);
+    __atomic_store_n(&region->active, 0, __ATOMIC_RELEASE);
+    region->base = NULL;
+    region->size = 0;
+    return NULL;
+  }
+
+  return region;
+}
+
+static void AddWrittenRun(Region *region, size_t firstPage, size_t endPage,
+                          rdcarray<rdcpair<size_t, size_t>> &ranges)
+{
+  mprotect(region->base + firstPage * pageSize, (endPage - firstPage) * pageSize, PROT_READ);
+
+  // clip to the requested range, and rebase so it's relative to what the caller passed in
+  size_t start = firstPage * pageSize;
+  size_t end = endPage * pageSize;
+
+  start = start > region->offset ? start - region->offset : 0;
+  end = RDCMIN(end - region->offset, region->requestedSize);
+
+  if(end > start)
+    ranges.push_back({start, end});
+}
+
+void GetWrittenRanges(Region *region, rdcarray<rdcpair<size_t, size_t>> &ranges)
+{
+  ranges.clear();
+
+  if(region == NULL)
+    return;
+
+  const size_t numPages = region->size / pageSize;
+  const size_t numWords = AlignUp(numPages, (size_t)64) / 64;
+
+  size_t runStart = 0;
+  bool inRun = false;
+
+  for(size_t w = 0; w < numWords; w++)
+  {
+    // clearing the bits *before* re-protecting the pages means a write in between is either
+    // already visible to the caller, or it faults again and is marked for next time.
+    uint64_t bits = __atomic_exchange_n(&region->dirty[w], 0ULL, __ATOMIC_ACQ_REL);
+
+    if(bits == 0 && !inRun)
+      continue;
+
+    for(size_t b = 0; b < 64 && w * 64 + b < numPages; b++)
+    {
+      const size_t page = w * 64 + b;
+      const bool dirty = ((bits >> b) & 1) != 0;
+
+      if(dirty && !inRun)
+      {
+        runStart = page;
+        inRun = true;
+      }
+      else if(!dirty && inRun)
+      {
+        AddWrittenRun(region, runStart, page, ranges);
+        inRun = false;
+      }
+    }
+  }
+
+  if(inRun)
+    AddWrittenRun(region, runStart, numPages, ranges);
+}
+
+void EndTracking(Region *region)
+{
+  if(region == NULL)
+    return;
+
+  SCOPED_LOCK(regionLock);
+
+  // make everything writeable before deactivating, so any fault still in flight for this region
+  // will find its page already writeable when the handler retries it.
+  mprotect(region->base, region->size, PROT_READ | PROT_WRITE);
+  __atomic_store_n(&region->active, 0, __ATOMIC_RELEASE);
+  region->base = NULL;
+  region->size = 0;
+  __atomic_fetch_add(&releaseCount, 1, __ATOMIC_RELEASE);
+}
+};
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+TEST_CASE("Test write tracking", "[osspecific]")
+{
+  const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  const size_t heapSize = pageSize * 64 + 123;
+
+  byte *heap = (byte *)mmap(NULL, heapSize + pageSize, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  REQUIRE(heap != MAP_FAILED);
+
+  // start partway into a page, as mapped ranges often do
+  byte *base = heap + 100;
+
+  WriteTracking::Region *region = WriteTracking::BeginTracking(base, heapSize);
+  REQUIRE(region != NULL);
+
+  rdcarray<rdcpair<size_t, size_t>> ranges;
+
+  WriteTracking::GetWrittenRanges(region, ranges);
+  CHECK(ranges.empty());
+
+  // reads aren't writes
+  volatile byte read = base[500];
+  (void)read;
+
+  WriteTracking::GetWrittenRanges(region, ranges);
+  CHECK(ranges.empty());
+
+  for(int round = 0; round < 4; round++)
+  {
+    rdcarray<size_t> written;
+
+    for(int i = 0; i < 20; i++)
+    {
+      size_t offs = size_t(rand()) % heapSize;
+      base[offs] = byte(i + 1);
+      written.push_back(offs);
+    }
+
+    // the very first and last bytes are outside of whole pages
+    if(round == 1)
+    {
+      base[0]++;
+      base[heapSize - 1]++;
+      written.push_back(0);
+      written.push_back(heapSize - 1);
+    }
+
+    WriteTracking::GetWrittenRanges(region, ranges);
+
+    size_t rangeBytes = 0;
+
+    for(const rdcpair<size_t, size_t> &range : ranges)
+    {
+      CHECK(range.first < range.second);
+      CHECK(range.second <= heapSize);
+
+      bool hasWrite = false;
+      for(size_t offs : written)
+        hasWrite |= (offs >= range.first && offs < range.second);
+      CHECK(hasWrite);
+
+      rangeBytes += range.second - range.first;
+    }
+
+    CHECK(rangeBytes <= written.size() * pageSize);
+
+    for(size_t offs : written)
+    {
+      bool found = false;
+      for(const rdcpair<size_t, size_t> &range : ranges)
+        found |= (offs >= range.first && offs < range.second);
+      CHECK(found);
+    }
+
+    // the pages are protected again, so nothing is reported twice
+    WriteTracking::GetWrittenRanges(region, ranges);
+    CHECK(ranges.empty());
+  }
+
+  WriteTracking::EndTracking(region);
+
+  // writes after tracking has ended go straight through
+  base[0] = 1;
+  base[heapSize - 1] = 2;
+
+  munmap(heap, heapSize + pageSize);
+}
+
+TEST_CASE("Test write tracking with regions sharing a page", "[osspecific]")
+{
+  const size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+
+  byte *heap = (byte *)mmap(NULL, pageSize * 2, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  REQUIRE(heap != MAP_FAILED);
+
+  // two small maps that don't overlap, but both round out to the first page
+  byte *first = heap + 100;
+  byte *second = heap + 1000;
+
+  WriteTracking::Region *region = WriteTracking::BeginTracking(first, 200);
+  REQUIRE(region != NULL);
+
+  // the second can't be tracked without interfering with the first, so its caller has to diff
+  CHECK(WriteTracking::BeginTracking(second, 200) == NULL);
+
+  // a region on a different page is unaffected
+  WriteTracking::Region *other = WriteTracking::BeginTracking(heap + pageSize + 10, 200);
+  CHECK(other != NULL);
+  WriteTracking::EndTracking(other);
+
+  rdcarray<rdcpair<size_t, size_t>> ranges;
+
+  // writes through both maps still land, and the first region sees its own
+  second[0] = 1;
+  first[50] = 2;
+
+  WriteTracking::GetWrittenRanges(region, ranges);
+  REQUIRE(ranges.size() == 1);
+  CHECK(ranges[0].first == 0);
+  CHECK(ranges[0].second == 200);
+
+  second[1] = 3;
+  first[51] = 4;
+
+  WriteTracking::GetWrittenRanges(region, ranges);
+  CHECK(ranges.size() == 1);
+
+  WriteTracking::EndTracking(region);
+
+  // once the first has gone the second can be tracked
+  region = WriteTracking::BeginTracking(second, 200);
+  REQUIRE(region != NULL);
+
+  second[10] = 5;
+
+  WriteTracking::GetWrittenRanges(region, ranges);
+  REQUIRE(ranges.size() == 1);
+  CHECK(ranges[0].first == 0);
+  CHECK(ranges[0].second == 200);
+
+  WriteTracking::EndTracking(region);
+
+  CHECK(second[0] == 1);
+  CHECK(second[1] == 3);
+  CHECK(second[10] == 5);
+  CHECK(first[51] == 4);
+
+  munmap(heap, pageSize * 2);
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
+
+#else
+
+// only implemented on linux for now, elsewhere callers fall back to comparing against a copy
+WriteTracking::Region *WriteTracking::BeginTracking(void *base, size_t size)
+{
+  return NULL;
+}
+
+void WriteTracking::GetWrittenRanges(Region *region, rdcarray<rdcpair<size_t, size_t>> &ranges)
+{
+  ranges.clear();
+}
+
+void WriteTracking::EndTracking(Region *region)
+{
+}
+
+#endif
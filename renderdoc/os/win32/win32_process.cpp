@@ -1751,3 +1751,18 @@ void Process::Shutdown()
 {
   // nothing to do
 }
+
+// write tracking isn't implemented on windows, callers fall back to comparing against a copy
+WriteTracking::Region *WriteTracking::BeginTracking(void *base, size_t size)
+{
+  return NULL;
+}
+
+void WriteTracking::GetWrittenRanges(Region *region, rdcarray<rdcpair<size_t, size_t>> &ranges)
+{
+  ranges.clear();
+}
+
+void WriteTracking::EndTracking(Region *region)
+{
+}
@@ -695,6 +695,31 @@ void ftruncateat(FILE *f, uint64_t length)
   ::_chsize_s(fd, (int64_t)length);
 }
 
+// lock a single byte far past any real data, so the lock doesn't block reads or writes of the
+// file contents by processes that don't take it
+static OVERLAPPED LockRange()
+{
+  OVERLAPPED ov = {};
+  ov.Offset = 0xffffffff;
+  ov.OffsetHigh = 0x7fffffff;
+  return ov;
+}
+
+bool flockexclusive(FILE *f)
+{
+  HANDLE file = (HANDLE)::_get_osfhandle(::_fileno(f));
+  OVERLAPPED ov = LockRange();
+  return LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, 1, 0, &ov) == TRUE;
+}
+
+void funlock(FILE *f)
+{
+  ::fflush(f);
+  HANDLE file = (HANDLE)::_get_osfhandle(::_fileno(f));
+  OVERLAPPED ov = LockRange();
+  UnlockFileEx(file, 0, 1, 0, &ov);
+}
+
 bool fflush(FILE *f)
 {
   return ::fflush(f) == 0;
@@ -705,6 +730,77 @@ int fclose(FILE *f)
   return ::fclose(f);
 }
 
+struct MappedView
+{
+  void *base;
+  const byte *data;
+  int32_t refcount;
+};
+
+MappedView *mapview_open(FILE *f, uint64_t offset, uint64_t length)
+{
+  if(f == NULL || length == 0)
+    return NULL;
+
+  // view offsets must be aligned to the allocation granularity, not just the page size
+  SYSTEM_INFO info = {};
+  GetSystemInfo(&info);
+
+  uint64_t alignedOffset = offset - (offset % info.dwAllocationGranularity);
+  uint64_t mappedSize = length + (offset - alignedOffset);
+
+  if(mappedSize != (uint64_t)(SIZE_T)mappedSize)
+    return NULL;
+
+  HANDLE file = (HANDLE)::_get_osfhandle(::_fileno(f));
+
+  HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+
+  if(mapping == NULL)
+  {
+    RDCWARN("Couldn't create file mapping: %u", GetLastError());
+    return NULL;
+  }
+
+  void *base = MapViewOfFile(mapping, FILE_MAP_READ, DWORD(alignedOffset >> 32),
+                             DWORD(alignedOffset & 0xffffffff), (SIZE_T)mappedSize);
+
+  // the view keeps the mapping alive, we don't need the handle anymore
+  CloseHandle(mapping);
+
+  if(base == NULL)
+  {
+    RDCWARN("Couldn't map %llu bytes at %llu: %u", length, offset, GetLastError());
+    return NULL;
+  }
+
+  MappedView *ret = new MappedView;
+  ret->base = base;
+  ret->data = (const byte *)base + (offset - alignedOffset);
+  ret->refcount = 1;
+  return ret;
+}
+
+const byte *mapview_data(MappedView *view)
+{
+  return view ? view->data : NULL;
+}
+
+void mapview_addref(MappedView *view)
+{
+  if(view)
+    Atomic::Inc32(&view->refcount);
+}
+
+void mapview_close(MappedView *view)
+{
+  if(view && Atomic::Dec32(&view->refcount) == 0)
+  {
+    UnmapViewOfFile(view->base);
+    delete view;
+  }
+}
+
 LogFileHandle *logfile_open(const rdcstr &filename)
 {
   rdcwstr wfn = StringFormat::UTF82Wide(filename);
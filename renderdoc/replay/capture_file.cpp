@@ -462,6 +462,10 @@ ResultDetails CaptureFile::Convert(const rdcstr &filename, const rdcstr &filetyp
   if(output.Error() != ResultCode::Succeeded)
     return output.Error();
 
+  // the chunk index is always regenerated for the frame capture section we write, so that captures
+  // from before it existed have one backfilled.
+  rdcarray<ChunkIndexEntry> chunkIndex;
+
   // when we don't have a frame capture section, write it from the structured data.
   int frameCaptureIndex = m_RDC->SectionIndex(SectionType::FrameCapture);
 
@@ -478,7 +482,7 @@ ResultDetails CaptureFile::Convert(const rdcstr &filename, const rdcstr &filetyp
       return result;
 
     SectionProperties frameCapture;
-    frameCapture.flags = SectionFlags::ZstdCompressed;
+    frameCapture.flags = SectionFlags::ZstdCompressed | SectionFlags::IndexedBlocks;
     frameCapture.type = SectionType::FrameCapture;
     frameCapture.name = ToStr(frameCapture.type);
     frameCapture.version = file->version;
@@ -487,8 +491,12 @@ ResultDetails CaptureFile::Convert(const rdcstr &filename, const rdcstr &filetyp
 
     WriteSerialiser ser(writer, Ownership::Nothing);
 
+    ser.SetChunkIndexRecording(true);
+
     ser.WriteStructuredFile(*file, exportProgress);
 
+    chunkIndex.swap(ser.GetChunkIndex());
+
     writer->Finish();
 
     RDResult ret = writer->GetError();
@@ -502,7 +510,7 @@ ResultDetails CaptureFile::Convert(const rdcstr &filename, const rdcstr &filetyp
   {
     // otherwise write it straight, but compress it to zstd
     SectionProperties props = m_RDC->GetSectionProperties(frameCaptureIndex);
-    props.flags = SectionFlags::ZstdCompressed;
+    props.flags = SectionFlags::ZstdCompressed | SectionFlags::IndexedBlocks;
 
     StreamWriter *writer = output.WriteSection(props);
     StreamReader *reader = m_RDC->ReadSection(frameCaptureIndex);
@@ -520,14 +528,31 @@ ResultDetails CaptureFile::Convert(const rdcstr &filename, const rdcstr &filetyp
 
     if(ret != ResultCode::Succeeded)
       return ret;
+
+    // the chunks are copied verbatim so any existing index is still valid, otherwise scan the
+    // section to build one
+    if(!m_RDC->GetChunkIndex(chunkIndex))
+    {
+      reader = m_RDC->ReadSection(frameCaptureIndex);
+
+      ret = RDCFile::BuildChunkIndex(reader, chunkIndex);
+
+      delete reader;
+
+      // a capture we can't index is still worth converting, it just won't have an index
+      if(ret != ResultCode::Succeeded)
+        RDCWARN("Couldn't build chunk index for capture: %s", ResultDetails(ret).Message().c_str());
+    }
   }
 
+  output.WriteChunkIndex(chunkIndex);
+
   // write all other sections
   for(int i = 0; i < m_RDC->NumSections(); i++)
   {
     const SectionProperties &props = m_RDC->GetSectionProperties(i);
 
-    if(props.type == SectionType::FrameCapture)
+    if(props.type == SectionType::FrameCapture || props.type == SectionType::ChunkIndex)
       continue;
 
     StreamWriter *writer = output.WriteSection(props);
@@ -841,12 +866,11 @@ rdcarray<rdcstr> CaptureFile::GetResolve(const rdcarray<uint64_t> &callstack)
     return ret;
   }
 
-  ret.reserve(callstack.size());
-  for(uint64_t frame : callstack)
-  {
-    Callstack::AddressDetails info = m_Resolver->GetAddr(frame);
-    ret.push_back(info.formattedString());
-  }
+  rdcarray<Callstack::AddressDetails> info = m_Resolver->GetAddrs(callstack);
+
+  ret.reserve(info.size());
+  for(Callstack::AddressDetails &frame : info)
+    ret.push_back(frame.formattedString());
 
   return ret;
 }
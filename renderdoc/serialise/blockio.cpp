@@ -0,0 +1,646 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "blockio.h"
+#include "lz4io.h"
+#include "zstdio.h"
+
+// how much uncompressed data to keep decompressing ahead of the read position
+static const uint64_t readAheadSize = 16 * 1024 * 1024;
+
+// sanity limit on the size of any one block, well above what any compressor writes
+static const uint64_t maxBlockSize = 64 * 1024 * 1024;
+
+IndexedDecompressor *IndexedDecompressor::Create(FILE *file, uint64_t dataOffset,
+                                                 uint64_t diskLength, uint64_t uncompressedSize,
+                                                 SectionFlags flags)
+{
+  SectionFlags codec = SectionFlags::NoFlags;
+  if(flags & SectionFlags::LZ4Compressed)
+    codec = SectionFlags::LZ4Compressed;
+  else if(flags & SectionFlags::ZstdCompressed)
+    codec = SectionFlags::ZstdCompressed;
+
+  if(file == NULL || codec == SectionFlags::NoFlags || diskLength < sizeof(CompressedBlockFooter))
+    return NULL;
+
+  CompressedBlockFooter footer = {};
+
+  FileIO::fseek64(file, dataOffset + diskLength - sizeof(footer), SEEK_SET);
+  if(FileIO::fread(&footer, 1, sizeof(footer), file) != sizeof(footer))
+    return NULL;
+
+  if(footer.magic != CompressedBlockFooter::Magic)
+    return NULL;
+
+  const uint64_t indexSize = footer.numBlocks * sizeof(CompressedBlock);
+
+  if(footer.numBlocks > 0xffffffffULL || indexSize > diskLength - sizeof(footer))
+    return NULL;
+
+  rdcarray<CompressedBlock> index;
+  index.resize((size_t)footer.numBlocks);
+
+  const uint64_t indexOffset = diskLength - sizeof(footer) - indexSize;
+
+  FileIO::fseek64(file, dataOffset + indexOffset, SEEK_SET);
+  if(FileIO::fread(index.data(), 1, (size_t)indexSize, file) != indexSize)
+    return NULL;
+
+  // validate the index so that we don't have to check anything later. Blocks must start at 0,
+  // be strictly increasing in both uncompressed and compressed offsets, and lie within the data.
+  if(index.empty() && uncompressedSize > 0)
+    return NULL;
+
+  uint64_t maxSize = 0;
+
+  for(size_t i = 0; i < index.size(); i++)
+  {
+    uint64_t uncompEnd = i + 1 < index.size() ? index[i + 1].uncompressedOffset : uncompressedSize;
+    uint64_t compEnd = i + 1 < index.size() ? index[i + 1].compressedOffset : indexOffset;
+
+    if(i == 0 && (index[i].uncompressedOffset != 0 || index[i].compressedOffset != 0))
+      return NULL;
+
+    if(uncompEnd <= index[i].uncompressedOffset ||
+       compEnd <= index[i].compressedOffset + sizeof(uint32_t))
+      return NULL;
+
+    maxSize = RDCMAX(maxSize, uncompEnd - index[i].uncompressedOffset);
+  }
+
+  if(maxSize > maxBlockSize)
+    return NULL;
+
+  IndexedDecompressor *ret = new IndexedDecompressor;
+
+  ret->m_File = file;
+  ret->m_DataOffset = dataOffset;
+  ret->m_IndexOffset = indexOffset;
+  ret->m_UncompressedSize = uncompressedSize;
+  ret->m_Codec = codec;
+  ret->m_Index.swap(index);
+  ret->m_MaxBlockSize = maxSize;
+
+  size_t numSlots = 4;
+  if(maxSize > 0)
+    numSlots = (size_t)RDCCLAMP<uint64_t>(readAheadSize / maxSize, 4, 128);
+
+  ret->m_Slots.resize(numSlots);
+
+  return ret;
+}
+
+IndexedDecompressor::~IndexedDecompressor()
+{
+  for(Slot &slot : m_Slots)
+  {
+    Retire(slot);
+    FreeAlignedBuffer(slot.data);
+  }
+}
+
+bool IndexedDecompressor::Recompress(Compressor *comp)
+{
+  bool success = true;
+
+  for(uint32_t i = 0; success && i < m_Index.size(); i++)
+  {
+    Slot *slot = FetchBlock(i);
+
+    if(!slot)
+      return false;
+
+    success &= comp->Write(slot->data, slot->size);
+
+    if(!success)
+      m_Error = comp->GetError();
+  }
+  success &= comp->Finish();
+
+  return success;
+}
+
+bool IndexedDecompressor::Read(void *data, uint64_t numBytes)
+{
+  if(m_Error != ResultCode::Succeeded)
+    return false;
+
+  if(numBytes == 0)
+    return true;
+
+  if(m_Offset + numBytes > m_UncompressedSize)
+  {
+    SET_ERROR_RESULT(m_Error, ResultCode::FileIOFailed,
+                     "Reading off the end of indexed compressed data");
+    return false;
+  }
+
+  byte *dst = (byte *)data;
+
+  while(numBytes > 0)
+  {
+    uint32_t block = FindBlock(m_Offset);
+
+    Slot *slot = FetchBlock(block);
+
+    if(!slot)
+      return false;
+
+    uint64_t blockOffset = m_Offset - m_Index[block].uncompressedOffset;
+    uint64_t copySize = RDCMIN(numBytes, slot->size - blockOffset);
+
+    if(dst)
+    {
+      memcpy(dst, slot->data + blockOffset, (size_t)copySize);
+      dst += copySize;
+    }
+
+    m_Offset += copySize;
+    numBytes -= copySize;
+  }
+
+  return true;
+}
+
+bool IndexedDecompressor::Seek(uint64_t offset)
+{
+  if(offset > m_UncompressedSize)
+    return false;
+
+  m_Offset = offset;
+
+  return true;
+}
+
+uint32_t IndexedDecompressor::FindBlock(uint64_t offset)
+{
+  const uint32_t numBlocks = (uint32_t)m_Index.size();
+
+  // reading is nearly always sequential, so check the current and next blocks first
+  for(uint32_t b = m_CurBlock; b < numBlocks && b <= m_CurBlock + 1; b++)
+  {
+    uint64_t end = b + 1 < numBlocks ? m_Index[b + 1].uncompressedOffset : m_UncompressedSize;
+    if(m_Index[b].uncompressedOffset <= offset && offset < end)
+    {
+      m_CurBlock = b;
+      return b;
+    }
+  }
+
+  // otherwise binary search for the last block starting at or before the offset
+  uint32_t lo = 0, hi = numBlocks;
+  while(hi - lo > 1)
+  {
+    uint32_t mid = (lo + hi) / 2;
+    if(m_Index[mid].uncompressedOffset <= offset)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  m_CurBlock = lo;
+  return lo;
+}
+
+IndexedDecompressor::Slot *IndexedDecompressor::FetchBlock(uint32_t block)
+{
+  const uint32_t numSlots = (uint32_t)m_Slots.size();
+
+  // when we can use the job system, make sure the blocks after this one are being decompressed in
+  // the background. Otherwise we only fetch the block that's needed
+  uint32_t lastBlock = block;
+  if(Threading::JobSystem::CanAddJobs())
+    lastBlock = RDCMIN(block + numSlots, (uint32_t)m_Index.size()) - 1;
+
+  for(uint32_t b = block; b <= lastBlock; b++)
+  {
+    if(m_Slots[b % numSlots].block != b)
+      Dispatch(b);
+  }
+
+  Slot &slot = m_Slots[block % numSlots];
+
+  // if no worker has started on this block yet, decompress it here rather than waiting. Otherwise
+  // wait for the worker to finish
+  if(Atomic::CmpExch32(&slot.state, 0, 1) == 0)
+  {
+    Decompress(slot);
+  }
+  else
+  {
+    while(Atomic::CmpExch32(&slot.state, 2, 2) != 2)
+      Threading::Sleep(0);
+  }
+
+  if(!slot.success)
+  {
+    m_Error = slot.error;
+    return NULL;
+  }
+
+  return &slot;
+}
+
+void IndexedDecompressor::Dispatch(uint32_t block)
+{
+  Slot &slot = m_Slots[block % m_Slots.size()];
+
+  // the slot may still be referenced by a job for a block we skipped past, e.g. after seeking
+  Retire(slot);
+
+  slot.block = block;
+  slot.state = 0;
+  slot.success = false;
+  slot.error = RDResult();
+  slot.size = (block + 1 < m_Index.size() ? m_Index[block + 1].uncompressedOffset
+                                          : m_UncompressedSize) -
+              m_Index[block].uncompressedOffset;
+
+  if(slot.data == NULL)
+    slot.data = AllocAlignedBuffer(m_MaxBlockSize);
+
+  // reads from the file only happen here on the reading thread, and we always seek since the file
+  // handle may be shared with other readers
+  const uint64_t compEnd =
+      block + 1 < m_Index.size() ? m_Index[block + 1].compressedOffset : m_IndexOffset;
+  const uint64_t maxCompSize = compEnd - m_Index[block].compressedOffset - sizeof(uint32_t);
+
+  uint32_t compSize = 0;
+
+  FileIO::fseek64(m_File, m_DataOffset + m_Index[block].compressedOffset, SEEK_SET);
+  bool success = FileIO::fread(&compSize, 1, sizeof(compSize), m_File) == sizeof(compSize);
+
+  if(success && compSize > maxCompSize)
+  {
+    SET_ERROR_RESULT(slot.error, ResultCode::FileCorrupted,
+                     "Compressed block %u has invalid size %u", block, compSize);
+    slot.state = 2;
+    return;
+  }
+
+  if(success)
+  {
+    slot.compressed.resize(compSize);
+    success = FileIO::fread(slot.compressed.data(), 1, compSize, m_File) == compSize;
+  }
+
+  if(!success)
+  {
+    SET_ERROR_RESULT(slot.error, ResultCode::FileIOFailed, "Error reading compressed block %u: %s",
+                     block, FileIO::ErrorString().c_str());
+    slot.state = 2;
+    return;
+  }
+
+  if(Threading::JobSystem::CanAddJobs())
+  {
+    slot.queued = 1;
+    slot.job = Threading::JobSystem::AddJob([this, &slot]() {
+      // the reader might have claimed this block already if it caught up with us
+      if(Atomic::CmpExch32(&slot.state, 0, 1) == 0)
+        Decompress(slot);
+
+      // after this the slot must not be touched
+      Atomic::Dec32(&slot.queued);
+    }, {}, "Decompress block");
+  }
+}
+
+void IndexedDecompressor::Decompress(Slot &slot)
+{
+  if(m_Codec == SectionFlags::LZ4Compressed)
+    slot.success = LZ4Decompressor::DecompressBlock(
+        slot.compressed.data(), slot.compressed.size(), slot.data, slot.size, slot.error);
+  else
+    slot.success = ZSTDDecompressor::DecompressBlock(
+        slot.compressed.data(), slot.compressed.size(), slot.data, slot.size, slot.error);
+
+  // mark as finished, from 1 to 2
+  Atomic::Inc32(&slot.state);
+}
+
+void IndexedDecompressor::Retire(Slot &slot)
+{
+  // claim the block if no job has started on it, so the job does nothing when it runs
+  Atomic::CmpExch32(&slot.state, 0, 1);
+
+  // the job can't have been freed while it's still queued. Waiting on it rather than spinning
+  // lets us run it ourselves if no worker has picked it up, e.g. if we're inside a job ourselves
+  if(Atomic::CmpExch32(&slot.queued, 0, 0) != 0)
+    Threading::JobSystem::WaitForJob(slot.job);
+
+  slot.job = NULL;
+}
+
+// upper bound on the memory used by blocks that are being filled, compressed, or waiting to be
+// written
+static const uint64_t parallelMemoryBudget = 64 * 1024 * 1024;
+
+ParallelCompressor::ParallelCompressor(StreamWriter *write, Ownership own, SectionFlags codec,
+                                       uint32_t numThreads)
+    : Compressor(write, own)
+{
+  if(codec & SectionFlags::ZstdCompressed)
+  {
+    m_Codec = SectionFlags::ZstdCompressed;
+    m_BlockSize = ZSTDCompressor::BlockSize;
+    m_BlockBound = ZSTDCompressor::CompressedBlockBound;
+  }
+  else
+  {
+    m_Codec = SectionFlags::LZ4Compressed;
+    m_BlockSize = LZ4Compressor::BlockSize;
+    m_BlockBound = LZ4Compressor::CompressedBlockBound;
+  }
+
+  // keep one core for the thread producing the data
+  if(numThreads == 0)
+    numThreads = RDCMAX(1U, Threading::NumberOfCores() - 1);
+
+  // we need enough blocks for every worker to have one while another is being filled
+  size_t numBlocks = (size_t)RDCMAX<uint64_t>(parallelMemoryBudget / (m_BlockSize + m_BlockBound), 2);
+
+  m_NumThreads = numThreads > 1 ? RDCMIN(numThreads, uint32_t(numBlocks - 1)) : 0;
+
+  // with no workers there's no point in more than one block
+  m_Blocks.resize(m_NumThreads > 0 ? numBlocks : 1);
+}
+
+ParallelCompressor::~ParallelCompressor()
+{
+  if(!m_Threads.empty())
+  {
+    {
+      SCOPED_LOCK(m_QueueLock);
+      m_Shutdown = true;
+    }
+
+    m_WorkSemaphore->Wake((uint32_t)m_Threads.size());
+
+    for(Threading::ThreadHandle t : m_Threads)
+    {
+      Threading::JoinThread(t);
+      Threading::CloseThread(t);
+    }
+  }
+
+  if(m_WorkSemaphore)
+    m_WorkSemaphore->Destroy();
+  if(m_DoneSemaphore)
+    m_DoneSemaphore->Destroy();
+
+  if(m_ZstdContext)
+    ZSTD_freeCCtx(m_ZstdContext);
+
+  for(Block &block : m_Blocks)
+  {
+    FreeAlignedBuffer(block.input);
+    FreeAlignedBuffer(block.output);
+  }
+}
+
+bool ParallelCompressor::Write(const void *data, uint64_t numBytes)
+{
+  if(m_Error != ResultCode::Succeeded)
+    return false;
+
+  const byte *src = (const byte *)data;
+
+  while(numBytes > 0)
+  {
+    // if the current block is full and there's more data coming, it wasn't the last block. Once
+    // there's more than one block it's worth starting the workers
+    if(m_Blocks[m_NextSubmit % m_Blocks.size()].inputSize == m_BlockSize)
+    {
+      StartWorkers();
+
+      if(!Submit())
+        return false;
+    }
+
+    Block &block = m_Blocks[m_NextSubmit % m_Blocks.size()];
+
+    // blocks are only allocated once they're needed, so small sections stay small
+    if(block.input == NULL)
+    {
+      block.input = AllocAlignedBuffer(m_BlockSize);
+      block.output = AllocAlignedBuffer(m_BlockBound);
+    }
+
+    uint64_t copySize = RDCMIN(numBytes, m_BlockSize - block.inputSize);
+    memcpy(block.input + block.inputSize, src, (size_t)copySize);
+
+    block.inputSize += copySize;
+    src += copySize;
+    numBytes -= copySize;
+  }
+
+  return true;
+}
+
+bool ParallelCompressor::Finish()
+{
+  if(m_Error != ResultCode::Succeeded)
+    return false;
+
+  bool success = true;
+
+  // submit whatever is in the current block, then write everything out
+  if(m_Blocks[m_NextSubmit % m_Blocks.size()].inputSize > 0)
+  {
+    // if this is the only block there's nothing to parallelise, so don't start any workers
+    if(m_NextSubmit > 0)
+      StartWorkers();
+
+    success &= Submit();
+  }
+
+  success &= WriteCompleted(true);
+
+  if(success)
+    success &= WriteBlockIndex();
+
+  return success;
+}
+
+void ParallelCompressor::StartWorkers()
+{
+  if(m_NumThreads == 0 || !m_Threads.empty())
+    return;
+
+  m_WorkSemaphore = Threading::Semaphore::Create();
+  m_DoneSemaphore = Threading::Semaphore::Create();
+
+  for(uint32_t i = 0; i < m_NumThreads; i++)
+    m_Threads.push_back(Threading::CreateThread([this]() { WorkerThread(); }));
+}
+
+bool ParallelCompressor::Submit()
+{
+  Block &block = m_Blocks[m_NextSubmit % m_Blocks.size()];
+  m_NextSubmit++;
+
+  block.state = 1;
+
+  if(m_Threads.empty())
+  {
+    if(m_Codec == SectionFlags::ZstdCompressed && m_ZstdContext == NULL)
+      m_ZstdContext = ZSTD_createCCtx();
+
+    Compress(block, m_ZstdContext);
+  }
+  else
+  {
+    {
+      SCOPED_LOCK(m_QueueLock);
+      m_Queue.push_back(&block);
+    }
+
+    m_WorkSemaphore->Wake(1);
+  }
+
+  // write out anything that's finished, waiting if the next block to fill is still in use
+  return WriteCompleted(false);
+}
+
+bool ParallelCompressor::WriteCompleted(bool all)
+{
+  while(m_NextWrite < m_NextSubmit)
+  {
+    Block &block = m_Blocks[m_NextWrite % m_Blocks.size()];
+
+    if(Atomic::CmpExch32(&block.state, 2, 2) != 2)
+    {
+      // we only need to wait when flushing everything, or if the block we want to fill next is
+      // this one that hasn't been written yet. Nothing else can be written before this block
+      if(!all && m_NextSubmit - m_NextWrite < m_Blocks.size())
+        return true;
+
+      // tell the workers we're waiting, then check again in case the block finished in between
+      Atomic::CmpExch32(&m_WriterWaiting, 0, 1);
+
+      if(Atomic::CmpExch32(&block.state, 2, 2) != 2)
+        m_DoneSemaphore->WaitForWake();
+
+      Atomic::CmpExch32(&m_WriterWaiting, 1, 0);
+
+      continue;
+    }
+
+    if(!WriteBlock(block))
+      return false;
+
+    m_NextWrite++;
+  }
+
+  return true;
+}
+
+bool ParallelCompressor::WriteBlock(Block &block)
+{
+  if(!block.success)
+  {
+    m_Error = block.error;
+    return false;
+  }
+
+  AddIndexedBlock(block.inputSize);
+
+  bool success = true;
+
+  // same layout as the serial compressors write
+  if(m_Codec == SectionFlags::ZstdCompressed)
+    success &= m_Write->Write((uint32_t)block.outputSize);
+  else
+    success &= m_Write->Write((int32_t)block.outputSize);
+  success &= m_Write->Write(block.output, block.outputSize);
+
+  if(!success)
+  {
+    m_Error = m_Write->GetError();
+    return false;
+  }
+
+  block.inputSize = block.outputSize = 0;
+  block.state = 0;
+
+  return true;
+}
+
+void ParallelCompressor::Compress(Block &block, ZSTD_CCtx *zstdContext)
+{
+  block.error = RDResult();
+
+  if(m_Codec == SectionFlags::ZstdCompressed)
+    block.success = ZSTDCompressor::CompressBlock(zstdContext, block.input, block.inputSize,
+                                                  block.output, block.outputSize, block.error);
+  else
+    block.success = LZ4Compressor::CompressBlock(block.input, block.inputSize, block.output,
+                                                 block.outputSize, block.error);
+
+  // mark as finished, from 1 to 2
+  Atomic::Inc32(&block.state);
+
+  // wake the writer if it's waiting. It might not be waiting for this block, but then it will just
+  // check and go back to sleep
+  if(Atomic::CmpExch32(&m_WriterWaiting, 1, 0) == 1)
+    m_DoneSemaphore->Wake(1);
+}
+
+void ParallelCompressor::WorkerThread()
+{
+  Threading::SetCurrentThreadName("RenderDoc - Compression");
+
+  ZSTD_CCtx *zstdContext = NULL;
+  if(m_Codec == SectionFlags::ZstdCompressed)
+    zstdContext = ZSTD_createCCtx();
+
+  while(true)
+  {
+    m_WorkSemaphore->WaitForWake();
+
+    Block *block = NULL;
+
+    {
+      SCOPED_LOCK(m_QueueLock);
+
+      if(!m_Queue.empty())
+      {
+        block = m_Queue[0];
+        m_Queue.erase(0);
+      }
+      else if(m_Shutdown)
+      {
+        break;
+      }
+    }
+
+    if(block)
+      Compress(*block, zstdContext);
+  }
+
+  if(zstdContext)
+    ZSTD_freeCCtx(zstdContext);
+}
@@ -0,0 +1,157 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include "zstd/zstd.h"
+#include "streamio.h"
+
+// Decompresses sections written with SectionFlags::IndexedBlocks. Since every block is independent
+// the reader can seek to any offset, and when the job system is available blocks ahead of the read
+// position are decompressed in parallel on the workers.
+class IndexedDecompressor : public Decompressor
+{
+public:
+  // reads the block index from the end of the section. Returns NULL if there's no valid index, in
+  // which case the section can still be read sequentially by the normal decompressors.
+  static IndexedDecompressor *Create(FILE *file, uint64_t dataOffset, uint64_t diskLength,
+                                     uint64_t uncompressedSize, SectionFlags flags);
+
+  ~IndexedDecompressor();
+
+  bool Recompress(Compressor *comp);
+  bool Read(void *data, uint64_t numBytes);
+  bool Seek(uint64_t offset);
+  bool CanSeek() { return true; }
+
+private:
+  IndexedDecompressor() : Decompressor(NULL, Ownership::Nothing) {}
+  struct Slot
+  {
+    // the block currently held in this slot
+    uint32_t block = ~0U;
+
+    // 0 = waiting to be decompressed, 1 = claimed for decompression, 2 = finished
+    int32_t state = 0;
+    // 1 while a job has been queued for this slot and might still reference it
+    int32_t queued = 0;
+    // the job that was queued, only valid while queued is 1
+    Threading::JobSystem::Job *job = NULL;
+
+    bytebuf compressed;
+    byte *data = NULL;
+    uint64_t size = 0;
+
+    bool success = false;
+    RDResult error;
+  };
+
+  uint32_t FindBlock(uint64_t offset);
+  Slot *FetchBlock(uint32_t block);
+  void Dispatch(uint32_t block);
+  void Decompress(Slot &slot);
+  void Retire(Slot &slot);
+
+  FILE *m_File = NULL;
+  uint64_t m_DataOffset = 0;
+  uint64_t m_IndexOffset = 0;
+  uint64_t m_UncompressedSize = 0;
+  SectionFlags m_Codec = SectionFlags::NoFlags;
+
+  rdcarray<CompressedBlock> m_Index;
+  uint64_t m_MaxBlockSize = 0;
+
+  uint64_t m_Offset = 0;
+  uint32_t m_CurBlock = 0;
+
+  // ring of blocks that are either decompressed or in-flight. Never resized after creation since
+  // jobs reference the slots
+  rdcarray<Slot> m_Slots;
+};
+
+// Compresses data in independent blocks on worker threads, writing them out in order. The output
+// is identical in format to the serial compressors, so it can be read back by either the normal
+// decompressors or IndexedDecompressor. The amount of data in flight is bounded, so when the
+// workers can't keep up the writing thread will wait for blocks to be finished.
+class ParallelCompressor : public Compressor
+{
+public:
+  // numThreads of 0 chooses based on the number of cores. With only one thread blocks are
+  // compressed inline on the writing thread.
+  ParallelCompressor(StreamWriter *write, Ownership own, SectionFlags codec, uint32_t numThreads = 0);
+  ~ParallelCompressor();
+
+  bool Write(const void *data, uint64_t numBytes);
+  bool Finish();
+
+private:
+  struct Block
+  {
+    byte *input = NULL;
+    uint64_t inputSize = 0;
+
+    byte *output = NULL;
+    uint64_t outputSize = 0;
+
+    // 0 = free, 1 = waiting to be or being compressed, 2 = compressed and ready to write
+    int32_t state = 0;
+
+    bool success = false;
+    RDResult error;
+  };
+
+  void StartWorkers();
+  bool Submit();
+  bool WriteCompleted(bool all);
+  bool WriteBlock(Block &block);
+  void Compress(Block &block, ZSTD_CCtx *zstdContext);
+  void WorkerThread();
+
+  SectionFlags m_Codec;
+  uint64_t m_BlockSize = 0;
+  uint64_t m_BlockBound = 0;
+
+  // ring of blocks, the block being filled is m_NextSubmit and the next block to be written out is
+  // m_NextWrite. Never resized after creation since workers reference the blocks
+  rdcarray<Block> m_Blocks;
+  uint64_t m_NextSubmit = 0;
+  uint64_t m_NextWrite = 0;
+
+  // used for inline compression when there are no worker threads
+  ZSTD_CCtx *m_ZstdContext = NULL;
+
+  uint32_t m_NumThreads = 0;
+  rdcarray<Threading::ThreadHandle> m_Threads;
+
+  // woken once for each block queued, and for each worker on shutdown
+  Threading::Semaphore *m_WorkSemaphore = NULL;
+  // woken when a block is finished while the writing thread is waiting for it
+  Threading::Semaphore *m_DoneSemaphore = NULL;
+  int32_t m_WriterWaiting = 0;
+
+  // protects the queue and shutdown flag
+  Threading::CriticalSection m_QueueLock;
+  rdcarray<Block *> m_Queue;
+  bool m_Shutdown = false;
+};
@@ -0,0 +1,224 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "callstack_table.h"
+
+// struct
+// {
+//   uint64_t count;
+//   struct
+//   {
+//     uint32_t numFrames;
+//     uint64_t frames[numFrames];
+//   } callstacks[count];
+// }
+
+// same sanity limit as for callstacks stored inline in chunks
+static const uint32_t MaxCallstackFrames = 4096;
+
+static uint64_t HashCallstack(const uint64_t *frames, size_t numFrames)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL ^ numFrames;
+  for(size_t i = 0; i < numFrames; i++)
+  {
+    hash ^= frames[i];
+    hash *= 0x100000001b3ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+CallstackTable::CallstackTable()
+{
+  m_ThreadCacheSlot = Threading::AllocateTLSSlot();
+}
+
+CallstackTable::~CallstackTable()
+{
+  for(ThreadCache *cache : m_ThreadCaches)
+    delete cache;
+}
+
+uint32_t CallstackTable::Intern(const uint64_t *frames, size_t numFrames)
+{
+  const uint64_t hash = HashCallstack(frames, numFrames);
+
+  ThreadCache *cache = (ThreadCache *)Threading::GetTLSValue(m_ThreadCacheSlot);
+  if(cache == NULL)
+  {
+    cache = new ThreadCache;
+    Threading::SetTLSValue(m_ThreadCacheSlot, cache);
+
+    SCOPED_LOCK(m_Lock);
+    m_ThreadCaches.push_back(cache);
+  }
+
+  ThreadCache::Slot &slot = cache->slots[hash % ThreadCache::NumSlots];
+
+  if(slot.index != InvalidIndex && slot.hash == hash && slot.frames.size() == numFrames &&
+     memcmp(slot.frames.data(), frames, numFrames * sizeof(uint64_t)) == 0)
+    return slot.index;
+
+  uint32_t index = FindOrAdd(hash, frames, numFrames);
+
+  slot.hash = hash;
+  slot.index = index;
+  slot.frames.assign(frames, numFrames);
+
+  return index;
+}
+
+uint32_t CallstackTable::FindOrAdd(uint64_t hash, const uint64_t *frames, size_t numFrames)
+{
+  SCOPED_LOCK(m_Lock);
+
+  auto it = m_Lookup.find(hash);
+
+  uint32_t first = it == m_Lookup.end() ? InvalidIndex : it->second;
+
+  for(uint32_t idx = first; idx != InvalidIndex; idx = m_Callstacks[idx].next)
+  {
+    const Entry &entry = m_Callstacks[idx];
+    if(entry.count == numFrames &&
+       memcmp(m_Frames.data() + entry.offset, frames, numFrames * sizeof(uint64_t)) == 0)
+      return idx;
+  }
+
+  uint32_t index = (uint32_t)m_Callstacks.size();
+  m_Callstacks.push_back({(uint32_t)m_Frames.size(), (uint32_t)numFrames, first});
+  m_Frames.append(frames, numFrames);
+  m_Lookup[hash] = index;
+
+  return index;
+}
+
+bool CallstackTable::Get(uint32_t index, rdcarray<uint64_t> &frames) const
+{
+  SCOPED_LOCK(m_Lock);
+
+  if(index >= m_Callstacks.size())
+  {
+    frames.clear();
+    return false;
+  }
+
+  const Entry &entry = m_Callstacks[index];
+  frames.assign(m_Frames.data() + entry.offset, entry.count);
+  return true;
+}
+
+uint32_t CallstackTable::NumCallstacks() const
+{
+  SCOPED_LOCK(m_Lock);
+  return (uint32_t)m_Callstacks.size();
+}
+
+void CallstackTable::Clear()
+{
+  SCOPED_LOCK(m_Lock);
+
+  m_Frames.clear();
+  m_Callstacks.clear();
+  m_Lookup.clear();
+
+  for(ThreadCache *cache : m_ThreadCaches)
+    for(ThreadCache::Slot &slot : cache->slots)
+      slot.index = InvalidIndex;
+}
+
+void CallstackTable::Write(StreamWriter *writer) const
+{
+  SCOPED_LOCK(m_Lock);
+
+  writer->Write((uint64_t)m_Callstacks.size());
+  for(const Entry &entry : m_Callstacks)
+  {
+    writer->Write(entry.count);
+    writer->Write(m_Frames.data() + entry.offset, entry.count * sizeof(uint64_t));
+  }
+}
+
+bool CallstackTable::Read(StreamReader *reader, uint64_t size)
+{
+  Clear();
+
+  SCOPED_LOCK(m_Lock);
+
+  uint64_t count = 0;
+  reader->Read(count);
+
+  if(reader->IsErrored() || size < sizeof(count))
+    return false;
+
+  uint64_t remaining = size - sizeof(count);
+
+  // every callstack needs at least its frame count
+  if(count > remaining / sizeof(uint32_t))
+    return false;
+
+  m_Callstacks.reserve((size_t)count);
+  for(uint64_t i = 0; i < count; i++)
+  {
+    uint32_t numFrames = 0;
+    reader->Read(numFrames);
+
+    if(reader->IsErrored() || remaining < sizeof(numFrames) || numFrames > MaxCallstackFrames ||
+       numFrames * sizeof(uint64_t) > remaining - sizeof(numFrames))
+      break;
+
+    remaining -= sizeof(numFrames) + numFrames * sizeof(uint64_t);
+
+    Entry entry = {(uint32_t)m_Frames.size(), numFrames, InvalidIndex};
+    m_Frames.resize(m_Frames.size() + numFrames);
+    reader->Read(m_Frames.data() + entry.offset, numFrames * sizeof(uint64_t));
+    m_Callstacks.push_back(entry);
+  }
+
+  if(reader->IsErrored() || m_Callstacks.size() != count)
+  {
+    m_Frames.clear();
+    m_Callstacks.clear();
+    return false;
+  }
+
+  // rebuild the lookup so that interning into a table that was read still finds duplicates
+  for(uint32_t idx = 0; idx < m_Callstacks.size(); idx++)
+  {
+    Entry &entry = m_Callstacks[idx];
+    uint64_t hash = HashCallstack(m_Frames.data() + entry.offset, entry.count);
+
+    auto it = m_Lookup.find(hash);
+    if(it != m_Lookup.end())
+    {
+      entry.next = it->second;
+      it->second = idx;
+    }
+    else
+    {
+      m_Lookup[hash] = idx;
+    }
+  }
+
+  return true;
+}
@@ -0,0 +1,96 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <unordered_map>
+#include "common/threading.h"
+#include "streamio.h"
+
+// Stores each unique callstack once, so that chunks can refer to a callstack with a 32-bit index
+// instead of each carrying its own copy of the frames. Each capture interns the callstacks of the
+// chunks written into it in its own table, which is written to its own section in the capture.
+//
+// Interning is lock-free for a callstack the calling thread has recently seen - each thread keeps a
+// small cache of the callstacks it interned and only takes the table's lock on a miss.
+class CallstackTable
+{
+public:
+  static const uint32_t InvalidIndex = ~0U;
+
+  CallstackTable();
+  ~CallstackTable();
+
+  // no copies
+  CallstackTable(const CallstackTable &other) = delete;
+  CallstackTable &operator=(const CallstackTable &other) = delete;
+
+  // returns the index of the given callstack, adding it to the table if it's not already present
+  uint32_t Intern(const uint64_t *frames, size_t numFrames);
+
+  // returns false if index is out of range, leaving frames empty
+  bool Get(uint32_t index, rdcarray<uint64_t> &frames) const;
+  uint32_t NumCallstacks() const;
+
+  // must not be called while other threads are interning
+  void Clear();
+
+  void Write(StreamWriter *writer) const;
+  // reads a table written by Write, replacing the current contents. Returns false and leaves the
+  // table empty if the data is malformed.
+  bool Read(StreamReader *reader, uint64_t size);
+
+private:
+  struct Entry
+  {
+    // offset and count in m_Frames
+    uint32_t offset;
+    uint32_t count;
+    // next callstack with the same hash, or InvalidIndex
+    uint32_t next;
+  };
+
+  struct ThreadCache
+  {
+    static const uint32_t NumSlots = 256;
+
+    struct Slot
+    {
+      uint64_t hash = 0;
+      uint32_t index = InvalidIndex;
+      rdcarray<uint64_t> frames;
+    } slots[NumSlots];
+  };
+
+  uint32_t FindOrAdd(uint64_t hash, const uint64_t *frames, size_t numFrames);
+
+  mutable Threading::CriticalSection m_Lock;
+  rdcarray<uint64_t> m_Frames;
+  rdcarray<Entry> m_Callstacks;
+  // hash -> most recently added callstack with that hash
+  std::unordered_map<uint64_t, uint32_t> m_Lookup;
+
+  uint64_t m_ThreadCacheSlot;
+  rdcarray<ThreadCache *> m_ThreadCaches;
+};
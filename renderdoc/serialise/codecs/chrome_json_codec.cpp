@@ -22,14 +22,144 @@
  * THE SOFTWARE.
  ******************************************************************************/
 
+#include <map>
 #include <utility>
 #include "api/replay/structured_data.h"
 #include "common/common.h"
 #include "common/formatting.h"
+#include "core/settings.h"
 #include "serialise/rdcfile.h"
 
-RDResult exportChrome(const rdcstr &filename, const RDCFile &rdc, const SDFile &structData,
-                      RENDERDOC_ProgressCallback progress)
+RDOC_CONFIG(bool, Capture_ChromeTraceMarkers, false,
+            "When exporting to chrome JSON, add a track per command buffer or thread with the "
+            "nesting of debug marker regions.");
+RDOC_CONFIG(bool, Capture_ChromeTraceChunkSizes, false,
+            "When exporting to chrome JSON, add a counter with the size in bytes of each chunk.");
+RDOC_CONFIG(bool, Capture_ChromeTraceThreadCost, false,
+            "When exporting to chrome JSON, add a counter per thread with the running total of "
+            "bytes serialised on that thread.");
+
+// chunks that open and close a marker region. The label is the first string in the chunk
+static const char *markerBeginChunks[] = {
+    "vkCmdDebugMarkerBeginEXT",
+    "vkCmdBeginDebugUtilsLabelEXT",
+    "vkQueueBeginDebugUtilsLabelEXT",
+    "glPushDebugGroup",
+    "glPushDebugGroupKHR",
+    "glPushGroupMarkerEXT",
+    "ID3DUserDefinedAnnotation::BeginEvent",
+    "ID3D12GraphicsCommandList::BeginEvent",
+    "ID3D12CommandQueue::BeginEvent",
+};
+
+static const char *markerEndChunks[] = {
+    "vkCmdDebugMarkerEndEXT",
+    "vkCmdEndDebugUtilsLabelEXT",
+    "vkQueueEndDebugUtilsLabelEXT",
+    "glPopDebugGroup",
+    "glPopDebugGroupKHR",
+    "glPopGroupMarkerEXT",
+    "ID3DUserDefinedAnnotation::EndEvent",
+    "ID3D12GraphicsCommandList::EndEvent",
+    "ID3D12CommandQueue::EndEvent",
+};
+
+static bool IsChunkNamed(const SDChunk *chunk, const char *const *names, size_t count)
+{
+  for(size_t i = 0; i < count; i++)
+    if(chunk->name == names[i])
+      return true;
+  return false;
+}
+
+static const SDObject *FindFirstString(const SDObject *obj)
+{
+  if(obj->type.basetype == SDBasic::String)
+    return obj;
+
+  for(size_t i = 0; i < obj->NumChildren(); i++)
+  {
+    const SDObject *ret = FindFirstString(obj->GetChild(i));
+    if(ret)
+      return ret;
+  }
+
+  return NULL;
+}
+
+static rdcstr EscapeJSON(const rdcstr &str)
+{
+  rdcstr ret;
+  ret.reserve(str.size());
+
+  for(char c : str)
+  {
+    if(c == '"' || c == '\\')
+    {
+      ret.push_back('\\');
+      ret.push_back(c);
+    }
+    else if((unsigned char)c < 0x20)
+    {
+      ret += StringFormat::Fmt("\\u%04x", (uint32_t)c);
+    }
+    else
+    {
+      ret.push_back(c);
+    }
+  }
+
+  return ret;
+}
+
+// writes trace events out to the file as they're generated, so only a small buffer is held in
+// memory no matter how large the capture is.
+struct ChromeTraceWriter
+{
+  static const size_t FlushSize = 64 * 1024;
+
+  FILE *f = NULL;
+  rdcstr buffer;
+  // stupid JSON not allowing trailing ,s :(
+  bool first = true;
+
+  ChromeTraceWriter(FILE *file) : f(file) { buffer.reserve(FlushSize * 2); }
+  ~ChromeTraceWriter() { Flush(); }
+  void Write(const rdcstr &str)
+  {
+    buffer += str;
+    if(buffer.size() >= FlushSize)
+      Flush();
+  }
+
+  void Event(const rdcstr &event)
+  {
+    if(!first)
+      buffer += ",";
+    first = false;
+
+    buffer += "\n    ";
+    Write(event);
+  }
+
+  void Flush()
+  {
+    if(!buffer.empty())
+      FileIO::fwrite(buffer.data(), 1, buffer.size(), f);
+    buffer.clear();
+  }
+};
+
+struct ChromeTraceTracks
+{
+  bool markers;
+  bool chunkSizes;
+  bool threadCost;
+};
+
+static RDResult WriteChromeTrace(const rdcstr &filename, const SDFile &structData,
+                                 const ChromeTraceTracks &tracks,
+                                 RENDERDOC_ProgressCallback progress)
 {
   FILE *f = FileIO::fopen(filename, FileIO::WriteText);
 
@@ -37,64 +167,158 @@ RDResult exportChrome(const rdcstr &filename, const RDCFile &rdc, const SDFile &
     RETURN_ERROR_RESULT(ResultCode::FileIOFailed, "Failed to open '%s' for write: %s",
                         filename.c_str(), FileIO::ErrorString().c_str());
 
-  rdcstr str;
+  {
+    ChromeTraceWriter writer(f);
 
-  // add header, customise this as needed.
-  str = R"({
+    // add header, customise this as needed.
+    writer.Write(R"({
   "displayTimeUnit": "ns",
-  "traceEvents": [)";
+  "traceEvents": [)");
 
-  const char *category = "Initialisation";
+    const char *category = "Initialisation";
 
-  // stupid JSON not allowing trailing ,s :(
-  bool first = true;
+    // chunks are on pid 5, markers go in their own process with a track for each command buffer or
+    // queue (or thread, for APIs without one) since regions nest within those and not the thread
+    // that recorded them.
+    const uint32_t chunkPid = 5, markerPid = 6;
 
-  int i = 0;
-  int numChunks = structData.chunks.count();
+    std::map<rdcstr, uint32_t> markerTracks;
+    rdcarray<uint32_t> markerDepth;
+    std::map<uint64_t, uint64_t> threadBytes;
+    uint64_t lastTimestamp = 0;
 
-  for(const SDChunk *chunk : structData.chunks)
-  {
-    if(chunk->metadata.chunkID == (uint32_t)SystemChunk::FirstDriverChunk + 1)
-      category = "Frame Capture";
+    int i = 0;
+    int numChunks = structData.chunks.count();
 
-    if(!first)
-      str += ",";
+    for(const SDChunk *chunk : structData.chunks)
+    {
+      const SDChunkMetaData &md = chunk->metadata;
 
-    first = false;
+      if(md.chunkID == (uint32_t)SystemChunk::FirstDriverChunk + 1)
+        category = "Frame Capture";
 
-    const char *fmt = R"(
-    { "name": "%s", "cat": "%s", "ph": "B", "ts": %llu, "pid": 5, "tid": %u },
-    { "ph": "E", "ts": %llu, "pid": 5, "tid": %u })";
+      lastTimestamp =
+          RDCMAX(lastTimestamp, md.timestampMicro + (uint64_t)RDCMAX(md.durationMicro, (int64_t)0));
 
-    if(chunk->metadata.durationMicro == 0)
-    {
-      fmt = R"(
-    { "name": "%s", "cat": "%s", "ph": "i", "ts": %llu, "pid": 5, "tid": %u })";
-    }
+      // durations of -1 weren't recorded, treat them as instantaneous
+      if(md.durationMicro <= 0)
+      {
+        writer.Event(StringFormat::Fmt(
+            R"({ "name": "%s", "cat": "%s", "ph": "i", "ts": %llu, "pid": %u, "tid": %llu })",
+            chunk->name.c_str(), category, md.timestampMicro, chunkPid, md.threadID));
+      }
+      else
+      {
+        writer.Event(StringFormat::Fmt(
+            R"({ "name": "%s", "cat": "%s", "ph": "B", "ts": %llu, "pid": %u, "tid": %llu })",
+            chunk->name.c_str(), category, md.timestampMicro, chunkPid, md.threadID));
+        writer.Event(StringFormat::Fmt(R"({ "ph": "E", "ts": %llu, "pid": %u, "tid": %llu })",
+                                       md.timestampMicro + md.durationMicro, chunkPid,
+                                       md.threadID));
+      }
 
-    str += StringFormat::Fmt(
-        fmt, chunk->name.c_str(), category, chunk->metadata.timestampMicro, chunk->metadata.threadID,
-        chunk->metadata.timestampMicro + chunk->metadata.durationMicro, chunk->metadata.threadID);
+      if(tracks.chunkSizes)
+      {
+        writer.Event(StringFormat::Fmt(
+            R"({ "name": "Chunk bytes", "ph": "C", "ts": %llu, "pid": %u, )"
+            R"("args": { "bytes": %llu } })",
+            md.timestampMicro, chunkPid, md.length));
+      }
 
-    if(progress)
-      progress(float(i) / float(numChunks));
+      if(tracks.threadCost)
+      {
+        uint64_t &total = threadBytes[md.threadID];
+        total += md.length;
+        writer.Event(StringFormat::Fmt(
+            R"({ "name": "Thread %llu serialised bytes", "ph": "C", "ts": %llu, "pid": %u, )"
+            R"("args": { "bytes": %llu } })",
+            md.threadID, md.timestampMicro, chunkPid, total));
+      }
 
-    i++;
-  }
+      if(tracks.markers)
+      {
+        bool begin = IsChunkNamed(chunk, markerBeginChunks, ARRAY_COUNT(markerBeginChunks));
+        bool end = !begin && IsChunkNamed(chunk, markerEndChunks, ARRAY_COUNT(markerEndChunks));
+
+        if(begin || end)
+        {
+          rdcstr trackName;
+          if(chunk->NumChildren() > 0 && chunk->GetChild(0)->type.basetype == SDBasic::Resource)
+            trackName = ToStr(chunk->GetChild(0)->data.basic.id);
+          else
+            trackName = StringFormat::Fmt("Thread %llu", md.threadID);
+
+          auto it = markerTracks.find(trackName);
+          if(it == markerTracks.end())
+          {
+            uint32_t newTrack = (uint32_t)markerTracks.size();
+            it = markerTracks.insert(std::make_pair(trackName, newTrack)).first;
+            markerDepth.push_back(0);
+
+            writer.Event(StringFormat::Fmt(
+                R"({ "name": "thread_name", "ph": "M", "pid": %u, "tid": %u, )"
+                R"("args": { "name": "%s" } })",
+                markerPid, it->second, EscapeJSON(trackName).c_str()));
+          }
+
+          uint32_t track = it->second;
+
+          if(begin)
+          {
+            const SDObject *label = FindFirstString(chunk);
+            writer.Event(StringFormat::Fmt(
+                R"({ "name": "%s", "cat": "Marker", "ph": "B", "ts": %llu, "pid": %u, "tid": %u })",
+                label ? EscapeJSON(label->data.str).c_str() : "", md.timestampMicro, markerPid,
+                track));
+            markerDepth[track]++;
+          }
+          else if(markerDepth[track] > 0)
+          {
+            // ignore unbalanced pops, the application may have opened the region before capturing
+            writer.Event(StringFormat::Fmt(R"({ "ph": "E", "ts": %llu, "pid": %u, "tid": %u })",
+                                           md.timestampMicro, markerPid, track));
+            markerDepth[track]--;
+          }
+        }
+      }
+
+      if(progress)
+        progress(float(i) / float(numChunks));
+
+      i++;
+    }
 
-  if(progress)
-    progress(1.0f);
+    // close any regions left open at the end of the capture
+    for(uint32_t track = 0; track < markerDepth.size(); track++)
+    {
+      for(; markerDepth[track] > 0; markerDepth[track]--)
+        writer.Event(StringFormat::Fmt(R"({ "ph": "E", "ts": %llu, "pid": %u, "tid": %u })",
+                                       lastTimestamp, markerPid, track));
+    }
 
-  // end trace events
-  str += "\n  ]\n}";
+    if(progress)
+      progress(1.0f);
 
-  FileIO::fwrite(str.data(), 1, str.size(), f);
+    // end trace events
+    writer.Write("\n  ]\n}");
+  }
 
   FileIO::fclose(f);
 
   return ResultCode::Succeeded;
 }
 
+RDResult exportChrome(const rdcstr &filename, const RDCFile &rdc, const SDFile &structData,
+                      RENDERDOC_ProgressCallback progress)
+{
+  ChromeTraceTracks tracks = {};
+  tracks.markers = Capture_ChromeTraceMarkers();
+  tracks.chunkSizes = Capture_ChromeTraceChunkSizes();
+  tracks.threadCost = Capture_ChromeTraceThreadCost();
+
+  return WriteChromeTrace(filename, structData, tracks, progress);
+}
+
 static ConversionRegistration XMLConversionRegistration(
     &exportChrome,
     {
@@ -104,3 +328,100 @@ static ConversionRegistration XMLConversionRegistration(
 by chrome's profiler at chrome://tracing)",
         false,
     });
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+static size_t CountOccurrences(const rdcstr &haystack, const rdcstr &needle)
+{
+  size_t ret = 0;
+  for(int32_t idx = haystack.find(needle); idx >= 0; idx = haystack.find(needle, idx + 1))
+    ret++;
+  return ret;
+}
+
+TEST_CASE("Chrome trace export", "[chrome]")
+{
+  SDFile sdfile;
+
+  ResourceId cmdA = ResourceIDGen::GetNewUniqueID();
+  ResourceId cmdB = ResourceIDGen::GetNewUniqueID();
+
+  auto addChunk = [&sdfile](const char *name, uint64_t thread, ResourceId cmd, const char *label) {
+    SDChunk *chunk = new SDChunk(rdcstr(name));
+    chunk->metadata.chunkID = (uint32_t)SystemChunk::FirstDriverChunk + 1;
+    chunk->metadata.threadID = thread;
+    chunk->metadata.timestampMicro = 1000 + sdfile.chunks.size() * 10;
+    chunk->metadata.durationMicro = 5;
+    chunk->metadata.length = 64 + sdfile.chunks.size();
+    chunk->AddAndOwnChild(makeSDResourceId("commandBuffer"_lit, cmd));
+    if(label)
+    {
+      SDObject *info = makeSDStruct("pLabelInfo"_lit, "VkDebugUtilsLabelEXT"_lit);
+      info->AddAndOwnChild(makeSDString("pLabelName"_lit, label));
+      chunk->AddAndOwnChild(info);
+    }
+    sdfile.chunks.push_back(chunk);
+  };
+
+  // two command buffers recorded interleaved on one thread, with their own nesting. B's end
+  // without a begin is ignored and A's second region is left open
+  addChunk("vkCmdEndDebugUtilsLabelEXT", 1, cmdB, NULL);
+  addChunk("vkCmdBeginDebugUtilsLabelEXT", 1, cmdA, "Outer \"A\"");
+  addChunk("vkCmdBeginDebugUtilsLabelEXT", 1, cmdB, "B");
+  addChunk("vkCmdBeginDebugUtilsLabelEXT", 1, cmdA, "Inner A");
+  addChunk("vkCmdEndDebugUtilsLabelEXT", 1, cmdB, NULL);
+  addChunk("vkCmdEndDebugUtilsLabelEXT", 1, cmdA, NULL);
+
+  // enough chunks that the output is flushed several times
+  for(uint32_t i = 0; i < 5000; i++)
+    addChunk("vkCmdDraw", 1 + (i % 3), i % 2 ? cmdA : cmdB, NULL);
+
+  rdcstr filename = FileIO::GetTempFolderFilename() + "/renderdoc_chrome_codec_test.json";
+
+  SECTION("Chunks only")
+  {
+    ChromeTraceTracks tracks = {};
+    RDResult res = WriteChromeTrace(filename, sdfile, tracks, NULL);
+    REQUIRE(res.code == ResultCode::Succeeded);
+
+    rdcstr json;
+    REQUIRE(FileIO::ReadAll(filename, json));
+
+    CHECK(json.beginsWith("{"));
+    CHECK(json.endsWith("\n  ]\n}"));
+    CHECK(CountOccurrences(json, R"("ph": "B")") == sdfile.chunks.size());
+    CHECK(CountOccurrences(json, R"("ph": "E")") == sdfile.chunks.size());
+    CHECK(CountOccurrences(json, R"("ph": "C")") == 0);
+    CHECK(CountOccurrences(json, "Marker") == 0);
+  }
+
+  SECTION("All tracks")
+  {
+    ChromeTraceTracks tracks = {};
+    tracks.markers = tracks.chunkSizes = tracks.threadCost = true;
+    RDResult res = WriteChromeTrace(filename, sdfile, tracks, NULL);
+    REQUIRE(res.code == ResultCode::Succeeded);
+
+    rdcstr json;
+    REQUIRE(FileIO::ReadAll(filename, json));
+
+    CHECK(json.endsWith("\n  ]\n}"));
+
+    // every chunk, plus three marker regions
+    CHECK(CountOccurrences(json, R"("ph": "B")") == sdfile.chunks.size() + 3);
+    CHECK(CountOccurrences(json, R"("ph": "E")") == sdfile.chunks.size() + 3);
+    CHECK(CountOccurrences(json, R"("cat": "Marker")") == 3);
+    CHECK(CountOccurrences(json, R"("name": "Outer \"A\"")") == 1);
+    CHECK(CountOccurrences(json, R"("name": "thread_name")") == 2);
+
+    CHECK(CountOccurrences(json, R"("name": "Chunk bytes")") == sdfile.chunks.size());
+    CHECK(CountOccurrences(json, "serialised bytes") == sdfile.chunks.size());
+    CHECK(CountOccurrences(json, "Thread 3 serialised bytes") > 0);
+  }
+
+  FileIO::Delete(filename);
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -0,0 +1,469 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include <map>
+#include "api/replay/structured_data.h"
+#include "common/common.h"
+#include "serialise/rdcfile.h"
+#include "serialise/streamio.h"
+
+// A compact column-oriented table of the chunks in a capture, for bulk analysis of many captures
+// without going through XML or replaying. Every chunk is one row. All values are little-endian.
+//
+// header:
+//   char     magic[8]            "RDCCOLS\0"
+//   uint32_t version             ColumnarVersion
+//   uint32_t numRows             number of chunks
+//   uint32_t numColumns
+//   string   driverName          (uint32_t length, then that many bytes with no terminator)
+//   uint64_t machineIdent
+//   uint64_t structuredVersion
+//
+// then numColumns columns, each:
+//   string   name
+//   uint32_t type                ColumnType
+//   uint32_t encoding            ColumnEncoding
+//   uint32_t count               numRows when dense
+//   uint32_t rows[count]         only when sparse, the rows that have a value in ascending order
+//   when type is String:
+//     uint32_t dictCount
+//     string   dict[dictCount]
+//     uint32_t values[count]     indices into dict
+//   otherwise:
+//     uint64_t values[count]     Float values are doubles, Resource values are the raw ID
+//
+// The chunk metadata is stored as dense columns first. After that each top-level parameter of each
+// chunk type that has a simple value gets a sparse column named "<chunk name>.<parameter name>".
+
+static const char ColumnarMagic[8] = {'R', 'D', 'C', 'C', 'O', 'L', 'S', 0};
+static const uint32_t ColumnarVersion = 1;
+
+enum class ColumnType : uint32_t
+{
+  UInt,
+  SInt,
+  Float,
+  String,
+  Resource,
+};
+
+enum class ColumnEncoding : uint32_t
+{
+  Dense,
+  Sparse,
+};
+
+struct Column
+{
+  Column(const rdcstr &n, ColumnType t, ColumnEncoding e) : name(n), type(t), encoding(e) {}
+  rdcstr name;
+  ColumnType type;
+  ColumnEncoding encoding;
+
+  rdcarray<uint32_t> rows;
+  rdcarray<uint64_t> values;
+
+  rdcarray<rdcstr> dict;
+  std::map<rdcstr, uint32_t> dictLookup;
+
+  void Add(uint32_t row, uint64_t value)
+  {
+    if(encoding == ColumnEncoding::Sparse)
+      rows.push_back(row);
+    values.push_back(value);
+  }
+
+  void AddString(uint32_t row, const rdcstr &str)
+  {
+    auto it = dictLookup.find(str);
+    if(it == dictLookup.end())
+    {
+      it = dictLookup.insert(std::make_pair(str, (uint32_t)dict.size())).first;
+      dict.push_back(str);
+    }
+    Add(row, it->second);
+  }
+};
+
+static void WriteString(StreamWriter &writer, const rdcstr &str)
+{
+  writer.Write((uint32_t)str.size());
+  writer.Write(str.c_str(), str.size());
+}
+
+static void WriteColumn(StreamWriter &writer, const Column &col)
+{
+  WriteString(writer, col.name);
+  writer.Write(col.type);
+  writer.Write(col.encoding);
+  writer.Write((uint32_t)col.values.size());
+
+  if(col.encoding == ColumnEncoding::Sparse)
+    writer.Write(col.rows.data(), col.rows.byteSize());
+
+  if(col.type == ColumnType::String)
+  {
+    writer.Write((uint32_t)col.dict.size());
+    for(const rdcstr &s : col.dict)
+      WriteString(writer, s);
+
+    for(uint64_t v : col.values)
+      writer.Write((uint32_t)v);
+  }
+  else
+  {
+    writer.Write(col.values.data(), col.values.byteSize());
+  }
+}
+
+// returns false if the object doesn't have a single value that can go in a column
+static bool GetColumnValue(const SDObject *obj, ColumnType &type, uint64_t &value)
+{
+  switch(obj->type.basetype)
+  {
+    case SDBasic::UnsignedInteger:
+    case SDBasic::Enum:
+      type = ColumnType::UInt;
+      value = obj->data.basic.u;
+      return true;
+    case SDBasic::Boolean:
+      type = ColumnType::UInt;
+      value = obj->data.basic.b ? 1 : 0;
+      return true;
+    case SDBasic::Character:
+      type = ColumnType::UInt;
+      value = (uint8_t)obj->data.basic.c;
+      return true;
+    case SDBasic::SignedInteger:
+      type = ColumnType::SInt;
+      value = (uint64_t)obj->data.basic.i;
+      return true;
+    case SDBasic::Float:
+      type = ColumnType::Float;
+      memcpy(&value, &obj->data.basic.d, sizeof(value));
+      return true;
+    case SDBasic::Resource:
+      RDCCOMPILE_ASSERT(sizeof(ResourceId) == sizeof(uint64_t), "ResourceId is not 64-bit");
+      type = ColumnType::Resource;
+      memcpy(&value, &obj->data.basic.id, sizeof(value));
+      return true;
+    case SDBasic::String: type = ColumnType::String; return true;
+    default: return false;
+  }
+}
+
+RDResult exportColumnar(const rdcstr &filename, const RDCFile &rdc, const SDFile &structData,
+                        RENDERDOC_ProgressCallback progress)
+{
+  const uint32_t numRows = (uint32_t)structData.chunks.size();
+
+  rdcarray<Column> columns;
+  columns.push_back(Column("chunkID", ColumnType::UInt, ColumnEncoding::Dense));
+  columns.push_back(Column("name", ColumnType::String, ColumnEncoding::Dense));
+  columns.push_back(Column("threadID", ColumnType::UInt, ColumnEncoding::Dense));
+  columns.push_back(Column("timestampMicro", ColumnType::UInt, ColumnEncoding::Dense));
+  columns.push_back(Column("durationMicro", ColumnType::SInt, ColumnEncoding::Dense));
+  columns.push_back(Column("length", ColumnType::UInt, ColumnEncoding::Dense));
+  columns.push_back(Column("flags", ColumnType::UInt, ColumnEncoding::Dense));
+
+  for(Column &col : columns)
+    col.values.reserve(numRows);
+
+  // parameter columns, keyed by their name
+  std::map<rdcstr, size_t> paramColumns;
+
+  for(uint32_t row = 0; row < numRows; row++)
+  {
+    const SDChunk *chunk = structData.chunks[row];
+    const SDChunkMetaData &md = chunk->metadata;
+
+    columns[0].Add(row, md.chunkID);
+    columns[1].AddString(row, chunk->name);
+    columns[2].Add(row, md.threadID);
+    columns[3].Add(row, md.timestampMicro);
+    columns[4].Add(row, (uint64_t)md.durationMicro);
+    columns[5].Add(row, md.length);
+    columns[6].Add(row, (uint64_t)md.flags);
+
+    // opaque chunks only contain a buffer of their data
+    if(!(md.flags & SDChunkFlags::OpaqueChunk))
+    {
+      for(size_t c = 0; c < chunk->NumChildren(); c++)
+      {
+        const SDObject *param = chunk->GetChild(c);
+
+        ColumnType type;
+        uint64_t value = 0;
+        if(!GetColumnValue(param, type, value))
+          continue;
+
+        rdcstr name = StringFormat::Fmt("%s.%s", chunk->name.c_str(), param->name.c_str());
+
+        auto it = paramColumns.find(name);
+        if(it == paramColumns.end())
+        {
+          it = paramColumns.insert(std::make_pair(name, columns.size())).first;
+          columns.push_back(Column(name, type, ColumnEncoding::Sparse));
+        }
+
+        Column &col = columns[it->second];
+
+        // the same parameter should always have the same type, but if not keep the first one seen
+        if(col.type != type)
+          continue;
+
+        if(type == ColumnType::String)
+          col.AddString(row, param->data.str);
+        else
+          col.Add(row, value);
+      }
+    }
+
+    if(progress && (row % 1024) == 0)
+      progress(0.8f * float(row) / float(numRows));
+  }
+
+  FILE *f = FileIO::fopen(filename, FileIO::WriteBinary);
+
+  if(!f)
+    RETURN_ERROR_RESULT(ResultCode::FileIOFailed, "Failed to open '%s' for write: %s",
+                        filename.c_str(), FileIO::ErrorString().c_str());
+
+  StreamWriter writer(f, Ownership::Stream);
+
+  writer.Write(ColumnarMagic);
+  writer.Write(ColumnarVersion);
+  writer.Write(numRows);
+  writer.Write((uint32_t)columns.size());
+  WriteString(writer, rdc.GetDriverName());
+  writer.Write(rdc.GetMachineIdent());
+  writer.Write(structData.version);
+
+  for(size_t i = 0; i < columns.size(); i++)
+  {
+    WriteColumn(writer, columns[i]);
+
+    if(progress)
+      progress(0.8f + 0.2f * float(i) / float(columns.size()));
+  }
+
+  writer.Finish();
+
+  if(writer.IsErrored())
+    RETURN_ERROR_RESULT(ResultCode::FileIOFailed, "Failed to write to '%s'", filename.c_str());
+
+  if(progress)
+    progress(1.0f);
+
+  return ResultCode::Succeeded;
+}
+
+static ConversionRegistration ColumnarConversionRegistration(
+    &exportColumnar,
+    {
+        "rdccols",
+        "Columnar chunk table",
+        R"(Exports the metadata of every chunk, and any simple top-level parameters, to a compact
+binary table with one column per field. Intended for bulk analysis of many captures.)",
+        false,
+    });
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+static rdcstr ReadString(StreamReader &reader)
+{
+  uint32_t len = 0;
+  reader.Read(len);
+  rdcstr ret;
+  ret.resize(len);
+  reader.Read(ret.data(), len);
+  return ret;
+}
+
+TEST_CASE("Columnar chunk export", "[columnar]")
+{
+  RDCFile rdc;
+  rdc.SetData(RDCDriver::Vulkan, "Vulkan", 0x1234, NULL, 100, 2.5);
+
+  SDFile sdfile;
+  sdfile.version = 0x15;
+
+  ResourceId buf = ResourceIDGen::GetNewUniqueID();
+
+  for(uint32_t i = 0; i < 100; i++)
+  {
+    SDChunk *chunk;
+    if(i % 4 == 3)
+    {
+      chunk = new SDChunk("vkCreateBuffer"_lit);
+      chunk->AddAndOwnChild(makeSDResourceId("buffer"_lit, buf));
+      chunk->AddAndOwnChild(makeSDString("name"_lit, i % 8 == 3 ? "foo" : "bar"));
+      // structs aren't flattened
+      chunk->AddAndOwnChild(makeSDStruct("pCreateInfo"_lit, "VkBufferCreateInfo"_lit));
+    }
+    else
+    {
+      chunk = new SDChunk("vkCmdDraw"_lit);
+      chunk->AddAndOwnChild(makeSDUInt32("vertexCount"_lit, i * 3));
+      chunk->AddAndOwnChild(makeSDFloat("weight"_lit, 0.5f));
+    }
+
+    chunk->metadata.chunkID = 1000 + (i % 4 == 3 ? 1 : 2);
+    chunk->metadata.threadID = 7 + i % 2;
+    chunk->metadata.timestampMicro = i * 100;
+    chunk->metadata.durationMicro = i % 5 == 0 ? -1 : 20;
+    chunk->metadata.length = 32 + i;
+    sdfile.chunks.push_back(chunk);
+  }
+
+  rdcstr filename = FileIO::GetTempFolderFilename() + "/renderdoc_columnar_codec_test.rdccols";
+
+  RDResult res = exportColumnar(filename, rdc, sdfile, NULL);
+  REQUIRE(res.code == ResultCode::Succeeded);
+
+  bytebuf contents;
+  REQUIRE(FileIO::ReadAll(filename, contents));
+  FileIO::Delete(filename);
+
+  StreamReader reader(contents);
+
+  char magic[8] = {};
+  uint32_t version = 0, numRows = 0, numColumns = 0;
+  uint64_t machineIdent = 0, sdVersion = 0;
+  reader.Read(magic);
+  reader.Read(version);
+  reader.Read(numRows);
+  reader.Read(numColumns);
+  rdcstr driverName = ReadString(reader);
+  reader.Read(machineIdent);
+  reader.Read(sdVersion);
+
+  CHECK(memcmp(magic, ColumnarMagic, sizeof(magic)) == 0);
+  CHECK(version == ColumnarVersion);
+  CHECK(numRows == 100);
+  CHECK(driverName == "Vulkan");
+  CHECK(machineIdent == 0x1234);
+  CHECK(sdVersion == 0x15);
+
+  // 7 metadata columns, then vertexCount, weight, buffer and name
+  REQUIRE(numColumns == 11);
+
+  for(uint32_t c = 0; c < numColumns; c++)
+  {
+    rdcstr name = ReadString(reader);
+    ColumnType type;
+    ColumnEncoding encoding;
+    uint32_t count = 0;
+    reader.Read(type);
+    reader.Read(encoding);
+    reader.Read(count);
+
+    rdcarray<uint32_t> rows;
+    if(encoding == ColumnEncoding::Sparse)
+    {
+      rows.resize(count);
+      reader.Read(rows.data(), rows.byteSize());
+    }
+    else
+    {
+      CHECK(count == numRows);
+      for(uint32_t r = 0; r < count; r++)
+        rows.push_back(r);
+    }
+
+    rdcarray<rdcstr> dict;
+    rdcarray<uint64_t> values;
+    values.resize(count);
+    if(type == ColumnType::String)
+    {
+      uint32_t dictCount = 0;
+      reader.Read(dictCount);
+      for(uint32_t d = 0; d < dictCount; d++)
+        dict.push_back(ReadString(reader));
+
+      for(uint32_t v = 0; v < count; v++)
+      {
+        uint32_t idx = 0;
+        reader.Read(idx);
+        REQUIRE(idx < dictCount);
+        values[v] = idx;
+      }
+    }
+    else
+    {
+      reader.Read(values.data(), values.byteSize());
+    }
+
+    REQUIRE(!reader.IsErrored());
+
+    for(uint32_t v = 0; v < count; v++)
+    {
+      const SDChunk *chunk = sdfile.chunks[rows[v]];
+      const SDChunkMetaData &md = chunk->metadata;
+
+      if(name == "chunkID")
+        CHECK(values[v] == md.chunkID);
+      else if(name == "name")
+        CHECK(dict[(size_t)values[v]] == chunk->name);
+      else if(name == "threadID")
+        CHECK(values[v] == md.threadID);
+      else if(name == "timestampMicro")
+        CHECK(values[v] == md.timestampMicro);
+      else if(name == "durationMicro")
+        CHECK((int64_t)values[v] == md.durationMicro);
+      else if(name == "length")
+        CHECK(values[v] == md.length);
+      else if(name == "flags")
+        CHECK(values[v] == 0);
+      else if(name == "vkCmdDraw.vertexCount")
+        CHECK(values[v] == rows[v] * 3);
+      else if(name == "vkCmdDraw.weight")
+      {
+        double d;
+        memcpy(&d, &values[v], sizeof(d));
+        CHECK((uint32_t)type == (uint32_t)ColumnType::Float);
+        CHECK(d == 0.5);
+      }
+      else if(name == "vkCreateBuffer.buffer")
+        CHECK(memcmp(&values[v], &buf, sizeof(buf)) == 0);
+      else if(name == "vkCreateBuffer.name")
+        CHECK(dict[(size_t)values[v]] == (rows[v] % 8 == 3 ? "foo" : "bar"));
+      else
+        FAIL("Unexpected column " << name);
+    }
+
+    if(name == "name" || name == "vkCreateBuffer.name")
+      CHECK(dict.size() == 2);
+    if(name.beginsWith("vkCmdDraw."))
+      CHECK(count == 75);
+    if(name.beginsWith("vkCreateBuffer."))
+      CHECK(count == 25);
+  }
+
+  CHECK(reader.AtEnd());
+}
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -26,12 +26,18 @@
 #include "api/replay/structured_data.h"
 #include "common/common.h"
 #include "common/formatting.h"
+#include "common/threading.h"
+#include "core/settings.h"
 #include "serialise/rdcfile.h"
 #include "strings/string_utils.h"
 
 #include "miniz/miniz.h"
 #include "pugixml/pugixml.hpp"
 
+RDOC_CONFIG(uint32_t, Capture_XMLZipCompressionLevel, 2,
+            "The deflate level (1-10) used for buffer data when exporting to XML+ZIP. 0 stores "
+            "buffers uncompressed, which is fastest to write and read but makes the largest zip.");
+
 struct ThumbTypeAndData
 {
   FileType format;
@@ -100,6 +106,227 @@ struct xml_file_writer : pugi::xml_writer
   }
 
   void write(const void *data, size_t size) { stream.Write(data, size); }
+  void writeString(const rdcstr &str) { stream.Write(str.c_str(), str.size()); }
+  // print a node as it would be indented at the given depth in a full document
+  void print(const pugi::xml_node &node, unsigned int depth)
+  {
+    node.print(*this, "\t", pugi::format_default, pugi::encoding_auto, depth);
+  }
+};
+
+// Pulls elements out of an XML stream one at a time without parsing the whole document. Only the
+// markup structure is tracked here, each element that's read is then parsed on its own with pugixml
+// so that only one top-level section or chunk needs to be in memory at once.
+class XMLElementReader
+{
+public:
+  enum class Tag
+  {
+    Open,
+    Close,
+    Empty,
+    End,
+  };
+
+  XMLElementReader(StreamReader &reader) : m_Reader(reader) {}
+  // read up to the next open, close or empty-element tag, skipping over text, comments, CDATA and
+  // declarations. Returns the element name and the raw text of the tag. End is returned if the
+  // stream ends or is malformed.
+  Tag NextTag(rdcstr &name, rdcstr &tag)
+  {
+    char c;
+
+    while(true)
+    {
+      do
+      {
+        if(!GetChar(c))
+          return Tag::End;
+      } while(c != '<');
+
+      if(!GetChar(c))
+        return Tag::End;
+
+      if(c == '?')
+      {
+        if(!SkipPast("?>"))
+          return Tag::End;
+        continue;
+      }
+
+      if(c == '!')
+      {
+        rdcstr markup = "<!";
+        while(markup.size() < 9 && GetChar(c))
+        {
+          markup.push_back(c);
+          if(markup == "<!--" || markup == "<![CDATA[" || c == '>')
+            break;
+        }
+
+        if(markup == "<!--")
+        {
+          if(!SkipPast("-->"))
+            return Tag::End;
+        }
+        else if(markup == "<![CDATA[")
+        {
+          if(!SkipPast("]]>"))
+            return Tag::End;
+        }
+        else if(markup.back() != '>')
+        {
+          // doctype or similar, we don't handle internal subsets
+          if(!SkipPast(">"))
+            return Tag::End;
+        }
+        continue;
+      }
+
+      break;
+    }
+
+    Tag ret = Tag::Open;
+
+    tag = "<";
+    name.clear();
+
+    if(c == '/')
+    {
+      ret = Tag::Close;
+      tag.push_back(c);
+      if(!GetChar(c))
+        return Tag::End;
+    }
+
+    while(c != '>' && c != '/' && !isspace((unsigned char)c))
+    {
+      name.push_back(c);
+      tag.push_back(c);
+      if(!GetChar(c))
+        return Tag::End;
+    }
+
+    // read the rest of the tag, attribute values can contain anything but their quote character
+    char quote = 0;
+    char prev = 0;
+    while(quote || c != '>')
+    {
+      tag.push_back(c);
+
+      if(quote && c == quote)
+        quote = 0;
+      else if(!quote && (c == '"' || c == '\''))
+        quote = c;
+
+      prev = c;
+      if(!GetChar(c))
+        return Tag::End;
+    }
+    tag.push_back(c);
+
+    if(name.empty())
+      return Tag::End;
+
+    if(ret == Tag::Open && prev == '/')
+      ret = Tag::Empty;
+
+    return ret;
+  }
+
+  // after an open tag from NextTag, read the rest of the element up to and including its close tag
+  // and return the whole text of the element
+  bool ReadElement(const rdcstr &openTag, rdcstr &element)
+  {
+    element = openTag;
+
+    m_Capture = &element;
+
+    rdcstr name, tag;
+    int depth = 1;
+    while(depth > 0)
+    {
+      Tag t = NextTag(name, tag);
+      if(t == Tag::End)
+        break;
+      else if(t == Tag::Open)
+        depth++;
+      else if(t == Tag::Close)
+        depth--;
+    }
+
+    m_Capture = NULL;
+
+    return depth == 0;
+  }
+
+  // parse an element returned by NextTag into doc. If it's an open tag, the whole element is read
+  // unless openTagOnly is set in which case only its attributes are parsed.
+  bool ParseElement(Tag t, const rdcstr &tag, pugi::xml_document &doc, bool openTagOnly = false)
+  {
+    rdcstr element;
+
+    if(t == Tag::Empty)
+      element = tag;
+    else if(t != Tag::Open)
+      return false;
+    else if(openTagOnly)
+      element = tag.substr(0, tag.size() - 1) + "/>";
+    else if(!ReadElement(tag, element))
+      return false;
+
+    doc.reset();
+    return doc.load_buffer(element.c_str(), element.size()) && doc.first_child();
+  }
+
+  // the number of bytes consumed so far
+  uint64_t GetOffset() const { return m_Reader.GetOffset() - (m_Buffer.size() - m_Pos); }
+private:
+  bool GetChar(char &c)
+  {
+    if(m_Pos >= m_Buffer.size())
+    {
+      uint64_t remaining = m_Reader.GetSize() - m_Reader.GetOffset();
+      if(remaining == 0 || m_Reader.IsErrored())
+        return false;
+
+      m_Buffer.resize((size_t)RDCMIN(remaining, (uint64_t)BufferSize));
+      if(!m_Reader.Read(m_Buffer.data(), m_Buffer.size()))
+        return false;
+      m_Pos = 0;
+    }
+
+    c = m_Buffer[m_Pos++];
+
+    if(m_Capture)
+      m_Capture->push_back(c);
+
+    return true;
+  }
+
+  bool SkipPast(const rdcstr &terminator)
+  {
+    rdcstr window;
+    char c;
+    while(GetChar(c))
+    {
+      window.push_back(c);
+      if(window.size() > terminator.size())
+        window.erase(0, 1);
+      if(window == terminator)
+        return true;
+    }
+    return false;
+  }
+
+  static const size_t BufferSize = 64 * 1024;
+
+  StreamReader &m_Reader;
+  rdcstr m_Buffer;
+  size_t m_Pos = 0;
+
+  // if set, everything read is appended here
+  rdcstr *m_Capture = NULL;
 };
 
 // avoid &, <, and > since they throw off the ascii alignment
@@ -221,7 +448,17 @@ static void HexDecode(const char *str, const char *end, bytebuf &out)
   }
 }
 
-static bool Obj2XML(pugi::xml_node &parent, SDObject &child)
+// bufferRemap, if set, maps from a buffer's index in the structured data to its entry in the zip,
+// since identical buffers are only stored once.
+static uint64_t BufferIndex(const rdcarray<uint64_t> *bufferRemap, uint64_t idx)
+{
+  if(bufferRemap && idx < bufferRemap->size())
+    return bufferRemap->at((size_t)idx);
+  return idx;
+}
+
+static bool Obj2XML(pugi::xml_node &parent, SDObject &child,
+                    const rdcarray<uint64_t> *bufferRemap = NULL)
 {
   pugi::xml_node obj = parent.append_child(typeNames[(uint32_t)child.type.basetype]);
 
@@ -278,7 +515,7 @@ static bool Obj2XML(pugi::xml_node &parent, SDObject &child)
 
     for(size_t o = 0; o < child.NumChildren(); o++)
     {
-      if(!Obj2XML(obj, *child.GetChild(o)))
+      if(!Obj2XML(obj, *child.GetChild(o), bufferRemap))
         return false;
 
       if(child.type.basetype == SDBasic::Array)
@@ -288,7 +525,7 @@ static bool Obj2XML(pugi::xml_node &parent, SDObject &child)
   else if(child.type.basetype == SDBasic::Buffer)
   {
     obj.append_attribute("byteLength") = child.type.byteSize;
-    obj.text() = child.data.basic.u;
+    obj.text() = BufferIndex(bufferRemap, child.data.basic.u);
   }
   else
   {
@@ -320,14 +557,21 @@ static bool Obj2XML(pugi::xml_node &parent, SDObject &child)
 }
 
 static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint64_t version,
-                               const StructuredChunkList &chunks, RENDERDOC_ProgressCallback progress)
+                               const StructuredChunkList &chunks,
+                               RENDERDOC_ProgressCallback progress,
+                               const rdcarray<uint64_t> *bufferRemap = NULL)
 {
+  xml_file_writer writer(filename);
+
+  // rather than building a tree for the whole document, each element under the root (and each
+  // chunk) is built in its own small document and printed at the depth it would have in the full
+  // tree. That gives identical output while only ever holding one chunk's nodes in memory.
   pugi::xml_document doc;
 
-  pugi::xml_node xRoot = doc.append_child("rdc");
+  writer.writeString("<?xml version=\"1.0\"?>\n<rdc>\n");
 
   {
-    pugi::xml_node xHeader = xRoot.append_child("header");
+    pugi::xml_node xHeader = doc.append_child("header");
 
     pugi::xml_node xDriver = xHeader.append_child("driver");
     xDriver.append_attribute("id") = (uint32_t)file.GetDriver();
@@ -359,6 +603,9 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
 
     xTimebase.append_attribute("base") = file.GetTimestampBase();
     xTimebase.append_attribute("frequency") = file.GetTimestampFrequency();
+
+    writer.print(xHeader, 1);
+    doc.reset();
   }
 
   if(progress)
@@ -383,7 +630,7 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
         bool succeeded = reader->SkipBytes(thumbHeader.len) && !reader->IsErrored();
         if(succeeded && (uint32_t)thumbHeader.format < (uint32_t)FileType::Count)
         {
-          pugi::xml_node xExtThumbnail = xRoot.append_child("extended_thumbnail");
+          pugi::xml_node xExtThumbnail = doc.append_child("extended_thumbnail");
 
           xExtThumbnail.append_attribute("width") = thumbHeader.width;
           xExtThumbnail.append_attribute("height") = thumbHeader.height;
@@ -397,6 +644,9 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
             xExtThumbnail.text() = "ext_thumb.raw";
           else
             RDCERR("Unexpected extended thumbnail format %s", ToStr(thumbHeader.format).c_str());
+
+          writer.print(xExtThumbnail, 1);
+          doc.reset();
         }
       }
 
@@ -411,9 +661,12 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
       {
         if(section.type == props.type)
         {
-          pugi::xml_node xFile = xRoot.append_child(section.chunkName.c_str());
+          pugi::xml_node xFile = doc.append_child(section.chunkName.c_str());
           xFile.text() = section.filename.c_str();
 
+          writer.print(xFile, 1);
+          doc.reset();
+
           delete reader;
           literalSection = true;
         }
@@ -423,7 +676,7 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
         continue;
     }
 
-    pugi::xml_node xSection = xRoot.append_child("section");
+    pugi::xml_node xSection = doc.append_child("section");
 
     if(props.flags & SectionFlags::ASCIIStored)
       xSection.append_attribute("ascii");
@@ -461,19 +714,20 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
       data.text().set(hexdata.c_str());
     }
 
+    writer.print(xSection, 1);
+    doc.reset();
+
     delete reader;
   }
 
   if(progress)
     progress(StructuredProgress(0.2f));
 
-  pugi::xml_node xChunks = xRoot.append_child("chunks");
-
-  xChunks.append_attribute("version") = version;
+  writer.writeString(StringFormat::Fmt("\t<chunks version=\"%llu\">\n", version));
 
   for(size_t c = 0; c < chunks.size(); c++)
   {
-    pugi::xml_node xChunk = xChunks.append_child("chunk");
+    pugi::xml_node xChunk = doc.append_child("chunk");
     SDChunk *chunk = chunks[c];
 
     xChunk.append_attribute("id") = chunk->metadata.chunkID;
@@ -503,13 +757,13 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
       RDCASSERT(chunk->NumChildren() > 0);
       pugi::xml_node opaque = xChunk.append_child("buffer");
       opaque.append_attribute("byteLength") = chunk->GetChild(0)->type.byteSize;
-      opaque.text() = chunk->GetChild(0)->data.basic.u;
+      opaque.text() = BufferIndex(bufferRemap, chunk->GetChild(0)->data.basic.u);
     }
     else
     {
       for(size_t o = 0; o < chunk->NumChildren(); o++)
       {
-        if(!Obj2XML(xChunk, *chunk->GetChild(o)))
+        if(!Obj2XML(xChunk, *chunk->GetChild(o), bufferRemap))
         {
           RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
                               "Malformed structured data, couldn't encode chunk child %s",
@@ -518,12 +772,14 @@ static RDResult Structured2XML(const rdcstr &filename, const RDCFile &file, uint
       }
     }
 
+    writer.print(xChunk, 2);
+    doc.reset();
+
     if(progress)
       progress(StructuredProgress(0.2f + 0.8f * (float(c) / float(chunks.size()))));
   }
 
-  xml_file_writer writer(filename);
-  doc.save(writer);
+  writer.writeString("\t</chunks>\n</rdc>\n");
 
   return writer.stream.GetError();
 }
@@ -639,26 +895,197 @@ static SDObject *XML2Obj(pugi::xml_node &obj)
   return ret;
 }
 
-static RDResult XML2Structured(const rdcstr &xml, const ThumbTypeAndData &thumb,
+static void XMLSection2RDC(pugi::xml_node xSection, const ThumbTypeAndData &extThumb,
+                           const std::map<SectionType, bytebuf> &literalFiles, RDCFile *rdc)
+{
+  if(!strcmp(xSection.name(), "extended_thumbnail"))
+  {
+    SectionProperties props = {};
+    props.type = SectionType::ExtendedThumbnail;
+    props.version = 1;
+    StreamWriter *w = rdc->WriteSection(props);
+
+    ExtThumbnailHeader header;
+    header.width = (uint16_t)xSection.attribute("width").as_uint();
+    header.height = (uint16_t)xSection.attribute("height").as_uint();
+    header.len = (uint32_t)extThumb.data.size();
+    header.format = extThumb.format;
+    w->Write(header);
+    w->Write(extThumb.data.data(), extThumb.data.size());
+
+    w->Finish();
+
+    delete w;
+
+    return;
+  }
+  else
+  {
+    for(const LiteralFileSection &section : literalFileSections)
+    {
+      if(section.chunkName == xSection.name())
+      {
+        auto litIt = literalFiles.find(section.type);
+        if(litIt != literalFiles.end())
+        {
+          SectionProperties props = {};
+          props.type = section.type;
+          props.version = 1;
+          props.flags = section.sectionFlags;
+
+          StreamWriter *w = rdc->WriteSection(props);
+          w->Write(litIt->second.data(), litIt->second.size());
+          w->Finish();
+
+          delete w;
+
+          return;
+        }
+      }
+    }
+  }
+
+  SectionProperties props;
+
+  if(xSection.attribute("ascii"))
+    props.flags |= SectionFlags::ASCIIStored;
+  if(xSection.attribute("lz4"))
+    props.flags |= SectionFlags::LZ4Compressed;
+  if(xSection.attribute("zstd"))
+    props.flags |= SectionFlags::ZstdCompressed;
+
+  pugi::xml_node name = xSection.child("name");
+  if(!name)
+  {
+    RDCERR("Malformed section, expected name node");
+    return;
+  }
+  props.name = name.text().as_string();
+
+  pugi::xml_node secVer = xSection.child("version");
+  if(!secVer)
+  {
+    RDCERR("Malformed section, expected version node");
+    return;
+  }
+  props.version = secVer.text().as_ullong();
+
+  pugi::xml_node type = xSection.child("type");
+  if(!type)
+  {
+    RDCERR("Malformed section, expected type node");
+    return;
+  }
+  props.type = (SectionType)type.text().as_uint();
+
+  pugi::xml_node data = xSection.child("data");
+  if(!data)
+  {
+    RDCERR("Malformed section, expected data node");
+    return;
+  }
+
+  const char *str = (const char *)data.text().get();
+  size_t len = strlen(str);
+
+  StreamWriter *writer = rdc->WriteSection(props);
+
+  if(props.flags & SectionFlags::ASCIIStored)
+  {
+    writer->Write(str, len);
+  }
+  else
+  {
+    bytebuf decoded;
+    HexDecode(str, str + len, decoded);
+    writer->Write(decoded.data(), decoded.size());
+  }
+
+  writer->Finish();
+  delete writer;
+}
+
+static RDResult XML2Chunk(pugi::xml_node xChunk, StructuredChunkList &chunks)
+{
+  SDChunk *chunk = new SDChunk(rdcstr(xChunk.attribute("name").as_string()));
+
+  chunk->metadata.chunkID = xChunk.attribute("id").as_uint();
+  chunk->metadata.length = xChunk.attribute("length").as_ullong();
+  if(xChunk.attribute("threadID"))
+    chunk->metadata.threadID = xChunk.attribute("threadID").as_ullong();
+  if(xChunk.attribute("timestamp"))
+    chunk->metadata.timestampMicro = xChunk.attribute("timestamp").as_ullong();
+  if(xChunk.attribute("duration"))
+    chunk->metadata.durationMicro = xChunk.attribute("duration").as_ullong();
+
+  pugi::xml_node callstack = xChunk.child("callstack");
+  if(callstack)
+  {
+    chunk->metadata.flags |= SDChunkFlags::HasCallstack;
+
+    size_t i = 0;
+    for(pugi::xml_node address = callstack.first_child(); address; address = address.next_sibling())
+    {
+      chunk->metadata.callstack.push_back(address.text().as_ullong());
+      i++;
+    }
+  }
+
+  chunks.push_back(chunk);
+
+  if(xChunk.attribute("opaque"))
+  {
+    pugi::xml_node opaque = xChunk.child("buffer");
+
+    chunk->metadata.flags |= SDChunkFlags::OpaqueChunk;
+
+    SDObject *buf = chunk->AddAndOwnChild(new SDObject("Opaque chunk"_lit, "Byte Buffer"_lit));
+    buf->type.basetype = SDBasic::Buffer;
+    buf->type.byteSize = opaque.attribute("byteLength").as_ullong();
+    buf->data.basic.u = opaque.text().as_ullong();
+  }
+  else
+  {
+    for(pugi::xml_node child = xChunk.first_child(); child; child = child.next_sibling())
+    {
+      SDObject *obj = XML2Obj(child);
+      if(!obj)
+      {
+        RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
+                            "Malformed xml document, converting chunk child <%s>", child.name());
+      }
+      chunk->AddAndOwnChild(obj);
+    }
+  }
+
+  return ResultCode::Succeeded;
+}
+
+static RDResult XML2Structured(StreamReader &reader, const ThumbTypeAndData &thumb,
                                const ThumbTypeAndData &extThumb,
                                const std::map<SectionType, bytebuf> &literalFiles,
                                const StructuredBufferList &buffers, RDCFile *rdc, uint64_t &version,
                                StructuredChunkList &chunks, RENDERDOC_ProgressCallback progress)
 {
+  // the document is read one element under the root at a time (and one chunk at a time), so memory
+  // use doesn't scale with the size of the document.
+  XMLElementReader xml(reader);
   pugi::xml_document doc;
-  doc.load_string(xml.c_str());
 
-  pugi::xml_node root = doc.child("rdc");
+  rdcstr name, tag;
+  XMLElementReader::Tag t = xml.NextTag(name, tag);
 
-  if(!root)
+  if(t != XMLElementReader::Tag::Open || name != "rdc")
     RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
                         "Malformed xml document, couldn't get root <rdc> node");
 
-  pugi::xml_node xHeader = root.first_child();
+  t = xml.NextTag(name, tag);
 
-  if(strcmp(xHeader.name(), "header") != 0)
+  if(name != "header" || !xml.ParseElement(t, tag, doc))
     RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
-                        "Malformed xml document, expected <header> node got <%s>", xHeader.name());
+                        "Malformed xml document, expected <header> node got <%s>", name.c_str());
+
+  pugi::xml_node xHeader = doc.first_child();
 
   // process the header and push meta-data into RDC
   {
@@ -719,218 +1146,235 @@ static RDResult XML2Structured(const rdcstr &xml, const ThumbTypeAndData &thumb,
     progress(StructuredProgress(0.1f));
 
   // push in other sections
-  pugi::xml_node xSection = xHeader.next_sibling();
+  t = xml.NextTag(name, tag);
 
-  while(!strcmp(xSection.name(), "section") || !strcmp(xSection.name(), "extended_thumbnail") ||
-        isLiteralFileChunkName(xSection.name()))
+  while(name == "section" || name == "extended_thumbnail" || isLiteralFileChunkName(name))
   {
-    if(!strcmp(xSection.name(), "extended_thumbnail"))
-    {
-      SectionProperties props = {};
-      props.type = SectionType::ExtendedThumbnail;
-      props.version = 1;
-      StreamWriter *w = rdc->WriteSection(props);
+    if(!xml.ParseElement(t, tag, doc))
+      RETURN_ERROR_RESULT(ResultCode::FileCorrupted, "Malformed xml document, reading <%s>",
+                          name.c_str());
 
-      ExtThumbnailHeader header;
-      header.width = (uint16_t)xSection.attribute("width").as_uint();
-      header.height = (uint16_t)xSection.attribute("height").as_uint();
-      header.len = (uint32_t)extThumb.data.size();
-      header.format = extThumb.format;
-      w->Write(header);
-      w->Write(extThumb.data.data(), extThumb.data.size());
+    XMLSection2RDC(doc.first_child(), extThumb, literalFiles, rdc);
 
-      w->Finish();
-
-      delete w;
+    t = xml.NextTag(name, tag);
+  }
 
-      xSection = xSection.next_sibling();
-      continue;
-    }
-    else
-    {
-      bool literalSection = false;
+  if(progress)
+    progress(StructuredProgress(0.2f));
 
-      for(const LiteralFileSection &section : literalFileSections)
-      {
-        if(section.chunkName == xSection.name())
-        {
-          auto litIt = literalFiles.find(section.type);
-          if(litIt != literalFiles.end())
-          {
-            SectionProperties props = {};
-            props.type = section.type;
-            props.version = 1;
-            props.flags = section.sectionFlags;
-
-            StreamWriter *w = rdc->WriteSection(props);
-            w->Write(litIt->second.data(), litIt->second.size());
-            w->Finish();
-
-            delete w;
-
-            xSection = xSection.next_sibling();
-            literalSection = true;
-          }
-        }
-      }
+  if(name != "chunks" || !xml.ParseElement(t, tag, doc, true))
+    RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
+                        "Malformed xml document, expected <chunks> node, got <%s>", name.c_str());
 
-      if(literalSection)
-        continue;
-    }
+  pugi::xml_node xChunks = doc.first_child();
 
-    SectionProperties props;
+  if(!xChunks.attribute("version"))
+    RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
+                        "Malformed xml document, expected version attribute");
 
-    if(xSection.attribute("ascii"))
-      props.flags |= SectionFlags::ASCIIStored;
-    if(xSection.attribute("lz4"))
-      props.flags |= SectionFlags::LZ4Compressed;
-    if(xSection.attribute("zstd"))
-      props.flags |= SectionFlags::ZstdCompressed;
+  version = xChunks.attribute("version").as_ullong();
 
-    pugi::xml_node name = xSection.child("name");
-    if(!name)
-    {
-      RDCERR("Malformed section, expected name node");
-      xSection = xSection.next_sibling();
-      continue;
-    }
-    props.name = name.text().as_string();
+  // an empty <chunks/> element has no children to read
+  if(t == XMLElementReader::Tag::Empty)
+    return ResultCode::Succeeded;
 
-    pugi::xml_node secVer = xSection.child("version");
-    if(!secVer)
-    {
-      RDCERR("Malformed section, expected version node");
-      xSection = xSection.next_sibling();
-      continue;
-    }
-    props.version = secVer.text().as_ullong();
+  for(t = xml.NextTag(name, tag); t != XMLElementReader::Tag::Close; t = xml.NextTag(name, tag))
+  {
+    if(t == XMLElementReader::Tag::End)
+      RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
+                          "Malformed xml document, unexpected end of document in <chunks>");
 
-    pugi::xml_node type = xSection.child("type");
-    if(!type)
-    {
-      RDCERR("Malformed section, expected type node");
-      xSection = xSection.next_sibling();
-      continue;
-    }
-    props.type = (SectionType)type.text().as_uint();
+    if(name != "chunk")
+      RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
+                          "Malformed xml document, expected <chunk> child under <chunks>, got <%s>",
+                          name.c_str());
 
-    pugi::xml_node data = xSection.child("data");
-    if(!data)
-    {
-      RDCERR("Malformed section, expected data node");
-      xSection = xSection.next_sibling();
-      continue;
-    }
+    if(!xml.ParseElement(t, tag, doc))
+      RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
+                          "Malformed xml document, reading <chunk> %zu", chunks.size());
 
-    const char *str = (const char *)data.text().get();
-    size_t len = strlen(str);
+    RDResult res = XML2Chunk(doc.first_child(), chunks);
+    if(res != ResultCode::Succeeded)
+      return res;
 
-    StreamWriter *writer = rdc->WriteSection(props);
+    if(progress)
+      progress(StructuredProgress(0.2f + 0.8f * float(xml.GetOffset()) / float(reader.GetSize())));
+  }
 
-    if(props.flags & SectionFlags::ASCIIStored)
-    {
-      writer->Write(str, len);
-    }
-    else
-    {
-      bytebuf decoded;
-      HexDecode(str, str + len, decoded);
-      writer->Write(decoded.data(), decoded.size());
-    }
+  return ResultCode::Succeeded;
+}
 
-    writer->Finish();
-    delete writer;
+// run callback(i) for each i in [0, count) in parallel. Each worker pulls the next index as it
+// finishes so that a few large buffers don't leave the others idle.
+static void ParallelForEach(size_t count, const std::function<void(size_t)> &callback)
+{
+  const size_t numWorkers = RDCMIN((size_t)Threading::NumberOfCores(), count);
 
-    xSection = xSection.next_sibling();
+  if(numWorkers <= 1)
+  {
+    for(size_t i = 0; i < count; i++)
+      callback(i);
+    return;
   }
 
-  if(progress)
-    progress(StructuredProgress(0.2f));
+  int32_t next = -1;
+  std::function<void()> work = [&next, &callback, count]() {
+    for(size_t i = (size_t)Atomic::Inc32(&next); i < count; i = (size_t)Atomic::Inc32(&next))
+      callback(i);
+  };
 
-  pugi::xml_node xChunks = xSection;
+  if(Threading::JobSystem::CanAddJobs())
+  {
+    rdcarray<Threading::JobSystem::Job *> jobs;
+    for(size_t j = 0; j < numWorkers; j++)
+      jobs.push_back(
+          Threading::JobSystem::AddJob(std::function<void()>(work), {}, "XML+ZIP buffers"));
 
-  if(strcmp(xSection.name(), "chunks") != 0)
-    RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
-                        "Malformed xml document, expected <chunks> node, got <%s>", xSection.name());
+    // we could be called at any point while replaying, so don't leave the jobs until the next sync
+    Threading::JobSystem::FreeJobs(jobs);
+  }
+  else
+  {
+    // the job system only runs under a replay driver, so converting from the command line or
+    // exporting without one starts threads just for this. This thread does its share too
+    rdcarray<Threading::ThreadHandle> threads;
+    for(size_t t = 1; t < numWorkers; t++)
+      threads.push_back(Threading::CreateThread(work));
 
-  if(!xChunks.attribute("version"))
-    RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
-                        "Malformed xml document, expected version attribute");
+    work();
 
-  version = xChunks.attribute("version").as_ullong();
+    for(Threading::ThreadHandle t : threads)
+    {
+      Threading::JoinThread(t);
+      Threading::CloseThread(t);
+    }
+  }
+}
 
-  size_t chunkIdx = 0;
-  size_t numChunks = std::distance(xChunks.begin(), xChunks.end());
+static void WriteZIPBuffers(mz_zip_archive &zip, const StructuredBufferList &buffers,
+                            rdcarray<uint64_t> &bufferRemap, RENDERDOC_ProgressCallback progress)
+{
+  static const bytebuf emptyBuffer;
 
-  for(pugi::xml_node xChunk = xChunks.first_child(); xChunk; xChunk = xChunk.next_sibling())
+  struct ZipBuffer
   {
-    if(strcmp(xChunk.name(), "chunk") != 0)
-      RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
-                          "Malformed xml document, expected <chunk> child under <chunks>, got <%s>",
-                          xChunk.name());
+    const bytebuf *data;
+    mz_uint32 crc;
+    void *compressed;
+    size_t compressedSize;
+  };
 
-    SDChunk *chunk = new SDChunk(rdcstr(xChunk.attribute("name").as_string()));
+  rdcarray<ZipBuffer> zipBuffers;
+  zipBuffers.resize(buffers.size());
 
-    chunk->metadata.chunkID = xChunk.attribute("id").as_uint();
-    chunk->metadata.length = xChunk.attribute("length").as_ullong();
-    if(xChunk.attribute("threadID"))
-      chunk->metadata.threadID = xChunk.attribute("threadID").as_ullong();
-    if(xChunk.attribute("timestamp"))
-      chunk->metadata.timestampMicro = xChunk.attribute("timestamp").as_ullong();
-    if(xChunk.attribute("duration"))
-      chunk->metadata.durationMicro = xChunk.attribute("duration").as_ullong();
+  for(size_t i = 0; i < buffers.size(); i++)
+  {
+    zipBuffers[i] = {};
+    zipBuffers[i].data = buffers[i] ? buffers[i] : &emptyBuffer;
+  }
 
-    pugi::xml_node callstack = xChunk.child("callstack");
-    if(callstack)
-    {
-      chunk->metadata.flags |= SDChunkFlags::HasCallstack;
+  // the CRC is needed for the zip entry anyway, so it doubles as the hash for finding duplicates
+  ParallelForEach(zipBuffers.size(), [&zipBuffers](size_t i) {
+    const bytebuf &data = *zipBuffers[i].data;
+    zipBuffers[i].crc = (mz_uint32)mz_crc32(MZ_CRC32_INIT, data.data(), data.size());
+  });
+
+  // identical buffers are only stored once, with every reference in the XML pointing at the first
+  // one. The zip entries are numbered contiguously so the importer needs no special handling.
+  rdcarray<ZipBuffer> uniqueBuffers;
+  std::map<rdcpair<uint64_t, mz_uint32>, rdcarray<uint64_t>> lookup;
 
-      size_t i = 0;
-      for(pugi::xml_node address = callstack.first_child(); address; address = address.next_sibling())
+  bufferRemap.resize(buffers.size());
+
+  for(size_t i = 0; i < zipBuffers.size(); i++)
+  {
+    const bytebuf &data = *zipBuffers[i].data;
+    rdcarray<uint64_t> &candidates = lookup[{data.size(), zipBuffers[i].crc}];
+
+    bufferRemap[i] = ~0ULL;
+    for(uint64_t c : candidates)
+    {
+      if(memcmp(uniqueBuffers[(size_t)c].data->data(), data.data(), data.size()) == 0)
       {
-        chunk->metadata.callstack.push_back(address.text().as_ullong());
-        i++;
+        bufferRemap[i] = c;
+        break;
       }
     }
 
-    chunks.push_back(chunk);
+    if(bufferRemap[i] == ~0ULL)
+    {
+      bufferRemap[i] = uniqueBuffers.size();
+      candidates.push_back(uniqueBuffers.size());
+      uniqueBuffers.push_back(zipBuffers[i]);
+    }
+  }
+
+  zipBuffers.clear();
+  lookup.clear();
+
+  const mz_uint level = RDCMIN(Capture_XMLZipCompressionLevel(), (uint32_t)MZ_UBER_COMPRESSION);
+  const int compFlags =
+      tdefl_create_comp_flags_from_zip_params(level, -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY);
+
+  // compress in batches so that only a bounded amount of compressed data is held before being
+  // written out in order
+  const size_t MaxBatchBuffers = 256;
+  const uint64_t MaxBatchBytes = 64 * 1024 * 1024;
 
-    if(xChunk.attribute("opaque"))
+  for(size_t batchStart = 0; batchStart < uniqueBuffers.size();)
+  {
+    size_t batchEnd = batchStart;
+    uint64_t batchBytes = 0;
+    while(batchEnd < uniqueBuffers.size() && batchEnd - batchStart < MaxBatchBuffers)
     {
-      pugi::xml_node opaque = xChunk.child("buffer");
+      // always take at least one buffer, however large
+      if(batchEnd > batchStart && batchBytes + uniqueBuffers[batchEnd].data->size() > MaxBatchBytes)
+        break;
 
-      chunk->metadata.flags |= SDChunkFlags::OpaqueChunk;
+      batchBytes += uniqueBuffers[batchEnd].data->size();
+      batchEnd++;
+    }
 
-      SDObject *buf = chunk->AddAndOwnChild(new SDObject("Opaque chunk"_lit, "Byte Buffer"_lit));
-      buf->type.basetype = SDBasic::Buffer;
-      buf->type.byteSize = opaque.attribute("byteLength").as_ullong();
-      buf->data.basic.u = opaque.text().as_ullong();
+    // very small buffers gain nothing from compression and miniz would store them anyway
+    if(level > 0)
+    {
+      ParallelForEach(batchEnd - batchStart, [&uniqueBuffers, batchStart, compFlags](size_t i) {
+        ZipBuffer &buf = uniqueBuffers[batchStart + i];
+        if(buf.data->size() > 3)
+          buf.compressed = tdefl_compress_mem_to_heap(buf.data->data(), buf.data->size(),
+                                                      &buf.compressedSize, compFlags);
+      });
     }
-    else
+
+    for(size_t i = batchStart; i < batchEnd; i++)
     {
-      for(pugi::xml_node child = xChunk.first_child(); child; child = child.next_sibling())
+      ZipBuffer &buf = uniqueBuffers[i];
+
+      if(buf.compressed)
       {
-        SDObject *obj = XML2Obj(child);
-        if(!obj)
-        {
-          RETURN_ERROR_RESULT(ResultCode::FileCorrupted,
-                              "Malformed xml document, converting chunk child <%s>", child.name());
-        }
-        chunk->AddAndOwnChild(obj);
+        mz_zip_writer_add_mem_ex(&zip, GetBufferName(i).c_str(), buf.compressed, buf.compressedSize,
+                                 NULL, 0, level | MZ_ZIP_FLAG_COMPRESSED_DATA, buf.data->size(),
+                                 buf.crc);
+        mz_free(buf.compressed);
+        buf.compressed = NULL;
+      }
+      else
+      {
+        mz_zip_writer_add_mem(&zip, GetBufferName(i).c_str(), buf.data->data(), buf.data->size(),
+                              level);
       }
-    }
 
-    if(progress)
-      progress(StructuredProgress(0.2f + 0.8f * (float(chunkIdx) / float(numChunks))));
+      if(progress)
+        progress(BufferProgress(float(i) / float(uniqueBuffers.size())));
+    }
 
-    chunkIdx++;
+    batchStart = batchEnd;
   }
-
-  return ResultCode::Succeeded;
 }
 
 static RDResult Buffers2ZIP(const rdcstr &filename, const RDCFile &file,
-                            const StructuredBufferList &buffers, RENDERDOC_ProgressCallback progress)
+                            const StructuredBufferList &buffers, rdcarray<uint64_t> &bufferRemap,
+                            RENDERDOC_ProgressCallback progress)
 {
   rdcstr zipFile = strip_extension(filename);
 
@@ -945,13 +1389,7 @@ static RDResult Buffers2ZIP(const rdcstr &filename, const RDCFile &file,
                         zipFile.c_str(), mz_zip_get_error_string(zip.m_last_error));
   }
 
-  for(size_t i = 0; i < buffers.size(); i++)
-  {
-    mz_zip_writer_add_mem(&zip, GetBufferName(i).c_str(), buffers[i]->data(), buffers[i]->size(), 2);
-
-    if(progress)
-      progress(BufferProgress(float(i) / float(buffers.size())));
-  }
+  WriteZIPBuffers(zip, buffers, bufferRemap, progress);
 
   const RDCThumb &th = file.GetThumbnail();
   if(!th.pixels.empty() && th.width > 0 && th.height > 0)
@@ -1128,23 +1566,21 @@ RDResult importXMLZ(const rdcstr &filename, StreamReader &reader, RDCFile *rdc,
       return res;
   }
 
-  rdcstr buf;
-  buf.resize((size_t)reader.GetSize());
-  reader.Read(buf.data(), buf.size());
-
-  return XML2Structured(buf.c_str(), thumb, extThumb, literalFiles, structData.buffers, rdc,
+  return XML2Structured(reader, thumb, extThumb, literalFiles, structData.buffers, rdc,
                         structData.version, structData.chunks, progress);
 }
 
 RDResult exportXMLZ(const rdcstr &filename, const RDCFile &rdc, const SDFile &structData,
                     RENDERDOC_ProgressCallback progress)
 {
-  RDResult ret = Buffers2ZIP(filename, rdc, structData.buffers, progress);
+  rdcarray<uint64_t> bufferRemap;
+  RDResult ret = Buffers2ZIP(filename, rdc, structData.buffers, bufferRemap, progress);
 
   if(ret != ResultCode::Succeeded)
     return ret;
 
-  return Structured2XML(filename, rdc, structData.version, structData.chunks, progress);
+  return Structured2XML(filename, rdc, structData.version, structData.chunks, progress,
+                        &bufferRemap);
 }
 
 RDResult exportXMLOnly(const rdcstr &filename, const RDCFile &rdc, const SDFile &structData,
@@ -1232,4 +1668,220 @@ TEST_CASE("XML/SDObject round trip", "[xml serialiser]")
   }
 }
 
+TEST_CASE("XML element reader", "[xml serialiser]")
+{
+  rdcstr xml = R"(<?xml version="1.0"?>
+<!-- a comment with <tags> in it -->
+<root attr="1">
+  <empty a="/>" b='>' />
+  <nested x="y"><inner>text &amp; <![CDATA[ </nested> ]]></inner><!-- </nested> --></nested>
+  <last>value</last>
+</root>
+)";
+
+  StreamReader reader((const byte *)xml.c_str(), xml.size());
+  XMLElementReader elements(reader);
+
+  rdcstr name, tag, element;
+
+  CHECK((elements.NextTag(name, tag) == XMLElementReader::Tag::Open));
+  CHECK(name == "root");
+  CHECK(tag == "<root attr=\"1\">");
+
+  CHECK((elements.NextTag(name, tag) == XMLElementReader::Tag::Empty));
+  CHECK(name == "empty");
+  CHECK(tag == "<empty a=\"/>\" b='>' />");
+
+  CHECK((elements.NextTag(name, tag) == XMLElementReader::Tag::Open));
+  CHECK(name == "nested");
+
+  REQUIRE(elements.ReadElement(tag, element));
+  CHECK(element ==
+        "<nested x=\"y\"><inner>text &amp; <![CDATA[ </nested> ]]></inner><!-- </nested> "
+        "--></nested>");
+
+  pugi::xml_document doc;
+  CHECK((elements.NextTag(name, tag) == XMLElementReader::Tag::Open));
+  REQUIRE(elements.ParseElement(XMLElementReader::Tag::Open, tag, doc));
+  CHECK(rdcstr(doc.first_child().name()) == "last");
+  CHECK(rdcstr(doc.first_child().text().as_string()) == "value");
+
+  CHECK((elements.NextTag(name, tag) == XMLElementReader::Tag::Close));
+  CHECK(name == "root");
+
+  CHECK((elements.NextTag(name, tag) == XMLElementReader::Tag::End));
+}
+
+TEST_CASE("XML capture export and import", "[xml serialiser]")
+{
+  const rdcstr notes = "Some notes & <markup> that </chunks> must survive";
+
+  RDCFile rdc;
+  rdc.SetData(RDCDriver::Vulkan, "Vulkan", 0x1234, NULL, 100, 2.5);
+
+  {
+    SectionProperties props = {};
+    props.type = SectionType::Notes;
+    props.name = "renderdoc/ui/notes";
+    props.version = 1;
+    props.flags = SectionFlags::ASCIIStored;
+
+    StreamWriter *w = rdc.WriteSection(props);
+    w->Write(notes.c_str(), notes.size());
+    w->Finish();
+    delete w;
+  }
+
+  SDFile sdfile;
+  sdfile.version = 0x15;
+
+  for(uint32_t c = 0; c < 200; c++)
+  {
+    SDChunk *chunk = new SDChunk(StringFormat::Fmt("Chunk %u", c));
+    chunk->metadata.chunkID = c + 1;
+    chunk->metadata.length = c * 4;
+    chunk->metadata.threadID = 10 + (c % 3);
+    chunk->AddAndOwnChild(makeSDUInt32("value"_lit, c));
+    chunk->AddAndOwnChild(makeSDString("str"_lit, "a<b>&c \"quoted\" </chunk>"));
+    sdfile.chunks.push_back(chunk);
+  }
+
+  rdcstr filename = FileIO::GetTempFolderFilename() + "/renderdoc_xml_codec_test.xml";
+
+  RDResult res = exportXMLOnly(filename, rdc, sdfile, NULL);
+  CHECK(res.code == ResultCode::Succeeded);
+
+  RDCFile imported;
+  SDFile importedData;
+
+  {
+    StreamReader reader(FileIO::fopen(filename, FileIO::ReadBinary));
+    res = importXMLZ(rdcstr(), reader, &imported, importedData, NULL);
+  }
+
+  FileIO::Delete(filename);
+
+  REQUIRE(res.code == ResultCode::Succeeded);
+
+  CHECK(imported.GetDriver() == RDCDriver::Vulkan);
+  CHECK(imported.GetDriverName() == "Vulkan");
+  CHECK(imported.GetMachineIdent() == 0x1234);
+  CHECK(imported.GetTimestampBase() == 100);
+  CHECK(imported.GetTimestampFrequency() == 2.5);
+
+  REQUIRE(imported.NumSections() == 1);
+  CHECK(imported.GetSectionProperties(0).type == SectionType::Notes);
+  CHECK(imported.GetSectionProperties(0).name == "renderdoc/ui/notes");
+
+  {
+    StreamReader *reader = imported.ReadSection(0);
+    rdcstr importedNotes;
+    importedNotes.resize((size_t)reader->GetSize());
+    reader->Read(importedNotes.data(), importedNotes.size());
+    delete reader;
+
+    CHECK(importedNotes == notes);
+  }
+
+  CHECK(importedData.version == sdfile.version);
+
+  REQUIRE(importedData.chunks.size() == sdfile.chunks.size());
+  for(size_t c = 0; c < sdfile.chunks.size(); c++)
+  {
+    SDChunk *a = sdfile.chunks[c];
+    SDChunk *b = importedData.chunks[c];
+
+    CHECK(a->name == b->name);
+    CHECK(a->metadata.chunkID == b->metadata.chunkID);
+    CHECK(a->metadata.length == b->metadata.length);
+    CHECK(a->metadata.threadID == b->metadata.threadID);
+    REQUIRE(b->NumChildren() == 2);
+    CHECK(b->GetChild(0)->AsUInt32() == c);
+    CHECK(b->GetChild(1)->AsString() == a->GetChild(1)->AsString());
+  }
+}
+
+TEST_CASE("XML+ZIP buffer deduplication", "[xml serialiser]")
+{
+  RDCFile rdc;
+  rdc.SetData(RDCDriver::Vulkan, "Vulkan", 0x1234, NULL, 100, 2.5);
+
+  SDFile sdfile;
+  sdfile.version = 0x15;
+
+  // 8 distinct contents, each repeated 4 times with an empty buffer thrown in. Half of them are the
+  // same size as each other so that the contents must be compared and not just the size.
+  const uint32_t numUnique = 8;
+  for(uint32_t i = 0; i < numUnique * 4 + 1; i++)
+  {
+    bytebuf *buf = new bytebuf;
+    if(i < numUnique * 4)
+    {
+      uint32_t contents = i % numUnique;
+      buf->resize(contents < numUnique / 2 ? 4096 : 1000 + contents * 100);
+      for(size_t b = 0; b < buf->size(); b++)
+        buf->data()[b] = byte((b / 64) * 7 + contents);
+    }
+    sdfile.buffers.push_back(buf);
+  }
+
+  for(uint32_t i = 0; i < sdfile.buffers.size(); i++)
+  {
+    SDChunk *chunk = new SDChunk("Chunk"_lit);
+    chunk->metadata.chunkID = i + 1;
+
+    SDObject *obj = new SDObject("data"_lit, "Buffer"_lit);
+    obj->type.basetype = SDBasic::Buffer;
+    obj->type.byteSize = sdfile.buffers[i]->size();
+    obj->data.basic.u = i;
+    chunk->AddAndOwnChild(obj);
+
+    sdfile.chunks.push_back(chunk);
+  }
+
+  rdcstr filename = FileIO::GetTempFolderFilename() + "/renderdoc_xml_codec_test.zip.xml";
+  rdcstr zipFilename = strip_extension(filename);
+
+  RDResult res = exportXMLZ(filename, rdc, sdfile, NULL);
+  REQUIRE(res.code == ResultCode::Succeeded);
+
+  {
+    mz_zip_archive zip;
+    memset(&zip, 0, sizeof(zip));
+    REQUIRE(mz_zip_reader_init_file(&zip, zipFilename.c_str(), 0));
+    CHECK(mz_zip_reader_get_num_files(&zip) == numUnique + 1);
+    mz_zip_reader_end(&zip);
+  }
+
+  RDCFile imported;
+  SDFile importedData;
+
+  {
+    StreamReader reader(FileIO::fopen(filename, FileIO::ReadBinary));
+    res = importXMLZ(filename, reader, &imported, importedData, NULL);
+  }
+
+  FileIO::Delete(filename);
+  FileIO::Delete(zipFilename);
+
+  REQUIRE(res.code == ResultCode::Succeeded);
+  REQUIRE(importedData.chunks.size() == sdfile.chunks.size());
+
+  for(size_t c = 0; c < sdfile.chunks.size(); c++)
+  {
+    SDObject *obj = importedData.chunks[c]->GetChild(0);
+    REQUIRE(obj->type.basetype == SDBasic::Buffer);
+    CHECK(obj->type.byteSize == sdfile.buffers[c]->size());
+
+    REQUIRE(obj->data.basic.u < importedData.buffers.size());
+    bytebuf *buf = importedData.buffers[(size_t)obj->data.basic.u];
+    REQUIRE(buf);
+    CHECK(*buf == *sdfile.buffers[c]);
+
+    // every repeat of the same contents resolves to the same zip entry
+    if(c >= numUnique && c < numUnique * 4)
+      CHECK(obj->data.basic.u == importedData.chunks[c - numUnique]->GetChild(0)->data.basic.u);
+  }
+}
+
 #endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -22,6 +22,7 @@
  * THE SOFTWARE.
  ******************************************************************************/
 
+#include "blockio.h"
 #include "lz4io.h"
 #include "serialiser.h"
 #include "zstdio.h"
@@ -190,4 +191,235 @@ TEST_CASE("Test ZSTD compression/decompression", "[streamio][zstd]")
   delete[] randomData;
 };
 
+TEST_CASE("Test indexed block compression/decompression", "[streamio][lz4][zstd]")
+{
+  const uint64_t dataSize = 6 * 1024 * 1024 + 1234;
+
+  byte *data = new byte[(size_t)dataSize];
+
+  // mix of compressible and incompressible data
+  for(uint64_t i = 0; i < dataSize; i++)
+    data[i] = (i / 4096) % 2 ? (rand() & 0xff) : byte(i & 0xff);
+
+  SectionFlags codec = SectionFlags::NoFlags;
+
+  SECTION("LZ4")
+  {
+    codec = SectionFlags::LZ4Compressed;
+  };
+
+  SECTION("ZSTD")
+  {
+    codec = SectionFlags::ZstdCompressed;
+  };
+
+  rdcstr filename = FileIO::GetTempFolderFilename() + "renderdoc_indexed_block_test.bin";
+
+  uint64_t diskLength = 0;
+
+  // write the data
+  {
+    StreamWriter *buf = new StreamWriter(FileIO::fopen(filename, FileIO::WriteBinary),
+                                         Ownership::Stream);
+
+    Compressor *comp = NULL;
+    if(codec == SectionFlags::LZ4Compressed)
+      comp = new LZ4Compressor(buf, Ownership::Stream);
+    else
+      comp = new ZSTDCompressor(buf, Ownership::Stream);
+
+    comp->SetBlockIndexed();
+
+    StreamWriter writer(comp, Ownership::Stream);
+
+    // write in odd-sized pieces to span blocks
+    for(uint64_t offs = 0; offs < dataSize; offs += 100000)
+      writer.Write(data + offs, RDCMIN<uint64_t>(100000, dataSize - offs));
+
+    writer.Finish();
+
+    CHECK_FALSE(writer.IsErrored());
+    CHECK(writer.GetOffset() == dataSize);
+
+    diskLength = buf->GetOffset();
+  }
+
+  byte *readData = new byte[(size_t)dataSize];
+
+  // the data must still be readable by the sequential decompressors
+  {
+    StreamReader *fileReader =
+        new StreamReader(FileIO::fopen(filename, FileIO::ReadBinary), diskLength, Ownership::Stream);
+
+    Decompressor *decomp = NULL;
+    if(codec == SectionFlags::LZ4Compressed)
+      decomp = new LZ4Decompressor(fileReader, Ownership::Stream);
+    else
+      decomp = new ZSTDDecompressor(fileReader, Ownership::Stream);
+
+    StreamReader reader(decomp, dataSize, Ownership::Stream);
+
+    memset(readData, 0, (size_t)dataSize);
+    reader.Read(readData, dataSize);
+
+    CHECK_FALSE(reader.IsErrored());
+    CHECK(reader.AtEnd());
+    CHECK_FALSE(memcmp(readData, data, (size_t)dataSize));
+  }
+
+  FILE *f = FileIO::fopen(filename, FileIO::ReadBinary);
+
+  // read back in order, then seek around
+  {
+    IndexedDecompressor *decomp = IndexedDecompressor::Create(f, 0, diskLength, dataSize, codec);
+
+    REQUIRE(decomp);
+
+    StreamReader reader(decomp, dataSize, Ownership::Stream);
+
+    memset(readData, 0, (size_t)dataSize);
+    for(uint64_t offs = 0; offs < dataSize; offs += 7777)
+      reader.Read(readData + offs, RDCMIN<uint64_t>(7777, dataSize - offs));
+
+    CHECK_FALSE(reader.IsErrored());
+    CHECK(reader.AtEnd());
+    CHECK_FALSE(memcmp(readData, data, (size_t)dataSize));
+
+    uint64_t offsets[] = {dataSize - 100, 0, 3 * 1024 * 1024 + 17, 1024 * 1024 - 50, 5000};
+
+    for(uint64_t offs : offsets)
+    {
+      uint32_t val = 0;
+      reader.SetOffset(offs);
+      CHECK(reader.GetOffset() == offs);
+      reader.Read(val);
+
+      uint32_t expected = 0;
+      memcpy(&expected, data + offs, sizeof(expected));
+      CHECK(val == expected);
+    }
+
+    CHECK_FALSE(reader.IsErrored());
+  }
+
+  // read with decompression happening on the job system
+  {
+    Threading::JobSystem::Init(3);
+
+    IndexedDecompressor *decomp = IndexedDecompressor::Create(f, 0, diskLength, dataSize, codec);
+
+    REQUIRE(decomp);
+
+    StreamReader reader(decomp, dataSize, Ownership::Stream);
+
+    memset(readData, 0, (size_t)dataSize);
+    reader.Read(readData, 1000);
+    reader.SetOffset(dataSize / 2);
+    reader.SetOffset(1000);
+    reader.Read(readData + 1000, dataSize - 1000);
+
+    CHECK_FALSE(reader.IsErrored());
+    CHECK_FALSE(memcmp(readData, data, (size_t)dataSize));
+
+    Threading::JobSystem::Shutdown();
+  }
+
+  // a broken index should be detected
+  {
+    IndexedDecompressor *decomp =
+        IndexedDecompressor::Create(f, 0, diskLength - 1, dataSize, codec);
+
+    CHECK(decomp == NULL);
+  }
+
+  FileIO::fclose(f);
+  FileIO::Delete(filename);
+
+  delete[] readData;
+  delete[] data;
+};
+
+TEST_CASE("Test parallel compression", "[streamio][lz4][zstd]")
+{
+  const uint64_t dataSize = 5 * 1024 * 1024 + 12345;
+  byte *data = new byte[(size_t)dataSize];
+
+  // mix of compressible and incompressible data
+  for(uint64_t i = 0; i < dataSize; i++)
+    data[i] = (i / 4096) % 3 ? byte(i & 0xff) : (rand() & 0xff);
+
+  SectionFlags codec = SectionFlags::NoFlags;
+
+  SECTION("LZ4")
+  {
+    codec = SectionFlags::LZ4Compressed;
+  };
+
+  SECTION("ZSTD")
+  {
+    codec = SectionFlags::ZstdCompressed;
+  };
+
+  auto compress = [&](uint32_t numThreads, uint64_t size) {
+    StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
+
+    {
+      StreamWriter writer(new ParallelCompressor(buf, Ownership::Nothing, codec, numThreads),
+                          Ownership::Stream);
+
+      // write in odd-sized pieces to span blocks
+      for(uint64_t offs = 0; offs < size; offs += 100000)
+        writer.Write(data + offs, RDCMIN<uint64_t>(100000, size - offs));
+
+      writer.Finish();
+
+      CHECK_FALSE(writer.IsErrored());
+      CHECK(writer.GetOffset() == size);
+    }
+
+    return buf;
+  };
+
+  auto verify = [&](StreamWriter *buf, uint64_t size) {
+    StreamReader *compReader = new StreamReader(buf->GetData(), buf->GetOffset());
+
+    Decompressor *decomp = NULL;
+    if(codec == SectionFlags::LZ4Compressed)
+      decomp = new LZ4Decompressor(compReader, Ownership::Stream);
+    else
+      decomp = new ZSTDDecompressor(compReader, Ownership::Stream);
+
+    StreamReader reader(decomp, size, Ownership::Stream);
+
+    byte *readData = new byte[(size_t)size];
+    reader.Read(readData, size);
+
+    CHECK_FALSE(reader.IsErrored());
+    CHECK(reader.AtEnd());
+    CHECK_FALSE(memcmp(readData, data, (size_t)size));
+
+    delete[] readData;
+  };
+
+  // compressing on workers must give the same result as compressing inline
+  StreamWriter *serial = compress(1, dataSize);
+  StreamWriter *parallel = compress(4, dataSize);
+
+  verify(serial, dataSize);
+  verify(parallel, dataSize);
+
+  CHECK(serial->GetOffset() == parallel->GetOffset());
+  CHECK_FALSE(memcmp(serial->GetData(), parallel->GetData(), (size_t)serial->GetOffset()));
+
+  delete serial;
+  delete parallel;
+
+  // less than a single block
+  StreamWriter *small = compress(4, 1000);
+  verify(small, 1000);
+  delete small;
+
+  delete[] data;
+};
+
 #endif    // ENABLED(ENABLE_UNIT_TESTS)
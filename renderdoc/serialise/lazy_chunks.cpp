@@ -0,0 +1,134 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "lazy_chunks.h"
+#include "core/settings.h"
+#include "rdcfile.h"
+
+RDOC_CONFIG(bool, Replay_LazyStructuredData, false,
+            "Load capture chunks as placeholders and only read their parameters into structured "
+            "data when they are first inspected, to reduce memory use on large captures.");
+
+LazyChunkSource *LazyChunkSource::Create(RDCFile *rdc, int sectionIndex, ChunkProcessor processor)
+{
+  if(!Replay_LazyStructuredData() || sectionIndex < 0)
+    return NULL;
+
+  return Create(rdc->ReadSection(sectionIndex), processor);
+}
+
+LazyChunkSource *LazyChunkSource::Create(StreamReader *reader, ChunkProcessor processor)
+{
+  if(reader->IsErrored() || !reader->CanSeek())
+  {
+    delete reader;
+    return NULL;
+  }
+
+  return new LazyChunkSource(reader, processor);
+}
+
+LazyChunkSource::LazyChunkSource(StreamReader *reader, ChunkProcessor processor)
+    : m_Reader(reader), m_Processor(processor)
+{
+}
+
+LazyChunkSource::~LazyChunkSource()
+{
+  SAFE_DELETE(m_Reader);
+}
+
+void LazyChunkSource::AddRef()
+{
+  Atomic::Inc32(&m_RefCount);
+}
+
+void LazyChunkSource::Release()
+{
+  if(Atomic::Dec32(&m_RefCount) == 0)
+    delete this;
+}
+
+void LazyChunkSource::AddChunk(SDChunk *chunk, uint64_t offset)
+{
+  AddRef();
+  chunk->SetLazyChunk(this, offset);
+}
+
+bool LazyChunkSource::IsPopulated(const SDObject *chunk)
+{
+  int32_t *populated = chunk->GetLazyChunkPopulatedFlag();
+  return populated && Atomic::CmpExch32(populated, 1, 1) == 1;
+}
+
+void LazyChunkSource::Populate(const SDObject *chunk)
+{
+  // this is called on every access, so avoid locking once the chunk is populated. The flag is only
+  // set after the children are, so if it's set they're safe to read
+  if(IsPopulated(chunk))
+    return;
+
+  SCOPED_LOCK(m_Lock);
+
+  // another thread may have populated the chunk while we waited
+  if(IsPopulated(chunk))
+    return;
+
+  m_Reader->SetOffset(chunk->GetLazyChunkOffset());
+
+  {
+    ReadSerialiser ser(m_Reader, Ownership::Nothing);
+
+    bool success = m_Processor(ser);
+
+    SDFile &file = ser.GetStructuredFile();
+
+    if(success && !m_Reader->IsErrored() && file.chunks.size() == 1)
+    {
+      // flags determined while reading the contents weren't known when the placeholder was made
+      SDChunk *placeholder = (SDChunk *)chunk;
+      placeholder->metadata.flags |= (file.chunks[0]->metadata.flags & SDChunkFlags::OpaqueChunk);
+
+      chunk->SetLazyChunkChildren(*file.chunks[0]);
+    }
+    else
+    {
+      RDCERR("Couldn't read structured data for chunk %s at offset %llu", chunk->name.c_str(),
+             chunk->GetLazyChunkOffset());
+
+      // the chunk is still marked as populated with no children, to avoid repeatedly trying to
+      // read it.
+      SDChunk empty(""_lit);
+      chunk->SetLazyChunkChildren(empty);
+    }
+  }
+
+  Atomic::CmpExch32(chunk->GetLazyChunkPopulatedFlag(), 0, 1);
+  Atomic::Inc32(&m_PopulatedCount);
+}
+
+void LazyChunkSource::Forget(const SDObject *chunk)
+{
+  Release();
+}
@@ -0,0 +1,81 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include <functional>
+#include "common/threading.h"
+#include "serialiser.h"
+
+class RDCFile;
+class ReadSerialiser;
+
+// Backs placeholder chunks in an SDFile that was loaded without reading chunk contents into
+// structured data. The first access to a placeholder re-reads its chunk from the capture, and the
+// populated children are then kept until the placeholder is deleted. They're never freed earlier
+// since pointers to them may have been handed out to anyone.
+//
+// The source is refcounted - each placeholder holds a reference so it lives as long as the SDFile.
+class LazyChunkSource : public SDLazyChunkSource
+{
+public:
+  // called with the serialiser positioned at the start of a chunk. It must read the chunk with
+  // structured export configured and call EndChunk, leaving the chunk as the only one in the
+  // serialiser's structured file. Buffers are not carried over so should not be exported.
+  typedef std::function<bool(ReadSerialiser &ser)> ChunkProcessor;
+
+  // returns NULL if lazy structured data is disabled or the section can't be read back at random
+  // offsets, in which case the caller should export structured data as normal.
+  static LazyChunkSource *Create(RDCFile *rdc, int sectionIndex, ChunkProcessor processor);
+  // reads from an arbitrary stream which the source takes ownership of, regardless of the config
+  // setting. Returns NULL and deletes the stream if it can't seek.
+  static LazyChunkSource *Create(StreamReader *reader, ChunkProcessor processor);
+
+  void AddRef();
+  void Release();
+
+  // register a placeholder chunk at the given offset in the stream and take a reference for it
+  void AddChunk(SDChunk *chunk, uint64_t offset);
+
+  // the number of placeholder chunks that have been populated so far
+  uint32_t GetPopulatedCount() { return (uint32_t)Atomic::CmpExch32(&m_PopulatedCount, 0, 0); }
+
+  // whether a placeholder's children have been populated, safe to call from any thread
+  static bool IsPopulated(const SDObject *chunk);
+
+  void Populate(const SDObject *chunk) override;
+  void Forget(const SDObject *chunk) override;
+
+private:
+  LazyChunkSource(StreamReader *reader, ChunkProcessor processor);
+  ~LazyChunkSource();
+
+  Threading::CriticalSection m_Lock;
+  int32_t m_RefCount = 1;
+
+  StreamReader *m_Reader = NULL;
+  ChunkProcessor m_Processor;
+
+  int32_t m_PopulatedCount = 0;
+};
@@ -26,6 +26,9 @@
 
 static const uint64_t lz4BlockSize = 1024 * 1024;
 
+const uint64_t LZ4Compressor::BlockSize = lz4BlockSize;
+const uint64_t LZ4Compressor::CompressedBlockBound = LZ4_COMPRESSBOUND(lz4BlockSize);
+
 LZ4Compressor::LZ4Compressor(StreamWriter *write, Ownership own) : Compressor(write, own)
 {
   m_Page[0] = AllocAlignedBuffer(lz4BlockSize);
@@ -115,7 +118,14 @@ bool LZ4Compressor::Finish()
   // uniform in size
   // only the last one can be smaller, so we only write a partial page when finishing.
   // Calling Write() after Finish() is illegal
-  return FlushPage0();
+  bool success = FlushPage0();
+
+  if(success)
+  {
+    success &= WriteBlockIndex();
+  }
+
+  return success;
 }
 
 bool LZ4Compressor::FlushPage0()
@@ -124,6 +134,10 @@ bool LZ4Compressor::FlushPage0()
   if(!m_CompressBuffer)
     return false;
 
+  // indexed blocks must be decompressible on their own, so don't reference the previous page
+  if(m_BlockIndexed)
+    LZ4_resetStream_fast(m_LZ4Comp);
+
   // m_PageOffset is the amount written, usually equal to lz4BlockSize except the last block.
   int32_t compSize =
       LZ4_compress_fast_continue(m_LZ4Comp, (const char *)m_Page[0], (char *)m_CompressBuffer,
@@ -139,6 +153,8 @@ bool LZ4Compressor::FlushPage0()
     return false;
   }
 
+  AddIndexedBlock(m_PageOffset);
+
   bool success = true;
 
   success &= m_Write->Write(compSize);
@@ -157,6 +173,23 @@ bool LZ4Compressor::FlushPage0()
   return success;
 }
 
+bool LZ4Compressor::CompressBlock(const byte *src, uint64_t srcSize, byte *dst, uint64_t &dstSize,
+                                  RDResult &error)
+{
+  int32_t compSize = LZ4_compress_fast((const char *)src, (char *)dst, (int)srcSize,
+                                       (int)LZ4_COMPRESSBOUND(lz4BlockSize), 20);
+
+  if(compSize <= 0)
+  {
+    SET_ERROR_RESULT(error, ResultCode::CompressionFailed, "LZ4 compression failed: %i", compSize);
+    return false;
+  }
+
+  dstSize = (uint64_t)compSize;
+
+  return true;
+}
+
 LZ4Decompressor::LZ4Decompressor(StreamReader *read, Ownership own) : Decompressor(read, own)
 {
   m_Page[0] = AllocAlignedBuffer(lz4BlockSize);
@@ -322,3 +355,19 @@ bool LZ4Decompressor::FillPage0()
 
   return success;
 }
+
+bool LZ4Decompressor::DecompressBlock(const byte *src, uint64_t srcSize, byte *dst, uint64_t dstSize,
+                                      RDResult &error)
+{
+  int32_t decompSize =
+      LZ4_decompress_safe((const char *)src, (char *)dst, (int)srcSize, (int)dstSize);
+
+  if(decompSize < 0 || uint64_t(decompSize) != dstSize)
+  {
+    SET_ERROR_RESULT(error, ResultCode::CompressionFailed,
+                     "LZ4 decompression failed on indexed block: %i", decompSize);
+    return false;
+  }
+
+  return true;
+}
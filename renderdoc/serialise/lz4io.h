@@ -36,6 +36,14 @@ public:
   bool Write(const void *data, uint64_t numBytes);
   bool Finish();
 
+  // the size of each block, and the maximum size it can compress to
+  static const uint64_t BlockSize;
+  static const uint64_t CompressedBlockBound;
+
+  // compress a single independent block of at most BlockSize bytes, for compressing in parallel
+  static bool CompressBlock(const byte *src, uint64_t srcSize, byte *dst, uint64_t &dstSize,
+                            RDResult &error);
+
 private:
   bool FlushPage0();
 
@@ -55,6 +63,10 @@ public:
   bool Recompress(Compressor *comp);
   bool Read(void *data, uint64_t numBytes);
 
+  // decompress a single independent block, as written with block indexing
+  static bool DecompressBlock(const byte *src, uint64_t srcSize, byte *dst, uint64_t dstSize,
+                              RDResult &error);
+
 private:
   bool FillPage0();
 
@@ -27,11 +27,25 @@
 #include "api/replay/version.h"
 #include "common/dds_readwrite.h"
 #include "common/formatting.h"
+#include "core/settings.h"
 #include "jpeg-compressor/jpge.h"
 #include "stb/stb_image.h"
+#include "blockio.h"
+#include "callstack_table.h"
 #include "lz4io.h"
+#include "section_cache.h"
+#include "serialiser.h"
 #include "zstdio.h"
 
+RDOC_CONFIG(uint32_t, Capture_CompressionThreads, 0,
+            "The number of threads used to compress capture sections. 0 chooses automatically "
+            "based on the number of cores, 1 compresses only on the thread writing the capture.");
+
+RDOC_CONFIG(uint32_t, Replay_SectionCacheSizeMB, 0,
+            "The maximum size in MB of the on-disk cache of decompressed capture data. When enabled, "
+            "opening a capture that has been opened before maps the cached data instead of "
+            "decompressing it again. 0 disables the cache.");
+
 // not provided by tinyexr, just do by hand
 bool is_exr_file(FILE *f)
 {
@@ -133,6 +147,18 @@ bool is_exr_file(FILE *f)
      char sectionName[sectionNameLength]; // UTF-8 string name of section, optional.
 
      byte sectiondata[length]; // actual contents of the section
+
+     // if sectionFlags contains IndexedBlocks the compressed blocks in sectiondata are independent
+     // and the end of sectiondata contains an index to locate them. Readers that don't know about
+     // the index can still decompress the blocks in order and stop after the uncompressed length.
+     //
+     // CompressedBlock
+     // {
+     //   uint64_t uncompressedOffset;
+     //   uint64_t compressedOffset; // relative to the start of sectiondata
+     // } blocks[numBlocks];
+     // uint64_t numBlocks;
+     // uint64_t magic; // 'RDBI'
    }
  };
 
@@ -337,8 +363,9 @@ void RDCFile::Init(StreamReader &reader)
   m_SerVer = header.version;
 
   // in v1.1 we changed chunk flags such that we could support 64-bit length. This is a backwards
-  // compatible change
-  if(m_SerVer != SERIALISE_VERSION && m_SerVer != V1_0_VERSION && m_SerVer != V1_1_VERSION)
+  // compatible change. Likewise in v1.3 chunks gained a flag to refer to a callstack by index.
+  if(m_SerVer != SERIALISE_VERSION && m_SerVer != V1_0_VERSION && m_SerVer != V1_1_VERSION &&
+     m_SerVer != V1_2_VERSION)
   {
     if(header.version < V1_0_VERSION)
     {
@@ -890,6 +917,61 @@ StreamReader *RDCFile::ReadSection(int index) const
 
   const SectionProperties &props = m_Sections[index];
   SectionLocation offsetSize = m_SectionLocations[index];
+
+  const uint64_t cacheBudget = uint64_t(Replay_SectionCacheSizeMB()) * 1024 * 1024;
+
+  // only the frame capture is large enough and read often enough to be worth caching
+  if(cacheBudget > 0 && props.type == SectionType::FrameCapture &&
+     (props.flags & (SectionFlags::LZ4Compressed | SectionFlags::ZstdCompressed)))
+  {
+    rdcstr dir = SectionCache::GetDefaultDirectory();
+    rdcstr key = SectionCache::MakeKey(m_File, props, offsetSize.dataOffset, offsetSize.diskLength);
+
+    if(!key.empty())
+    {
+      StreamReader *cached = SectionCache::Open(dir, key, props.uncompressedSize);
+
+      if(!cached && props.uncompressedSize <= cacheBudget)
+        cached = SectionCache::Insert(dir, key, props.uncompressedSize, cacheBudget,
+                                      DecompressSection(index));
+
+      if(cached)
+        return cached;
+    }
+  }
+
+  return DecompressSection(index);
+}
+
+StreamReader *RDCFile::DecompressSection(int index) const
+{
+  const SectionProperties &props = m_Sections[index];
+  SectionLocation offsetSize = m_SectionLocations[index];
+
+  if(props.flags & SectionFlags::IndexedBlocks)
+  {
+    IndexedDecompressor *decomp =
+        IndexedDecompressor::Create(m_File, offsetSize.dataOffset, offsetSize.diskLength,
+                                    props.uncompressedSize, props.flags);
+
+    if(decomp)
+      return new StreamReader(decomp, props.uncompressedSize, Ownership::Stream);
+
+    // the blocks can still be read in order even if the index is broken
+    RDCWARN("Section '%s' has an invalid block index, decompressing sequentially",
+            props.name.c_str());
+  }
+
+  // uncompressed sections can be read straight out of a mapping of the file without copying
+  if(!(props.flags & (SectionFlags::LZ4Compressed | SectionFlags::ZstdCompressed)))
+  {
+    FileIO::MappedView *view =
+        FileIO::mapview_open(m_File, offsetSize.dataOffset, offsetSize.diskLength);
+
+    if(view)
+      return new StreamReader(view, offsetSize.diskLength);
+  }
+
   FileIO::fseek64(m_File, offsetSize.dataOffset, SEEK_SET);
 
   StreamReader *fileReader = new StreamReader(m_File, offsetSize.diskLength, Ownership::Nothing);
@@ -969,6 +1051,11 @@ StreamWriter *RDCFile::WriteSection(const SectionProperties &props)
 
   rdcstr name = props.name;
   SectionType type = props.type;
+  SectionFlags flags = props.flags;
+
+  // block indexing is only meaningful for compressed sections
+  if(!(flags & (SectionFlags::LZ4Compressed | SectionFlags::ZstdCompressed)))
+    flags = flags & ~SectionFlags::IndexedBlocks;
 
   // normalise names for known sections
   if(type != SectionType::Unknown && type < SectionType::Count)
@@ -1200,7 +1287,7 @@ StreamWriter *RDCFile::WriteSection(const SectionProperties &props)
                                 // sectionVersion
                                 props.version,
                                 // sectionFlags
-                                props.flags,
+                                flags,
                                 // sectionNameLength
                                 uint32_t(name.length() + 1)};
 
@@ -1221,23 +1308,38 @@ StreamWriter *RDCFile::WriteSection(const SectionProperties &props)
 
   StreamWriter *compWriter = NULL;
 
-  if(props.flags & SectionFlags::LZ4Compressed)
+  Compressor *compressor = NULL;
+
+  if(flags & SectionFlags::IndexedBlocks)
+  {
+    // indexed blocks are independent so they can be compressed in parallel
+    compressor = new ParallelCompressor(fileWriter, Ownership::Stream, flags,
+                                        Capture_CompressionThreads());
+  }
+  else if(flags & SectionFlags::LZ4Compressed)
   {
     // the user will delete the compressed writer, and then it will delete the compressor and the
     // file writer
-    compWriter =
-        new StreamWriter(new LZ4Compressor(fileWriter, Ownership::Stream), Ownership::Stream);
+    compressor = new LZ4Compressor(fileWriter, Ownership::Stream);
   }
-  else if(props.flags & SectionFlags::ZstdCompressed)
+  else if(flags & SectionFlags::ZstdCompressed)
+  {
+    compressor = new ZSTDCompressor(fileWriter, Ownership::Stream);
+  }
+
+  if(compressor)
   {
-    compWriter =
-        new StreamWriter(new ZSTDCompressor(fileWriter, Ownership::Stream), Ownership::Stream);
+    if(flags & SectionFlags::IndexedBlocks)
+      compressor->SetBlockIndexed();
+
+    compWriter = new StreamWriter(compressor, Ownership::Stream);
   }
 
   uint64_t dataOffset = FileIO::ftell64(m_File);
 
   m_CurrentWritingProps = props;
   m_CurrentWritingProps.name = name;
+  m_CurrentWritingProps.flags = flags;
 
   // register a destroy callback to tidy up the section at the end
   fileWriter->AddCloseCallback([this, type, name, headerOffset, dataOffset, fileWriter, compWriter]() {
@@ -1300,6 +1402,176 @@ StreamWriter *RDCFile::WriteSection(const SectionProperties &props)
   return compWriter ? compWriter : fileWriter;
 }
 
+// the chunk index section is a uint64_t count followed by that many tightly packed entries:
+//
+// struct
+// {
+//   uint32_t chunkID;
+//   uint64_t offset; // offset of the chunk header in the uncompressed frame capture section
+//   uint64_t length; // length of the chunk including the header and alignment padding
+// } entries[count];
+static const uint64_t ChunkIndexVersion = 1;
+static const uint64_t ChunkIndexEntrySize = sizeof(uint32_t) + sizeof(uint64_t) * 2;
+
+bool RDCFile::GetChunkIndex(rdcarray<ChunkIndexEntry> &index) const
+{
+  index.clear();
+
+  int idx = SectionIndex(SectionType::ChunkIndex);
+  int frameIdx = SectionIndex(SectionType::FrameCapture);
+  if(idx < 0 || frameIdx < 0)
+    return false;
+
+  const SectionProperties &props = m_Sections[idx];
+  if(props.version != ChunkIndexVersion)
+  {
+    RDCWARN("Ignoring chunk index section with unsupported version %llu", props.version);
+    return false;
+  }
+
+  StreamReader *reader = ReadSection(idx);
+  if(!reader)
+    return false;
+
+  uint64_t count = 0;
+  reader->Read(count);
+
+  if(reader->IsErrored() || count * ChunkIndexEntrySize + sizeof(count) != props.uncompressedSize)
+  {
+    RDCWARN("Ignoring malformed chunk index section");
+    delete reader;
+    return false;
+  }
+
+  const uint64_t frameSize = m_Sections[frameIdx].uncompressedSize;
+  uint64_t prevEnd = 0;
+
+  index.resize((size_t)count);
+  for(ChunkIndexEntry &entry : index)
+  {
+    reader->Read(entry.chunkID);
+    reader->Read(entry.offset);
+    reader->Read(entry.length);
+
+    // chunks must be in order, not overlap, and lie entirely within the frame capture
+    if(reader->IsErrored() || entry.offset < prevEnd || entry.length > frameSize ||
+       entry.offset > frameSize - entry.length)
+    {
+      RDCWARN("Ignoring chunk index section which doesn't match frame capture");
+      index.clear();
+      delete reader;
+      return false;
+    }
+
+    prevEnd = entry.offset + entry.length;
+  }
+
+  delete reader;
+
+  return true;
+}
+
+void RDCFile::WriteChunkIndex(const rdcarray<ChunkIndexEntry> &index)
+{
+  if(index.empty())
+    return;
+
+  SectionProperties props = {};
+  props.type = SectionType::ChunkIndex;
+  props.version = ChunkIndexVersion;
+  props.flags = SectionFlags::LZ4Compressed;
+  StreamWriter *w = WriteSection(props);
+
+  w->Write((uint64_t)index.size());
+  for(const ChunkIndexEntry &entry : index)
+  {
+    w->Write(entry.chunkID);
+    w->Write(entry.offset);
+    w->Write(entry.length);
+  }
+
+  w->Finish();
+
+  delete w;
+}
+
+RDResult RDCFile::BuildChunkIndex(StreamReader *reader, rdcarray<ChunkIndexEntry> &index)
+{
+  index.clear();
+
+  ReadSerialiser ser(reader, Ownership::Nothing);
+
+  while(!reader->AtEnd())
+  {
+    ChunkIndexEntry entry;
+    entry.offset = reader->GetOffset();
+    entry.chunkID = ser.ReadChunk<uint32_t>();
+    ser.SkipCurrentChunk();
+    ser.EndChunk();
+
+    if(reader->IsErrored())
+    {
+      index.clear();
+      return reader->GetError();
+    }
+
+    entry.length = reader->GetOffset() - entry.offset;
+    index.push_back(entry);
+  }
+
+  return ResultCode::Succeeded;
+}
+
+// the layout of the callstack table section is owned by CallstackTable::Write
+static const uint64_t CallstackTableVersion = 1;
+
+bool RDCFile::GetCallstackTable(CallstackTable &table) const
+{
+  table.Clear();
+
+  int idx = SectionIndex(SectionType::CallstackTable);
+  if(idx < 0)
+    return false;
+
+  const SectionProperties &props = m_Sections[idx];
+  if(props.version != CallstackTableVersion)
+  {
+    RDCWARN("Ignoring callstack table section with unsupported version %llu", props.version);
+    return false;
+  }
+
+  StreamReader *reader = ReadSection(idx);
+  if(!reader)
+    return false;
+
+  bool ret = table.Read(reader, props.uncompressedSize);
+
+  if(!ret)
+    RDCWARN("Ignoring malformed callstack table section");
+
+  delete reader;
+
+  return ret;
+}
+
+void RDCFile::WriteCallstackTable(const CallstackTable &table)
+{
+  if(table.NumCallstacks() == 0)
+    return;
+
+  SectionProperties props = {};
+  props.type = SectionType::CallstackTable;
+  props.version = CallstackTableVersion;
+  props.flags = SectionFlags::LZ4Compressed;
+  StreamWriter *w = WriteSection(props);
+
+  table.Write(w);
+
+  w->Finish();
+
+  delete w;
+}
+
 FILE *RDCFile::StealImageFileHandle(rdcstr &filename)
 {
   if(m_Driver != RDCDriver::Image)
@@ -29,6 +29,9 @@
 
 extern const char *SectionTypeNames[];
 
+struct ChunkIndexEntry;
+class CallstackTable;
+
 struct RDCThumb
 {
   bytebuf pixels;
@@ -51,13 +54,14 @@ public:
   // version number of overall file format or chunk organisation. If the contents/meaning/order of
   // chunks have changed this does not need to be bumped, there are version numbers within each
   // API that interprets the stream that can be bumped.
-  static const uint32_t SERIALISE_VERSION = 0x00000102;
+  static const uint32_t SERIALISE_VERSION = 0x00000103;
 
   // this must never be changed - files before this were in the v0.x series and didn't have embedded
   // version numbers
   static const uint32_t V1_0_VERSION = 0x00000100;
   static const uint32_t V1_1_VERSION = 0x00000101;
   static const uint32_t V1_2_VERSION = 0x00000102;
+  static const uint32_t V1_3_VERSION = 0x00000103;
 
   ~RDCFile();
 
@@ -89,12 +93,25 @@ public:
   StreamReader *ReadSection(int index) const;
   StreamWriter *WriteSection(const SectionProperties &props);
 
+  // the chunk index locates every chunk in the uncompressed frame capture section. Returns false if
+  // there's no index or it doesn't match the frame capture section.
+  bool GetChunkIndex(rdcarray<ChunkIndexEntry> &index) const;
+  void WriteChunkIndex(const rdcarray<ChunkIndexEntry> &index);
+  // scan the chunks in a frame capture section to build an index for captures that don't have one
+  static RDResult BuildChunkIndex(StreamReader *reader, rdcarray<ChunkIndexEntry> &index);
+
+  // the callstack table holds the callstacks that chunks refer to by index. Returns false if
+  // there's no table or it can't be read.
+  bool GetCallstackTable(CallstackTable &table) const;
+  void WriteCallstackTable(const CallstackTable &table);
+
   // Only valid if GetDriver returns RDCDriver::Image, passes over the underlying FILE * for use
   // loading the image directly, since the RDC container isn't there to read from a section.
   FILE *StealImageFileHandle(rdcstr &filename);
 
 private:
   void Init(StreamReader &reader);
+  StreamReader *DecompressSection(int index) const;
 
   FILE *m_File = NULL;
   rdcstr m_Filename;
@@ -0,0 +1,362 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#include "section_cache.h"
+#include <algorithm>
+#include "api/replay/data_types.h"
+#include "common/formatting.h"
+#include "md5/md5.h"
+
+namespace
+{
+static const uint32_t SectionCacheMagic = MAKE_FOURCC('R', 'D', 'S', 'C');
+static const uint32_t SectionCacheVersion = 1;
+
+// how much of the stored data at each end of the section is hashed into the key. The header
+// already contains both sizes so this is enough to tell captures apart without reading the whole
+// section, which would cost as much as just decompressing it.
+static const uint64_t KeySampleSize = 64 * 1024;
+
+static const uint64_t CopyChunkSize = 4 * 1024 * 1024;
+
+// header at the start of each cache file, the decompressed data follows immediately after
+struct SectionCacheHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+  char key[32];
+  byte reserved[16];
+};
+
+static_assert(sizeof(SectionCacheHeader) == 64, "Section cache header has changed size");
+
+rdcstr EntryFilename(const rdcstr &dir, const rdcstr &key)
+{
+  return dir + "/" + key + ".rdcache";
+}
+
+bool IsEntry(const PathEntry &entry)
+{
+  return !(entry.flags & (PathProperty::Directory | PathProperty::ErrorAccessDenied |
+                          PathProperty::ErrorInvalidPath | PathProperty::ErrorUnknown)) &&
+         entry.filename.endsWith(".rdcache");
+}
+};
+
+rdcstr SectionCache::GetDefaultDirectory()
+{
+  return FileIO::GetAppFolderFilename("section_cache");
+}
+
+rdcstr SectionCache::MakeKey(FILE *file, const SectionProperties &props, uint64_t dataOffset,
+                             uint64_t diskLength)
+{
+  MD5_CTX ctx;
+  MD5_Init(&ctx);
+
+  MD5_Update(&ctx, props.name.c_str(), (unsigned long)props.name.size());
+  MD5_Update(&ctx, &props.type, sizeof(props.type));
+  MD5_Update(&ctx, &props.flags, sizeof(props.flags));
+  MD5_Update(&ctx, &props.version, sizeof(props.version));
+  MD5_Update(&ctx, &props.uncompressedSize, sizeof(props.uncompressedSize));
+  MD5_Update(&ctx, &props.compressedSize, sizeof(props.compressedSize));
+  MD5_Update(&ctx, &diskLength, sizeof(diskLength));
+
+  bytebuf sample;
+
+  // hash the start and end of the stored data. For small sections these overlap and cover the
+  // whole section.
+  uint64_t sampleOffsets[2] = {0, diskLength - RDCMIN(diskLength, KeySampleSize)};
+
+  for(uint64_t offs : sampleOffsets)
+  {
+    sample.resize((size_t)RDCMIN(diskLength - offs, KeySampleSize));
+
+    FileIO::fseek64(file, dataOffset + offs, SEEK_SET);
+    if(FileIO::fread(sample.data(), 1, sample.size(), file) != sample.size())
+      return rdcstr();
+
+    MD5_Update(&ctx, sample.data(), (unsigned long)sample.size());
+  }
+
+  byte digest[16];
+  MD5_Final(digest, &ctx);
+
+  rdcstr ret;
+  for(byte b : digest)
+    ret += StringFormat::Fmt("%02x", b);
+  return ret;
+}
+
+StreamReader *SectionCache::Open(const rdcstr &dir, const rdcstr &key, uint64_t size)
+{
+  if(key.size() != sizeof(SectionCacheHeader::key) || size == 0)
+    return NULL;
+
+  FILE *f = FileIO::fopen(EntryFilename(dir, key), FileIO::UpdateBinary);
+
+  if(!f)
+    return NULL;
+
+  SectionCacheHeader header = {};
+  FileIO::MappedView *view = NULL;
+
+  if(FileIO::fread(&header, 1, sizeof(header), f) == sizeof(header) &&
+     header.magic == SectionCacheMagic && header.version == SectionCacheVersion &&
+     header.size == size && key == rdcstr(header.key, sizeof(header.key)) &&
+     FileIO::GetFileSize(EntryFilename(dir, key)) >= sizeof(header) + size)
+  {
+    // rewrite the header (unchanged) to bump the modification time, which is what eviction uses to
+    // find the least recently used entries.
+    FileIO::fseek64(f, 0, SEEK_SET);
+    FileIO::fwrite(&header, 1, sizeof(header), f);
+    FileIO::fflush(f);
+
+    view = FileIO::mapview_open(f, sizeof(header), size);
+  }
+
+  // the mapping stays valid after the file is closed
+  FileIO::fclose(f);
+
+  if(!view)
+    return NULL;
+
+  return new StreamReader(view, size);
+}
+
+StreamReader *SectionCache::Insert(const rdcstr &dir, const rdcstr &key, uint64_t size,
+                                   uint64_t budget, StreamReader *source)
+{
+  if(key.size() != sizeof(SectionCacheHeader::key) || size == 0 ||
+     size + sizeof(SectionCacheHeader) > budget)
+  {
+    delete source;
+    return NULL;
+  }
+
+  rdcstr filename = EntryFilename(dir, key);
+
+  // write to a temporary file first, so that other processes never see a partial entry
+  rdcstr tmpFilename = StringFormat::Fmt("%s.%u.tmp", filename.c_str(), Process::GetCurrentPID());
+
+  FileIO::CreateParentDirectory(filename);
+
+  FILE *f = FileIO::fopen(tmpFilename, FileIO::WriteBinary);
+
+  if(!f)
+  {
+    RDCWARN("Couldn't create section cache entry '%s'", tmpFilename.c_str());
+    delete source;
+    return NULL;
+  }
+
+  SectionCacheHeader header = {};
+  header.magic = SectionCacheMagic;
+  header.version = SectionCacheVersion;
+  header.size = size;
+  memcpy(header.key, key.c_str(), sizeof(header.key));
+
+  bool success = FileIO::fwrite(&header, 1, sizeof(header), f) == sizeof(header);
+
+  bytebuf chunk;
+  chunk.resize((size_t)RDCMIN(size, CopyChunkSize));
+
+  for(uint64_t offs = 0; success && offs < size; offs += chunk.size())
+  {
+    size_t chunkSize = (size_t)RDCMIN(size - offs, CopyChunkSize);
+
+    success = source->Read(chunk.data(), chunkSize) && !source->IsErrored() &&
+              FileIO::fwrite(chunk.data(), 1, chunkSize, f) == chunkSize;
+  }
+
+  delete source;
+
+  FileIO::fclose(f);
+
+  // if another process raced us and wrote the same entry, either copy is fine
+  if(!success || !FileIO::Move(tmpFilename, filename, true))
+  {
+    RDCWARN("Couldn't write section cache entry '%s'", filename.c_str());
+    FileIO::Delete(tmpFilename);
+    return Open(dir, key, size);
+  }
+
+  Trim(dir, budget, key);
+
+  return Open(dir, key, size);
+}
+
+void SectionCache::Trim(const rdcstr &dir, uint64_t budget, const rdcstr &keep)
+{
+  rdcarray<PathEntry> entries;
+  FileIO::GetFilesInDirectory(dir, entries);
+
+  rdcarray<PathEntry> evictable;
+  uint64_t total = 0;
+
+  for(const PathEntry &entry : entries)
+  {
+    if(!IsEntry(entry))
+      continue;
+
+    total += entry.size;
+
+    if(!entry.filename.beginsWith(keep + "."))
+      evictable.push_back(entry);
+  }
+
+  // oldest first
+  std::sort(evictable.begin(), evictable.end(),
+            [](const PathEntry &a, const PathEntry &b) { return a.lastmod < b.lastmod; });
+
+  for(const PathEntry &entry : evictable)
+  {
+    if(total <= budget)
+      break;
+
+    // deleting a file that another process has mapped is fine on posix, and fails harmlessly on
+    // windows so it will be evicted next time.
+    FileIO::Delete(dir + "/" + entry.filename);
+    total -= entry.size;
+  }
+}
+
+#if ENABLED(ENABLE_UNIT_TESTS)
+
+#include "catch/catch.hpp"
+
+TEST_CASE("Test section cache", "[section_cache]")
+{
+  rdcstr dir = FileIO::GetTempFolderFilename() + "renderdoc_section_cache_test";
+
+  // clear out anything left from a previous run
+  SectionCache::Trim(dir, 0, rdcstr());
+
+  const uint64_t MB = 1024 * 1024;
+
+  bytebuf dataA, dataB;
+  dataA.resize(size_t(MB));
+  dataB.resize(size_t(MB + MB / 2));
+
+  for(size_t i = 0; i < dataA.size(); i++)
+    dataA[i] = byte(i * 7);
+  for(size_t i = 0; i < dataB.size(); i++)
+    dataB[i] = byte(i * 13);
+
+  const rdcstr keyA = "0123456789abcdef0123456789abcdef";
+  const rdcstr keyB = "fedcba9876543210fedcba9876543210";
+
+  auto check = [](StreamReader *reader, const bytebuf &expected) {
+    REQUIRE(reader);
+    CHECK(reader->IsMapped());
+    REQUIRE(reader->GetSize() == expected.size());
+
+    bytebuf contents;
+    contents.resize(expected.size());
+    CHECK(reader->Read(contents.data(), contents.size()));
+    CHECK(contents == expected);
+
+    delete reader;
+  };
+
+  SECTION("Missing entries")
+  {
+    CHECK(SectionCache::Open(dir, keyA, dataA.size()) == NULL);
+
+    // invalid keys are rejected
+    CHECK(SectionCache::Open(dir, "abc", dataA.size()) == NULL);
+    CHECK(SectionCache::Insert(dir, "abc", dataA.size(), 4 * MB, new StreamReader(dataA)) == NULL);
+  };
+
+  SECTION("Insert and re-open")
+  {
+    check(SectionCache::Insert(dir, keyA, dataA.size(), 4 * MB, new StreamReader(dataA)), dataA);
+
+    check(SectionCache::Open(dir, keyA, dataA.size()), dataA);
+
+    // a different size is a miss
+    CHECK(SectionCache::Open(dir, keyA, dataA.size() - 1) == NULL);
+
+    // the readers own the mapping, so they can outlive each other
+    StreamReader *first = SectionCache::Open(dir, keyA, dataA.size());
+    StreamReader *second = SectionCache::Open(dir, keyA, dataA.size());
+    delete first;
+    check(second, dataA);
+  };
+
+  SECTION("Eviction")
+  {
+    check(SectionCache::Insert(dir, keyA, dataA.size(), 4 * MB, new StreamReader(dataA)), dataA);
+
+    // both entries don't fit, so the old one is evicted to make room
+    check(SectionCache::Insert(dir, keyB, dataB.size(), 2 * MB, new StreamReader(dataB)), dataB);
+
+    CHECK(SectionCache::Open(dir, keyA, dataA.size()) == NULL);
+    check(SectionCache::Open(dir, keyB, dataB.size()), dataB);
+
+    // sections larger than the whole cache are never stored
+    CHECK(SectionCache::Insert(dir, keyA, dataA.size(), MB, new StreamReader(dataA)) == NULL);
+    CHECK(SectionCache::Open(dir, keyA, dataA.size()) == NULL);
+  };
+
+  SECTION("Keys")
+  {
+    rdcstr filename = dir + "/key_source.bin";
+    FileIO::CreateParentDirectory(filename);
+
+    FILE *f = FileIO::fopen(filename, FileIO::WriteBinary);
+    REQUIRE(f);
+    FileIO::fwrite(dataB.data(), 1, dataB.size(), f);
+    FileIO::fclose(f);
+
+    f = FileIO::fopen(filename, FileIO::ReadBinary);
+    REQUIRE(f);
+
+    SectionProperties props;
+    props.type = SectionType::FrameCapture;
+    props.flags = SectionFlags::ZstdCompressed;
+    props.compressedSize = MB;
+    props.uncompressedSize = 4 * MB;
+
+    rdcstr key = SectionCache::MakeKey(f, props, 0, MB);
+    CHECK(key.size() == 32);
+
+    // the same data gives the same key
+    CHECK(SectionCache::MakeKey(f, props, 0, MB) == key);
+
+    // different data or properties don't
+    CHECK(SectionCache::MakeKey(f, props, 1, MB) != key);
+
+    props.version++;
+    CHECK(SectionCache::MakeKey(f, props, 0, MB) != key);
+
+    FileIO::fclose(f);
+    FileIO::Delete(filename);
+  };
+
+  SectionCache::Trim(dir, 0, rdcstr());
+};
+
+#endif    // ENABLED(ENABLE_UNIT_TESTS)
@@ -0,0 +1,55 @@
+/******************************************************************************
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2019-2024 Baldur Karlsson
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ ******************************************************************************/
+
+#pragma once
+
+#include "streamio.h"
+
+struct SectionProperties;
+
+// A persistent on-disk cache of decompressed capture sections. Entries are keyed by a hash of the
+// section header and its stored contents, so re-opening the same capture (from any path) can map
+// the decompressed data directly instead of decompressing it again. The cache is bounded in size,
+// and the least recently used entries are evicted first.
+namespace SectionCache
+{
+// the default location of the cache, inside the app folder
+rdcstr GetDefaultDirectory();
+
+// calculates the key for the section stored at [dataOffset, dataOffset + diskLength) in file.
+rdcstr MakeKey(FILE *file, const SectionProperties &props, uint64_t dataOffset, uint64_t diskLength);
+
+// returns a reader over a mapping of the cached section, or NULL if it's not in the cache.
+StreamReader *Open(const rdcstr &dir, const rdcstr &key, uint64_t size);
+
+// reads the whole section from source into the cache, evicting old entries to keep the cache
+// within budget bytes. The source is always deleted. Returns a reader over the new entry, or NULL
+// if the section couldn't be cached - in which case the source data has been consumed.
+StreamReader *Insert(const rdcstr &dir, const rdcstr &key, uint64_t size, uint64_t budget,
+                     StreamReader *source);
+
+// evicts least recently used entries until the cache fits in budget bytes. The entry for keep is
+// never evicted.
+void Trim(const rdcstr &dir, uint64_t budget, const rdcstr &keep);
+};
@@ -29,6 +29,8 @@
 #include "api/replay/renderdoc_replay.h"
 #include "core/core.h"
 #include "strings/string_utils.h"
+#include "callstack_table.h"
+#include "lazy_chunks.h"
 
 #if ENABLED(RDOC_DEVEL)
 
@@ -114,6 +116,8 @@ uint32_t Serialiser<SerialiserMode::Reading>::BeginChunk(uint32_t, uint64_t)
 
   m_ChunkMetadata = SDChunkMetaData();
 
+  uint64_t chunkOffset = m_Read->GetOffset();
+
   {
     uint32_t c = 0;
     bool success = m_Read->Read(c);
@@ -148,6 +152,22 @@ uint32_t Serialiser<SerialiserMode::Reading>::BeginChunk(uint32_t, uint64_t)
         m_Read->Read(NULL, numFrames * sizeof(uint64_t));
       }
     }
+    else if(c & ChunkCallstackIndex)
+    {
+      uint32_t callstack = CallstackTable::InvalidIndex;
+      m_Read->Read(callstack);
+
+      // padding keeps the rest of the chunk aligned as it was before the callstack was interned
+      uint32_t padding = 0;
+      m_Read->Read(padding);
+      if(padding < ChunkAlignment)
+        m_Read->Read(NULL, padding);
+      else
+        RDCERR("Read invalid callstack index padding: %u", padding);
+
+      if(m_CallstackTable && m_CallstackTable->Get(callstack, m_ChunkMetadata.callstack))
+        m_ChunkMetadata.flags |= SDChunkFlags::HasCallstack;
+    }
 
     if(c & ChunkThreadID)
       m_Read->Read(m_ChunkMetadata.threadID);
@@ -200,7 +220,20 @@ uint32_t Serialiser<SerialiserMode::Reading>::BeginChunk(uint32_t, uint64_t)
     chunk->metadata = m_ChunkMetadata;
 
     m_StructuredFile->chunks.push_back(chunk);
-    m_StructureStack.push_back(chunk);
+
+    if(m_LazyChunkSource)
+    {
+      chunk->type.byteSize = m_ChunkMetadata.length;
+      m_LazyChunkSource->AddChunk(chunk, m_LazyChunkBase + chunkOffset);
+
+      // don't export the contents, they'll be read from the source when needed
+      m_ExportStructured = false;
+      m_LazyChunkSkipped = true;
+    }
+    else
+    {
+      m_StructureStack.push_back(chunk);
+    }
 
     m_InternalElement = 0;
   }
@@ -313,6 +346,12 @@ void Serialiser<SerialiserMode::Reading>::EndChunk()
 
   // align to the natural chunk alignment
   m_Read->AlignTo<ChunkAlignment>();
+
+  if(m_LazyChunkSkipped)
+  {
+    m_ExportStructured = true;
+    m_LazyChunkSkipped = false;
+  }
 }
 
 /////////////////////////////////////////////////////////////
@@ -367,9 +406,11 @@ uint32_t Serialiser<SerialiserMode::Writing>::BeginChunk(uint32_t chunkID, uint6
 
       m_ChunkMetadata.chunkID = chunkID;
 
-      /////////////////
+      // length is filled out in EndChunk
+      if(m_RecordChunkIndex)
+        m_ChunkIndex.push_back({chunkID, m_Write->GetOffset(), 0});
 
-      m_Write->Write(c);
+      uint32_t callstackIndex = CallstackTable::InvalidIndex;
 
       if(c & ChunkCallstack)
       {
@@ -394,11 +435,31 @@ uint32_t Serialiser<SerialiserMode::Writing>::BeginChunk(uint32_t chunkID, uint6
 
         m_ChunkMetadata.flags |= SDChunkFlags::HasCallstack;
 
+        if(m_CallstackTable && !m_ChunkMetadata.callstack.empty())
+        {
+          callstackIndex = m_CallstackTable->Intern(m_ChunkMetadata.callstack.data(),
+                                                    m_ChunkMetadata.callstack.size());
+          c = (c & ~ChunkCallstack) | ChunkCallstackIndex;
+        }
+      }
+
+      /////////////////
+
+      m_Write->Write(c);
+
+      if(c & ChunkCallstack)
+      {
         uint32_t numFrames = (uint32_t)m_ChunkMetadata.callstack.size();
         m_Write->Write(numFrames);
 
         m_Write->Write(m_ChunkMetadata.callstack.data(), m_ChunkMetadata.callstack.byteSize());
       }
+      else if(c & ChunkCallstackIndex)
+      {
+        m_Write->Write(callstackIndex);
+        // no padding is needed when writing the chunk directly
+        m_Write->Write(uint32_t(0));
+      }
 
       if(c & ChunkThreadID)
       {
@@ -568,11 +629,72 @@ void Serialiser<SerialiserMode::Writing>::EndChunk()
   // align to the natural chunk alignment
   m_Write->AlignTo<ChunkAlignment>();
 
+  if(m_RecordChunkIndex && !m_ChunkIndex.empty())
+    m_ChunkIndex.back().length = m_Write->GetOffset() - m_ChunkIndex.back().offset;
+
   m_ChunkMetadata = SDChunkMetaData();
 
   m_Write->Flush();
 }
 
+template <>
+void Serialiser<SerialiserMode::Writing>::WriteSerialisedChunk(const byte *chunkData,
+                                                               uint64_t chunkLength)
+{
+  uint32_t header = 0;
+  uint32_t numFrames = 0;
+
+  if(chunkLength >= sizeof(header) + sizeof(numFrames))
+  {
+    memcpy(&header, chunkData, sizeof(header));
+    memcpy(&numFrames, chunkData + sizeof(header), sizeof(numFrames));
+  }
+
+  // the index is followed by the padding size
+  const uint64_t indexSize = sizeof(uint32_t) * 2;
+  const uint64_t inlineSize = sizeof(numFrames) + numFrames * sizeof(uint64_t);
+
+  // chunks are recorded ahead of time without a table, so their callstacks are inline. The data
+  // after the callstack was aligned relative to the start of the chunk so the header can only
+  // shrink by a multiple of the alignment, and callstacks too short to save anything stay inline.
+  if(m_CallstackTable && (header & ChunkCallstack) && numFrames > 0 && numFrames < 4096 &&
+     sizeof(header) + inlineSize <= chunkLength && inlineSize >= indexSize + ChunkAlignment)
+  {
+    const uint64_t removed = ((inlineSize - indexSize) / ChunkAlignment) * ChunkAlignment;
+    const uint32_t padding = uint32_t(inlineSize - indexSize - removed);
+
+    // chunk data is allocated aligned, so the frames following the header and count are too
+    uint32_t index = m_CallstackTable->Intern(
+        (const uint64_t *)(chunkData + sizeof(header) + sizeof(numFrames)), numFrames);
+
+    header = (header & ~ChunkCallstack) | ChunkCallstackIndex;
+
+    if(m_RecordChunkIndex)
+      m_ChunkIndex.push_back(
+          {header & ChunkIndexMask, m_Write->GetOffset(), chunkLength - removed});
+
+    static const byte zeroes[ChunkAlignment] = {};
+
+    m_Write->Write(header);
+    m_Write->Write(index);
+    m_Write->Write(padding);
+    m_Write->Write(zeroes, padding);
+
+    const uint64_t rest = sizeof(header) + inlineSize;
+    m_Write->Write(chunkData + rest, chunkLength - rest);
+
+    return;
+  }
+
+  if(m_RecordChunkIndex && chunkLength >= sizeof(header))
+  {
+    memcpy(&header, chunkData, sizeof(header));
+    m_ChunkIndex.push_back({header & ChunkIndexMask, m_Write->GetOffset(), chunkLength});
+  }
+
+  m_Write->Write(chunkData, chunkLength);
+}
+
 template <>
 void Serialiser<SerialiserMode::Writing>::WriteStructuredFile(const SDFile &file,
                                                               RENDERDOC_ProgressCallback progress)
@@ -639,7 +761,8 @@ void Serialiser<SerialiserMode::Writing>::WriteStructuredFile(const SDFile &file
 
     if(m_ChunkMetadata.length == 0)
     {
-      m_Write->Write(scratchWriter.GetWriter()->GetData(), scratchWriter.GetWriter()->GetOffset());
+      WriteSerialisedChunk(scratchWriter.GetWriter()->GetData(),
+                           scratchWriter.GetWriter()->GetOffset());
       scratchWriter.GetWriter()->Rewind();
     }
 
@@ -729,7 +852,7 @@ void DoSerialise(SerialiserType &ser, SDObject &el, StructuredObjectList &childr
   // children all at once (which could be slow). This is a bit of a hack as this can take many
   // seconds and cause a timeout during transfer, and it would be uglier to try and keep the
   // connection alive while serialising chunks.
-  uint64_t childCount = children.size();
+  uint64_t childCount = ser.IsReading() ? children.size() : el.NumChildren();
   SERIALISE_ELEMENT(childCount).Hidden();
 
   if(ser.IsReading())
@@ -1092,6 +1215,11 @@ Chunk *Chunk::Create(Serialiser<SerialiserMode::Writing> &ser, uint16_t chunkTyp
   return ret;
 }
 
+void Chunk::Write(Serialiser<SerialiserMode::Writing> &ser)
+{
+  ser.WriteSerialisedChunk(m_Data, m_Length);
+}
+
 ChunkPagePool::~ChunkPagePool()
 {
   // all allocated pages are in precisely one list, so just free the contents of both lists
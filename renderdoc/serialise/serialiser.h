@@ -31,6 +31,9 @@
 #include "common/result.h"
 #include "streamio.h"
 
+class CallstackTable;
+class LazyChunkSource;
+
 // function to deallocate anything from a serialise. Default impl
 // does no deallocation of anything.
 template <class T>
@@ -57,6 +60,10 @@ enum class SerialiserFlags
 {
   NoFlags = 0x0,
   AllocateMemory = 0x1,
+  // when reading from a mapped stream, return a pointer directly into the mapping instead of
+  // allocating and copying. The buffer must not be modified or kept past the end of the chunk, and
+  // must only be freed through ScopedDeserialiseArray. Only valid together with AllocateMemory.
+  ReadView = 0x2,
 };
 
 BITMASK_OPERATORS(SerialiserFlags);
@@ -82,6 +89,16 @@ enum class SerialiserMode
 
 struct CompressedFileIO;
 
+// the location of one chunk in a serialised stream, as recorded for the chunk index section. The
+// offset and length are in the uncompressed stream and include the chunk header and any trailing
+// alignment padding.
+struct ChunkIndexEntry
+{
+  uint32_t chunkID;
+  uint64_t offset;
+  uint64_t length;
+};
+
 template <SerialiserMode sertype>
 class Serialiser
 {
@@ -108,6 +125,8 @@ public:
     ChunkDuration = 0x00040000,
     ChunkTimestamp = 0x00080000,
     Chunk64BitSize = 0x00100000,
+    // the callstack is an index into a CallstackTable rather than stored inline
+    ChunkCallstackIndex = 0x00200000,
   };
 
   //////////////////////////////////////////
@@ -125,8 +144,18 @@ public:
   }
   StreamWriter *GetWriter() { return m_Write; }
   StreamReader *GetReader() { return m_Read; }
+  // returns true if the buffer was returned as a view into the stream, and must not be freed
+  bool IsReadView(const void *ptr) const { return IsReading() && m_Read && m_Read->IsView(ptr); }
   uint32_t GetChunkMetadataRecording() { return m_ChunkFlags; }
   void SetChunkMetadataRecording(uint32_t flags);
+
+  // when enabled, the location of every chunk written is recorded so that a chunk index section can
+  // be written alongside the stream.
+  void SetChunkIndexRecording(bool record) { m_RecordChunkIndex = record; }
+  rdcarray<ChunkIndexEntry> &GetChunkIndex() { return m_ChunkIndex; }
+  // write a pre-serialised chunk at the current offset. With a callstack table its inline callstack
+  // is interned and replaced by an index, otherwise it's written verbatim.
+  void WriteSerialisedChunk(const byte *chunkData, uint64_t chunkLength);
   void SetChunkTimestampBasis(uint64_t base, double freq)
   {
     m_TimerBase = base;
@@ -179,6 +208,21 @@ public:
     m_TimerFrequency = timeFreq;
   }
 
+  // while structured exporting, add chunks as placeholders to be read later from source instead of
+  // exporting their contents. baseOffset is added to the chunk's offset in this stream to get the
+  // offset in the source's stream.
+  void ConfigureLazyStructuredExport(LazyChunkSource *source, uint64_t baseOffset)
+  {
+    m_LazyChunkSource = source;
+    m_LazyChunkBase = baseOffset;
+  }
+
+  // when reading, the table that chunks refer to their callstacks in. Chunks with a callstack index
+  // read without a table, or with an index out of range, have no callstack.
+  // When writing, callstacks are interned into the table and chunks only store the index. Without a
+  // table they're written inline.
+  void SetCallstackTable(CallstackTable *table) { m_CallstackTable = table; }
+
   uint32_t BeginChunk(uint32_t chunkID, uint64_t byteLength);
   void EndChunk();
 
@@ -285,6 +329,7 @@ public:
     }
 
     byte *tempAlloc = NULL;
+    bool readView = false;
 
     {
       if(IsWriting())
@@ -308,10 +353,20 @@ public:
 #if !defined(__COVERITY__)
         if(!m_Structuriser && (flags & SerialiserFlags::AllocateMemory))
         {
-          if(byteSize > 0)
+          if(byteSize > 0 && (flags & SerialiserFlags::ReadView) && m_Read->IsMapped())
+          {
+            // point into the mapping, there is nothing to allocate or read
+            el = (byte *)m_Read->ReadView(byteSize);
+            readView = true;
+          }
+          else if(byteSize > 0)
+          {
             el = AllocAlignedBuffer(byteSize);
+          }
           else
+          {
             el = NULL;
+          }
         }
 
         // if we're exporting the buffers, make sure to always alloc space to read the data, so we
@@ -326,7 +381,8 @@ public:
         }
 #endif
 
-        m_Read->Read(el, byteSize);
+        if(!readView)
+          m_Read->Read(el, byteSize);
       }
     }
 
@@ -1602,6 +1658,9 @@ private:
 
   uint32_t m_ChunkFlags = 0;
   SDChunkMetaData m_ChunkMetadata;
+
+  bool m_RecordChunkIndex = false;
+  rdcarray<ChunkIndexEntry> m_ChunkIndex;
   double m_TimerFrequency = 1.0;
   uint64_t m_TimerBase = 0;
 
@@ -1626,6 +1685,13 @@ private:
 
   ChunkLookup m_ChunkLookup = NULL;
   FileIO::LogFileHandle *m_DebugDumpLog = NULL;
+
+  CallstackTable *m_CallstackTable = NULL;
+
+  LazyChunkSource *m_LazyChunkSource = NULL;
+  uint64_t m_LazyChunkBase = 0;
+  // set while structured export is disabled for the contents of a placeholder chunk
+  bool m_LazyChunkSkipped = false;
 };
 
 #ifndef SERIALISER_IMPL
@@ -1914,10 +1980,7 @@ public:
     return ret;
   }
 
-  void Write(Serialiser<SerialiserMode::Writing> &ser)
-  {
-    ser.GetWriter()->Write((const void *)m_Data, (size_t)m_Length);
-  }
+  void Write(Serialiser<SerialiserMode::Writing> &ser);
 
 private:
   Chunk() = default;
@@ -2040,7 +2103,7 @@ struct ScopedDeserialiseArray<SerialiserType, void *>
   ScopedDeserialiseArray(const SerialiserType &ser, void **el, uint64_t) : m_Ser(ser), m_El(el) {}
   ~ScopedDeserialiseArray()
   {
-    if(m_Ser.IsReading())
+    if(m_Ser.IsReading() && !m_Ser.IsReadView(*m_El))
       FreeAlignedBuffer((byte *)*m_El);
   }
   const SerialiserType &m_Ser;
@@ -2056,7 +2119,7 @@ struct ScopedDeserialiseArray<SerialiserType, const void *>
   }
   ~ScopedDeserialiseArray()
   {
-    if(m_Ser.IsReading())
+    if(m_Ser.IsReading() && !m_Ser.IsReadView(*m_El))
       FreeAlignedBuffer((byte *)*m_El);
   }
   const SerialiserType &m_Ser;
@@ -2069,7 +2132,7 @@ struct ScopedDeserialiseArray<SerialiserType, byte *>
   ScopedDeserialiseArray(const SerialiserType &ser, byte **el, uint64_t) : m_Ser(ser), m_El(el) {}
   ~ScopedDeserialiseArray()
   {
-    if(m_Ser.IsReading())
+    if(m_Ser.IsReading() && !m_Ser.IsReadView(*m_El))
       FreeAlignedBuffer(*m_El);
   }
   const SerialiserType &m_Ser;
@@ -2120,6 +2183,14 @@ struct ScopedDeserialiseArray<SerialiserType, byte *>
       GET_SERIALISER, &obj, count);                                                               \
   GET_SERIALISER.Serialise(STRING_LITERAL(#obj), obj, count, SerialiserFlags::AllocateMemory)
 
+// as SERIALISE_ELEMENT_ARRAY, but for read-only byte buffers that can be handed out as a view into
+// a mapped stream instead of being allocated and copied.
+#define SERIALISE_ELEMENT_ARRAY_VIEW(obj, count)                                                  \
+  ScopedDeserialiseArray<decltype(GET_SERIALISER), decltype(obj)> CONCAT(deserialise_, __LINE__)( \
+      GET_SERIALISER, &obj, count);                                                               \
+  GET_SERIALISER.Serialise(STRING_LITERAL(#obj), obj, count,                                      \
+                           SerialiserFlags::AllocateMemory | SerialiserFlags::ReadView)
+
 #define SERIALISE_ELEMENT_OPT(obj)                                           \
   ScopedDeserialiseNullable<decltype(GET_SERIALISER), decltype(obj)> CONCAT( \
       deserialise_, __LINE__)(GET_SERIALISER, &obj);                         \
@@ -27,6 +27,9 @@
 #if ENABLED(ENABLE_UNIT_TESTS)
 
 #include "catch/catch.hpp"
+#include "callstack_table.h"
+#include "lazy_chunks.h"
+#include "rdcfile.h"
 
 void WriteAllBasicTypes(WriteSerialiser &ser)
 {
@@ -682,6 +685,237 @@ TEST_CASE("Read/write chunk metadata", "[serialiser]")
   delete buf;
 };
 
+TEST_CASE("Read/write chunk callstacks by index", "[serialiser][callstack]")
+{
+  const uint64_t stackA[] = {0x1000, 0x2000, 0x3000};
+  const uint64_t stackB[] = {0x1000, 0x2000, 0x3000, 0x4000};
+  const uint64_t stackC[] = {0x5000};
+
+  CallstackTable table;
+
+  uint32_t idxA = table.Intern(stackA, ARRAY_COUNT(stackA));
+  uint32_t idxB = table.Intern(stackB, ARRAY_COUNT(stackB));
+
+  CHECK(idxA != idxB);
+  CHECK(table.Intern(stackA, ARRAY_COUNT(stackA)) == idxA);
+  CHECK(table.Intern(stackB, ARRAY_COUNT(stackB)) == idxB);
+
+  // interning from another thread, which has its own cache, finds the same callstacks
+  uint32_t threadIdxA = CallstackTable::InvalidIndex, threadIdxC = CallstackTable::InvalidIndex;
+  Threading::ThreadHandle thread = Threading::CreateThread([&]() {
+    threadIdxA = table.Intern(stackA, ARRAY_COUNT(stackA));
+    threadIdxC = table.Intern(stackC, ARRAY_COUNT(stackC));
+  });
+  Threading::JoinThread(thread);
+  Threading::CloseThread(thread);
+
+  uint32_t idxC = table.Intern(stackC, ARRAY_COUNT(stackC));
+
+  CHECK(threadIdxA == idxA);
+  CHECK(threadIdxC == idxC);
+  CHECK(table.NumCallstacks() == 3);
+
+  StreamWriter tableData(StreamWriter::DefaultScratchSize);
+  table.Write(&tableData);
+
+  CallstackTable readTable;
+  {
+    StreamReader reader(tableData.GetData(), tableData.GetOffset());
+    REQUIRE(readTable.Read(&reader, tableData.GetOffset()));
+  }
+
+  CHECK(readTable.NumCallstacks() == 3);
+  CHECK(readTable.Intern(stackB, ARRAY_COUNT(stackB)) == idxB);
+
+  // truncated data is rejected
+  {
+    CallstackTable badTable;
+    StreamReader reader(tableData.GetData(), tableData.GetOffset() - 8);
+    CHECK_FALSE(badTable.Read(&reader, tableData.GetOffset() - 8));
+    CHECK(badTable.NumCallstacks() == 0);
+  }
+
+  // chunks written with a callstack index, padded to the chunk alignment
+  StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
+
+  const uint32_t indices[] = {idxB, idxA, 1234};
+  for(uint32_t idx : indices)
+  {
+    const uint32_t header = 1 | WriteSerialiser::ChunkCallstackIndex;
+    const uint32_t padding = 4;
+    const uint32_t length = 64 - sizeof(uint32_t) * 5;
+    buf->Write(header);
+    buf->Write(idx);
+    buf->Write(padding);
+    buf->Write(uint32_t(0));
+    buf->Write(length);
+    buf->Write(idx + 7);
+    buf->AlignTo<64>();
+  }
+
+  {
+    ReadSerialiser ser(new StreamReader(buf->GetData(), buf->GetOffset()), Ownership::Stream);
+
+    ser.SetCallstackTable(&readTable);
+
+    for(uint32_t idx : indices)
+    {
+      ser.ReadChunk<uint32_t>();
+
+      uint32_t dummy = 0;
+      ser.Serialise("dummy"_lit, dummy);
+      CHECK(dummy == idx + 7);
+
+      rdcarray<uint64_t> expected;
+      readTable.Get(idx, expected);
+
+      CHECK(ser.ChunkMetadata().callstack == expected);
+      CHECK(bool(ser.ChunkMetadata().flags & SDChunkFlags::HasCallstack) == !expected.empty());
+
+      ser.EndChunk();
+    }
+
+    REQUIRE_FALSE(ser.IsErrored());
+    CHECK(ser.GetReader()->AtEnd());
+  }
+
+  // without a table the chunks read fine with no callstack
+  {
+    ReadSerialiser ser(new StreamReader(buf->GetData(), buf->GetOffset()), Ownership::Stream);
+
+    ser.ReadChunk<uint32_t>();
+
+    CHECK(ser.ChunkMetadata().callstack.empty());
+
+    ser.SkipCurrentChunk();
+    ser.EndChunk();
+
+    REQUIRE_FALSE(ser.IsErrored());
+  }
+
+  delete buf;
+};
+
+TEST_CASE("Callstacks are interned as chunks are written", "[serialiser][callstack]")
+{
+  rdcarray<uint64_t> shortStack = {0x1000, 0x2000, 0x3000};
+  rdcarray<uint64_t> longStack;
+  for(uint64_t i = 0; i < 20; i++)
+    longStack.push_back(0x10000 + i * 0x10);
+
+  bytebuf contents;
+  for(uint32_t i = 0; i < 100; i++)
+    contents.push_back(byte(i));
+
+  // chunks are recorded ahead of time with their callstacks inline
+  rdcarray<Chunk *> chunks;
+  {
+    WriteSerialiser ser(new StreamWriter(StreamWriter::DefaultScratchSize), Ownership::Stream);
+
+    ser.SetChunkMetadataRecording(WriteSerialiser::ChunkCallstack);
+
+    for(const rdcarray<uint64_t> &stack : {longStack, shortStack, longStack})
+    {
+      ser.ChunkMetadata().callstack = stack;
+
+      SCOPED_SERIALISE_CHUNK(1);
+
+      uint32_t numFrames = (uint32_t)stack.size();
+      bytebuf data = contents;
+      SERIALISE_ELEMENT(numFrames);
+      SERIALISE_ELEMENT(data);
+
+      chunks.push_back(scope.Get());
+    }
+
+    REQUIRE_FALSE(ser.IsErrored());
+  }
+
+  // without a table they're written verbatim
+  uint64_t inlineSize = 0;
+  {
+    WriteSerialiser ser(new StreamWriter(StreamWriter::DefaultScratchSize), Ownership::Stream);
+
+    for(Chunk *c : chunks)
+      c->Write(ser);
+
+    inlineSize = ser.GetWriter()->GetOffset();
+  }
+
+  StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
+
+  // each capture has its own table, which only holds the callstacks of the chunks written into it
+  CallstackTable table;
+  rdcarray<ChunkIndexEntry> index;
+
+  {
+    WriteSerialiser ser(buf, Ownership::Nothing);
+
+    ser.SetChunkMetadataRecording(WriteSerialiser::ChunkCallstack);
+    ser.SetChunkIndexRecording(true);
+    ser.SetCallstackTable(&table);
+
+    for(Chunk *c : chunks)
+    {
+      c->Write(ser);
+      c->Delete();
+    }
+
+    // chunks written directly are interned too
+    ser.ChunkMetadata().callstack = shortStack;
+    {
+      SCOPED_SERIALISE_CHUNK(2);
+
+      uint32_t numFrames = (uint32_t)shortStack.size();
+      bytebuf data = contents;
+      SERIALISE_ELEMENT(numFrames);
+      SERIALISE_ELEMENT(data);
+    }
+
+    REQUIRE_FALSE(ser.IsErrored());
+
+    index.swap(ser.GetChunkIndex());
+  }
+
+  CHECK(table.NumCallstacks() == 2);
+
+  // a recorded chunk can only shrink by whole multiples of the alignment so that its contents stay
+  // aligned, so the short callstack stays inline and each long one saves 128 bytes
+  REQUIRE(index.size() == 4);
+  CHECK(index[3].offset == inlineSize - 256);
+  for(size_t i = 0; i + 1 < index.size(); i++)
+    CHECK(index[i].offset + index[i].length == index[i + 1].offset);
+  CHECK(index.back().offset + index.back().length == buf->GetOffset());
+
+  {
+    ReadSerialiser ser(new StreamReader(buf->GetData(), buf->GetOffset()), Ownership::Stream);
+
+    ser.SetCallstackTable(&table);
+
+    for(size_t i = 0; i < index.size(); i++)
+    {
+      CHECK(ser.GetReader()->GetOffset() == index[i].offset);
+
+      ser.ReadChunk<uint32_t>();
+
+      uint32_t numFrames = 0;
+      bytebuf data;
+      SERIALISE_ELEMENT(numFrames);
+      SERIALISE_ELEMENT(data);
+
+      CHECK(ser.ChunkMetadata().callstack == (numFrames == 3 ? shortStack : longStack));
+      CHECK(data == contents);
+
+      ser.EndChunk();
+    }
+
+    REQUIRE_FALSE(ser.IsErrored());
+    CHECK(ser.GetReader()->AtEnd());
+  }
+
+  delete buf;
+};
+
 TEST_CASE("Verify multiple chunks can be merged", "[serialiser][chunks]")
 {
   StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
@@ -840,6 +1074,276 @@ TEST_CASE("Verify multiple chunks can be merged", "[serialiser][chunks]")
   delete buf;
 };
 
+TEST_CASE("Verify chunk index locates each chunk", "[serialiser][chunks]")
+{
+  StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
+
+  Chunk *chunk = NULL;
+  {
+    WriteSerialiser ser(new StreamWriter(StreamWriter::DefaultScratchSize), Ownership::Stream);
+
+    SCOPED_SERIALISE_CHUNK(7);
+
+    rdcstr s = "pre-recorded chunk";
+    SERIALISE_ELEMENT(s);
+
+    chunk = scope.Get();
+    REQUIRE(chunk);
+  }
+
+  rdcarray<ChunkIndexEntry> index;
+  {
+    WriteSerialiser ser(buf, Ownership::Nothing);
+
+    ser.SetChunkIndexRecording(true);
+
+    // chunk with a fixed up length
+    {
+      SCOPED_SERIALISE_CHUNK(5);
+
+      uint32_t value = 55;
+      SERIALISE_ELEMENT(value);
+    }
+
+    chunk->Write(ser);
+
+    // chunk with an over-estimated length that will be padded
+    {
+      SCOPED_SERIALISE_CHUNK(6, 512);
+
+      uint64_t value = 66;
+      SERIALISE_ELEMENT(value);
+    }
+
+    chunk->Write(ser);
+
+    REQUIRE_FALSE(ser.IsErrored());
+
+    index.swap(ser.GetChunkIndex());
+  }
+
+  chunk->Delete();
+
+  REQUIRE(index.size() == 4);
+  CHECK(index[0].chunkID == 5);
+  CHECK(index[1].chunkID == 7);
+  CHECK(index[2].chunkID == 6);
+  CHECK(index[3].chunkID == 7);
+
+  CHECK(index[0].offset == 0);
+  for(size_t i = 1; i < index.size(); i++)
+    CHECK(index[i].offset == index[i - 1].offset + index[i - 1].length);
+  CHECK(index.back().offset + index.back().length == buf->GetOffset());
+  CHECK(index[2].length > 512);
+
+  SECTION("Each indexed chunk can be read independently")
+  {
+    for(const ChunkIndexEntry &entry : index)
+    {
+      ReadSerialiser ser(new StreamReader(buf->GetData() + entry.offset, entry.length),
+                         Ownership::Stream);
+
+      CHECK(ser.ReadChunk<uint32_t>() == entry.chunkID);
+      ser.SkipCurrentChunk();
+      ser.EndChunk();
+
+      REQUIRE_FALSE(ser.IsErrored());
+      CHECK(ser.GetReader()->AtEnd());
+    }
+  }
+
+  SECTION("Scanning the stream builds the same index")
+  {
+    StreamReader reader(buf->GetData(), buf->GetOffset());
+
+    rdcarray<ChunkIndexEntry> built;
+    RDResult result = RDCFile::BuildChunkIndex(&reader, built);
+
+    CHECK(result.code == ResultCode::Succeeded);
+    REQUIRE(built.size() == index.size());
+    for(size_t i = 0; i < index.size(); i++)
+    {
+      CHECK(built[i].chunkID == index[i].chunkID);
+      CHECK(built[i].offset == index[i].offset);
+      CHECK(built[i].length == index[i].length);
+    }
+  }
+
+  SECTION("Index round-trips through a capture file")
+  {
+    RDCFile rdc;
+
+    SectionProperties props = {};
+    props.type = SectionType::FrameCapture;
+    StreamWriter *w = rdc.WriteSection(props);
+    w->Write(buf->GetData(), (size_t)buf->GetOffset());
+    w->Finish();
+    delete w;
+
+    rdcarray<ChunkIndexEntry> read;
+    CHECK_FALSE(rdc.GetChunkIndex(read));
+
+    rdc.WriteChunkIndex(index);
+
+    REQUIRE(rdc.GetChunkIndex(read));
+    REQUIRE(read.size() == index.size());
+    for(size_t i = 0; i < index.size(); i++)
+    {
+      CHECK(read[i].chunkID == index[i].chunkID);
+      CHECK(read[i].offset == index[i].offset);
+      CHECK(read[i].length == index[i].length);
+    }
+  }
+
+  delete buf;
+};
+
+TEST_CASE("Verify lazy structured chunks are read on demand", "[serialiser][chunks]")
+{
+  StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
+
+  {
+    WriteSerialiser ser(buf, Ownership::Nothing);
+
+    for(uint32_t i = 0; i < 8; i++)
+    {
+      SCOPED_SERIALISE_CHUNK(i + 1);
+
+      uint32_t value = i * 10;
+      rdcstr str = StringFormat::Fmt("chunk %u", i);
+      SERIALISE_ELEMENT(value);
+      SERIALISE_ELEMENT(str);
+    }
+
+    REQUIRE_FALSE(ser.IsErrored());
+  }
+
+  ChunkLookup testChunkLoop = [](uint32_t) -> rdcstr { return "TestChunk"; };
+
+  int processed = 0;
+  LazyChunkSource *source = LazyChunkSource::Create(
+      new StreamReader(buf->GetData(), buf->GetOffset()), [&](ReadSerialiser &ser) {
+        processed++;
+
+        ser.ConfigureStructuredExport(testChunkLoop, false, 0, 1.0);
+        ser.ReadChunk<uint32_t>();
+
+        uint32_t value;
+        rdcstr str;
+        SERIALISE_ELEMENT(value);
+        SERIALISE_ELEMENT(str);
+
+        ser.EndChunk();
+        return true;
+      });
+
+  REQUIRE(source);
+
+  SDFile file;
+
+  {
+    ReadSerialiser ser(new StreamReader(buf->GetData(), buf->GetOffset()), Ownership::Stream);
+
+    ser.ConfigureStructuredExport(testChunkLoop, false, 0, 1.0);
+    ser.ConfigureLazyStructuredExport(source, 0);
+
+    for(uint32_t i = 0; i < 8; i++)
+    {
+      CHECK(ser.ReadChunk<uint32_t>() == i + 1);
+
+      // the contents can still be read as normal, they're just not exported
+      uint32_t value;
+      rdcstr str;
+      SERIALISE_ELEMENT(value);
+      SERIALISE_ELEMENT(str);
+
+      ser.EndChunk();
+
+      CHECK(value == i * 10);
+    }
+
+    REQUIRE_FALSE(ser.IsErrored());
+    CHECK(ser.GetReader()->AtEnd());
+
+    file.Swap(ser.GetStructuredFile());
+  }
+
+  REQUIRE(file.chunks.size() == 8);
+  for(uint32_t i = 0; i < 8; i++)
+  {
+    CHECK(file.chunks[i]->IsLazyChunk());
+    CHECK_FALSE(LazyChunkSource::IsPopulated(file.chunks[i]));
+    CHECK(file.chunks[i]->metadata.chunkID == i + 1);
+    CHECK(file.chunks[i]->type.byteSize > 0);
+  }
+  CHECK(processed == 0);
+
+  // only the chunk accessed is read
+  REQUIRE(file.chunks[3]->FindChild("value"));
+  CHECK(file.chunks[3]->FindChild("value")->AsUInt32() == 30);
+  CHECK(file.chunks[3]->NumChildren() == 2);
+  CHECK(rdcstr(file.chunks[3]->GetChild(1)->AsString()) == "chunk 3");
+  CHECK(processed == 1);
+  CHECK(source->GetPopulatedCount() == 1);
+
+  // populating other chunks never frees ones already populated, so pointers handed out stay valid
+  const SDObject *str3 = file.chunks[3]->GetChild(1);
+  for(uint32_t i = 0; i < 3; i++)
+    CHECK(file.chunks[i]->GetChild(0)->AsUInt32() == i * 10);
+  CHECK(processed == 4);
+  CHECK(source->GetPopulatedCount() == 4);
+  CHECK(LazyChunkSource::IsPopulated(file.chunks[3]));
+  CHECK(file.chunks[3]->GetChild(1) == str3);
+  CHECK(rdcstr(str3->AsString()) == "chunk 3");
+
+  // and each chunk is only read once, even when first accessed from several threads at once
+  CHECK(file.chunks[3]->GetChild(0)->AsUInt32() == 30);
+  CHECK(processed == 4);
+
+  {
+    int32_t mismatches = 0;
+    Threading::ThreadHandle threads[4];
+    for(Threading::ThreadHandle &t : threads)
+    {
+      t = Threading::CreateThread([&file, &mismatches]() {
+        if(file.chunks[4]->GetChild(0)->AsUInt32() != 40)
+          Atomic::Inc32(&mismatches);
+      });
+    }
+
+    for(Threading::ThreadHandle t : threads)
+    {
+      Threading::JoinThread(t);
+      Threading::CloseThread(t);
+    }
+
+    CHECK(mismatches == 0);
+    CHECK(processed == 5);
+  }
+
+  // duplicates are fully owned
+  SDChunk *dup = file.chunks[5]->Duplicate();
+  CHECK_FALSE(dup->IsLazyChunk());
+  REQUIRE(dup->NumChildren() == 2);
+  CHECK(dup->GetChild(0)->AsUInt32() == 50);
+  delete dup;
+
+  // modifying a placeholder makes it fully owned
+  file.chunks[6]->AddAndOwnChild(makeSDUInt32("extra"_lit, 123));
+  CHECK_FALSE(file.chunks[6]->IsLazyChunk());
+  CHECK(file.chunks[6]->NumChildren() == 3);
+  CHECK(file.chunks[6]->GetChild(0)->AsUInt32() == 60);
+
+  CHECK(source->GetPopulatedCount() == 7);
+
+  // the placeholders keep the source alive after our reference is released
+  source->Release();
+
+  CHECK(rdcstr(file.chunks[7]->GetChild(1)->AsString()) == "chunk 7");
+
+  delete buf;
+};
+
 TEST_CASE("Read/write container types", "[serialiser][structured]")
 {
   StreamWriter *buf = new StreamWriter(StreamWriter::DefaultScratchSize);
@@ -39,6 +39,39 @@ Decompressor::~Decompressor()
     delete m_Read;
 }
 
+void Compressor::AddIndexedBlock(uint64_t uncompressedSize)
+{
+  if(!m_BlockIndexed || uncompressedSize == 0)
+    return;
+
+  m_BlockIndex.push_back({m_UncompressedOffset, m_Write->GetOffset()});
+  m_UncompressedOffset += uncompressedSize;
+}
+
+bool Compressor::WriteBlockIndex()
+{
+  if(!m_BlockIndexed)
+    return true;
+
+  CompressedBlockFooter footer;
+  footer.numBlocks = m_BlockIndex.size();
+  footer.magic = CompressedBlockFooter::Magic;
+
+  bool success = true;
+
+  success &= m_Write->Write(m_BlockIndex.data(), m_BlockIndex.byteSize());
+  success &= m_Write->Write(footer);
+
+  if(!success)
+    m_Error = m_Write->GetError();
+
+  // the index can only be written once, any further blocks would not be found
+  m_BlockIndexed = false;
+  m_BlockIndex.clear();
+
+  return success;
+}
+
 static const uint64_t initialBufferSize = 64 * 1024;
 const byte StreamWriter::empty[128] = {};
 
@@ -173,11 +206,22 @@ StreamReader::StreamReader(FILE *file)
 StreamReader::StreamReader(StreamReader *reader, uint64_t bufferSize)
 {
   m_InputSize = m_BufferSize = bufferSize;
+
+  m_Ownership = Ownership::Nothing;
+
+  // if the source is mapped we can share its mapping instead of copying the data out
+  if(reader->IsMapped() && reader->GetOffset() + bufferSize <= reader->GetSize())
+  {
+    m_Mapping = reader->m_Mapping;
+    FileIO::mapview_addref(m_Mapping);
+
+    m_BufferHead = m_BufferBase = (byte *)reader->ReadView(bufferSize);
+    return;
+  }
+
   m_BufferHead = m_BufferBase = AllocAlignedBuffer(m_BufferSize);
 
   reader->Read(m_BufferBase, bufferSize);
-
-  m_Ownership = Ownership::Nothing;
 }
 
 StreamReader::StreamReader(Decompressor *decompressor, uint64_t uncompressedSize, Ownership own)
@@ -193,12 +237,38 @@ StreamReader::StreamReader(Decompressor *decompressor, uint64_t uncompressedSize
   ReadFromExternal(m_BufferBase, RDCMIN(uncompressedSize, m_BufferSize));
 }
 
+StreamReader::StreamReader(FileIO::MappedView *view, uint64_t viewSize)
+{
+  if(view == NULL)
+  {
+    SET_ERROR_RESULT(m_Error, ResultCode::InvalidParameter, "Stream created with invalid mapping");
+    m_InputSize = 0;
+
+    m_BufferSize = 0;
+    m_BufferHead = m_BufferBase = NULL;
+
+    m_Ownership = Ownership::Nothing;
+    return;
+  }
+
+  m_Mapping = view;
+
+  // the mapping is read-only, but we never write through the buffer when it's not our allocation
+  m_InputSize = m_BufferSize = viewSize;
+  m_BufferHead = m_BufferBase = (byte *)FileIO::mapview_data(view);
+
+  m_Ownership = Ownership::Nothing;
+}
+
 StreamReader::~StreamReader()
 {
   for(StreamCloseCallback cb : m_Callbacks)
     cb();
 
-  FreeAlignedBuffer(m_BufferBase);
+  if(m_Mapping)
+    FileIO::mapview_close(m_Mapping);
+  else
+    FreeAlignedBuffer(m_BufferBase);
 
   if(m_Ownership == Ownership::Stream)
   {
@@ -212,6 +282,26 @@ StreamReader::~StreamReader()
 
 void StreamReader::SetOffset(uint64_t offs)
 {
+  if(m_Decompressor && m_BufferBase)
+  {
+    // seeking forward within the data we've already read can be done directly
+    uint64_t bufferEnd = m_ReadOffset + RDCMIN(m_BufferSize, m_InputSize - m_ReadOffset);
+    if(offs >= GetOffset() && offs <= bufferEnd)
+    {
+      m_BufferHead = m_BufferBase + (offs - m_ReadOffset);
+      return;
+    }
+
+    if(offs <= m_InputSize && m_Decompressor->Seek(offs))
+    {
+      // refill the window from the new offset
+      m_ReadOffset = offs;
+      m_BufferHead = m_BufferBase;
+      ReadFromExternal(m_BufferBase, RDCMIN(m_InputSize - offs, m_BufferSize));
+      return;
+    }
+  }
+
   if(m_File || m_Decompressor)
   {
     RDCERR("File and decompress stream readers do not support seeking");
@@ -43,6 +43,24 @@ class StreamReader;
 
 typedef std::function<void()> StreamCloseCallback;
 
+// with block indexing enabled, each compressed block is independent of any previous blocks and
+// after the last block an array of these is written, followed by a CompressedBlockFooter.
+struct CompressedBlock
+{
+  // the offset in the uncompressed data where this block begins
+  uint64_t uncompressedOffset;
+  // the offset in the compressed data of this block's header
+  uint64_t compressedOffset;
+};
+
+struct CompressedBlockFooter
+{
+  static const uint64_t Magic = MAKE_FOURCC('R', 'D', 'B', 'I');
+
+  uint64_t numBlocks;
+  uint64_t magic;
+};
+
 class Compressor
 {
 public:
@@ -52,10 +70,20 @@ public:
   virtual bool Write(const void *data, uint64_t numBytes) = 0;
   virtual bool Finish() = 0;
 
+  // must be called before any data is written
+  void SetBlockIndexed() { m_BlockIndexed = true; }
+
 protected:
+  void AddIndexedBlock(uint64_t uncompressedSize);
+  bool WriteBlockIndex();
+
   StreamWriter *m_Write;
   Ownership m_Ownership;
   RDResult m_Error;
+
+  bool m_BlockIndexed = false;
+  uint64_t m_UncompressedOffset = 0;
+  rdcarray<CompressedBlock> m_BlockIndex;
 };
 
 class Decompressor
@@ -66,6 +94,9 @@ public:
   RDResult GetError() { return m_Error; }
   virtual bool Recompress(Compressor *comp) = 0;
   virtual bool Read(void *data, uint64_t numBytes) = 0;
+  // only supported by decompressors that can randomly access their data
+  virtual bool Seek(uint64_t offset) { return false; }
+  virtual bool CanSeek() { return false; }
 
 protected:
   StreamReader *m_Read;
@@ -95,6 +126,8 @@ public:
   StreamReader(FILE *file);
   StreamReader(StreamReader *reader, uint64_t bufferSize);
   StreamReader(Decompressor *decompressor, uint64_t uncompressedSize, Ownership own);
+  // takes ownership of the caller's reference to the view
+  StreamReader(FileIO::MappedView *view, uint64_t viewSize);
 
   ~StreamReader();
 
@@ -106,6 +139,11 @@ public:
       m_Error = res;
   }
   void SetOffset(uint64_t offs);
+  // returns true if SetOffset can move anywhere in the stream, not just forward within the window
+  bool CanSeek() const
+  {
+    return !m_File && !m_Sock && !m_Dummy && (!m_Decompressor || m_Decompressor->CanSeek());
+  }
 
   inline uint64_t GetOffset() { return m_BufferHead - m_BufferBase + m_ReadOffset; }
   inline uint64_t GetSize() { return m_InputSize; }
@@ -215,6 +253,31 @@ public:
     return true;
   }
 
+  // mapped streams can return pointers directly into the mapping instead of copying. The pointer
+  // remains valid as long as this stream, or any stream sharing its mapping, is alive.
+  bool IsMapped() const { return m_Mapping != NULL; }
+  bool IsView(const void *ptr) const
+  {
+    return m_Mapping && ptr >= m_BufferBase && ptr < m_BufferBase + m_BufferSize;
+  }
+
+  const byte *ReadView(uint64_t numBytes)
+  {
+    if(!m_Mapping || IsErrored())
+      return NULL;
+
+    if(GetOffset() + numBytes > GetSize())
+    {
+      m_BufferHead = m_BufferBase + m_BufferSize;
+      SET_ERROR_RESULT(m_Error, ResultCode::FileIOFailed, "Reading off the end of data stream");
+      return NULL;
+    }
+
+    const byte *ret = m_BufferHead;
+    m_BufferHead += numBytes;
+    return ret;
+  }
+
   bool SkipBytes(uint64_t numBytes)
   {
     // fast path for file skipping
@@ -277,6 +340,9 @@ private:
   // the decompressor, if reading from it
   Decompressor *m_Decompressor = NULL;
 
+  // the mapped view, if the buffer points into one instead of being allocated
+  FileIO::MappedView *m_Mapping = NULL;
+
   // the offset in the file/decompressor that corresponds to the start of m_BufferBase
   uint64_t m_ReadOffset = 0;
 
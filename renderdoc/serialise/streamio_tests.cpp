@@ -24,6 +24,7 @@
 
 #include "streamio.h"
 #include "common/timing.h"
+#include "serialiser.h"
 
 #if ENABLED(ENABLE_UNIT_TESTS)
 
@@ -170,6 +171,170 @@ TEST_CASE("Test stream I/O with invalid/broken outputs", "[streamio]")
   };
 };
 
+TEST_CASE("Test stream I/O from a mapped file", "[streamio]")
+{
+  rdcstr filename = FileIO::GetTempFolderFilename() + "renderdoc_mapped_stream_test.bin";
+
+  // deliberately start the data at an offset that isn't page aligned
+  const uint64_t dataOffset = 100;
+
+  rdcarray<uint32_t> values;
+  values.resize(64 * 1024);
+  for(size_t i = 0; i < values.size(); i++)
+    values[i] = uint32_t(i * 7 + 3);
+
+  {
+    FILE *f = FileIO::fopen(filename, FileIO::WriteBinary);
+    REQUIRE(f);
+
+    byte padding[dataOffset] = {};
+    FileIO::fwrite(padding, 1, sizeof(padding), f);
+    FileIO::fwrite(values.data(), 1, values.byteSize(), f);
+    FileIO::fclose(f);
+  }
+
+  FILE *f = FileIO::fopen(filename, FileIO::ReadBinary);
+  REQUIRE(f);
+
+  FileIO::MappedView *view = FileIO::mapview_open(f, dataOffset, values.byteSize());
+
+  // the mapping should be independent of the file
+  FileIO::fclose(f);
+
+  REQUIRE(view);
+
+  SECTION("Reading and views")
+  {
+    StreamReader reader(view, values.byteSize());
+    view = NULL;
+
+    CHECK(reader.IsMapped());
+    CHECK(reader.GetSize() == values.byteSize());
+
+    uint32_t test = 0;
+    reader.Read(test);
+    CHECK(test == values[0]);
+    reader.Read(test);
+    CHECK(test == values[1]);
+
+    const uint32_t *ptr = (const uint32_t *)reader.ReadView(sizeof(uint32_t) * 100);
+    REQUIRE(ptr);
+    CHECK(reader.IsView(ptr));
+    CHECK(ptr[0] == values[2]);
+    CHECK(ptr[99] == values[101]);
+    CHECK(reader.GetOffset() == sizeof(uint32_t) * 102);
+
+    CHECK_FALSE(reader.IsView(&test));
+
+    reader.SetOffset(sizeof(uint32_t) * 5000);
+    reader.Read(test);
+    CHECK(test == values[5000]);
+
+    CHECK_FALSE(reader.IsErrored());
+
+    EXPECT_ERROR();
+
+    // views off the end should fail just like reads
+    CHECK(reader.ReadView(values.byteSize()) == NULL);
+    CHECK(DID_ERROR_HAPPEN());
+    CHECK(reader.IsErrored());
+  };
+
+  SECTION("Sub-stream shares the mapping")
+  {
+    StreamReader *reader = new StreamReader(view, values.byteSize());
+    view = NULL;
+
+    reader->SkipBytes(sizeof(uint32_t) * 10);
+
+    StreamReader sub(reader, sizeof(uint32_t) * 1000);
+
+    // the parent can go away, the sub-stream keeps the mapping alive
+    delete reader;
+
+    CHECK(sub.IsMapped());
+    CHECK(sub.GetSize() == sizeof(uint32_t) * 1000);
+
+    uint32_t test = 0;
+    sub.Read(test);
+    CHECK(test == values[10]);
+
+    sub.SetOffset(sizeof(uint32_t) * 999);
+    sub.Read(test);
+    CHECK(test == values[1009]);
+
+    CHECK_FALSE(sub.IsErrored());
+    CHECK(sub.AtEnd());
+  };
+
+  SECTION("Serialised buffers as views")
+  {
+    FileIO::mapview_close(view);
+
+    const void *data = values.data();
+    uint64_t dataSize = values.byteSize();
+
+    // serialise to memory so the chunk length can be fixed up, then write that out to the file
+    {
+      WriteSerialiser ser(new StreamWriter(StreamWriter::DefaultScratchSize), Ownership::Stream);
+
+      {
+        SCOPED_SERIALISE_CHUNK(5);
+
+        SERIALISE_ELEMENT_ARRAY_VIEW(data, dataSize);
+        SERIALISE_ELEMENT_ARRAY(data, dataSize);
+      }
+
+      StreamWriter *writer = ser.GetWriter();
+
+      f = FileIO::fopen(filename, FileIO::WriteBinary);
+      REQUIRE(f);
+      FileIO::fwrite(writer->GetData(), 1, (size_t)writer->GetOffset(), f);
+      FileIO::fclose(f);
+    }
+
+    f = FileIO::fopen(filename, FileIO::ReadBinary);
+    REQUIRE(f);
+    uint64_t fileSize = FileIO::GetFileSize(filename);
+    view = FileIO::mapview_open(f, 0, fileSize);
+    FileIO::fclose(f);
+    REQUIRE(view);
+
+    ReadSerialiser ser(new StreamReader(view, fileSize), Ownership::Stream);
+    view = NULL;
+
+    uint32_t chunkID = ser.ReadChunk<uint32_t>();
+    CHECK(chunkID == 5);
+
+    {
+      const void *viewData = NULL;
+      const void *allocData = NULL;
+
+      SERIALISE_ELEMENT_ARRAY_VIEW(viewData, dataSize);
+      SERIALISE_ELEMENT_ARRAY(allocData, dataSize);
+
+      REQUIRE(viewData);
+      REQUIRE(allocData);
+
+      // only the buffer that asked for a view gets one
+      CHECK(ser.IsReadView(viewData));
+      CHECK_FALSE(ser.IsReadView(allocData));
+
+      CHECK(memcmp(viewData, values.data(), values.byteSize()) == 0);
+      CHECK(memcmp(allocData, values.data(), values.byteSize()) == 0);
+    }
+
+    ser.EndChunk();
+
+    CHECK_FALSE(ser.IsErrored());
+  };
+
+  if(view)
+    FileIO::mapview_close(view);
+
+  FileIO::Delete(filename);
+};
+
 TEST_CASE("Test stream I/O operations over the network", "[streamio][network]")
 {
   uint16_t port = 8235;
@@ -27,6 +27,10 @@
 
 static const uint64_t zstdBlockSize = 128 * 1024;
 static const uint64_t compressBlockSize = ZSTD_compressBound(zstdBlockSize);
+static const int zstdCompressionLevel = 7;
+
+const uint64_t ZSTDCompressor::BlockSize = zstdBlockSize;
+const uint64_t ZSTDCompressor::CompressedBlockBound = compressBlockSize;
 
 ZSTDCompressor::ZSTDCompressor(StreamWriter *write, Ownership own) : Compressor(write, own)
 {
@@ -112,7 +116,14 @@ bool ZSTDCompressor::Finish()
   // only the last one can be smaller, so we only write a partial page when finishing.
   // Calling Write() after Finish() is illegal
 
-  return FlushPage();
+  bool success = FlushPage();
+
+  if(success)
+  {
+    success &= WriteBlockIndex();
+  }
+
+  return success;
 }
 
 bool ZSTDCompressor::FlushPage()
@@ -132,6 +143,9 @@ bool ZSTDCompressor::FlushPage()
   if(!m_CompressBuffer)
     return false;
 
+  // every zstd frame is already independent, so indexing only needs to record where it is
+  AddIndexedBlock(m_PageOffset);
+
   // a bit redundant to write this but it means we can read the entire frame without
   // doing multiple reads
   success &= m_Write->Write((uint32_t)out.pos);
@@ -145,7 +159,7 @@ bool ZSTDCompressor::FlushPage()
 
 bool ZSTDCompressor::CompressZSTDFrame(ZSTD_inBuffer &in, ZSTD_outBuffer &out)
 {
-  size_t err = ZSTD_initCStream(m_Stream, 7);
+  size_t err = ZSTD_initCStream(m_Stream, zstdCompressionLevel);
 
   if(ZSTD_isError(err))
   {
@@ -199,6 +213,24 @@ bool ZSTDCompressor::CompressZSTDFrame(ZSTD_inBuffer &in, ZSTD_outBuffer &out)
   return true;
 }
 
+bool ZSTDCompressor::CompressBlock(ZSTD_CCtx *ctx, const byte *src, uint64_t srcSize, byte *dst,
+                                   uint64_t &dstSize, RDResult &error)
+{
+  size_t compSize = ZSTD_compressCCtx(ctx, dst, (size_t)compressBlockSize, src, (size_t)srcSize,
+                                      zstdCompressionLevel);
+
+  if(ZSTD_isError(compSize))
+  {
+    SET_ERROR_RESULT(error, ResultCode::CompressionFailed, "ZSTD compression failed: %s",
+                     ZSTD_getErrorName(compSize));
+    return false;
+  }
+
+  dstSize = (uint64_t)compSize;
+
+  return true;
+}
+
 ZSTDDecompressor::ZSTDDecompressor(StreamReader *read, Ownership own) : Decompressor(read, own)
 {
   m_Page = AllocAlignedBuffer(zstdBlockSize);
@@ -357,3 +389,26 @@ bool ZSTDDecompressor::FillPage()
 
   return success;
 }
+
+bool ZSTDDecompressor::DecompressBlock(const byte *src, uint64_t srcSize, byte *dst,
+                                       uint64_t dstSize, RDResult &error)
+{
+  size_t decompSize = ZSTD_decompress(dst, (size_t)dstSize, src, (size_t)srcSize);
+
+  if(ZSTD_isError(decompSize))
+  {
+    SET_ERROR_RESULT(error, ResultCode::CompressionFailed,
+                     "ZSTD decompression failed on indexed block: %s", ZSTD_getErrorName(decompSize));
+    return false;
+  }
+
+  if(decompSize != dstSize)
+  {
+    SET_ERROR_RESULT(error, ResultCode::CompressionFailed,
+                     "ZSTD decompression of indexed block produced %zu bytes, expected %llu",
+                     decompSize, dstSize);
+    return false;
+  }
+
+  return true;
+}
@@ -36,6 +36,15 @@ public:
   bool Write(const void *data, uint64_t numBytes);
   bool Finish();
 
+  // the size of each frame, and the maximum size it can compress to
+  static const uint64_t BlockSize;
+  static const uint64_t CompressedBlockBound;
+
+  // compress a single frame of at most BlockSize bytes, for compressing in parallel. The context is
+  // only used for scratch memory and can be reused for each block
+  static bool CompressBlock(ZSTD_CCtx *ctx, const byte *src, uint64_t srcSize, byte *dst,
+                            uint64_t &dstSize, RDResult &error);
+
 private:
   bool FlushPage();
 
@@ -57,6 +66,10 @@ public:
   bool Recompress(Compressor *comp);
   bool Read(void *data, uint64_t numBytes);
 
+  // decompress a single frame, as written with block indexing
+  static bool DecompressBlock(const byte *src, uint64_t srcSize, byte *dst, uint64_t dstSize,
+                              RDResult &error);
+
 private:
   bool FillPage();
 
@@ -48,6 +48,24 @@ uint32_t strhash(const char *str, uint32_t seed)
   return hash;
 }
 
+uint64_t strhash64(const char *str, uint64_t seed)
+{
+  if(str == NULL)
+    return seed;
+
+  // 64-bit FNV-1a
+  uint64_t hash = seed;
+
+  while(*str)
+  {
+    hash ^= (unsigned char)*str;
+    hash *= 1099511628211ULL;
+    str++;
+  }
+
+  return hash;
+}
+
 rdcstr strlower(const rdcstr &str)
 {
   rdcstr newstr(str);
@@ -279,6 +297,24 @@ TEST_CASE("String hashing", "[string]")
 
     CHECK(partial == complete);
   };
+
+  SECTION("64-bit hashing")
+  {
+    CHECK(strhash64("foobar") == strhash64("foobar"));
+    CHECK(strhash64("foobar") != strhash64("blah"));
+    CHECK(strhash64(NULL, 5) == 5);
+    CHECK(strhash64("", 5) == 5);
+
+    // known FNV-1a values
+    CHECK(strhash64("") == 0xcbf29ce484222325ULL);
+    CHECK(strhash64("a") == 0xaf63dc4c8601ec8cULL);
+    CHECK(strhash64("foobar") == 0x85944171f73967e8ULL);
+
+    uint64_t partial = strhash64("foo");
+    partial = strhash64("bar", partial);
+
+    CHECK(partial == strhash64("foobar"));
+  };
 };
 
 TEST_CASE("String manipulation", "[string]")
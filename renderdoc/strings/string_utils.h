@@ -32,6 +32,7 @@ rdcstr strlower(const rdcstr &str);
 rdcstr strupper(const rdcstr &str);
 
 uint32_t strhash(const char *str, uint32_t existingHash = 5381);
+uint64_t strhash64(const char *str, uint64_t existingHash = 14695981039346656037ULL);
 
 rdcstr get_basename(const rdcstr &path);
 rdcstr get_dirname(const rdcstr &path);